@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_BENCHMARK_HPP_INCLUDED__
+#define __SPIN_BENCHMARK_HPP_INCLUDED__
+
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+
+namespace benchmark
+{
+  /** @brief Prevent the compiler from optimizing a value away */
+  template<typename T>
+  inline void keep(T &&value)
+  { asm volatile("" : : "g"(&value) : "memory"); }
+
+  /** @brief Prevent the compiler from caching memory across this point */
+  inline void clobber()
+  { asm volatile("" : : : "memory"); }
+
+  /**
+   * @brief Run procedure for iterations times and report cost per iteration
+   * @returns Nanoseconds per iteration
+   */
+  template<typename Procedure>
+  double measure(const char *name, std::size_t iterations,
+      Procedure &&procedure)
+  {
+    auto start = std::chrono::steady_clock::now();
+    procedure(iterations);
+    auto stop = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration_cast<std::chrono::duration<double,
+      std::nano>>(stop - start).count() / iterations;
+    std::printf("%-40s %10.3f ns/op\n", name, ns);
+    return ns;
+  }
+}
+
+#endif
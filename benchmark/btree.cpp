@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/btree.hpp>
+#include <spin/intruse/rbtree.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // Indexed objects are large enough that nodes of rbtree don't share cache
+  // lines, as they usually don't in real programs
+  struct item : spin::intruse::rbtree_node<std::uint64_t, item>
+  {
+    item(std::uint64_t key)
+      : rbtree_node(key)
+    { }
+
+    static std::uint64_t key(const item &x) noexcept
+    { return get_index(x); }
+
+    char payload[64];
+  };
+
+  using rbtree_type = spin::intruse::rbtree<std::uint64_t, item>;
+  using btree_type = spin::btree<std::uint64_t, item>;
+
+  void run(std::size_t n, std::size_t lookups)
+  {
+    std::mt19937_64 rng(n);
+
+    // Distinct keys in random order, objects are allocated in this order so
+    // that neighbours in key order are far apart in memory
+    std::vector<std::uint64_t> keys(n);
+    for (std::size_t i = 0; i < n; ++i)
+      keys[i] = i * 2;
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    std::vector<item> items;
+    items.reserve(n);
+    for (auto k : keys)
+      items.emplace_back(k);
+
+    rbtree_type rbtree;
+    btree_type btree;
+    for (auto &x : items)
+    {
+      rbtree.insert(x);
+      btree.insert(item::key(x), x);
+    }
+
+    std::vector<std::uint64_t> queries(lookups);
+    for (auto &q : queries)
+      q = keys[rng() % n];
+
+    std::string suffix = " n=" + std::to_string(n);
+    std::uint64_t sum = 0;
+
+    benchmark::measure(("rbtree find" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += rbtree.find(queries[i]) != rbtree.end();
+        });
+
+    benchmark::measure(("btree find" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += btree.find(queries[i]) != btree.end();
+        });
+
+    // Keys are even, so odd keys are never found
+    benchmark::measure(("rbtree lower_bound" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += rbtree.lower_bound(queries[i] + 1) != rbtree.end();
+        });
+
+    benchmark::measure(("btree lower_bound" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += btree.lower_bound(queries[i] + 1) != btree.end();
+        });
+
+    benchmark::measure(("rbtree iterate" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto &x : rbtree)
+            sum += x.payload[0];
+        });
+
+    benchmark::measure(("btree iterate" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto i = btree.begin(); i != btree.end(); ++i)
+            sum += i->payload[0];
+        });
+
+    benchmark::keep(sum);
+    rbtree.clear();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t max = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                             : 10000000;
+  std::size_t lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                                 : 1000000;
+
+  for (std::size_t n = 10000; n <= max; n *= 10)
+    run(n, lookups);
+  return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/epoch.hpp>
+#include <spin/intruse/concurrent_skiplist.hpp>
+#include <spin/intruse/rbtree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  // Indexed objects are large enough that nodes don't share cache lines,
+  // as they usually don't in real programs
+  struct skiplist_item
+    : spin::intruse::concurrent_skiplist_node<std::uint64_t, skiplist_item>
+  {
+    explicit skiplist_item(std::uint64_t key)
+      : concurrent_skiplist_node(key)
+      , reclaimed(true)
+    { }
+
+    std::atomic_bool reclaimed;
+    char payload[64];
+  };
+
+  struct rbtree_item : spin::intruse::rbtree_node<std::uint64_t, rbtree_item>
+  {
+    explicit rbtree_item(std::uint64_t key)
+      : rbtree_node(key)
+      , linked(false)
+    { }
+
+    bool linked;
+    char payload[64];
+  };
+
+  using skiplist_type
+    = spin::intruse::concurrent_skiplist<std::uint64_t, skiplist_item>;
+  using rbtree_type = spin::intruse::rbtree<std::uint64_t, rbtree_item>;
+
+  /** @brief Number of keys inserted and erased over and over by writer */
+  constexpr std::size_t max_churn_size = 1024;
+
+  /**
+   * @brief Run @a reader in @a threads threads while one thread inserts
+   * and erases with @a writer, reports time per lookup
+   */
+  template<typename Reader, typename Writer>
+  void run_concurrent(const std::string &name, std::size_t threads,
+      std::size_t lookups, Reader &&reader, Writer &&writer)
+  {
+    std::atomic_bool stop(false);
+    benchmark::measure((name + " readers="
+          + std::to_string(threads)).c_str(), lookups,
+        [&](std::size_t n)
+        {
+          std::thread w([&] { writer(stop); });
+          std::vector<std::thread> readers;
+          for (std::size_t i = 0; i < threads; ++i)
+            readers.emplace_back([&, i] { reader(i, n / threads); });
+          for (auto &t : readers)
+            t.join();
+          stop.store(true);
+          w.join();
+        });
+  }
+
+  void run(std::size_t n, std::size_t max_threads, std::size_t lookups)
+  {
+    std::mt19937_64 rng(n);
+
+    // Readers look up even keys, which stay, while writer inserts and
+    // erases odd ones
+    std::vector<std::uint64_t> keys(n);
+    for (std::size_t i = 0; i < n; ++i)
+      keys[i] = i * 2;
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    std::size_t churn_size = std::min(n, max_churn_size);
+    std::deque<skiplist_item> skiplist_items;
+    std::deque<rbtree_item> rbtree_items;
+    for (auto k : keys)
+    {
+      skiplist_items.emplace_back(k);
+      rbtree_items.emplace_back(k);
+    }
+    for (std::size_t i = 0; i < churn_size; ++i)
+    {
+      skiplist_items.emplace_back(keys[i] + 1);
+      rbtree_items.emplace_back(keys[i] + 1);
+    }
+
+    skiplist_type skiplist;
+    rbtree_type rbtree;
+    std::mutex mutex;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      skiplist.insert(skiplist_items[i]);
+      rbtree.insert(rbtree_items[i]);
+    }
+
+    std::vector<std::uint64_t> queries(lookups);
+    for (auto &q : queries)
+      q = keys[rng() % n];
+
+    std::string suffix = " n=" + std::to_string(n);
+    std::atomic<std::uint64_t> sum(0);
+
+    auto skiplist_reader = [&](std::size_t id, std::size_t m)
+    {
+      std::uint64_t local = 0;
+      for (std::size_t i = 0; i < m; ++i)
+      {
+        spin::epoch::guard guard;
+        local += skiplist.find(queries[(id * m + i) % lookups]) != nullptr;
+      }
+      sum += local;
+    };
+
+    auto rbtree_reader = [&](std::size_t id, std::size_t m)
+    {
+      std::uint64_t local = 0;
+      for (std::size_t i = 0; i < m; ++i)
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        local += rbtree.find(queries[(id * m + i) % lookups]) != rbtree.end();
+      }
+      sum += local;
+    };
+
+    auto skiplist_writer = [&](std::atomic_bool &stop)
+    {
+      for (std::size_t i = 0; !stop.load(std::memory_order_relaxed); ++i)
+      {
+        auto &x = skiplist_items[n + i % churn_size];
+        if (x.reclaimed.load(std::memory_order_acquire))
+        {
+          x.reclaimed.store(false, std::memory_order_relaxed);
+          skiplist.insert(x);
+        }
+        else
+          skiplist.erase(x, [&x]
+              { x.reclaimed.store(true, std::memory_order_release); });
+        std::this_thread::yield();
+      }
+      spin::epoch::synchronize();
+    };
+
+    auto rbtree_writer = [&](std::atomic_bool &stop)
+    {
+      for (std::size_t i = 0; !stop.load(std::memory_order_relaxed); ++i)
+      {
+        auto &x = rbtree_items[n + i % churn_size];
+        {
+          std::lock_guard<std::mutex> guard(mutex);
+          if (x.linked)
+            rbtree.erase(rbtree.find(rbtree_item::get_index(x)));
+          else
+            rbtree.insert(x);
+          x.linked = !x.linked;
+        }
+        std::this_thread::yield();
+      }
+    };
+
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+      run_concurrent("skiplist find" + suffix, threads, lookups,
+          skiplist_reader, skiplist_writer);
+      run_concurrent("mutex rbtree find" + suffix, threads, lookups,
+          rbtree_reader, rbtree_writer);
+    }
+
+    benchmark::keep(sum);
+    rbtree.clear();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                 : std::thread::hardware_concurrency();
+  std::size_t lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                                 : 4000000;
+  std::size_t n = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000;
+  run(std::max<std::size_t>(n, 1), std::max<std::size_t>(threads, 1),
+      std::max<std::size_t>(lookups, 1));
+  return 0;
+}
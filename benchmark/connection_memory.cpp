@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/stream_socket.hpp>
+#include <spin/unix_socket.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+  // Each connection takes two descriptors
+  constexpr std::size_t connections = 4000;
+  constexpr std::size_t message_size = 200;
+
+  std::size_t resident_bytes()
+  {
+    long pages = 0, resident = 0;
+    if (FILE *f = std::fopen("/proc/self/statm", "r"))
+    {
+      if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+      std::fclose(f);
+    }
+    return static_cast<std::size_t>(resident)
+      * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  }
+
+  /**
+   * @brief Report growth of resident memory, and bytes of pooled blocks
+   * referenced, per connection
+   */
+  void report(const char *name, std::size_t before, spin::scheduler &loop)
+  {
+    double rss = (static_cast<double>(resident_bytes()) - before)
+      / connections;
+    auto s = loop.get_buffer_pool().get_statistics();
+    std::size_t used = 0;
+    for (auto &c : s.classes)
+      used += c.used_blocks * c.block_size;
+    std::printf("%-40s %10.0f rss %8.0f pooled bytes/connection\n", name,
+        rss, static_cast<double>(used) / connections);
+  }
+
+  /** @brief Run @a f in a child process so that each starts from scratch */
+  template<typename Procedure>
+  void isolate(Procedure &&f)
+  {
+    std::fflush(stdout);
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+      f();
+      std::fflush(stdout);
+      ::_exit(0);
+    }
+    int status;
+    ::waitpid(pid, &status, 0);
+  }
+
+  /** @brief Run the loop until @a done returns true */
+  template<typename Predicate>
+  void run_until(spin::scheduler &loop, Predicate &&done)
+  {
+    spin::task check;
+    check.reset_routine([&]
+        {
+          if (done())
+            loop.stop();
+          else
+            loop.dispatch(check);
+        });
+    loop.dispatch(check);
+    loop.run();
+  }
+
+  /**
+   * @brief Idle and after-traffic memory of connections, @a leftover bytes
+   * of each message are left unconsumed
+   */
+  void run_stream_socket(std::size_t leftover)
+  {
+    spin::scheduler loop;
+    std::size_t before = resident_bytes();
+    std::size_t received = 0;
+    std::vector<std::unique_ptr<spin::stream_socket>> sockets;
+    for (std::size_t i = 0; i < connections; ++i)
+    {
+      auto pair = spin::open_socket_pair(SOCK_STREAM);
+      sockets.emplace_back(new spin::stream_socket(loop,
+            std::move(pair.first),
+            [&, leftover](spin::stream_socket &, spin::buffer &data)
+            {
+              received += data.size();
+              data.consume(data.size() - leftover);
+            },
+            [](spin::stream_socket &, const std::error_code &) { }));
+      sockets.emplace_back(new spin::stream_socket(loop,
+            std::move(pair.second),
+            [](spin::stream_socket &, spin::buffer &) { },
+            [](spin::stream_socket &, const std::error_code &) { }));
+    }
+    run_until(loop, [] { return true; });
+    report(leftover ? "stream_socket(idle, partial test)"
+        : "stream_socket(idle)", before, loop);
+
+    char message[message_size] = { };
+    for (std::size_t i = 0; i < connections; ++i)
+      sockets[2 * i + 1]->send(message, sizeof(message));
+    run_until(loop, [&] { return received == connections * message_size; });
+    report(leftover ? "stream_socket(partial message kept)"
+        : "stream_socket(after traffic)", before, loop);
+  }
+
+  void run_unix_socket()
+  {
+    spin::scheduler loop;
+    std::size_t before = resident_bytes();
+    std::size_t received = 0;
+    std::vector<std::unique_ptr<spin::unix_socket>> sockets;
+    for (std::size_t i = 0; i < connections; ++i)
+    {
+      auto pair = spin::open_socket_pair(SOCK_STREAM);
+      sockets.emplace_back(new spin::unix_socket(loop,
+            std::move(pair.first),
+            [&](spin::unix_socket &, spin::unix_message *m, std::size_t n)
+            {
+              for (std::size_t k = 0; k < n; ++k)
+                received += m[k].size;
+            },
+            [](spin::unix_socket &, const std::error_code &) { }));
+      sockets.emplace_back(new spin::unix_socket(loop,
+            std::move(pair.second),
+            [](spin::unix_socket &, spin::unix_message *, std::size_t) { },
+            [](spin::unix_socket &, const std::error_code &) { }));
+    }
+    run_until(loop, [] { return true; });
+    report("unix_socket(idle, preallocated)", before, loop);
+
+    char message[message_size] = { };
+    for (std::size_t i = 0; i < connections; ++i)
+      sockets[2 * i + 1]->send(message, sizeof(message));
+    run_until(loop, [&] { return received == connections * message_size; });
+    report("unix_socket(after traffic)", before, loop);
+  }
+}
+
+int main()
+{
+  isolate([] { run_unix_socket(); });
+  isolate([] { run_stream_socket(0); });
+  isolate([] { run_stream_socket(10); });
+}
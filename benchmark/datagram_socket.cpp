@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/datagram_socket.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+  constexpr std::size_t packets = 200000;
+  constexpr std::size_t payload_size = 64;
+
+  // Bounded so that no datagram is dropped by the receive buffer
+  constexpr std::size_t window = 128;
+
+  /** @brief Pump datagrams through loopback within a single scheduler */
+  void run(const char *name, std::size_t batch_size, bool offload)
+  {
+    spin::scheduler loop;
+    spin::datagram_socket::options opt;
+    opt.batch_size = batch_size;
+    opt.gro = offload;
+    opt.gso = offload;
+    if (offload)
+      opt.buffer_size = 65536;
+
+    std::size_t received = 0;
+    std::size_t sent = 0;
+    auto local = spin::socket_address::from_ip("127.0.0.1", 0);
+
+    spin::datagram_socket server(loop, local,
+        [&](spin::datagram_socket &, spin::datagram *d, std::size_t n)
+        {
+          for (std::size_t i = 0; i < n; ++i)
+            received += d[i].segment_size == 0 ? 1
+              : (d[i].size + d[i].segment_size - 1) / d[i].segment_size;
+          if (received == packets)
+            loop.stop();
+        }, opt);
+    spin::set_socket_option(server.get_device(), SOL_SOCKET, SO_RCVBUF,
+        4 << 20);
+
+    spin::datagram_socket client(loop, local,
+        [](spin::datagram_socket &, spin::datagram *, std::size_t) { }, opt);
+    client.connect(server.get_local_address());
+
+    char payload[payload_size];
+    std::memset(payload, 0, sizeof(payload));
+    spin::task sender;
+    sender.reset_routine([&]
+        {
+          while (sent < packets && sent - received < window
+              && client.send(payload, sizeof(payload)))
+            ++sent;
+          if (sent < packets)
+            loop.dispatch(sender);
+        });
+
+    double ns = benchmark::measure(name, packets, [&](std::size_t)
+        {
+          loop.dispatch(sender);
+          loop.run();
+        });
+    std::printf("%-40s %10.0f packets/s\n", name, 1e9 / ns);
+  }
+}
+
+int main()
+{
+  run("datagram_socket(batch=1)", 1, false);
+  run("datagram_socket(batch=32)", 32, false);
+  run("datagram_socket(batch=32, gso, gro)", 32, true);
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/epoch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  struct object
+  {
+    explicit object(long v)
+      : value(v)
+    { }
+
+    long value;
+  };
+
+  /**
+   * @brief A plain hazard pointer domain to compare with, one slot per
+   * thread and a scan of all slots for every batch of retired objects
+   */
+  class hazard_domain
+  {
+  public:
+    static constexpr std::size_t max_threads = 64;
+    static constexpr std::size_t scan_threshold = 128;
+
+    hazard_domain()
+      : m_slots()
+      , m_next_slot(0)
+    { }
+
+    struct slot
+    {
+      std::atomic<object *> pointer;
+      char padding[64];
+    };
+
+    slot &acquire_slot()
+    { return m_slots[m_next_slot.fetch_add(1) % max_threads]; }
+
+    static object *protect(slot &s, const std::atomic<object *> &src)
+    {
+      auto *p = src.load(std::memory_order_relaxed);
+      for ( ; ; )
+      {
+        s.pointer.store(p, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto *q = src.load(std::memory_order_acquire);
+        if (q == p)
+          return p;
+        p = q;
+      }
+    }
+
+    static void clear(slot &s)
+    { s.pointer.store(nullptr, std::memory_order_release); }
+
+    void retire(std::vector<object *> &retired, object *p)
+    {
+      retired.push_back(p);
+      if (retired.size() < scan_threshold)
+        return;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::vector<object *> hazards;
+      for (auto &s : m_slots)
+        if (auto *h = s.pointer.load(std::memory_order_acquire))
+          hazards.push_back(h);
+      std::sort(hazards.begin(), hazards.end());
+      auto kept = std::partition(retired.begin(), retired.end(),
+          [&](object *x)
+          { return std::binary_search(hazards.begin(), hazards.end(), x); });
+      for (auto i = kept; i != retired.end(); ++i)
+        delete *i;
+      retired.erase(kept, retired.end());
+    }
+
+  private:
+    slot m_slots[max_threads];
+    std::atomic_size_t m_next_slot;
+  };
+
+  constexpr std::size_t hazard_domain::max_threads;
+  constexpr std::size_t hazard_domain::scan_threshold;
+
+  hazard_domain s_hazard_domain;
+  std::atomic<object *> s_shared(nullptr);
+
+  /**
+   * @brief Run @a reader in @a threads threads while one thread replaces
+   * the shared object with @a writer, reports time per read
+   */
+  template<typename Reader, typename Writer>
+  void run_concurrent(const std::string &name, std::size_t threads,
+      std::size_t reads, Reader &&reader, Writer &&writer)
+  {
+    std::atomic_bool stop(false);
+    benchmark::measure((name + " threads="
+          + std::to_string(threads)).c_str(), reads,
+        [&](std::size_t n)
+        {
+          std::thread w([&] { writer(stop); });
+          std::vector<std::thread> readers;
+          for (std::size_t i = 0; i < threads; ++i)
+            readers.emplace_back([&] { reader(n / threads); });
+          for (auto &t : readers)
+            t.join();
+          stop.store(true);
+          w.join();
+        });
+  }
+
+  void run(std::size_t threads, std::size_t reads)
+  {
+    long sum = 0;
+    s_shared.store(new object(0));
+
+    auto epoch_reader = [&](std::size_t n)
+    {
+      long local = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        spin::epoch::guard guard;
+        local += s_shared.load(std::memory_order_acquire)->value;
+      }
+      benchmark::keep(local);
+    };
+
+    auto registered_reader = [&](std::size_t n)
+    {
+      spin::epoch::registration registration;
+      long local = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        spin::epoch::guard guard;
+        local += s_shared.load(std::memory_order_acquire)->value;
+
+        // As a scheduler does once per iteration
+        if (i % 64 == 63)
+          spin::epoch::quiescent();
+      }
+      benchmark::keep(local);
+    };
+
+    auto hazard_reader = [&](std::size_t n)
+    {
+      auto &slot = s_hazard_domain.acquire_slot();
+      long local = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        local += hazard_domain::protect(slot, s_shared)->value;
+        hazard_domain::clear(slot);
+      }
+      benchmark::keep(local);
+    };
+
+    auto epoch_writer = [](std::atomic_bool &stop)
+    {
+      for (long v = 1; !stop.load(std::memory_order_relaxed); ++v)
+      {
+        auto *old = s_shared.exchange(new object(v));
+        spin::epoch::retire([old] { delete old; });
+        std::this_thread::yield();
+      }
+      spin::epoch::synchronize();
+    };
+
+    auto hazard_writer = [](std::atomic_bool &stop)
+    {
+      std::vector<object *> retired;
+      for (long v = 1; !stop.load(std::memory_order_relaxed); ++v)
+      {
+        s_hazard_domain.retire(retired,
+            s_shared.exchange(new object(v)));
+        std::this_thread::yield();
+      }
+      // Readers have exited
+      for (auto *p : retired)
+        delete p;
+    };
+
+    benchmark::measure("epoch guard", reads,
+        [&](std::size_t n) { epoch_reader(n); });
+    benchmark::measure("epoch guard registered", reads,
+        [&](std::size_t n) { registered_reader(n); });
+    benchmark::measure("hazard pointer", reads,
+        [&](std::size_t n) { hazard_reader(n); });
+
+    run_concurrent("epoch guard", threads, reads, epoch_reader,
+        epoch_writer);
+    run_concurrent("epoch guard registered", threads, reads,
+        registered_reader, epoch_writer);
+    run_concurrent("hazard pointer", threads, reads, hazard_reader,
+        hazard_writer);
+
+    benchmark::measure("epoch retire", reads / 10,
+        [&](std::size_t n)
+        {
+          for (std::size_t i = 0; i < n; ++i)
+          {
+            auto *old = s_shared.exchange(new object(i));
+            spin::epoch::retire([old] { delete old; });
+          }
+          spin::epoch::synchronize();
+        });
+
+    benchmark::measure("hazard pointer retire", reads / 10,
+        [&](std::size_t n)
+        {
+          std::vector<object *> retired;
+          for (std::size_t i = 0; i < n; ++i)
+            s_hazard_domain.retire(retired, s_shared.exchange(new object(i)));
+          for (auto *p : retired)
+            delete p;
+        });
+
+    benchmark::keep(sum);
+    delete s_shared.load();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                 : std::thread::hardware_concurrency();
+  std::size_t reads = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                               : 10000000;
+  run(std::max<std::size_t>(threads, 1), reads);
+  return 0;
+}
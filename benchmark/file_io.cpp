@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/file_io.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+  constexpr std::size_t block_size = 4096;
+  constexpr std::size_t file_blocks = 16384;
+  constexpr std::size_t reads = 200000;
+
+  // Reads in flight
+  constexpr std::size_t window = 32;
+
+  spin::system_handle create_file(int flags)
+  {
+    const char *dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/file_io_XXXXXX";
+    int fd = ::mkostemp(&path[0], O_CLOEXEC);
+    if (fd == -1)
+      return spin::system_handle(-1);
+    spin::system_handle file(fd);
+    std::vector<char> block(block_size, 'x');
+    for (std::size_t i = 0; i < file_blocks; ++i)
+      if (::pwrite(fd, block.data(), block_size, i * block_size) == -1)
+        return spin::system_handle(-1);
+    ::fsync(fd);
+    if (flags != 0)
+      file = spin::system_handle(::open(path.c_str(), O_RDONLY | O_CLOEXEC
+            | flags));
+    ::unlink(path.c_str());
+    return file;
+  }
+
+  std::vector<std::uint64_t> make_offsets()
+  {
+    std::mt19937_64 engine(42);
+    std::vector<std::uint64_t> ret(reads);
+    for (auto &x : ret)
+      x = engine() % file_blocks * block_size;
+    return ret;
+  }
+
+  /** @brief Blocking pread in the loop thread, what file_io replaces */
+  void run_blocking(const char *name, const spin::system_handle &file,
+      const std::vector<std::uint64_t> &offsets)
+  {
+    auto memory = spin::allocate_aligned(block_size, block_size);
+    double ns = benchmark::measure(name, reads, [&](std::size_t n)
+        {
+          for (std::size_t i = 0; i < n; ++i)
+            if (::pread(file.get_raw_handle(), memory.get(), block_size,
+                  static_cast<::off_t>(offsets[i])) == -1)
+              std::abort();
+        });
+    std::printf("%-40s %10.0f reads/s\n", name, 1e9 / ns);
+  }
+
+  /** @brief Keep a window of reads in flight through file_io */
+  void run_async(const char *name, const spin::system_handle &file,
+      const std::vector<std::uint64_t> &offsets, bool use_io_uring,
+      bool registered)
+  {
+    spin::scheduler loop;
+    spin::file_io::options opt;
+    opt.use_io_uring = use_io_uring;
+    spin::file_io io(loop, opt);
+    if (use_io_uring && io.get_backend() != spin::file_io::backend::io_uring)
+      return;
+
+    auto memory = spin::allocate_aligned(block_size * window, block_size);
+    ::iovec buffer = { memory.get(), block_size * window };
+    if (registered)
+      io.register_buffers(&buffer, 1);
+
+    std::size_t issued = 0;
+    std::size_t completed = 0;
+    spin::routine<std::size_t> issue;
+    issue = [&](std::size_t slot)
+    {
+      io.pread(file, memory.get() + slot * block_size, block_size,
+          offsets[issued++],
+          [&, slot](std::size_t, const std::error_code &e)
+          {
+            if (e)
+              std::abort();
+            if (++completed == reads)
+              loop.stop();
+            else if (issued < reads)
+              issue(slot);
+          });
+    };
+
+    double ns = benchmark::measure(name, reads, [&](std::size_t)
+        {
+          for (std::size_t i = 0; i < window; ++i)
+            issue(i);
+          loop.run();
+        });
+    std::printf("%-40s %10.0f reads/s\n", name, 1e9 / ns);
+  }
+
+  void run_all(const char *title, const spin::system_handle &file)
+  {
+    auto offsets = make_offsets();
+    std::printf("%s\n", title);
+    run_blocking("pread", file, offsets);
+    run_async("file_io(io_uring)", file, offsets, true, false);
+    run_async("file_io(io_uring, registered buffers)", file, offsets, true,
+        true);
+    run_async("file_io(threads)", file, offsets, false, false);
+  }
+}
+
+int main()
+{
+  spin::system_handle cached = create_file(0);
+  if (!cached)
+    return 1;
+  run_all("4 KiB random reads, page cache", cached);
+
+  spin::system_handle direct = create_file(O_DIRECT);
+  if (direct)
+    run_all("4 KiB random reads, O_DIRECT", direct);
+}
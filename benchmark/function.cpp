@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/function.hpp>
+#include <spin/routine.hpp>
+#include <spin/function_ref.hpp>
+#include <spin/inplace_function.hpp>
+
+#include <functional>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+  // Callables are constructed and invoked behind non-inlined functions so
+  // that the compiler cannot see through the type erasure
+
+  template<typename Function>
+  __attribute__((noinline))
+  void call(const Function &f, long &counter)
+  { f(counter); }
+
+  template<typename Function, typename Functor>
+  __attribute__((noinline))
+  void construct(const Functor &functor)
+  {
+    Function f(functor);
+    benchmark::keep(f);
+  }
+
+  template<typename Function>
+  void run(const std::string &name, std::size_t iterations)
+  {
+    long counter = 0;
+    long step = 1;
+    auto functor = [step](long &x) { x += step; };
+
+    Function f(functor);
+    benchmark::measure((name + " call").c_str(), iterations,
+        [&](std::size_t n)
+        {
+          for (std::size_t i = 0; i < n; ++i)
+            call(f, counter);
+        });
+    benchmark::keep(counter);
+
+    benchmark::measure((name + " construct").c_str(), iterations,
+        [&](std::size_t n)
+        {
+          for (std::size_t i = 0; i < n; ++i)
+            construct<Function>(functor);
+        });
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                    : 100000000;
+
+  run<std::function<void(long &)>>("std::function", iterations);
+  run<spin::function<void(long &)>>("spin::function", iterations);
+  run<spin::routine<long &>>("spin::routine", iterations);
+  run<spin::function_ref<void(long &)>>("spin::function_ref", iterations);
+  run<spin::inplace_function<void(long &)>>("spin::inplace_function",
+      iterations);
+  return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/intruse/hash_table.hpp>
+#include <spin/intruse/rbtree.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+  // The same objects are indexed by all containers, so only the cost of
+  // the index itself differs
+  struct item
+    : spin::intruse::hash_table_node<std::uint64_t, item>
+    , spin::intruse::rbtree_node<std::uint64_t, item>
+  {
+    item(std::uint64_t key)
+      : hash_table_node(key)
+      , rbtree_node(key)
+    { }
+
+    char payload[64];
+  };
+
+  using hash_table_type = spin::intruse::hash_table<std::uint64_t, item>;
+  using rbtree_type = spin::intruse::rbtree<std::uint64_t, item>;
+  using unordered_map_type = std::unordered_map<std::uint64_t, item *>;
+
+  /**
+   * @brief A bijection scrambling keys, so that std::hash, which is
+   * identity for integers, doesn't make a perfect distribution for
+   * unordered_map as sequential keys would
+   */
+  std::uint64_t scramble(std::uint64_t x)
+  {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  void run(std::size_t n, std::size_t lookups)
+  {
+    std::mt19937_64 rng(n);
+    std::vector<std::uint64_t> keys(n);
+    for (std::size_t i = 0; i < n; ++i)
+      keys[i] = scramble(i);
+
+    std::vector<item> items;
+    items.reserve(n);
+    for (auto k : keys)
+      items.emplace_back(k);
+
+    std::vector<std::uint64_t> queries(lookups), misses(lookups);
+    for (auto &q : queries)
+      q = keys[rng() % n];
+    for (auto &q : misses)
+      q = scramble(n + rng() % n);
+
+    std::string suffix = " n=" + std::to_string(n);
+    std::uint64_t sum = 0;
+    hash_table_type hash_table;
+    rbtree_type rbtree;
+    unordered_map_type unordered_map;
+
+    benchmark::measure(("hash_table insert" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto &x : items)
+            hash_table.insert(x);
+        });
+
+    benchmark::measure(("unordered_map insert" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto &x : items)
+            unordered_map.emplace(x.hash_table_node::get_index(x), &x);
+        });
+
+    benchmark::measure(("rbtree insert" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto &x : items)
+            rbtree.insert(x);
+        });
+
+    benchmark::measure(("hash_table find" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += hash_table.find(queries[i])->payload[0];
+        });
+
+    benchmark::measure(("unordered_map find" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += unordered_map.find(queries[i])->second->payload[0];
+        });
+
+    benchmark::measure(("rbtree find" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += rbtree.find(queries[i])->payload[0];
+        });
+
+    benchmark::measure(("hash_table miss" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += hash_table.count(misses[i]);
+        });
+
+    benchmark::measure(("unordered_map miss" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += unordered_map.count(misses[i]);
+        });
+
+    benchmark::measure(("rbtree miss" + suffix).c_str(), lookups,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+            sum += rbtree.find(misses[i]) != rbtree.end();
+        });
+
+    benchmark::measure(("hash_table erase" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto k : keys)
+            sum += hash_table.erase(k);
+        });
+
+    benchmark::measure(("unordered_map erase" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto k : keys)
+            sum += unordered_map.erase(k);
+        });
+
+    benchmark::measure(("rbtree erase" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (auto k : keys)
+            rbtree.erase(rbtree.find(k));
+        });
+
+    benchmark::keep(sum);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t max = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                             : 10000000;
+  std::size_t lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                                 : 1000000;
+
+  for (std::size_t n = 10000; n <= max; n *= 10)
+    run(n, lookups);
+  return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/intruse/pairing_heap.hpp>
+#include <spin/intruse/dary_heap.hpp>
+#include <spin/intruse/rbtree.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // Timers are linked into all the queues, so only the cost of the queue
+  // itself differs
+  struct timer
+    : spin::intruse::pairing_heap_node<std::uint64_t, timer>
+    , spin::intruse::dary_heap_node<std::uint64_t, timer>
+    , spin::intruse::rbtree_node<std::uint64_t, timer>
+  {
+    timer(std::uint64_t deadline)
+      : pairing_heap_node(deadline)
+      , dary_heap_node(deadline)
+      , rbtree_node(deadline)
+    { }
+
+    char payload[64];
+  };
+
+  using pairing_node = spin::intruse::pairing_heap_node<std::uint64_t, timer>;
+  using dary_node = spin::intruse::dary_heap_node<std::uint64_t, timer>;
+  using rbtree_node = spin::intruse::rbtree_node<std::uint64_t, timer>;
+
+  using pairing_heap_type = spin::intruse::pairing_heap<std::uint64_t, timer>;
+  using dary_heap_type = spin::intruse::dary_heap<std::uint64_t, timer>;
+  using rbtree_type = spin::intruse::rbtree<std::uint64_t, timer>;
+
+  /** @brief Queue operations of a timer-like workload for each container */
+  struct pairing_queue
+  {
+    static constexpr const char *name = "pairing_heap";
+    pairing_heap_type heap;
+
+    void arm(timer &t, std::uint64_t deadline)
+    {
+      heap.update_index(t, deadline);
+      heap.push(t);
+    }
+
+    void rearm(timer &t, std::uint64_t deadline)
+    { heap.update_index(t, deadline); }
+
+    timer &expire()
+    {
+      timer &t = heap.top();
+      heap.pop();
+      return t;
+    }
+
+    void cancel(timer &t)
+    { heap.erase(t); }
+
+    static std::uint64_t deadline_of(const timer &t)
+    { return pairing_node::get_index(t); }
+  };
+
+  struct dary_queue
+  {
+    static constexpr const char *name = "dary_heap";
+    dary_heap_type heap;
+
+    void arm(timer &t, std::uint64_t deadline)
+    {
+      heap.update_index(t, deadline);
+      heap.push(t);
+    }
+
+    void rearm(timer &t, std::uint64_t deadline)
+    { heap.update_index(t, deadline); }
+
+    timer &expire()
+    {
+      timer &t = heap.top();
+      heap.pop();
+      return t;
+    }
+
+    void cancel(timer &t)
+    { heap.erase(t); }
+
+    static std::uint64_t deadline_of(const timer &t)
+    { return dary_node::get_index(t); }
+  };
+
+  struct rbtree_queue
+  {
+    static constexpr const char *name = "rbtree";
+    rbtree_type tree;
+
+    void arm(timer &t, std::uint64_t deadline)
+    {
+      rbtree_node::update_index(t, deadline);
+      tree.insert(t, spin::intruse::policy_backmost);
+    }
+
+    void rearm(timer &t, std::uint64_t deadline)
+    { rbtree_node::update_index(t, deadline, spin::intruse::policy_backmost); }
+
+    timer &expire()
+    {
+      timer &t = *tree.begin();
+      rbtree_node::unlink(t);
+      return t;
+    }
+
+    void cancel(timer &t)
+    { rbtree_node::unlink(t); }
+
+    static std::uint64_t deadline_of(const timer &t)
+    { return rbtree_node::get_index(t); }
+  };
+
+  template<typename Queue>
+  void run(std::size_t n, std::size_t ops)
+  {
+    std::mt19937_64 rng(n);
+    std::vector<std::uint64_t> delays(ops);
+    std::vector<std::size_t> picks(ops);
+    for (auto &d : delays)
+      d = 1 + rng() % n;
+    for (auto &p : picks)
+      p = rng() % n;
+
+    std::vector<timer> timers;
+    timers.reserve(n + 1);
+    for (std::size_t i = 0; i < n; ++i)
+      timers.emplace_back(0);
+
+    Queue queue;
+    std::string prefix = Queue::name;
+    std::string suffix = " n=" + std::to_string(n);
+    std::uint64_t now = 0, sum = 0;
+
+    benchmark::measure((prefix + " arm" + suffix).c_str(), n,
+        [&](std::size_t)
+        {
+          for (std::size_t i = 0; i < n; ++i)
+            queue.arm(timers[i], delays[i % ops]);
+        });
+
+    // Periodic timers: the earliest one expires and is armed again
+    benchmark::measure((prefix + " expire" + suffix).c_str(), ops,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+          {
+            timer &t = queue.expire();
+            now = Queue::deadline_of(t);
+            sum += t.payload[0];
+            queue.arm(t, now + delays[i]);
+          }
+        });
+
+    // Idle timeouts: a pending timer is pushed back on activity
+    benchmark::measure((prefix + " rearm" + suffix).c_str(), ops,
+        [&](std::size_t m)
+        {
+          for (std::size_t i = 0; i < m; ++i)
+          {
+            timer &t = timers[picks[i]];
+            queue.rearm(t, Queue::deadline_of(t) + delays[i]);
+          }
+        });
+
+    // Request timeouts: most timers are canceled before they expire
+    timers.emplace_back(0);
+    benchmark::measure((prefix + " arm+cancel" + suffix).c_str(), ops,
+        [&](std::size_t m)
+        {
+          timer &t = timers.back();
+          for (std::size_t i = 0; i < m; ++i)
+          {
+            queue.arm(t, now + delays[i]);
+            queue.cancel(t);
+          }
+        });
+
+    benchmark::keep(sum);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t max = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                             : 1000000;
+  std::size_t ops = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                             : 1000000;
+
+  for (std::size_t n = 1000; n <= max; n *= 10)
+  {
+    run<pairing_queue>(n, ops);
+    run<dary_queue>(n, ops);
+    run<rbtree_queue>(n, ops);
+  }
+  return 0;
+}
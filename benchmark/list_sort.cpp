@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "benchmark.hpp"
+
+#include <spin/intruse/list.hpp>
+#include <spin/parallel_sort.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct item : spin::intruse::list_node<item>
+  {
+    item(std::uint32_t key)
+      : key(key)
+    { }
+
+    std::uint32_t key;
+    char payload[48];
+  };
+
+  struct by_key
+  {
+    bool operator () (const item &x, const item &y) const noexcept
+    { return x.key < y.key; }
+  };
+
+  using list_type = spin::intruse::list<item>;
+
+  struct record
+  {
+    bool operator < (const record &r) const noexcept
+    { return key < r.key; }
+
+    std::uint32_t key;
+    char payload[48];
+  };
+
+  void run(const char *pattern, const std::vector<std::uint32_t> &keys)
+  {
+    auto n = keys.size();
+    std::string suffix = std::string(" ") + pattern + " n="
+      + std::to_string(n);
+
+    // Both kinds of lists have their nodes allocated in list order, so
+    // only the algorithms differ
+    std::vector<item> items;
+    items.reserve(n);
+    for (auto k : keys)
+      items.emplace_back(k);
+
+    list_type l;
+    auto fill = [&]
+    {
+      l.clear();
+      for (std::size_t i = 0; i < n; ++i)
+        l.push_back(items[i]);
+    };
+
+    fill();
+    benchmark::measure(("intruse::list::sort" + suffix).c_str(), n,
+        [&](std::size_t) { l.sort(by_key()); });
+    benchmark::keep(l.front().key);
+
+    fill();
+    auto pool = spin::thread_pool::get_instance();
+    benchmark::measure(("parallel_sort" + suffix).c_str(), n,
+        [&](std::size_t) { spin::parallel_sort(l, by_key(), *pool); });
+    benchmark::keep(l.front().key);
+    l.clear();
+
+    std::list<record> sl;
+    for (auto k : keys)
+      sl.push_back(record { k, { } });
+    benchmark::measure(("std::list::sort" + suffix).c_str(), n,
+        [&](std::size_t) { sl.sort(); });
+    benchmark::keep(sl.front().key);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t max = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                             : 1000000;
+
+  for (std::size_t n = 10000; n <= max; n *= 10)
+  {
+    std::mt19937 rng(n);
+    std::vector<std::uint32_t> keys(n);
+    for (auto &k : keys)
+      k = rng();
+    run("random", keys);
+
+    for (std::size_t i = 0; i < n; ++i)
+      keys[i] = i;
+    run("sorted", keys);
+
+    for (std::size_t i = 0; i < n; ++i)
+      keys[i] = n - i;
+    run("reversed", keys);
+
+    for (std::size_t i = 0; i < n; ++i)
+      keys[i] = rng() % 100 == 0 ? rng() % n : i;
+    run("nearly-sorted", keys);
+  }
+  return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/acceptor.hpp>
+#include <spin/task.hpp>
+#include <spin/utils.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+
+namespace spin
+{
+  namespace
+  {
+    // Time to wait before accepting again once out of descriptors
+    constexpr std::chrono::milliseconds accept_retry_delay(100);
+
+    system_handle open_listening_socket(const socket_address &local,
+        const acceptor::options &opt)
+    {
+      system_handle ret = open_socket(local.get_family(), opt.type);
+      if (local.get_family() != AF_UNIX)
+        set_socket_option(ret, SOL_SOCKET, SO_REUSEADDR, 1);
+      if (opt.reuse_port)
+        set_socket_option(ret, SOL_SOCKET, SO_REUSEPORT, 1);
+      if (::bind(ret.get_raw_handle(), local.get_data(), local.get_size())
+          == -1)
+        throw_exception_for_last_error();
+      if (::listen(ret.get_raw_handle(), opt.backlog) == -1)
+        throw_exception_for_last_error();
+      return ret;
+    }
+  }
+
+  acceptor::acceptor(scheduler &s, const socket_address &local,
+      accept_handler handler, const options &opt)
+    : io_event_source(s, open_listening_socket(local, opt), readonly)
+    , m_handler(std::move(handler))
+    , m_retry_timer(s, [this] { on_readable(); })
+  { }
+
+  acceptor::acceptor(scheduler &s, const socket_address &local,
+      const options &opt)
+    : io_event_source(s, open_listening_socket(local, opt), readonly)
+    , m_handler()
+    , m_retry_timer(s, [this] { on_readable(); })
+  { }
+
+  socket_address acceptor::get_local_address() const
+  { return spin::get_local_address(get_device()); }
+
+  void acceptor::on_readable() noexcept
+  {
+    int fd = get_device().get_raw_handle();
+    bool exhausted = false;
+    drain_readable([this, fd, &exhausted] () -> std::ptrdiff_t
+        {
+          for ( ; ; )
+          {
+            int conn = ::accept4(fd, nullptr, nullptr,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (conn == -1)
+            {
+              // The connection was reset before it's accepted
+              if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+              exhausted = errno == EMFILE || errno == ENFILE
+                || errno == ENOBUFS || errno == ENOMEM;
+              return -1;
+            }
+            system_handle handle(conn);
+            on_accepted(handle);
+            return 0;
+          }
+        });
+
+    // Connections are left in the backlog as no descriptor is available,
+    // and no edge will come for them
+    if (exhausted)
+      m_retry_timer.reset(steady_timer::clock::now() + accept_retry_delay);
+    on_drained();
+  }
+
+  void acceptor::on_accepted(system_handle &connection) noexcept
+  { m_handler(connection); }
+
+  void acceptor::on_drained() noexcept
+  { }
+
+  struct distributing_acceptor::shared_state
+  {
+    shared_state(connection_handler h, std::size_t workers)
+      : handler(std::move(h))
+      , connections(new std::atomic_size_t[workers])
+    {
+      for (std::size_t i = 0; i < workers; ++i)
+        connections[i].store(0, std::memory_order_relaxed);
+    }
+
+    connection_handler handler;
+    std::unique_ptr<std::atomic_size_t[]> connections;
+  };
+
+  /** @brief Connections of an edge posted to a worker, deleted once run */
+  struct distributing_acceptor::handoff
+  {
+    handoff(std::shared_ptr<shared_state> s, std::size_t w)
+      : t([this] { run(); })
+      , connections()
+      , state(std::move(s))
+      , worker(w)
+    { }
+
+    void run()
+    {
+      auto guard = make_block_guard([this] () noexcept { delete this; });
+      for (auto &c : connections)
+        state->handler(c, worker);
+    }
+
+    task t;
+    std::vector<system_handle> connections;
+    std::shared_ptr<shared_state> state;
+    std::size_t worker;
+  };
+
+  distributing_acceptor::distributing_acceptor(scheduler &s,
+      const socket_address &local, std::vector<scheduler *> workers,
+      connection_handler handler, policy p, const options &opt)
+    : acceptor(s, local, opt)
+    , m_workers(std::move(workers))
+    , m_policy(p)
+    , m_next(0)
+    , m_state(std::make_shared<shared_state>(std::move(handler),
+          m_workers.size()))
+    , m_handoffs(m_workers.size(), nullptr)
+  {
+    if (m_workers.empty())
+      throw std::invalid_argument("No worker to distribute connections to");
+  }
+
+  void distributing_acceptor::release(std::size_t worker) noexcept
+  { m_state->connections[worker].fetch_sub(1, std::memory_order_relaxed); }
+
+  std::size_t distributing_acceptor::get_connection_count(std::size_t worker)
+    const noexcept
+  { return m_state->connections[worker].load(std::memory_order_relaxed); }
+
+  std::size_t distributing_acceptor::pick() noexcept
+  {
+    if (m_policy == policy::round_robin)
+      return m_next++ % m_workers.size();
+
+    // Start from the next one so that idle workers are picked in turn
+    std::size_t n = m_workers.size();
+    std::size_t best = m_next % n;
+    std::size_t least = get_connection_count(best);
+    for (std::size_t k = 1; k < n && least != 0; ++k)
+    {
+      std::size_t i = (m_next + k) % n;
+      std::size_t count = get_connection_count(i);
+      if (count < least)
+      {
+        best = i;
+        least = count;
+      }
+    }
+    m_next = best + 1;
+    return best;
+  }
+
+  void distributing_acceptor::on_accepted(system_handle &connection) noexcept
+  {
+    std::size_t worker = pick();
+    try
+    {
+      handoff *&h = m_handoffs[worker];
+      if (h == nullptr)
+        h = new handoff(m_state, worker);
+      h->connections.push_back(std::move(connection));
+    }
+    catch (std::bad_alloc &)
+    {
+      // Drop the connection, it's closed by the caller
+      return;
+    }
+    m_state->connections[worker].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void distributing_acceptor::on_drained() noexcept
+  {
+    for (std::size_t i = 0; i < m_workers.size(); ++i)
+      if (m_handoffs[i] != nullptr)
+      {
+        m_workers[i]->post(m_handoffs[i]->t);
+        m_handoffs[i] = nullptr;
+      }
+  }
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/buffer_pool.hpp>
+
+#include <cassert>
+#include <new>
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+namespace spin
+{
+  namespace
+  {
+    /** @brief Map an arena aligned to its size, so it can use huge pages */
+    void *map_arena(bool huge_pages, bool &huge)
+    {
+      constexpr std::size_t size = buffer_pool::arena_size;
+      huge = false;
+      if (huge_pages)
+      {
+        void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+        {
+          huge = true;
+          return p;
+        }
+      }
+
+      // Map twice the size and trim both ends to get aligned
+      void *p = ::mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+        throw std::bad_alloc();
+      auto begin = reinterpret_cast<std::uintptr_t>(p);
+      auto aligned = (begin + size - 1) & ~(std::uintptr_t(size) - 1);
+      if (aligned != begin)
+        ::munmap(p, aligned - begin);
+      if (aligned + size != begin + 2 * size)
+        ::munmap(reinterpret_cast<void *>(aligned + size),
+            begin + size - aligned);
+      if (huge_pages)
+        ::madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+      return reinterpret_cast<void *>(aligned);
+    }
+  }
+
+  struct buffer_pool::arena
+  {
+    arena(buffer_pool &pool, std::size_t size_class, bool huge_pages)
+      : memory(nullptr)
+      , huge(false)
+      , count(arena_size / get_block_size(size_class))
+      , blocks(new detail::buffer_block[count])
+    {
+      memory = static_cast<char *>(map_arena(huge_pages, huge));
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        detail::buffer_block &b = blocks[i];
+        b.refs.store(0, std::memory_order_relaxed);
+        b.size_class = static_cast<std::uint32_t>(size_class);
+        b.pool = &pool;
+        b.data = memory + i * get_block_size(size_class);
+      }
+    }
+
+    ~arena() noexcept
+    { ::munmap(memory, arena_size); }
+
+    char *memory;
+    bool huge;
+    const std::size_t count;
+    const std::unique_ptr<detail::buffer_block[]> blocks;
+  };
+
+  buffer buffer::slice(std::size_t offset, std::size_t size) const
+  {
+    if (offset > m_size || size > m_size - offset)
+      throw std::out_of_range("Slice exceeds buffer");
+    buffer ret(*this);
+    ret.m_data += offset;
+    ret.m_size = size;
+    return ret;
+  }
+
+  void buffer::resize(std::size_t size)
+  {
+    if (size > capacity())
+      throw std::length_error("Size exceeds capacity of buffer");
+    m_size = size;
+  }
+
+  void buffer::consume(std::size_t n)
+  {
+    if (n > m_size)
+      throw std::out_of_range("Consume more than buffer size");
+    m_data += n;
+    m_size -= n;
+  }
+
+  buffer_pool::buffer_pool(bool huge_pages)
+    : m_huge_pages(huge_pages)
+    , m_owner()
+    , m_arenas()
+    , m_huge_page_arenas(0)
+    , m_free()
+    , m_free_count()
+    , m_block_count()
+    , m_padding_0()
+    , m_remote()
+    , m_remote_count()
+    , m_padding_1()
+  {
+    for (auto &c : m_remote_count)
+      c.store(0, std::memory_order_relaxed);
+  }
+
+  buffer_pool::~buffer_pool() noexcept
+  {
+    reclaim();
+    for (std::size_t i = 0; i < size_class_count; ++i)
+    {
+      assert(m_free_count[i] == m_block_count[i]
+          && "All buffers must be released before the pool is destroyed");
+      m_free[i].clear();
+    }
+  }
+
+  buffer buffer_pool::allocate(std::size_t size)
+  {
+    std::size_t size_class = get_size_class(size);
+    if (size_class == size_class_count)
+      throw std::length_error("Buffer larger than 64 KiB");
+
+    if (m_owner == std::thread::id())
+      m_owner = std::this_thread::get_id();
+    assert(m_owner == std::this_thread::get_id()
+        && "Buffers must be allocated in the owner thread");
+
+    auto &free_list = m_free[size_class];
+    if (free_list.empty())
+    {
+      reclaim();
+      if (free_list.empty())
+        grow(size_class);
+    }
+
+    detail::buffer_block &b = free_list.front();
+    free_list.pop_front();
+    m_free_count[size_class]--;
+    b.refs.store(1, std::memory_order_relaxed);
+    return buffer(&b, get_block_size(size_class));
+  }
+
+  std::size_t buffer_pool::reclaim() noexcept
+  {
+    auto l = m_remote.pop_all();
+    std::size_t n = 0;
+    while (!l.empty())
+    {
+      detail::buffer_block &b = l.front();
+      l.pop_front();
+      m_remote_count[b.size_class].fetch_sub(1, std::memory_order_relaxed);
+      m_free[b.size_class].push_front(b);
+      m_free_count[b.size_class]++;
+      n++;
+    }
+    return n;
+  }
+
+  void buffer_pool::release(detail::buffer_block &b) noexcept
+  {
+    if (std::this_thread::get_id() == m_owner)
+    {
+      // Reuse the most recently released block, which is likely in cache
+      m_free[b.size_class].push_front(b);
+      m_free_count[b.size_class]++;
+    }
+    else
+    {
+      m_remote_count[b.size_class].fetch_add(1, std::memory_order_relaxed);
+      m_remote.push(b);
+    }
+  }
+
+  void buffer_pool::grow(std::size_t size_class)
+  {
+    m_arenas.reserve(m_arenas.size() + 1);
+    std::unique_ptr<arena> a(new arena(*this, size_class, m_huge_pages));
+    for (std::size_t i = a->count; i != 0; --i)
+      m_free[size_class].push_front(a->blocks[i - 1]);
+    m_free_count[size_class] += a->count;
+    m_block_count[size_class] += a->count;
+    if (a->huge)
+      m_huge_page_arenas++;
+    m_arenas.push_back(std::move(a));
+  }
+
+  buffer_pool_statistics buffer_pool::get_statistics() const noexcept
+  {
+    buffer_pool_statistics ret;
+    for (std::size_t i = 0; i < size_class_count; ++i)
+    {
+      auto &c = ret.classes[i];
+      c.block_size = get_block_size(i);
+      c.blocks = m_block_count[i];
+      c.free_blocks = m_free_count[i];
+      c.remote_blocks = m_remote_count[i].load(std::memory_order_relaxed);
+      c.used_blocks = c.blocks - c.free_blocks - c.remote_blocks;
+    }
+    ret.arenas = m_arenas.size();
+    ret.huge_page_arenas = m_huge_page_arenas;
+    ret.reserved_bytes = m_arenas.size() * arena_size;
+    return ret;
+  }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/channel.hpp>
+
+#include <sys/eventfd.h>
+
+namespace spin
+{
+
+  channel_base::channel_base(scheduler &s, std::size_t batch_size)
+    : event_source(s, system_handle{eventfd, 0, EFD_NONBLOCK | EFD_CLOEXEC})
+    , m_scheduler(s)
+    , m_batch_size(batch_size)
+    , m_drain_task([this] { drain(); })
+    , m_padding_0()
+    , m_notified(false)
+    , m_padding_1()
+  { }
+
+  void channel_base::notify()
+  {
+    // Pair with the fence in drain, so that either the consumer sees the
+    // message pushed, or we see the flag cleared and write the eventfd
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_notified.load(std::memory_order_relaxed)
+        || m_notified.exchange(true, std::memory_order_relaxed))
+      return;
+
+    if (::eventfd_write(get_device().get_raw_handle(), 1) == -1)
+      throw_exception_for_last_error();
+  }
+
+  void channel_base::on_emit() noexcept
+  {
+    eventfd_t value;
+    ::eventfd_read(get_device().get_raw_handle(), &value);
+    // Handlers run in a task, which is executed in this iteration too, so
+    // that an exception thrown by them propagates out of scheduler::run
+    if (m_drain_task.is_canceled())
+      m_scheduler.dispatch(m_drain_task);
+  }
+
+  void channel_base::drain()
+  {
+    m_notified.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    std::size_t n;
+    try
+    {
+      n = consume(m_batch_size);
+    }
+    catch (...)
+    {
+      // Messages left are handled once the scheduler runs again
+      m_notified.store(true, std::memory_order_relaxed);
+      m_scheduler.dispatch(m_drain_task);
+      throw;
+    }
+
+    if (n == m_batch_size)
+    {
+      // There may be more, suppress wakeups and continue in next iteration
+      m_notified.store(true, std::memory_order_relaxed);
+      if (m_drain_task.is_canceled())
+        m_scheduler.dispatch(m_drain_task);
+    }
+  }
+
+}
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/datagram_socket.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace spin
+{
+  namespace
+  {
+    // Limits of a single UDP_SEGMENT message imposed by kernel
+    constexpr std::size_t max_gso_size = 65507;
+    constexpr std::size_t max_gso_segments = 64;
+
+    system_handle open_bound_socket(const socket_address &local,
+        const datagram_socket::options &opt)
+    {
+      if (opt.batch_size == 0 || opt.buffer_size == 0)
+        throw std::invalid_argument("Batch size and buffer size must be "
+            "positive");
+
+      system_handle ret = open_socket(local.get_family(), SOCK_DGRAM,
+          IPPROTO_UDP);
+      if (opt.reuse_port)
+        set_socket_option(ret, SOL_SOCKET, SO_REUSEPORT, 1);
+      if (::bind(ret.get_raw_handle(), local.get_data(), local.get_size())
+          == -1)
+        throw_exception_for_last_error();
+      return ret;
+    }
+
+    bool is_transient_error(int error) noexcept
+    {
+      // Reported asynchronously by ICMP for a datagram sent earlier
+      return error == ECONNREFUSED || error == EHOSTUNREACH
+        || error == ENETUNREACH;
+    }
+  }
+
+  datagram_socket::datagram_socket(scheduler &s, const socket_address &local,
+      receive_handler handler, const options &opt)
+    : io_event_source(s, open_bound_socket(local, opt), readwrite)
+    , m_scheduler(s)
+    , m_handler(std::move(handler))
+    , m_batch_size(opt.batch_size)
+    , m_buffer_size(opt.buffer_size)
+    , m_gro(false)
+    , m_gso(false)
+    , m_receive_buffer(new char[opt.batch_size * opt.buffer_size])
+    , m_receive_headers(opt.batch_size)
+    , m_receive_iovecs(opt.batch_size)
+    , m_sources(opt.batch_size)
+    , m_receive_control()
+    , m_datagrams(opt.batch_size)
+    , m_send_buffer(new char[opt.batch_size * opt.buffer_size])
+    , m_send_buffer_used(0)
+    , m_send_headers(opt.batch_size)
+    , m_send_iovecs(opt.batch_size)
+    , m_outgoings(opt.batch_size)
+    , m_send_control()
+    , m_send_head(0)
+    , m_send_tail(0)
+    , m_pending_count(0)
+    , m_flush_task([this] { flush(); })
+    , m_receive_task([this]
+        { drain_readable([this] { return receive_batch(); }); })
+  {
+    int fd = get_device().get_raw_handle();
+    if (opt.gro)
+    {
+      int value = 1;
+      m_gro = ::setsockopt(fd, IPPROTO_UDP, UDP_GRO, &value,
+          sizeof(value)) == 0;
+    }
+    if (opt.gso)
+    {
+      int value;
+      ::socklen_t size = sizeof(value);
+      m_gso = ::getsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &value, &size) == 0;
+    }
+
+    if (m_gro)
+      m_receive_control.resize(m_batch_size);
+    if (m_gso)
+      m_send_control.resize(m_batch_size);
+
+    for (std::size_t i = 0; i < m_batch_size; ++i)
+    {
+      m_receive_iovecs[i].iov_base = &m_receive_buffer[i * m_buffer_size];
+      m_receive_iovecs[i].iov_len = m_buffer_size;
+      ::msghdr &hdr = m_receive_headers[i].msg_hdr;
+      std::memset(&hdr, 0, sizeof(hdr));
+      hdr.msg_name = m_sources[i].get_data();
+      hdr.msg_iov = &m_receive_iovecs[i];
+      hdr.msg_iovlen = 1;
+      if (m_gro)
+        hdr.msg_control = &m_receive_control[i];
+      std::memset(&m_send_headers[i].msg_hdr, 0, sizeof(::msghdr));
+    }
+  }
+
+  datagram_socket::~datagram_socket() noexcept
+  {
+    m_flush_task.cancel();
+    m_receive_task.cancel();
+  }
+
+  void datagram_socket::connect(const socket_address &peer)
+  {
+    if (::connect(get_device().get_raw_handle(), peer.get_data(),
+          peer.get_size()) == -1)
+      throw_exception_for_last_error();
+  }
+
+  socket_address datagram_socket::get_local_address() const
+  { return spin::get_local_address(get_device()); }
+
+  bool datagram_socket::send(const void *data, std::size_t size,
+      const socket_address &to)
+  { return enqueue(data, size, &to); }
+
+  bool datagram_socket::send(const void *data, std::size_t size)
+  { return enqueue(data, size, nullptr); }
+
+  bool datagram_socket::enqueue(const void *data, std::size_t size,
+      const socket_address *to)
+  {
+    if (size > m_buffer_size)
+      throw std::length_error("Datagram is larger than buffer size");
+
+    const std::size_t capacity = m_batch_size * m_buffer_size;
+    if (m_send_buffer_used + size > capacity)
+      if (flush() != 0)
+        return false;
+
+    socket_address none;
+    const socket_address &destination = to ? *to : none;
+
+    // Append to the last message as another segment if it's a run of
+    // datagrams of the same size to the same destination, only the last
+    // segment of a run may be shorter
+    if (m_gso && m_send_tail != m_send_head)
+    {
+      outgoing &last = m_outgoings[m_send_tail - 1];
+      ::iovec &iov = m_send_iovecs[m_send_tail - 1];
+      if (iov.iov_len == last.segment_size * last.segments
+          && size <= last.segment_size
+          && last.segments < max_gso_segments
+          && iov.iov_len + size <= max_gso_size
+          && last.destination == destination)
+      {
+        std::memcpy(&m_send_buffer[m_send_buffer_used], data, size);
+        m_send_buffer_used += size;
+        iov.iov_len += size;
+        last.segments++;
+        m_pending_count++;
+        return true;
+      }
+    }
+
+    if (m_send_tail == m_batch_size)
+      if (flush() != 0)
+        return false;
+
+    std::size_t i = m_send_tail;
+    char *payload = &m_send_buffer[m_send_buffer_used];
+    std::memcpy(payload, data, size);
+    m_send_buffer_used += size;
+    m_send_iovecs[i].iov_base = payload;
+    m_send_iovecs[i].iov_len = size;
+    m_outgoings[i].destination = destination;
+    m_outgoings[i].segment_size = size;
+    m_outgoings[i].segments = 1;
+
+    ::msghdr &hdr = m_send_headers[i].msg_hdr;
+    hdr.msg_name = to ? m_outgoings[i].destination.get_data() : nullptr;
+    hdr.msg_namelen = to ? to->get_size() : 0;
+    hdr.msg_iov = &m_send_iovecs[i];
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = nullptr;
+    hdr.msg_controllen = 0;
+
+    m_send_tail++;
+    m_pending_count++;
+    if (m_flush_task.is_canceled())
+      m_scheduler.dispatch(m_flush_task);
+    return true;
+  }
+
+  std::size_t datagram_socket::flush() noexcept
+  {
+    if (m_gso)
+      for (std::size_t i = m_send_head; i != m_send_tail; ++i)
+      {
+        ::msghdr &hdr = m_send_headers[i].msg_hdr;
+        if (m_outgoings[i].segments == 1)
+        {
+          hdr.msg_control = nullptr;
+          hdr.msg_controllen = 0;
+          continue;
+        }
+        hdr.msg_control = &m_send_control[i];
+        hdr.msg_controllen = CMSG_SPACE(sizeof(std::uint16_t));
+        ::cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+        std::uint16_t segment_size
+          = static_cast<std::uint16_t>(m_outgoings[i].segment_size);
+        std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+      }
+
+    drain_writable([this] { return send_batch(); });
+
+    if (m_send_head == m_send_tail)
+    {
+      m_send_head = m_send_tail = 0;
+      m_send_buffer_used = 0;
+      m_flush_task.cancel();
+    }
+    return m_pending_count;
+  }
+
+  std::ptrdiff_t datagram_socket::send_batch() noexcept
+  {
+    int fd = get_device().get_raw_handle();
+    while (m_send_head != m_send_tail)
+    {
+      int n = ::sendmmsg(fd, &m_send_headers[m_send_head],
+          static_cast<unsigned>(m_send_tail - m_send_head), MSG_DONTWAIT);
+      if (n == -1)
+      {
+        if (errno == EINTR)
+          continue;
+        // Wait for on_writable
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          return -1;
+        // The first message failed, drop it as UDP is unreliable anyway
+        n = 1;
+      }
+      std::ptrdiff_t bytes = 0;
+      for ( ; n != 0; --n)
+      {
+        bytes += static_cast<std::ptrdiff_t>(
+            m_send_iovecs[m_send_head].iov_len);
+        m_pending_count -= m_outgoings[m_send_head++].segments;
+      }
+      return bytes;
+    }
+    return -1;
+  }
+
+  void datagram_socket::on_readable() noexcept
+  {
+    // Handlers run in a task, which is executed in this iteration too, so
+    // that an exception thrown by them propagates out of scheduler::run
+    if (m_receive_task.is_canceled())
+      m_scheduler.dispatch(m_receive_task);
+  }
+
+  std::ptrdiff_t datagram_socket::receive_batch()
+  {
+    int fd = get_device().get_raw_handle();
+    for ( ; ; )
+    {
+      for (std::size_t i = 0; i < m_batch_size; ++i)
+      {
+        ::msghdr &hdr = m_receive_headers[i].msg_hdr;
+        hdr.msg_namelen = socket_address::get_capacity();
+        hdr.msg_controllen = m_gro ? sizeof(control_buffer) : 0;
+        hdr.msg_flags = 0;
+      }
+
+      int n = ::recvmmsg(fd, m_receive_headers.data(),
+          static_cast<unsigned>(m_batch_size), MSG_DONTWAIT, nullptr);
+      if (n == -1)
+      {
+        if (errno == EINTR || is_transient_error(errno))
+          continue;
+        return -1;
+      }
+
+      for (int i = 0; i < n; ++i)
+      {
+        ::msghdr &hdr = m_receive_headers[i].msg_hdr;
+        datagram &d = m_datagrams[i];
+        m_sources[i].set_size(hdr.msg_namelen);
+        d.data = &m_receive_buffer[i * m_buffer_size];
+        d.size = m_receive_headers[i].msg_len;
+        d.segment_size = 0;
+        d.source = &m_sources[i];
+        d.truncated = (hdr.msg_flags & MSG_TRUNC) != 0;
+        if (!m_gro)
+          continue;
+        for (::cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+            cmsg = CMSG_NXTHDR(&hdr, cmsg))
+          if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+          {
+            int segment_size;
+            std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(int));
+            if (static_cast<std::size_t>(segment_size) < d.size)
+              d.segment_size = static_cast<std::size_t>(segment_size);
+          }
+      }
+      m_handler(*this, m_datagrams.data(), static_cast<std::size_t>(n));
+
+      // A short batch doesn't mean the queue is drained, recvmmsg also
+      // returns early if an error is pending; only EAGAIN tells so
+      std::ptrdiff_t bytes = 0;
+      for (int i = 0; i < n; ++i)
+        bytes += static_cast<std::ptrdiff_t>(m_datagrams[i].size);
+      return bytes;
+    }
+  }
+
+  void datagram_socket::on_writable() noexcept
+  {
+    if (m_pending_count != 0)
+      flush();
+  }
+
+  void datagram_socket::on_error() noexcept
+  {
+    // Clear the pending error reported by ICMP
+    int error;
+    ::socklen_t size = sizeof(error);
+    ::getsockopt(get_device().get_raw_handle(), SOL_SOCKET, SO_ERROR, &error,
+        &size);
+  }
+}
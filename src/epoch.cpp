@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/epoch.hpp>
+#include <spin/utils.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace spin
+{
+  namespace
+  {
+    struct limbo_entry
+    {
+      std::uint64_t m_epoch;
+      routine<> m_callback;
+    };
+
+    // A list rather than a deque, so that pending callbacks are handed
+    // over by splicing, which neither allocates nor throws
+    using limbo_list = std::list<limbo_entry>;
+
+    /**
+     * @brief Per-thread record scanned by threads advancing the epoch
+     *
+     * Records are never freed, a record released by an exited thread is
+     * reused by the next thread.
+     */
+    struct participant
+    {
+      // (epoch << 1) | 1 when observing shared nodes, 0 otherwise
+      std::atomic<std::uint64_t> m_state;
+      std::atomic_bool m_in_use;
+      participant *m_next;
+
+      // Owned by the thread using this record
+      std::size_t m_nest;
+      std::size_t m_registrations;
+      bool m_offline;
+      limbo_list m_limbo;
+      char m_padding[cache_line_size];
+    };
+
+    /** @brief Number of pending callbacks which makes retire reclaim */
+    constexpr std::size_t retire_threshold = 128;
+
+    std::atomic<std::uint64_t> s_epoch(1);
+    std::atomic<participant *> s_participants(nullptr);
+
+    // Callbacks left by exited or blocking threads
+    std::mutex s_orphan_mutex;
+    limbo_list s_orphans;
+    std::atomic_bool s_has_orphans(false);
+
+    // A plain pointer is checked in the fast path rather than an object
+    // with dynamic initialization, which needs a guard on every access
+    thread_local participant *t_participant = nullptr;
+
+    participant *acquire_participant()
+    {
+      auto *p = s_participants.load(std::memory_order_acquire);
+      for ( ; p != nullptr; p = p->m_next)
+      {
+        bool in_use = false;
+        if (!p->m_in_use.load(std::memory_order_relaxed)
+            && p->m_in_use.compare_exchange_strong(in_use, true,
+              std::memory_order_acquire))
+          return p;
+      }
+
+      p = new participant;
+      p->m_state.store(0, std::memory_order_relaxed);
+      p->m_in_use.store(true, std::memory_order_relaxed);
+      p->m_nest = 0;
+      p->m_registrations = 0;
+      p->m_offline = false;
+      p->m_next = s_participants.load(std::memory_order_relaxed);
+      while (!s_participants.compare_exchange_weak(p->m_next, p,
+            std::memory_order_release, std::memory_order_relaxed))
+        ;
+      return p;
+    }
+
+    /** @brief Hand pending callbacks over to other threads */
+    void abandon_limbo(participant &p) noexcept
+    {
+      if (p.m_limbo.empty())
+        return;
+      std::lock_guard<std::mutex> guard(s_orphan_mutex);
+      s_orphans.splice(s_orphans.end(), p.m_limbo);
+      s_has_orphans.store(true, std::memory_order_relaxed);
+    }
+
+    void release_participant(participant &p) noexcept
+    {
+      abandon_limbo(p);
+      p.m_nest = 0;
+      p.m_registrations = 0;
+      p.m_offline = false;
+      p.m_state.store(0, std::memory_order_release);
+      p.m_in_use.store(false, std::memory_order_release);
+    }
+
+    struct thread_record
+    {
+      ~thread_record()
+      {
+        if (t_participant == nullptr)
+          return;
+        release_participant(*t_participant);
+        t_participant = nullptr;
+      }
+    };
+
+    participant &local_participant()
+    {
+      if (t_participant != nullptr)
+        return *t_participant;
+      static thread_local thread_record record;
+      (void) record;
+      t_participant = acquire_participant();
+      return *t_participant;
+    }
+
+    bool is_announcing(const participant &p) noexcept
+    { return p.m_registrations != 0 && !p.m_offline; }
+
+    /** @brief Announce current thread is observing the current epoch */
+    void announce(participant &p) noexcept
+    {
+      auto state = (s_epoch.load(std::memory_order_relaxed) << 1) | 1;
+      if (p.m_state.load(std::memory_order_relaxed) == state)
+        return;
+      p.m_state.store(state, std::memory_order_relaxed);
+
+      // The announcement must be visible before any shared node is loaded
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void depart(participant &p) noexcept
+    { p.m_state.store(0, std::memory_order_release); }
+
+    /** @brief Advance the epoch if no thread is in an older epoch */
+    bool try_advance() noexcept
+    {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto e = s_epoch.load(std::memory_order_relaxed);
+      auto *p = s_participants.load(std::memory_order_acquire);
+      for ( ; p != nullptr; p = p->m_next)
+      {
+        auto state = p->m_state.load(std::memory_order_acquire);
+        if ((state & 1) != 0 && (state >> 1) != e)
+          return false;
+      }
+      s_epoch.compare_exchange_strong(e, e + 1, std::memory_order_acq_rel,
+          std::memory_order_relaxed);
+      return true;
+    }
+
+    void collect(limbo_list &limbo, std::uint64_t e,
+        std::vector<routine<>> &ready)
+    {
+      while (!limbo.empty() && limbo.front().m_epoch + 2 <= e)
+      {
+        ready.push_back(std::move(limbo.front().m_callback));
+        limbo.pop_front();
+      }
+    }
+
+    std::size_t reclaim_participant(participant &p)
+    {
+      try_advance();
+      auto e = s_epoch.load(std::memory_order_acquire);
+
+      // Callbacks may retire more objects, collect them before invoking
+      std::vector<routine<>> ready;
+      ready.reserve(p.m_limbo.size());
+      collect(p.m_limbo, e, ready);
+      if (s_has_orphans.load(std::memory_order_relaxed))
+      {
+        std::lock_guard<std::mutex> guard(s_orphan_mutex);
+        collect(s_orphans, e, ready);
+        s_has_orphans.store(!s_orphans.empty(), std::memory_order_relaxed);
+      }
+
+      for (auto &callback : ready)
+        callback();
+      return ready.size();
+    }
+  }
+
+  void epoch::enter()
+  {
+    participant &p = local_participant();
+    if (p.m_nest++ == 0 && !is_announcing(p))
+      announce(p);
+  }
+
+  void epoch::leave() noexcept
+  {
+    participant &p = local_participant();
+    assert(p.m_nest != 0);
+    if (--p.m_nest == 0 && !is_announcing(p))
+      depart(p);
+  }
+
+  bool epoch::is_active()
+  { return local_participant().m_nest != 0; }
+
+  void epoch::quiescent()
+  {
+    participant &p = local_participant();
+    if (p.m_nest != 0)
+      return;
+    if (is_announcing(p))
+      announce(p);
+    if (!p.m_limbo.empty() || s_has_orphans.load(std::memory_order_relaxed))
+      reclaim_participant(p);
+  }
+
+  void epoch::offline()
+  {
+    participant &p = local_participant();
+    p.m_offline = true;
+    if (p.m_nest == 0)
+      depart(p);
+
+    // Otherwise they would not be invoked until this thread wakes up
+    abandon_limbo(p);
+  }
+
+  void epoch::online()
+  {
+    participant &p = local_participant();
+    p.m_offline = false;
+    if (p.m_nest == 0 && is_announcing(p))
+      announce(p);
+  }
+
+  void epoch::retire(routine<> callback)
+  {
+    // The object must have been unlinked before the epoch is sampled
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    participant &p = local_participant();
+    p.m_limbo.push_back(limbo_entry{s_epoch.load(std::memory_order_relaxed),
+        std::move(callback)});
+    if (p.m_limbo.size() >= retire_threshold)
+      reclaim_participant(p);
+  }
+
+  std::size_t epoch::reclaim()
+  { return reclaim_participant(local_participant()); }
+
+  void epoch::synchronize()
+  {
+    participant &p = local_participant();
+    assert(p.m_nest == 0);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto target = s_epoch.load(std::memory_order_relaxed) + 2;
+    while (s_epoch.load(std::memory_order_acquire) < target)
+    {
+      if (is_announcing(p))
+        announce(p);
+      if (!try_advance())
+        std::this_thread::yield();
+    }
+    reclaim_participant(p);
+  }
+
+  void epoch::register_thread()
+  {
+    participant &p = local_participant();
+    if (p.m_registrations++ == 0 && p.m_nest == 0 && !p.m_offline)
+      announce(p);
+  }
+
+  void epoch::unregister_thread() noexcept
+  {
+    participant &p = local_participant();
+    assert(p.m_registrations != 0);
+    if (--p.m_registrations == 0 && p.m_nest == 0)
+      depart(p);
+  }
+}
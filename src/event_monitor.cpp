@@ -16,6 +16,10 @@
  */
 
 #include <spin/event_monitor.hpp>
+#include <spin/epoch.hpp>
+
+#include <array>
+#include <chrono>
 
 #include <sys/eventfd.h>
 #include <sys/epoll.h>
@@ -25,7 +29,8 @@ namespace spin
 
 
   event_monitor::event_monitor()
-    : m_interrupt_callback([] (int) {})
+    : m_interrupt_callback { [] (int) {}, this,
+        &callback::type_of<event_monitor> }
     , m_interrupter { eventfd, 0, EFD_NONBLOCK }
     , m_monitor { epoll_create1, EPOLL_CLOEXEC }
   {
@@ -47,12 +52,33 @@ namespace spin
       throw_exception_for_last_error();
   }
 
-  void event_monitor::wait(bool allow_blocking)
+  void event_monitor::wait(bool allow_blocking,
+      statistics_counters *statistics, watchdog_probe *probe)
   {
     std::array<::epoll_event, 128> evarray;
     int timeout = allow_blocking ? -1 : 0;
+#ifdef SPIN_ENABLE_STATISTICS
+    auto start = std::chrono::steady_clock::now();
+#endif
+    // Don't hold reclamation back while blocking
+    if (allow_blocking)
+      epoch::offline();
     int result = ::epoll_wait(m_monitor.get_raw_handle(),
         evarray.data(), evarray.size(), timeout);
+    if (allow_blocking)
+      epoch::online();
+#ifdef SPIN_ENABLE_STATISTICS
+    if (statistics)
+    {
+      statistics_counters::record(statistics->wait_time,
+          std::chrono::steady_clock::now() - start);
+      statistics_counters::add(statistics->waits);
+      if (allow_blocking)
+        statistics_counters::add(statistics->blocking_waits);
+    }
+#else
+    (void) statistics;
+#endif
 
     if (result == -1)
     {
@@ -67,9 +93,22 @@ namespace spin
 
     for (int i = 0; i < result; i++)
     {
-      const routine<int> *pfunc
-        = reinterpret_cast<const routine<int>*>(evarray[i].data.ptr);
-      (*pfunc)(evarray[i].events);
+      const callback *pfunc
+        = reinterpret_cast<const callback *>(evarray[i].data.ptr);
+#ifdef SPIN_ENABLE_STATISTICS
+      if (statistics)
+        statistics_counters::add(pfunc == &m_interrupt_callback
+            ? statistics->interrupts : statistics->events);
+#endif
+      if (probe && probe->is_watched())
+      {
+        probe->enter(watchdog_activity::event,
+            pfunc->get_owner_type(pfunc->owner));
+        pfunc->function(evarray[i].events);
+        probe->leave();
+      }
+      else
+        pfunc->function(evarray[i].events);
     }
   }
 }
@@ -25,13 +25,13 @@ namespace spin
   event_source::event_source(scheduler &schd, system_handle device)
     : m_monitor(schd.get_event_monitor())
     , m_device(std::move(device))
-    , m_callback([this](int events)
+    , m_callback { [this](int events)
         {
           if (events & EPOLLERR)
             this->on_error();
           if (events & EPOLLIN)
             this->on_emit();
-        })
+        }, this, &event_monitor::callback::type_of<event_source> }
   {
     ::epoll_event epev;
     epev.events = EPOLLIN | EPOLLET;
@@ -63,7 +63,7 @@ namespace spin
   io_event_source::io_event_source(scheduler &schd, system_handle device, int events)
     : m_monitor(schd.get_event_monitor())
     , m_device(std::move(device))
-    , m_callback([this](int events)
+    , m_callback { [this](int events)
         {
           if (events & EPOLLERR)
             this->on_error();
@@ -73,7 +73,11 @@ namespace spin
 
           if (events & EPOLLOUT)
             this->on_writable();
-        })
+        }, this, &event_monitor::callback::type_of<io_event_source> }
+    , m_scheduler(schd)
+    , m_budget()
+    , m_readable_task([this] { on_readable(); })
+    , m_writable_task([this] { on_writable(); })
   {
     ::epoll_event epev;
     epev.events = events;
@@ -0,0 +1,656 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/file_io.hpp>
+#include <spin/event_source.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace spin
+{
+  namespace
+  {
+    // Linux transfers at most this many bytes per read or write
+    constexpr std::size_t max_transfer_size = 0x7ffff000;
+
+    // Completions an I/O thread collects before posting them
+    constexpr std::size_t completion_batch_size = 32;
+
+    int io_uring_setup(unsigned entries, ::io_uring_params &params) noexcept
+    {
+      return static_cast<int>(::syscall(__NR_io_uring_setup, entries,
+            &params));
+    }
+
+    int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+        unsigned flags) noexcept
+    {
+      return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit,
+            min_complete, flags, nullptr, 0));
+    }
+
+    int io_uring_register(int fd, unsigned opcode, const void *arg,
+        unsigned count) noexcept
+    {
+      return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode,
+            arg, count));
+    }
+  }
+
+  direct_io_alignment get_direct_io_alignment(const system_handle &file)
+    noexcept
+  {
+    direct_io_alignment ret;
+    ret.memory = 4096;
+    ret.offset = 4096;
+#ifdef STATX_DIOALIGN
+    struct ::statx st;
+    if (::statx(file.get_raw_handle(), "", AT_EMPTY_PATH, STATX_DIOALIGN,
+          &st) == 0 && (st.stx_mask & STATX_DIOALIGN) != 0
+        && st.stx_dio_mem_align != 0 && st.stx_dio_offset_align != 0)
+    {
+      ret.memory = st.stx_dio_mem_align;
+      ret.offset = st.stx_dio_offset_align;
+    }
+#else
+    (void)file;
+#endif
+    return ret;
+  }
+
+  aligned_memory allocate_aligned(std::size_t size, std::size_t alignment)
+  {
+    void *p = nullptr;
+    if (::posix_memalign(&p, std::max(alignment, sizeof(void *)),
+          std::max(size, std::size_t(1))) != 0)
+      throw std::bad_alloc();
+    return aligned_memory(static_cast<char *>(p));
+  }
+
+  struct file_io::request : public task
+  {
+    enum operation
+    {
+      read,
+      write,
+      fsync,
+      fdatasync,
+      fallocate
+    };
+
+    request(operation op, const system_handle &file,
+        completion_handler h) noexcept
+      : task([this] { complete(); })
+      , opcode(op)
+      , fd(file.get_raw_handle())
+      , data(nullptr)
+      , size(0)
+      , offset(0)
+      , length(0)
+      , mode(0)
+      , buffer_index(-1)
+      , result(0)
+      , handler(std::move(h))
+    { }
+
+    /** @brief Execute with blocking system call, in an I/O thread */
+    void execute() noexcept
+    {
+      ::ssize_t n;
+      do
+      {
+        switch (opcode)
+        {
+        case read:
+          n = ::pread(fd, data, size, static_cast<::off_t>(offset));
+          break;
+        case write:
+          n = ::pwrite(fd, data, size, static_cast<::off_t>(offset));
+          break;
+        case fsync:
+          n = ::fsync(fd);
+          break;
+        case fdatasync:
+          n = ::fdatasync(fd);
+          break;
+        default:
+          n = ::fallocate(fd, mode, static_cast<::off_t>(offset),
+              static_cast<::off_t>(length));
+          break;
+        }
+      } while (n == -1 && errno == EINTR);
+      result = n == -1 ? -errno : n;
+    }
+
+    /** @brief Fill a submission queue entry of io_uring */
+    void prepare(::io_uring_sqe &sqe) noexcept
+    {
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.fd = fd;
+      sqe.user_data = reinterpret_cast<std::uintptr_t>(this);
+      switch (opcode)
+      {
+      case read:
+      case write:
+        if (buffer_index < 0)
+          sqe.opcode = opcode == read ? IORING_OP_READ : IORING_OP_WRITE;
+        else
+        {
+          sqe.opcode = opcode == read
+            ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+          sqe.buf_index = static_cast<std::uint16_t>(buffer_index);
+        }
+        sqe.addr = reinterpret_cast<std::uintptr_t>(data);
+        sqe.len = static_cast<std::uint32_t>(size);
+        sqe.off = offset;
+        break;
+      case fsync:
+      case fdatasync:
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fsync_flags = opcode == fdatasync ? IORING_FSYNC_DATASYNC : 0;
+        break;
+      default:
+        sqe.opcode = IORING_OP_FALLOCATE;
+        sqe.off = offset;
+        sqe.addr = length;
+        sqe.len = static_cast<std::uint32_t>(mode);
+        break;
+      }
+    }
+
+    /** @brief Delete this request and call the handler */
+    void complete()
+    {
+      std::unique_ptr<request> guard(this);
+      completion_handler h(std::move(handler));
+      std::error_code error;
+      std::size_t transferred = 0;
+      if (result < 0)
+        error.assign(static_cast<int>(-result), std::system_category());
+      else
+        transferred = static_cast<std::size_t>(result);
+      guard.reset();
+      h(transferred, error);
+    }
+
+    operation opcode;
+    int fd;
+    void *data;
+    std::size_t size;
+    std::uint64_t offset;
+    std::uint64_t length;
+    int mode;
+    int buffer_index;
+    std::ptrdiff_t result;
+    completion_handler handler;
+  };
+
+  /**
+   * @brief Submission and completion rings of io_uring mapped into memory
+   *
+   * Only the thread of the scheduler touches the rings, the kernel is the
+   * other side of both of them.
+   */
+  class file_io::ring
+  {
+  public:
+    explicit ring(unsigned entries)
+      : m_params()
+      , m_fd(setup(entries, m_params))
+      , m_rings(nullptr)
+      , m_rings_size(std::max<std::size_t>(
+            m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned),
+            m_params.cq_off.cqes
+              + m_params.cq_entries * sizeof(::io_uring_cqe)))
+      , m_sqes(nullptr)
+      , m_sq_tail(0)
+      , m_inflight(0)
+    {
+      void *p = ::mmap(nullptr, m_rings_size, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, m_fd.get_raw_handle(),
+          IORING_OFF_SQ_RING);
+      if (p == MAP_FAILED)
+        throw_exception_for_last_error();
+      m_rings = static_cast<char *>(p);
+
+      p = ::mmap(nullptr, get_sqes_size(), PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, m_fd.get_raw_handle(), IORING_OFF_SQES);
+      if (p == MAP_FAILED)
+      {
+        int error = errno;
+        ::munmap(m_rings, m_rings_size);
+        throw std::system_error(error, std::system_category());
+      }
+      m_sqes = static_cast<::io_uring_sqe *>(p);
+
+      // Entry i of the submission ring always refers to sqe i
+      unsigned *array = at(m_params.sq_off.array);
+      for (unsigned i = 0; i < m_params.sq_entries; ++i)
+        array[i] = i;
+      m_sq_tail = *at(m_params.sq_off.tail);
+    }
+
+    ~ring() noexcept
+    {
+      ::munmap(m_sqes, get_sqes_size());
+      ::munmap(m_rings, m_rings_size);
+    }
+
+    void register_eventfd(const system_handle &eventfd)
+    {
+      int fd = eventfd.get_raw_handle();
+      if (io_uring_register(m_fd.get_raw_handle(), IORING_REGISTER_EVENTFD,
+            &fd, 1) == -1)
+        throw_exception_for_last_error();
+    }
+
+    void register_buffers(const ::iovec *buffers, std::size_t count)
+    {
+      if (io_uring_register(m_fd.get_raw_handle(), IORING_REGISTER_BUFFERS,
+            buffers, static_cast<unsigned>(count)) == -1)
+        throw_exception_for_last_error();
+    }
+
+    void unregister_buffers() noexcept
+    {
+      io_uring_register(m_fd.get_raw_handle(), IORING_UNREGISTER_BUFFERS,
+          nullptr, 0);
+    }
+
+    /**
+     * @brief Test if another operation may be queued, it's not only limited
+     * by the submission ring but also by the completion ring as it's never
+     * allowed to overflow
+     */
+    bool is_full() const noexcept
+    {
+      return m_inflight == m_params.cq_entries
+        || m_sq_tail - load(m_params.sq_off.head) == m_params.sq_entries;
+    }
+
+    /** @brief Get next entry to fill, must not be called if #is_full */
+    ::io_uring_sqe &get_sqe() noexcept
+    {
+      ++m_inflight;
+      return m_sqes[m_sq_tail++ & (m_params.sq_entries - 1)];
+    }
+
+    /**
+     * @brief Submit entries queued
+     * @returns false if some are not accepted by kernel yet
+     */
+    bool submit() noexcept
+    {
+      __atomic_store_n(at(m_params.sq_off.tail), m_sq_tail,
+          __ATOMIC_RELEASE);
+      unsigned count = m_sq_tail - load(m_params.sq_off.head);
+      if (count == 0)
+        return true;
+      int n = io_uring_enter(m_fd.get_raw_handle(), count, 0, 0);
+      return n >= 0 && static_cast<unsigned>(n) == count;
+    }
+
+    /** @brief Block until at least one operation completes */
+    void wait() noexcept
+    { io_uring_enter(m_fd.get_raw_handle(), 0, 1, IORING_ENTER_GETEVENTS); }
+
+    /** @brief Pass each completed request and its result to @a callback */
+    template<typename Callback>
+    void reap(Callback &&callback) noexcept
+    {
+      unsigned *head = at(m_params.cq_off.head);
+      unsigned h = *head;
+      unsigned tail = load(m_params.cq_off.tail);
+      auto *cqes = reinterpret_cast<::io_uring_cqe *>(
+          m_rings + m_params.cq_off.cqes);
+      for ( ; h != tail; ++h)
+      {
+        ::io_uring_cqe &cqe = cqes[h & (m_params.cq_entries - 1)];
+        --m_inflight;
+        callback(reinterpret_cast<request *>(cqe.user_data), cqe.res);
+      }
+      __atomic_store_n(head, h, __ATOMIC_RELEASE);
+    }
+
+    unsigned get_inflight() const noexcept
+    { return m_inflight; }
+
+  private:
+    static system_handle setup(unsigned entries, ::io_uring_params &params)
+    {
+      std::memset(&params, 0, sizeof(params));
+      int fd = io_uring_setup(entries, params);
+      if (fd == -1)
+        throw_exception_for_last_error();
+      system_handle ret(fd);
+
+      // Single mapping of both rings, and IORING_OP_READ, IORING_OP_WRITE
+      // and IORING_OP_FALLOCATE, which come with IORING_FEAT_RW_CUR_POS
+      const unsigned required = IORING_FEAT_SINGLE_MMAP
+        | IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+      if ((params.features & required) != required)
+        throw std::system_error(ENOSYS, std::system_category());
+      return ret;
+    }
+
+    unsigned *at(std::uint32_t offset) const noexcept
+    { return reinterpret_cast<unsigned *>(m_rings + offset); }
+
+    unsigned load(std::uint32_t offset) const noexcept
+    { return __atomic_load_n(at(offset), __ATOMIC_ACQUIRE); }
+
+    std::size_t get_sqes_size() const noexcept
+    { return m_params.sq_entries * sizeof(::io_uring_sqe); }
+
+    ::io_uring_params m_params;
+    system_handle m_fd;
+    char *m_rings;
+    const std::size_t m_rings_size;
+    ::io_uring_sqe *m_sqes;
+    unsigned m_sq_tail;
+    unsigned m_inflight;
+  };
+
+  /** @brief The eventfd notified by io_uring once operations complete */
+  class file_io::completion_source : public io_event_source
+  {
+  public:
+    completion_source(scheduler &s, file_io &owner)
+      : io_event_source(s, system_handle(::eventfd, 0,
+            EFD_NONBLOCK | EFD_CLOEXEC), readonly)
+      , m_owner(owner)
+    { }
+
+  protected:
+    void on_readable() noexcept override
+    {
+      ::eventfd_t value;
+      ::eventfd_read(get_device().get_raw_handle(), &value);
+      m_owner.reap();
+    }
+
+  private:
+    file_io &m_owner;
+  };
+
+  file_io::file_io(scheduler &s, const options &opt)
+    : m_scheduler(s)
+    , m_ring()
+    , m_completion_source()
+    , m_monitor()
+    , m_buffers()
+    , m_backlog()
+    , m_flush_task([this] { flush(); })
+    , m_mutex()
+    , m_cond()
+    , m_exited(false)
+    , m_threads()
+  {
+    if (opt.queue_depth == 0 || opt.threads == 0)
+      throw std::invalid_argument("Queue depth and number of threads must "
+          "be positive");
+
+    if (opt.use_io_uring)
+    {
+      try
+      {
+        m_ring.reset(new ring(opt.queue_depth));
+      }
+      catch (std::system_error &)
+      {
+        // Not supported by the kernel, or not permitted, e.g. by seccomp
+      }
+    }
+
+    if (m_ring)
+    {
+      m_completion_source.reset(new completion_source(s, *this));
+      m_ring->register_eventfd(m_completion_source->get_device());
+      return;
+    }
+
+    m_monitor = s.get_event_monitor();
+    try
+    {
+      for (unsigned i = 0; i < opt.threads; ++i)
+        m_threads.emplace_back(&file_io::thread_routine, this);
+    }
+    catch (...)
+    {
+      std::unique_lock<std::mutex> guard(m_mutex);
+      m_exited = true;
+      guard.unlock();
+      m_cond.notify_all();
+      for (auto &t : m_threads)
+        t.join();
+      throw;
+    }
+  }
+
+  file_io::~file_io() noexcept
+  {
+    if (m_ring)
+    {
+      // The kernel may still write to buffers of operations in flight
+      m_flush_task.cancel();
+      while (m_ring->get_inflight() != 0)
+      {
+        m_ring->submit();
+        m_ring->wait();
+        m_ring->reap([](request *r, int) { delete r; });
+      }
+    }
+    else
+    {
+      std::unique_lock<std::mutex> guard(m_mutex);
+      m_exited = true;
+      guard.unlock();
+      m_cond.notify_all();
+      for (auto &t : m_threads)
+        t.join();
+    }
+
+    while (!m_backlog.empty())
+    {
+      auto &r = static_cast<request &>(m_backlog.front());
+      r.cancel();
+      delete &r;
+    }
+  }
+
+  void file_io::pread(const system_handle &file, void *data,
+      std::size_t size, std::uint64_t offset, completion_handler handler)
+  {
+    std::unique_ptr<request> r(new request(request::read, file,
+          std::move(handler)));
+    r->data = data;
+    r->size = std::min(size, max_transfer_size);
+    r->offset = offset;
+    submit(r.release());
+  }
+
+  void file_io::pwrite(const system_handle &file, const void *data,
+      std::size_t size, std::uint64_t offset, completion_handler handler)
+  {
+    std::unique_ptr<request> r(new request(request::write, file,
+          std::move(handler)));
+    r->data = const_cast<void *>(data);
+    r->size = std::min(size, max_transfer_size);
+    r->offset = offset;
+    submit(r.release());
+  }
+
+  void file_io::fsync(const system_handle &file, bool data_only,
+      completion_handler handler)
+  {
+    submit(new request(data_only ? request::fdatasync : request::fsync,
+          file, std::move(handler)));
+  }
+
+  void file_io::fallocate(const system_handle &file, int mode,
+      std::uint64_t offset, std::uint64_t length,
+      completion_handler handler)
+  {
+    std::unique_ptr<request> r(new request(request::fallocate, file,
+          std::move(handler)));
+    r->mode = mode;
+    r->offset = offset;
+    r->length = length;
+    submit(r.release());
+  }
+
+  void file_io::register_buffers(const ::iovec *buffers, std::size_t count)
+  {
+    if (!m_ring)
+      return;
+
+    // Sorted so that the buffer of an operation is found by binary search
+    std::vector<::iovec> sorted(buffers, buffers + count);
+    std::sort(sorted.begin(), sorted.end(),
+        [](const ::iovec &lhs, const ::iovec &rhs)
+        { return lhs.iov_base < rhs.iov_base; });
+    unregister_buffers();
+    if (sorted.empty())
+      return;
+    m_ring->register_buffers(sorted.data(), sorted.size());
+    m_buffers.swap(sorted);
+  }
+
+  void file_io::unregister_buffers() noexcept
+  {
+    if (!m_ring || m_buffers.empty())
+      return;
+    m_ring->unregister_buffers();
+    m_buffers.clear();
+  }
+
+  int file_io::find_registered_buffer(const void *data, std::size_t size)
+    const noexcept
+  {
+    auto *p = static_cast<const char *>(data);
+    auto i = std::upper_bound(m_buffers.begin(), m_buffers.end(), p,
+        [](const char *x, const ::iovec &v)
+        { return x < static_cast<const char *>(v.iov_base); });
+    if (i == m_buffers.begin())
+      return -1;
+    --i;
+    auto *base = static_cast<const char *>(i->iov_base);
+    if (p + size > base + i->iov_len)
+      return -1;
+    return static_cast<int>(i - m_buffers.begin());
+  }
+
+  void file_io::submit(request *r)
+  {
+    if (m_ring)
+    {
+      m_backlog.push_back(*r);
+      if (m_flush_task.is_canceled())
+        m_scheduler.dispatch(m_flush_task);
+      return;
+    }
+
+    std::unique_lock<std::mutex> guard(m_mutex);
+    m_backlog.push_back(*r);
+    guard.unlock();
+    m_cond.notify_one();
+  }
+
+  void file_io::flush() noexcept
+  {
+    while (!m_backlog.empty() && !m_ring->is_full())
+    {
+      auto &r = static_cast<request &>(m_backlog.front());
+      r.cancel();
+      // Resolved only now as buffers may be registered again meanwhile
+      if (r.opcode == request::read || r.opcode == request::write)
+        r.buffer_index = find_registered_buffer(r.data, r.size);
+      r.prepare(m_ring->get_sqe());
+    }
+
+    // Interrupted, or the kernel is short of memory; retry in next
+    // iteration. Those left in backlog are queued once some complete.
+    if (!m_ring->submit())
+      m_scheduler.dispatch(m_flush_task);
+  }
+
+  void file_io::reap() noexcept
+  {
+    task::queue_type completed;
+    m_ring->reap([&completed](request *r, int result)
+        {
+          r->result = result;
+          completed.push_back(*r);
+        });
+    m_scheduler.dispatch(std::move(completed));
+    if (!m_backlog.empty() && m_flush_task.is_canceled())
+      m_scheduler.dispatch(m_flush_task);
+  }
+
+  void file_io::thread_routine() noexcept
+  {
+    task::queue_type completed;
+    std::size_t count = 0;
+    std::unique_lock<std::mutex> guard(m_mutex);
+    while (!m_exited)
+    {
+      // Post completions when there's nothing more to do right now, or
+      // when there are enough of them
+      if (count != 0
+          && (m_backlog.empty() || count == completion_batch_size))
+      {
+        guard.unlock();
+        m_scheduler.post(std::move(completed));
+        count = 0;
+        guard.lock();
+        continue;
+      }
+
+      if (m_backlog.empty())
+      {
+        m_cond.wait(guard);
+        continue;
+      }
+
+      auto &r = static_cast<request &>(m_backlog.front());
+      r.cancel();
+      guard.unlock();
+      r.execute();
+      completed.push_back(r);
+      ++count;
+      guard.lock();
+    }
+
+    while (!completed.empty())
+    {
+      auto &r = static_cast<request &>(completed.front());
+      r.cancel();
+      delete &r;
+    }
+  }
+}
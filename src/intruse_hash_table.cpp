@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/intruse/hash_table.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+namespace spin
+{
+  namespace
+  {
+    /** @brief log2 of the number of buckets allocated first */
+    constexpr unsigned min_bucket_bits = 3;
+
+    /** @brief Number of old buckets moved by each insertion */
+    constexpr std::size_t migration_step = 2;
+  }
+
+  namespace intruse
+  {
+    bool hash_table_node<void, void>::unlink(hash_table_node &node) noexcept
+    {
+      if (node.m_pprev == nullptr)
+        return false;
+      *node.m_pprev = node.m_next;
+      if (node.m_next != nullptr)
+        node.m_next->m_pprev = node.m_pprev;
+      node.m_table->m_size--;
+      node.m_next = nullptr;
+      node.m_pprev = nullptr;
+      node.m_table = nullptr;
+      return true;
+    }
+
+    hash_table_node<void, void>::hash_table_node(hash_table_node &&n) noexcept
+      : hash_table_node()
+    { take_place(n); }
+
+    hash_table_node<void, void> &
+    hash_table_node<void, void>::operator = (hash_table_node &&n) noexcept
+    {
+      if (&n != this)
+      {
+        unlink(*this);
+        take_place(n);
+      }
+      return *this;
+    }
+
+    void hash_table_node<void, void>::take_place(hash_table_node &n) noexcept
+    {
+      if (n.m_pprev == nullptr)
+        return;
+      m_next = n.m_next;
+      m_pprev = n.m_pprev;
+      m_table = n.m_table;
+      m_hash = n.m_hash;
+      *m_pprev = this;
+      if (m_next != nullptr)
+        m_next->m_pprev = &m_next;
+      n.m_next = nullptr;
+      n.m_pprev = nullptr;
+      n.m_table = nullptr;
+    }
+
+    hash_table_node<void, void>::table::table() noexcept
+      : m_buckets(nullptr)
+      , m_old_buckets(nullptr)
+      , m_bits(0)
+      , m_old_bits(0)
+      , m_rehash_index(0)
+      , m_size(0)
+    { }
+
+    hash_table_node<void, void>::table::table(table &&t) noexcept
+      : table()
+    { swap(t); }
+
+    hash_table_node<void, void>::table::~table() noexcept
+    {
+      clear();
+      delete[] m_buckets;
+    }
+
+    void hash_table_node<void, void>::table::swap(table &t) noexcept
+    {
+      std::swap(m_buckets, t.m_buckets);
+      std::swap(m_old_buckets, t.m_old_buckets);
+      std::swap(m_bits, t.m_bits);
+      std::swap(m_old_bits, t.m_old_bits);
+      std::swap(m_rehash_index, t.m_rehash_index);
+      std::swap(m_size, t.m_size);
+      adopt();
+      t.adopt();
+    }
+
+    std::size_t hash_table_node<void, void>::table::bucket_index(
+        std::size_t hash, unsigned bits) noexcept
+    {
+      // Fibonacci hashing takes the high bits, so that poor hash functions
+      // such as identity of integers still spread, and bucket i is split
+      // into bucket 2i and 2i+1 when the table doubles
+      return static_cast<std::size_t>(
+          (static_cast<std::uint64_t>(hash) * 0x9e3779b97f4a7c15ULL)
+          >> (64 - bits));
+    }
+
+    hash_table_node<void, void> **
+    hash_table_node<void, void>::table::bucket(std::size_t hash) const noexcept
+    {
+      if (m_old_buckets != nullptr)
+      {
+        auto i = bucket_index(hash, m_old_bits);
+        if (i >= m_rehash_index)
+          return &m_old_buckets[i];
+      }
+      return &m_buckets[bucket_index(hash, m_bits)];
+    }
+
+    hash_table_node<void, void> *
+    hash_table_node<void, void>::table::chain(std::size_t hash) const noexcept
+    { return m_buckets == nullptr ? nullptr : *bucket(hash); }
+
+    void hash_table_node<void, void>::table::link(hash_table_node &node,
+        std::size_t hash)
+    {
+      if (m_buckets == nullptr)
+        grow(min_bucket_bits);
+      else if (m_size >= bucket_count())
+        grow(m_bits + 1);
+      else
+        migrate(migration_step);
+
+      auto **b = bucket(hash);
+      node.m_next = *b;
+      node.m_pprev = b;
+      node.m_table = this;
+      node.m_hash = hash;
+      if (*b != nullptr)
+        (*b)->m_pprev = &node.m_next;
+      *b = &node;
+      ++m_size;
+    }
+
+    void hash_table_node<void, void>::table::rehash(std::size_t count)
+    {
+      unsigned bits = min_bucket_bits;
+      while ((std::size_t(1) << bits) < count)
+        ++bits;
+      if (m_buckets != nullptr && bits <= m_bits)
+        return;
+      grow(bits);
+      migrate(std::numeric_limits<std::size_t>::max());
+    }
+
+    void hash_table_node<void, void>::table::clear() noexcept
+    {
+      auto reset = [](hash_table_node **buckets, unsigned bits,
+          std::size_t index) noexcept
+      {
+        for (auto i = index; i < (std::size_t(1) << bits); ++i)
+        {
+          for (auto *p = buckets[i]; p != nullptr; )
+          {
+            auto *next = p->m_next;
+            p->m_next = nullptr;
+            p->m_pprev = nullptr;
+            p->m_table = nullptr;
+            p = next;
+          }
+          buckets[i] = nullptr;
+        }
+      };
+
+      if (m_old_buckets != nullptr)
+      {
+        reset(m_old_buckets, m_old_bits, m_rehash_index);
+        delete[] m_old_buckets;
+        m_old_buckets = nullptr;
+      }
+      if (m_buckets != nullptr)
+        reset(m_buckets, m_bits, 0);
+      m_size = 0;
+    }
+
+    hash_table_node<void, void> *
+    hash_table_node<void, void>::table::first() const noexcept
+    {
+      if (m_old_buckets != nullptr)
+        if (auto *p = scan(m_old_buckets, m_old_bits, m_rehash_index))
+          return p;
+      return m_buckets == nullptr ? nullptr : scan(m_buckets, m_bits, 0);
+    }
+
+    hash_table_node<void, void> *
+    hash_table_node<void, void>::table::next(const hash_table_node &node)
+      const noexcept
+    {
+      if (node.m_next != nullptr)
+        return node.m_next;
+
+      // Old buckets are iterated before new buckets
+      if (m_old_buckets != nullptr)
+      {
+        auto i = bucket_index(node.m_hash, m_old_bits);
+        if (i >= m_rehash_index)
+        {
+          if (auto *p = scan(m_old_buckets, m_old_bits, i + 1))
+            return p;
+          return scan(m_buckets, m_bits, 0);
+        }
+      }
+      return scan(m_buckets, m_bits, bucket_index(node.m_hash, m_bits) + 1);
+    }
+
+    hash_table_node<void, void> *
+    hash_table_node<void, void>::table::scan(hash_table_node **buckets,
+        unsigned bits, std::size_t index) const noexcept
+    {
+      for (auto n = std::size_t(1) << bits; index < n; ++index)
+        if (buckets[index] != nullptr)
+          return buckets[index];
+      return nullptr;
+    }
+
+    void hash_table_node<void, void>::table::migrate(std::size_t n) noexcept
+    {
+      for ( ; n != 0 && m_old_buckets != nullptr; --n)
+      {
+        auto *p = m_old_buckets[m_rehash_index];
+        m_old_buckets[m_rehash_index] = nullptr;
+        ++m_rehash_index;
+        while (p != nullptr)
+        {
+          auto *next = p->m_next;
+          auto **b = &m_buckets[bucket_index(p->m_hash, m_bits)];
+          p->m_next = *b;
+          p->m_pprev = b;
+          if (*b != nullptr)
+            (*b)->m_pprev = &p->m_next;
+          *b = p;
+          p = next;
+        }
+
+        if (m_rehash_index == (std::size_t(1) << m_old_bits))
+        {
+          delete[] m_old_buckets;
+          m_old_buckets = nullptr;
+        }
+      }
+    }
+
+    void hash_table_node<void, void>::table::grow(unsigned bits)
+    {
+      auto **buckets = new hash_table_node *[std::size_t(1) << bits]();
+      migrate(std::numeric_limits<std::size_t>::max());
+      m_old_buckets = m_buckets;
+      m_old_bits = m_bits;
+      m_rehash_index = 0;
+      m_buckets = buckets;
+      m_bits = bits;
+    }
+
+    void hash_table_node<void, void>::table::adopt() noexcept
+    {
+      for (auto *p = first(); p != nullptr; p = next(*p))
+        p->m_table = this;
+    }
+  }
+}
@@ -17,7 +17,9 @@
 
 #include <spin/intruse/rbtree.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <utility>
 
 namespace spin
 {
@@ -31,6 +33,8 @@ namespace spin
       , m_has_r(false)
       , m_is_red(false)
       , m_is_container(false)
+      , m_is_counted(false)
+      , m_is_augmented(false)
     { }
 
     rbtree_node<void, void>::
@@ -42,6 +46,8 @@ namespace spin
       , m_has_r(false)
       , m_is_red(true)
       , m_is_container(true)
+      , m_is_counted(false)
+      , m_is_augmented(false)
     { }
 
     rbtree_node<void, void>::~rbtree_node() noexcept
@@ -55,8 +61,12 @@ namespace spin
     rbtree_node<void, void> &
       rbtree_node<void, void>::operator = (rbtree_node &&n) noexcept
     {
+      // The type of node doesn't change, so don't reset it
+      bool is_counted = m_is_counted, is_augmented = m_is_augmented;
       this->~rbtree_node();
       new (this) rbtree_node(std::move(n));
+      m_is_counted = is_counted;
+      m_is_augmented = is_augmented;
       return *this;
     }
 
@@ -260,6 +270,8 @@ namespace spin
 
       y->m_l = this;
       m_p = y;
+      update_summary();
+      y->update_summary();
     }
 
     void rbtree_node<void, void>::rrotate() noexcept
@@ -289,6 +301,8 @@ namespace spin
 
       y->m_r = this;
       m_p = y;
+      update_summary();
+      y->update_summary();
     }
 
     void rbtree_node<void, void>::
@@ -303,6 +317,7 @@ namespace spin
       m_l = node;
       m_has_l = true;
       node->m_is_red = true;
+      propagate_summary(node);
       rebalance_for_insertion(node);
     }
 
@@ -318,6 +333,7 @@ namespace spin
       m_r = node;
       m_has_r = true;
       node->m_is_red = true;
+      propagate_summary(node);
       rebalance_for_insertion(node);
     }
 
@@ -328,6 +344,7 @@ namespace spin
       assert(!node->m_is_red);
       m_p = m_l = m_r = node;
       node->m_p = node->m_l = node->m_r = this;
+      node->update_summary();
     }
 
     void rbtree_node<void, void>::
@@ -338,7 +355,7 @@ namespace spin
       if (m_is_container)
         insert_root_node(node);
       else if (m_has_l)
-        prev()->insert_to_left(node);
+        prev()->insert_to_right(node);
       else
         insert_to_left(node);
     }
@@ -351,7 +368,7 @@ namespace spin
       if (m_is_container)
         insert_root_node(node);
       else if (this->m_has_r)
-        next()->insert_to_right(node);
+        next()->insert_to_left(node);
       else
         insert_to_right(node);
     }
@@ -379,6 +396,11 @@ namespace spin
       if (m_has_l && m_has_r)
         swap_nodes(*this, *y);
 
+      // Remember where the black height may decrease, as this node may not
+      // be replaced by a child
+      auto *parent = m_p;
+      bool is_left = !parent->m_is_container && this == parent->m_l;
+
       if (m_has_l)
         x = m_l;
       else if (m_has_r)
@@ -459,10 +481,16 @@ namespace spin
         }
       }
 
-      bool need_rebalance = !m_is_red;
+      if (!parent->m_is_container)
+        propagate_summary(parent);
 
-      if (need_rebalance)
-        rebalance_for_unlink(x);
+      if (!m_is_red)
+      {
+        if (x != this && x->m_is_red)
+          x->m_is_red = false;
+        else if (!parent->m_is_container)
+          rebalance_for_unlink(parent, is_left);
+      }
       unlink_cleanup();
       return y;
     }
@@ -485,16 +513,25 @@ namespace spin
     void rbtree_node<void, void>::
       transfer_link(rbtree_node<void, void> &node) noexcept
     {
-      assert(!node.m_is_container);
-      assert(!node.is_linked());
+      // Container node can only be transfered to a node that is not linked
+      // or an empty container node, and it's left empty
+      assert(node.m_is_container
+          ? m_is_container && node.is_empty_container_node()
+          : !node.is_linked());
 
       if (is_linked())
       {
         if (is_empty_container_node())
         {
-          node.~rbtree_node();
-          new (&node) rbtree_node(container);
-          unlink_cleanup();
+          if (!node.m_is_container)
+          {
+            bool is_counted = node.m_is_counted;
+            bool is_augmented = node.m_is_augmented;
+            node.~rbtree_node();
+            new (&node) rbtree_node(container);
+            node.m_is_counted = is_counted;
+            node.m_is_augmented = is_augmented;
+          }
           return;
         }
 
@@ -511,6 +548,7 @@ namespace spin
           node.m_p->m_p = &node;
           node.m_l->m_l = &node;
           node.m_r->m_r = &node;
+          m_p = m_l = m_r = this;
           return;
         }
 
@@ -541,6 +579,25 @@ namespace spin
       }
     }
 
+    void rbtree_node<void, void>::update_summary() noexcept
+    {
+      if (m_is_counted)
+        static_cast<counted_node*>(this)->m_count = 1
+          + counted_node::count(m_l, m_has_l)
+          + counted_node::count(m_r, m_has_r);
+      else if (m_is_augmented)
+        static_cast<augmented_node*>(this)->m_update(*this);
+    }
+
+    void rbtree_node<void, void>::
+      propagate_summary(rbtree_node<void, void> *node) noexcept
+    {
+      if (!node->m_is_counted && !node->m_is_augmented)
+        return;
+      for ( ; !node->m_is_container; node = node->m_p)
+        node->update_summary();
+    }
+
     void rbtree_node<void, void>::
     rebalance_for_insertion(rbtree_node *node) noexcept
     {
@@ -612,15 +669,13 @@ namespace spin
     }
 
     void rbtree_node<void, void>::
-      rebalance_for_unlink(rbtree_node *node) noexcept
+      rebalance_for_unlink(rbtree_node *parent, bool is_left) noexcept
     {
-      // Be careful that node may have detached from the tree
-      while (node->m_is_red == false && !node->is_container_or_root())
+      // The subtree on the is_left side of parent has one less black node
+      // than the other side, and its root, if any, is black
+      for ( ; ; )
       {
-        auto *parent = node;
-        assert(!parent->is_root_node());
-
-        if (parent->m_l == node)
+        if (is_left)
         {
           assert (parent->m_has_r);
 
@@ -628,53 +683,50 @@ namespace spin
           if (w->m_is_red)
             // case 1:
           {
-            // as node is black but w is red, the following assertion must
-            // satisfied
+            // as w is red, it must have two black children
             assert (w->m_has_l);
             assert (w->m_has_r);
             parent->lrotate();
             parent->m_is_red = true;
-            parent->m_p->m_is_red = false;
+            w->m_is_red = false;
             w = parent->m_r;
           }
 
-
           if ((!w->m_has_l || w->m_l->m_is_red == false)
               && (!w->m_has_r || w->m_r->m_is_red == false))
-          // case 2:
+            // case 2:
           {
             w->m_is_red = true;
-            node = parent;
-            parent = node->m_p;
-          }
-          else
-          {
-            if (!w->m_has_r || w->m_r->m_is_red == false)
-              // case 3:
+            if (parent->m_is_red || parent->m_p->m_is_container)
             {
-              assert(w->m_has_l);
-              //w->m_is_red = true;
-              //w->m_l->m_is_red = false;
-
-              w->rrotate();
-              w->m_p->m_is_red = false;
-              w->m_is_red = true;
-              w = parent->m_r;
+              parent->m_is_red = false;
+              return;
             }
+            auto *node = parent;
+            parent = node->m_p;
+            is_left = parent->m_has_l && parent->m_l == node;
+            continue;
+          }
 
-            // case 4:
-
-            assert(w->m_has_r);
-            w->m_is_red = parent->m_is_red;
-            //parent->m_is_red = false;
-            //w->m_r->m_is_red = false;
-            parent->lrotate();
-            parent->m_is_red = false;
-            w->m_r->m_is_red = false;
-            break;
+          if (!w->m_has_r || w->m_r->m_is_red == false)
+            // case 3:
+          {
+            assert (w->m_has_l);
+            w->rrotate();
+            w->m_p->m_is_red = false;
+            w->m_is_red = true;
+            w = parent->m_r;
           }
+
+          // case 4:
+          assert (w->m_has_r);
+          w->m_is_red = parent->m_is_red;
+          parent->lrotate();
+          parent->m_is_red = false;
+          w->m_r->m_is_red = false;
+          return;
         }
-        else if (parent->m_r == node)
+        else
         {
           assert (parent->m_has_l);
 
@@ -682,64 +734,50 @@ namespace spin
           if (w->m_is_red)
             // case 1:
           {
-            // as node is black but w is red, the following assertion must
-            // satisfied
+            // as w is red, it must have two black children
             assert (w->m_has_l);
             assert (w->m_has_r);
-            //parent->m_l->m_is_red = false;
-            //parent->m_is_red = true;
             parent->rrotate();
             parent->m_is_red = true;
-            parent->m_p->m_is_red = false;
+            w->m_is_red = false;
             w = parent->m_l;
           }
 
-
           if ((!w->m_has_l || w->m_l->m_is_red == false)
               && (!w->m_has_r || w->m_r->m_is_red == false))
-          // case 2:
+            // case 2:
           {
             w->m_is_red = true;
-            node = parent;
-            parent = node->m_p;
-          }
-          else
-          {
-            if (!w->m_has_l || w->m_l->m_is_red == false)
-              // case 3:
+            if (parent->m_is_red || parent->m_p->m_is_container)
             {
-              assert(w->m_has_r);
-              //w->m_is_red = true;
-              //w->m_r->m_is_red = false;
-
-              w->lrotate();
-              w->m_is_red = true;
-              w->m_p->m_is_red = false;
-              w = parent->m_l;
+              parent->m_is_red = false;
+              return;
             }
+            auto *node = parent;
+            parent = node->m_p;
+            is_left = parent->m_has_l && parent->m_l == node;
+            continue;
+          }
 
-            // case 4:
-
-            assert(w->m_has_l);
-            w->m_is_red = parent->m_is_red;
-            parent->rrotate();
-            parent->m_is_red = false;
-            w->m_l->m_is_red = false;
-            break;
+          if (!w->m_has_l || w->m_l->m_is_red == false)
+            // case 3:
+          {
+            assert (w->m_has_r);
+            w->lrotate();
+            w->m_p->m_is_red = false;
+            w->m_is_red = true;
+            w = parent->m_l;
           }
+
+          // case 4:
+          assert (w->m_has_l);
+          w->m_is_red = parent->m_is_red;
+          parent->rrotate();
+          parent->m_is_red = false;
+          w->m_l->m_is_red = false;
+          return;
         }
-        else
-          break;
       }
-
-      if (node->m_is_container)
-        return;
-      else if (!node->is_root_node())
-        node = node->get_root_node();
-      if (node)
-        node->m_is_red = false;
-      //if (node->is_root_node())
-      //  node->m_is_red = false;
     }
 
     void rbtree_node<void, void>::
@@ -750,6 +788,11 @@ namespace spin
       lhs.transfer_link(tmp);
       rhs.transfer_link(lhs);
       tmp.transfer_link(rhs);
+
+      // Summary belongs to the position rather than the node
+      if (lhs.m_is_counted)
+        std::swap(static_cast<counted_node&>(lhs).m_count,
+            static_cast<counted_node&>(rhs).m_count);
     }
 
     void rbtree_node<void, void>::insert(rbtree_node<void, void> *entry,
@@ -813,5 +856,397 @@ namespace spin
 
     }
 
+    void rbtree_node<void, void>::link_sorted(rbtree_node<void, void> *container,
+        rbtree_node<void, void> *chain, std::size_t n) noexcept
+    {
+      assert (container->is_empty_container_node());
+      if (n == 0)
+        return;
+
+      struct builder
+      {
+        rbtree_node *m_cursor;
+        rbtree_node *m_prev;
+        std::size_t m_red_depth;
+
+        // Build a subtree of n nodes taken from cursor in order, sizes of
+        // the left and right subtree of any node differ at most one, so all
+        // leaves are in the deepest two levels
+        rbtree_node *build(std::size_t n, std::size_t depth) noexcept
+        {
+          if (n == 0)
+            return nullptr;
+
+          auto *l = build((n - 1) / 2, depth + 1);
+          auto *node = m_cursor;
+          m_cursor = node->m_r;
+
+          if (l != nullptr)
+          {
+            node->m_l = l;
+            node->m_has_l = true;
+            l->m_p = node;
+          }
+          else
+            node->m_l = m_prev;
+
+          // The right thread of predecessor is already this node as they
+          // are chained via m_r
+          m_prev = node;
+          node->m_is_red = depth == m_red_depth;
+
+          auto *r = build(n - 1 - (n - 1) / 2, depth + 1);
+          if (r != nullptr)
+          {
+            node->m_r = r;
+            node->m_has_r = true;
+            r->m_p = node;
+          }
+          node->update_summary();
+          return node;
+        }
+      };
+
+      // Count the levels, the deepest level is colored red if it's not full
+      // so that all paths have the same number of black nodes
+      std::size_t levels = 0;
+      while ((n >> levels) != 0)
+        ++levels;
+      bool full = ((n + 1) & n) == 0;
+
+      rbtree_node *last = chain;
+      while (last->m_r != nullptr)
+        last = last->m_r;
+      last->m_r = container;
+
+      builder b { chain, container, full ? levels : levels - 1 };
+      auto *root = b.build(n, 0);
+      assert (b.m_cursor == container);
+
+      root->m_p = container;
+      container->m_p = root;
+      container->m_l = chain;
+      container->m_r = last;
+    }
+
+    rbtree_node<void, void> *
+      rbtree_node<void, void>::unlink_all(rbtree_node<void, void> *container,
+          bool make_chain) noexcept
+    {
+      assert (container->m_is_container);
+      if (container->is_empty_container_node())
+        return nullptr;
+
+      auto *first = container->m_l;
+      for (auto *p = first; p != container; )
+      {
+        // Nodes after p are still intact, so successor can be found as
+        // usual before p is cleared
+        auto *next = p->next();
+        p->m_l = p->m_r = p->m_p = nullptr;
+        p->m_is_red = p->m_has_l = p->m_has_r = false;
+        if (make_chain && next != container)
+          p->m_r = next;
+        p = next;
+      }
+
+      container->m_p = container->m_l = container->m_r = container;
+      return first;
+    }
+
+    std::size_t rbtree_node<void, void>::
+      black_height(const rbtree_node<void, void> *root) noexcept
+    {
+      std::size_t h = 0;
+      for (auto *p = root; p != nullptr; p = p->m_has_l ? p->m_l : nullptr)
+        if (!p->m_is_red)
+          ++h;
+      return h;
+    }
+
+    rbtree_node<void, void> *rbtree_node<void, void>::
+      join_subtrees(rbtree_node<void, void> *l, std::size_t lh,
+          rbtree_node<void, void> *k, rbtree_node<void, void> *r,
+          std::size_t rh, std::size_t &h) noexcept
+    {
+      assert (l == nullptr || !l->m_is_red);
+      assert (r == nullptr || !r->m_is_red);
+
+      auto attach_left = [] (rbtree_node *p, rbtree_node *c) noexcept
+      {
+        p->m_l = c;
+        p->m_has_l = true;
+        c->m_p = p;
+      };
+
+      auto attach_right = [] (rbtree_node *p, rbtree_node *c) noexcept
+      {
+        p->m_r = c;
+        p->m_has_r = true;
+        c->m_p = p;
+      };
+
+      k->m_has_l = k->m_has_r = false;
+      if (lh == rh)
+      {
+        if (l != nullptr)
+          attach_left(k, l);
+        if (r != nullptr)
+          attach_right(k, r);
+        k->m_is_red = false;
+        k->update_summary();
+        h = lh + 1;
+        return k;
+      }
+
+      // Hang the taller subtree under a temporary container so that
+      // rotation and rebalancing can tell where the root is
+      rbtree_node tmp(container);
+      k->m_is_red = true;
+
+      if (lh > rh)
+      {
+        tmp.m_p = l;
+        l->m_p = &tmp;
+        auto *p = l;
+        if (r == nullptr)
+        {
+          while (p->m_has_r)
+            p = p->m_r;
+          attach_right(p, k);
+          k->m_l = p;
+        }
+        else
+        {
+          // Find the black node in the right spine that has the same black
+          // height as r, and replace it with k
+          for (auto ph = lh; p->m_is_red || ph != rh; p = p->m_r)
+            if (!p->m_is_red)
+              --ph;
+          attach_right(p->m_p, k);
+          attach_left(k, p);
+          attach_right(k, r);
+        }
+      }
+      else
+      {
+        tmp.m_p = r;
+        r->m_p = &tmp;
+        auto *p = r;
+        if (l == nullptr)
+        {
+          while (p->m_has_l)
+            p = p->m_l;
+          attach_left(p, k);
+          k->m_r = p;
+        }
+        else
+        {
+          for (auto ph = rh; p->m_is_red || ph != lh; p = p->m_l)
+            if (!p->m_is_red)
+              --ph;
+          attach_left(p->m_p, k);
+          attach_right(k, p);
+          attach_left(k, l);
+        }
+      }
+
+      propagate_summary(k);
+      rebalance_for_insertion(k);
+
+      auto *root = tmp.m_p;
+      tmp.m_p = &tmp;
+
+      // Subtree of the shorter one is kept intact by rebalancing, so the
+      // black height can be counted from there up to root within time
+      // proportional to the difference
+      auto *shorter = lh > rh ? r : l;
+      if (shorter == nullptr)
+        h = black_height(root);
+      else
+      {
+        h = std::min(lh, rh);
+        for (auto *p = shorter; p != root; )
+        {
+          p = p->m_p;
+          if (!p->m_is_red)
+            ++h;
+        }
+      }
+      root->m_p = nullptr;
+      return root;
+    }
+
+    void rbtree_node<void, void>::
+      set_container(rbtree_node<void, void> *container,
+          rbtree_node<void, void> *root, rbtree_node<void, void> *front,
+          rbtree_node<void, void> *back) noexcept
+    {
+      if (root == nullptr)
+      {
+        container->m_p = container->m_l = container->m_r = container;
+        return;
+      }
+
+      root->m_p = container;
+      container->m_p = root;
+      container->m_l = front;
+      container->m_r = back;
+      front->m_l = container;
+      back->m_r = container;
+    }
+
+    void rbtree_node<void, void>::split(rbtree_node<void, void> *container,
+        rbtree_node<void, void> *node, rbtree_node<void, void> *right) noexcept
+    {
+      assert (container->m_is_container);
+      assert (right->is_empty_container_node());
+      if (node == container)
+        return;
+
+      auto *front = container->m_l;
+      auto *back = container->m_r;
+      auto *prev = node->prev();
+
+      // Detach a child subtree of black height h as a standalone one
+      auto detach = [] (rbtree_node *p, bool exists, std::size_t &h) noexcept
+        -> rbtree_node *
+      {
+        if (!exists)
+        {
+          h = 0;
+          return nullptr;
+        }
+        if (p->m_is_red)
+        {
+          p->m_is_red = false;
+          ++h;
+        }
+        return p;
+      };
+
+      // Walk from node up to root, the left part is joined with each
+      // ancestor that node is in the right subtree of and its left subtree,
+      // the right part likewise. Black heights of the joined subtrees never
+      // decrease so the whole walk takes logarithmic time. Threads between
+      // the joined parts are already correct as they're adjacent in order.
+      auto x = node;
+      auto *parent = node->m_p;
+      auto hx = black_height(node);
+      auto hc = hx - (node->m_is_red ? 0 : 1);
+
+      auto lh = hc, rh = hc;
+      auto *l = detach(node->m_l, node->m_has_l, lh);
+      auto *r = detach(node->m_r, node->m_has_r, rh);
+      r = join_subtrees(nullptr, 0, node, r, rh, rh);
+
+      while (!parent->m_is_container)
+      {
+        auto *p = parent;
+        bool is_left = p->m_has_l && p->m_l == x;
+        bool is_black = !p->m_is_red;
+        parent = p->m_p;
+
+        auto sh = hx;
+        if (is_left)
+        {
+          auto *s = detach(p->m_r, p->m_has_r, sh);
+          r = join_subtrees(r, rh, p, s, sh, rh);
+        }
+        else
+        {
+          auto *s = detach(p->m_l, p->m_has_l, sh);
+          l = join_subtrees(s, sh, p, l, lh, lh);
+        }
+
+        if (is_black)
+          ++hx;
+        x = p;
+      }
+
+      set_container(container, l, front, prev);
+      set_container(right, r, node, back);
+    }
+
+    void rbtree_node<void, void>::join(rbtree_node<void, void> *left,
+        rbtree_node<void, void> *right) noexcept
+    {
+      assert (left->m_is_container);
+      assert (right->m_is_container);
+      if (right->is_empty_container_node())
+        return;
+
+      if (left->is_empty_container_node())
+      {
+        set_container(left, right->m_p, right->m_l, right->m_r);
+        set_container(right, nullptr, nullptr, nullptr);
+        return;
+      }
+
+      // The first node of right tree becomes the node between
+      auto *front = left->m_l;
+      auto *k = right->m_l;
+      k->unlink();
+
+      auto *l = left->m_p;
+      auto lh = black_height(l);
+      left->m_r->m_r = k;
+
+      rbtree_node *r = nullptr, *back = k;
+      std::size_t rh = 0;
+      if (!right->is_empty_container_node())
+      {
+        r = right->m_p;
+        rh = black_height(r);
+        back = right->m_r;
+        right->m_l->m_l = k;
+        set_container(right, nullptr, nullptr, nullptr);
+      }
+
+      std::size_t h;
+      auto *root = join_subtrees(l, lh, k, r, rh, h);
+      set_container(left, root, front, back);
+    }
+
+    std::size_t rbtree_node<void, void>::counted_node::size(
+        const rbtree_node<void, void> *container) noexcept
+    {
+      assert (container->m_is_container);
+      return count(container->m_p, !container->is_empty_container_node());
+    }
+
+    std::size_t rbtree_node<void, void>::counted_node::rank() const noexcept
+    {
+      if (m_is_container)
+        return size(this);
+
+      std::size_t ret = count(m_l, m_has_l);
+      for (const rbtree_node *p = this; !p->m_p->m_is_container; p = p->m_p)
+        if (p->m_p->m_has_r && p->m_p->m_r == p)
+          ret += count(p->m_p->m_l, p->m_p->m_has_l) + 1;
+      return ret;
+    }
+
+    rbtree_node<void, void> *rbtree_node<void, void>::counted_node::select(
+        rbtree_node<void, void> *container, std::size_t k) noexcept
+    {
+      if (k >= size(container))
+        return container;
+
+      auto *p = container->m_p;
+      for ( ; ; )
+      {
+        auto l = count(p->m_l, p->m_has_l);
+        if (k < l)
+          p = p->m_l;
+        else if (k == l)
+          return p;
+        else
+        {
+          k -= l + 1;
+          p = p->m_r;
+        }
+      }
+    }
   }
 }
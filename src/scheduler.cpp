@@ -18,8 +18,12 @@
 #include <spin/scheduler.hpp>
 #include <spin/transform_iterator.hpp>
 #include <spin/event_monitor.hpp>
+#include <spin/epoch.hpp>
+#include <spin/buffer_pool.hpp>
 
 #include <mutex>
+#include <array>
+#include <chrono>
 
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
@@ -35,16 +39,98 @@ namespace spin
       std::lock_guard<spin_lock> guard(lock);
       return std::move(q);
     }
+
+    /** @brief Number of tasks detached from queue at once */
+    constexpr std::size_t task_batch_size = 64;
+
+    /** @brief How many tasks ahead the routine will be prefetched */
+    constexpr std::size_t task_prefetch_distance = 4;
+
+    /**
+     * @brief Execute all tasks in q in batches
+     * @returns Number of tasks executed
+     *
+     * Each batch collects pointers of the following tasks into a contiguous
+     * array, so that routine storage of upcoming tasks can be prefetched
+     * while the current one is running instead of chasing list pointers
+     * just in time. A task may cancel others in the same batch, so a task is
+     * only executed if it is still the front of q; otherwise the remaining
+     * batch is discarded and collected again.
+     */
+    std::size_t execute_tasks(task::queue_type &q,
+        statistics_counters *statistics, watchdog_probe &probe)
+    {
+      std::array<task *, task_batch_size> batch;
+      std::size_t count = 0;
+#ifdef SPIN_ENABLE_STATISTICS
+      auto start = std::chrono::steady_clock::now();
+#else
+      (void) statistics;
+#endif
+
+      while (!q.empty())
+      {
+        std::size_t n = 0;
+        for (auto i = q.begin(); i != q.end() && n != batch.size(); ++i)
+        {
+          batch[n] = &*i;
+          // Fetch the line holding the end of the routine, after the links
+          __builtin_prefetch(
+              reinterpret_cast<const char *>(batch[n]) + sizeof(task) - 1);
+          ++n;
+        }
+
+        for (std::size_t k = 0; k != n; ++k)
+        {
+          task &t = *batch[k];
+          if (q.empty() || &q.front() != &t)
+            break;
+          if (k + task_prefetch_distance < n)
+            batch[k + task_prefetch_distance]->prefetch();
+          t.cancel();
+          if (probe.is_watched())
+          {
+            probe.enter(watchdog_activity::task, t.target_type());
+            t();
+            probe.leave();
+          }
+          else
+            t();
+          ++count;
+#ifdef SPIN_ENABLE_STATISTICS
+          auto stop = std::chrono::steady_clock::now();
+          statistics_counters::record(statistics->task_time, stop - start);
+          start = stop;
+#endif
+        }
+      }
+#ifdef SPIN_ENABLE_STATISTICS
+      statistics_counters::add(statistics->tasks, count);
+#endif
+      return count;
+    }
   }
 
   scheduler::scheduler()
     : m_event_monitor_ptr()
+    , m_buffer_pool()
     , m_dispatched_queue()
     , m_posted_queue()
     , m_lock()
     , m_running(false)
+    , m_last_iteration_task_count(0)
+#ifdef SPIN_ENABLE_STATISTICS
+    , m_statistics()
+#endif
+    , m_watchdog_probe(*this)
   { }
 
+  scheduler::~scheduler()
+  {
+    if (auto *w = m_watchdog_probe.get_owner())
+      w->unwatch(*this);
+  }
+
   std::shared_ptr<event_monitor> scheduler::get_event_monitor()
   {
     auto p = m_event_monitor_ptr.lock();
@@ -54,6 +140,38 @@ namespace spin
     return p;
   }
 
+  buffer_pool &scheduler::get_buffer_pool()
+  {
+    if (!m_buffer_pool)
+      m_buffer_pool.reset(new buffer_pool());
+    return *m_buffer_pool;
+  }
+
+  scheduler_statistics scheduler::get_statistics() const noexcept
+  {
+#ifdef SPIN_ENABLE_STATISTICS
+    return m_statistics.load();
+#else
+    return scheduler_statistics();
+#endif
+  }
+
+  void scheduler::reset_statistics() noexcept
+  {
+#ifdef SPIN_ENABLE_STATISTICS
+    m_statistics.reset();
+#endif
+  }
+
+  bool scheduler::is_statistics_enabled() noexcept
+  {
+#ifdef SPIN_ENABLE_STATISTICS
+    return true;
+#else
+    return false;
+#endif
+  }
+
   void scheduler::interrupt()
   {
     if (auto p = m_event_monitor_ptr.lock())
@@ -63,27 +181,46 @@ namespace spin
   void scheduler::run()
   {
     m_running = true;
+    epoch::registration registration;
     auto guard = make_block_guard(
-        [&] () noexcept { m_running = false; });
+        [&] () noexcept
+        {
+          m_running = false;
+          // in case of a task or an event callback has thrown
+          m_watchdog_probe.leave();
+          // The thread may exit once returned, which a report being handled
+          // may still signal for backtrace
+          if (auto *w = m_watchdog_probe.get_owner())
+            w->settle(m_watchdog_probe);
+        });
 
     while (m_running)
     {
+      // Tasks and event callbacks of last iteration have finished, so this
+      // thread references no shared node protected by epoch
+      epoch::quiescent();
+
       task::queue_type q(std::move(m_dispatched_queue));
       q.splice(q.end(), unqueue_posted_task(m_lock, m_posted_queue));
 
+#ifdef SPIN_ENABLE_STATISTICS
+      statistics_counters *statistics = &m_statistics;
+#else
+      statistics_counters *statistics = nullptr;
+#endif
       if (auto p = m_event_monitor_ptr.lock())
       {
-        p->wait(q.empty());
+        p->wait(q.empty(), statistics, &m_watchdog_probe);
         q.splice(q.end(), m_dispatched_queue);
       } else if (q.empty())
         return;
 
-      for (auto i = q.begin(); i != q.end(); )
-      {
-        auto &t = *i++;
-        t.cancel();
-        t();
-      }
+#ifdef SPIN_ENABLE_STATISTICS
+      statistics_counters::add(m_statistics.iterations);
+#endif
+      m_last_iteration_task_count.store(execute_tasks(q, statistics,
+            m_watchdog_probe),
+          std::memory_order_relaxed);
     }
 
   }
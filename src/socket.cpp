@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2013 LAN Xingcan
+ * Copyright (C) 2014 LAN Xingcan
  * All right reserved
  *
  * Permission to use, copy, modify, and/or distribute this software for any
@@ -16,13 +16,164 @@
  */
 
 #include <spin/socket.hpp>
-#include <sys/socket.h>
-#include <unistd.h>
-#include <sys/epoll.h>
 
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/un.h>
 
 namespace spin
 {
+  socket_address::socket_address() noexcept
+    : m_storage()
+    , m_size(0)
+  { }
+
+  socket_address::socket_address(const ::sockaddr *addr, ::socklen_t size)
+    : m_storage()
+    , m_size(size)
+  {
+    if (size > get_capacity())
+      throw std::invalid_argument("Socket address is too long");
+    std::memcpy(&m_storage, addr, size);
+  }
+
+  socket_address socket_address::from_ip(const std::string &host,
+      std::uint16_t port)
+  {
+    socket_address ret;
+    auto *v4 = reinterpret_cast<::sockaddr_in *>(&ret.m_storage);
+    auto *v6 = reinterpret_cast<::sockaddr_in6 *>(&ret.m_storage);
+    if (::inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1)
+    {
+      v4->sin_family = AF_INET;
+      v4->sin_port = htons(port);
+      ret.m_size = sizeof(::sockaddr_in);
+    }
+    else if (::inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1)
+    {
+      v6->sin6_family = AF_INET6;
+      v6->sin6_port = htons(port);
+      ret.m_size = sizeof(::sockaddr_in6);
+    }
+    else
+      throw std::invalid_argument("Not a numeric IP address: " + host);
+    return ret;
+  }
+
+  socket_address socket_address::from_unix_path(const std::string &path)
+  {
+    socket_address ret;
+    auto *un = reinterpret_cast<::sockaddr_un *>(&ret.m_storage);
+    if (path.empty() || path.size() >= sizeof(un->sun_path))
+      throw std::invalid_argument("Invalid Unix domain socket path: " + path);
+    un->sun_family = AF_UNIX;
+    std::memcpy(un->sun_path, path.data(), path.size());
+    ret.m_size = static_cast<::socklen_t>(offsetof(::sockaddr_un, sun_path)
+        + path.size() + 1);
+    return ret;
+  }
+
+  socket_address socket_address::from_abstract_name(const std::string &name)
+  {
+    socket_address ret;
+    auto *un = reinterpret_cast<::sockaddr_un *>(&ret.m_storage);
+    if (name.size() >= sizeof(un->sun_path))
+      throw std::invalid_argument("Abstract socket name is too long");
+    un->sun_family = AF_UNIX;
+    // Leading NUL marks the abstract namespace, name is not NUL-terminated
+    std::memcpy(un->sun_path + 1, name.data(), name.size());
+    ret.m_size = static_cast<::socklen_t>(offsetof(::sockaddr_un, sun_path)
+        + 1 + name.size());
+    return ret;
+  }
+
+  std::uint16_t socket_address::get_port() const noexcept
+  {
+    switch (get_family())
+    {
+    case AF_INET:
+      return ntohs(reinterpret_cast<const ::sockaddr_in *>(&m_storage)
+          ->sin_port);
+    case AF_INET6:
+      return ntohs(reinterpret_cast<const ::sockaddr_in6 *>(&m_storage)
+          ->sin6_port);
+    default:
+      return 0;
+    }
+  }
+
+  std::string socket_address::to_string() const
+  {
+    char buffer[INET6_ADDRSTRLEN];
+    switch (get_family())
+    {
+    case AF_INET:
+      ::inet_ntop(AF_INET, &reinterpret_cast<const ::sockaddr_in *>(
+            &m_storage)->sin_addr, buffer, sizeof(buffer));
+      return std::string(buffer) + ":" + std::to_string(get_port());
+    case AF_INET6:
+      ::inet_ntop(AF_INET6, &reinterpret_cast<const ::sockaddr_in6 *>(
+            &m_storage)->sin6_addr, buffer, sizeof(buffer));
+      return "[" + std::string(buffer) + "]:" + std::to_string(get_port());
+    case AF_UNIX:
+      {
+        auto *un = reinterpret_cast<const ::sockaddr_un *>(&m_storage);
+        std::size_t size = m_size - offsetof(::sockaddr_un, sun_path);
+        if (size == 0)
+          return std::string();
+        if (un->sun_path[0] == '\0')
+          return "@" + std::string(un->sun_path + 1, size - 1);
+        return std::string(un->sun_path, ::strnlen(un->sun_path, size));
+      }
+    default:
+      return std::string();
+    }
+  }
+
+  system_handle open_socket(int family, int type, int protocol)
+  {
+    return system_handle(::socket, family,
+        type | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+  }
+
+  std::pair<system_handle, system_handle> open_socket_pair(int type)
+  {
+    int fds[2];
+    if (::socketpair(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds)
+        == -1)
+      throw_exception_for_last_error();
+    return std::make_pair(system_handle(fds[0]), system_handle(fds[1]));
+  }
+
+  void set_socket_option(const system_handle &socket, int level, int name,
+      int value)
+  {
+    if (::setsockopt(socket.get_raw_handle(), level, name, &value,
+          sizeof(value)) == -1)
+      throw_exception_for_last_error();
+  }
 
+  socket_address get_local_address(const system_handle &socket)
+  {
+    socket_address ret;
+    ::socklen_t size = ret.get_capacity();
+    if (::getsockname(socket.get_raw_handle(), ret.get_data(), &size) == -1)
+      throw_exception_for_last_error();
+    ret.set_size(size);
+    return ret;
+  }
 
+  socket_address get_peer_address(const system_handle &socket)
+  {
+    socket_address ret;
+    ::socklen_t size = ret.get_capacity();
+    if (::getpeername(socket.get_raw_handle(), ret.get_data(), &size) == -1)
+      throw_exception_for_last_error();
+    ret.set_size(size);
+    return ret;
+  }
 }
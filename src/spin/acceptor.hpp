@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_ACCEPTOR_HPP_INCLUDED__
+#define __SPIN_ACCEPTOR_HPP_INCLUDED__
+
+#include <spin/event_source.hpp>
+#include <spin/routine.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/socket.hpp>
+#include <spin/timer.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace spin
+{
+  /**
+   * @brief Listening socket of a connection oriented protocol, e.g. TCP or
+   * Unix domain stream and seqpacket
+   *
+   * On each readable edge, connections are accepted until the backlog is
+   * drained or the iteration budget of io_event_source is used up, each one
+   * is non-blocking and close-on-exec. If the process or the system runs
+   * out of descriptors, connections left in the backlog are accepted again
+   * after a short delay.
+   */
+  class __SPIN_EXPORT__ acceptor : public io_event_source
+  {
+  public:
+    struct options
+    {
+      options() noexcept
+        : type(SOCK_STREAM)
+        , backlog(SOMAXCONN)
+        , reuse_port(false)
+      { }
+
+      /** @brief SOCK_STREAM or SOCK_SEQPACKET */
+      int type;
+
+      /** @brief Argument of listen */
+      int backlog;
+
+      /** @brief Set SO_REUSEPORT before bind */
+      bool reuse_port;
+    };
+
+    /** @brief Handler called with each connection accepted */
+    using accept_handler = routine<system_handle &>;
+
+    /**
+     * @brief Construct an acceptor listening on @a local
+     * @throws std::system_error if failed to create, bind or listen, e.g.
+     * a file already exists at the path of a Unix domain address
+     */
+    acceptor(scheduler &s, const socket_address &local,
+        accept_handler handler, const options &opt = options());
+
+    virtual ~acceptor() = default;
+
+    /** @brief Get the address listening on */
+    socket_address get_local_address() const;
+
+  protected:
+    /** @brief Constructor for subclasses overriding #on_accepted */
+    acceptor(scheduler &s, const socket_address &local, const options &opt);
+
+    /** @brief Called with each connection accepted, calls the handler */
+    virtual void on_accepted(system_handle &connection) noexcept;
+
+    /** @brief Called after connections of an edge are accepted */
+    virtual void on_drained() noexcept;
+
+    void on_readable() noexcept override;
+
+  private:
+    accept_handler m_handler;
+    steady_timer m_retry_timer;
+  };
+
+  /**
+   * @brief Acceptor handing connections over to a set of worker schedulers
+   *
+   * Each connection is assigned to the worker with least connections, or
+   * to workers in turn. Connections of a readable edge are delivered to
+   * each worker with a single post, so a burst of connections costs one
+   * wakeup per worker.
+   *
+   * The alternative is to run an acceptor with reuse_port set in each
+   * worker on the same address and let the kernel hash connections among
+   * them, which avoids the handover but can't respond to load.
+   */
+  class __SPIN_EXPORT__ distributing_acceptor : public acceptor
+  {
+  public:
+    enum class policy
+    {
+      least_connections,
+      round_robin
+    };
+
+    /**
+     * @brief Handler called in the thread of the worker with a connection
+     * and the index of the worker
+     */
+    using connection_handler = routine<system_handle &, std::size_t>;
+
+    /**
+     * @brief Construct an acceptor listening on @a local
+     * @param s The scheduler accepting connections
+     * @param workers Schedulers which connections are handed over to, they
+     * must outlive the connections posted to them
+     * @throws std::system_error if failed to create, bind or listen
+     */
+    distributing_acceptor(scheduler &s, const socket_address &local,
+        std::vector<scheduler *> workers, connection_handler handler,
+        policy p = policy::least_connections,
+        const options &opt = options());
+
+    ~distributing_acceptor() = default;
+
+    /**
+     * @brief Tell a connection handed over to @a worker is closed, may be
+     * called in any thread
+     */
+    void release(std::size_t worker) noexcept;
+
+    /** @brief Get number of connections handed over to @a worker */
+    std::size_t get_connection_count(std::size_t worker) const noexcept;
+
+    /** @brief Get number of workers */
+    std::size_t get_worker_count() const noexcept
+    { return m_workers.size(); }
+
+  protected:
+    void on_accepted(system_handle &connection) noexcept override;
+
+    void on_drained() noexcept override;
+
+  private:
+    struct shared_state;
+    struct handoff;
+
+    std::size_t pick() noexcept;
+
+    const std::vector<scheduler *> m_workers;
+    const policy m_policy;
+    std::size_t m_next;
+    std::shared_ptr<shared_state> m_state;
+    std::vector<handoff *> m_handoffs;
+  };
+}
+
+#endif
@@ -0,0 +1,777 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_BTREE_HPP_INCLUDED__
+#define __SPIN_BTREE_HPP_INCLUDED__
+
+#include <spin/functional.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace spin
+{
+  namespace detail
+  {
+    /** @brief Number of keys in a btree node, about four cache lines */
+    template<typename Key>
+    constexpr std::size_t btree_default_capacity() noexcept
+    { return 256 / sizeof(Key) < 8 ? 8 : 256 / sizeof(Key); }
+  }
+
+  /**
+   * @brief An ordered index of objects in a B+-tree
+   *
+   * It serves as a companion of intruse::rbtree for read-mostly workloads.
+   * Keys are copied into the index and kept contiguously in each node, so a
+   * lookup touches only a few cache lines per level and never touches the
+   * indexed objects, which are referred to by the leaves. Keys of
+   * arithmetic type are searched in a node with a branchless loop that the
+   * compiler can vectorize.
+   *
+   * Keys are unique in an index. Inserting or erasing an element
+   * invalidates all iterators.
+   * @tparam Key Type of key, must be default constructible and copy
+   * assignable
+   * @tparam Type Type of indexed objects
+   * @tparam Comparator Comparator of keys
+   * @tparam Capacity Maximum number of keys in a node
+   */
+  template<typename Key, typename Type, typename Comparator = less<Key>,
+    std::size_t Capacity = detail::btree_default_capacity<Key>()>
+  class btree
+  {
+    static_assert(Capacity >= 4, "Capacity of btree node is too small");
+
+    /** @brief Maximum levels, enough as every node but root is half full */
+    static constexpr std::size_t max_height = 64;
+
+    static constexpr std::size_t min_size = Capacity / 2;
+
+    struct node
+    {
+      std::size_t m_size;
+      Key m_keys[Capacity];
+    };
+
+    struct leaf : node
+    {
+      Type *m_values[Capacity];
+      leaf *m_prev;
+      leaf *m_next;
+    };
+
+    struct inner : node
+    {
+      node *m_children[Capacity + 1];
+    };
+
+    template<bool IsConst>
+    class basic_iterator
+    {
+      friend class btree;
+
+      template<bool>
+      friend class basic_iterator;
+    public:
+      // Nested type similar with STL
+      using iterator_category = std::bidirectional_iterator_tag;
+      using value_type        = Type;
+      using reference         = typename std::conditional<IsConst,
+            const Type &, Type &>::type;
+      using pointer           = typename std::conditional<IsConst,
+            const Type *, Type *>::type;
+      using difference_type   = std::ptrdiff_t;
+
+      basic_iterator() noexcept
+        : m_leaf(nullptr)
+        , m_pos(0)
+      { }
+
+      /** @brief Conversion from iterator to const_iterator */
+      template<bool OtherConst, typename = typename std::enable_if<
+        IsConst && !OtherConst>::type>
+      basic_iterator(const basic_iterator<OtherConst> &other) noexcept
+        : m_leaf(other.m_leaf)
+        , m_pos(other.m_pos)
+      { }
+
+      /** @brief Get the key of the element */
+      const Key &key() const noexcept
+      { return m_leaf->m_keys[m_pos]; }
+
+      reference operator * () const noexcept
+      { return *m_leaf->m_values[m_pos]; }
+
+      pointer operator -> () const noexcept
+      { return m_leaf->m_values[m_pos]; }
+
+      basic_iterator &operator ++ () noexcept
+      {
+        if (++m_pos == m_leaf->m_size && m_leaf->m_next != nullptr)
+        {
+          m_leaf = m_leaf->m_next;
+          m_pos = 0;
+        }
+        return *this;
+      }
+
+      basic_iterator operator ++ (int) noexcept
+      {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+
+      basic_iterator &operator -- () noexcept
+      {
+        if (m_pos == 0)
+        {
+          m_leaf = m_leaf->m_prev;
+          m_pos = m_leaf->m_size;
+        }
+        --m_pos;
+        return *this;
+      }
+
+      basic_iterator operator -- (int) noexcept
+      {
+        auto ret = *this;
+        --*this;
+        return ret;
+      }
+
+      friend bool operator == (const basic_iterator &x,
+          const basic_iterator &y) noexcept
+      { return x.m_leaf == y.m_leaf && x.m_pos == y.m_pos; }
+
+      friend bool operator != (const basic_iterator &x,
+          const basic_iterator &y) noexcept
+      { return !(x == y); }
+
+    private:
+      basic_iterator(leaf *l, std::size_t pos) noexcept
+        : m_leaf(l)
+        , m_pos(pos)
+      {
+        // The end of a leaf other than the last one is the begin of the
+        // next leaf
+        if (m_pos == m_leaf->m_size && m_leaf->m_next != nullptr)
+        {
+          m_leaf = m_leaf->m_next;
+          m_pos = 0;
+        }
+      }
+
+      leaf *m_leaf;
+      std::size_t m_pos;
+    };
+
+  public:
+    using key_type = Key;
+    using value_type = Type;
+    using size_type = std::size_t;
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    static constexpr std::size_t capacity = Capacity;
+
+    btree()
+      : m_root(new leaf())
+      , m_first(static_cast<leaf*>(m_root))
+      , m_last(m_first)
+      , m_height(0)
+      , m_size(0)
+    {
+      m_first->m_size = 0;
+      m_first->m_prev = m_first->m_next = nullptr;
+    }
+
+    btree(btree &&t)
+      : btree()
+    { swap(t); }
+
+    btree &operator = (btree &&t) noexcept
+    {
+      swap(t);
+      return *this;
+    }
+
+    btree(const btree &) = delete;
+
+    btree &operator = (const btree &) = delete;
+
+    ~btree() noexcept
+    { destroy(m_root, m_height); }
+
+    /** @brief Test if this index is empty */
+    bool empty() const noexcept
+    { return m_size == 0; }
+
+    /** @brief Get number of elements */
+    size_type size() const noexcept
+    { return m_size; }
+
+    iterator begin() noexcept
+    { return iterator(m_first, 0); }
+
+    iterator end() noexcept
+    { return iterator(m_last, m_last->m_size); }
+
+    const_iterator begin() const noexcept
+    { return const_iterator(m_first, 0); }
+
+    const_iterator end() const noexcept
+    { return const_iterator(m_last, m_last->m_size); }
+
+    const_iterator cbegin() const noexcept
+    { return begin(); }
+
+    const_iterator cend() const noexcept
+    { return end(); }
+
+    /** @brief Find the element with key @p key, or end() if not found */
+    iterator find(const Key &key)
+    {
+      auto i = lower_bound(key);
+      if (i == end() || cmper(key, i.key()))
+        return end();
+      return i;
+    }
+
+    /** @brief Find the element with key @p key, or end() if not found */
+    const_iterator find(const Key &key) const
+    { return const_cast<btree*>(this)->find(key); }
+
+    /** @brief Find the first element whose key is not less than @p key */
+    iterator lower_bound(const Key &key)
+    {
+      auto *l = find_leaf(key);
+      return iterator(l, lower_position(*l, key));
+    }
+
+    /** @brief Find the first element whose key is not less than @p key */
+    const_iterator lower_bound(const Key &key) const
+    { return const_cast<btree*>(this)->lower_bound(key); }
+
+    /** @brief Find the first element whose key is greater than @p key */
+    iterator upper_bound(const Key &key)
+    {
+      auto *l = find_leaf(key);
+      return iterator(l, upper_position(*l, key));
+    }
+
+    /** @brief Find the first element whose key is greater than @p key */
+    const_iterator upper_bound(const Key &key) const
+    { return const_cast<btree*>(this)->upper_bound(key); }
+
+    /**
+     * @brief Index @p value with @p key
+     * @returns Iterator to the element with @p key and whether it's inserted,
+     * an existing element is not replaced
+     * @throws std::bad_alloc if failed to allocate nodes, or anything that
+     * copying a key throws; this index is not changed in that case
+     */
+    std::pair<iterator, bool> insert(const Key &key, Type &value)
+    {
+      path_type path;
+      auto *l = find_leaf(key, path);
+      auto pos = lower_position(*l, key);
+      if (pos != l->m_size && !cmper(key, l->m_keys[pos]))
+        return std::make_pair(iterator(l, pos), false);
+
+      // Count full nodes from leaf upward and allocate all the nodes that
+      // splitting needs before anything is changed
+      std::size_t splits = 0;
+      if (l->m_size == Capacity)
+      {
+        splits = 1;
+        while (splits <= m_height
+            && path[m_height - splits].node->m_size == Capacity)
+          ++splits;
+      }
+      spare_nodes spare(splits, splits > m_height);
+
+      // Keys are copied before anything is changed too, the separator is
+      // the first key moved to the new leaf, wherever the key goes
+      Key copy(key);
+      if (l->m_size != Capacity)
+      {
+        insert_to_leaf(*l, pos, copy, value);
+        ++m_size;
+        return std::make_pair(iterator(l, pos), true);
+      }
+      Key separator(l->m_keys[Capacity / 2]);
+
+      auto *r = spare.get_leaf();
+      split_leaf(*l, *r);
+      iterator ret;
+      if (pos <= l->m_size)
+      {
+        insert_to_leaf(*l, pos, copy, value);
+        ret = iterator(l, pos);
+      }
+      else
+      {
+        insert_to_leaf(*r, pos - l->m_size, copy, value);
+        ret = iterator(r, pos - l->m_size);
+      }
+      ++m_size;
+
+      // Insert separator to parent level by level
+      node *child = r;
+      for (std::size_t level = m_height; ; --level)
+      {
+        if (level == 0)
+        {
+          auto *root = spare.get_inner();
+          root->m_size = 1;
+          root->m_keys[0] = std::move(separator);
+          root->m_children[0] = m_root;
+          root->m_children[1] = child;
+          m_root = root;
+          ++m_height;
+          break;
+        }
+
+        auto *p = path[level - 1].node;
+        auto idx = path[level - 1].index;
+        if (p->m_size != Capacity)
+        {
+          insert_to_inner(*p, idx, separator, child);
+          break;
+        }
+        auto *q = spare.get_inner();
+        split_inner(*p, idx, separator, child, *q);
+        child = q;
+      }
+      return std::make_pair(ret, true);
+    }
+
+    /**
+     * @brief Remove the element with key @p key
+     * @returns Whether an element is removed
+     */
+    bool erase(const Key &key)
+    {
+      path_type path;
+      auto *l = find_leaf(key, path);
+      auto pos = lower_position(*l, key);
+      if (pos == l->m_size || cmper(key, l->m_keys[pos]))
+        return false;
+
+      --m_size;
+      std::move(l->m_keys + pos + 1, l->m_keys + l->m_size, l->m_keys + pos);
+      std::move(l->m_values + pos + 1, l->m_values + l->m_size,
+          l->m_values + pos);
+      --l->m_size;
+
+      // Fix underflow level by level, every node but root is kept at least
+      // half full
+      node *n = l;
+      for (std::size_t level = m_height; level != 0; --level)
+      {
+        if (n->m_size >= min_size)
+          return true;
+        auto *p = path[level - 1].node;
+        auto idx = path[level - 1].index;
+        if (level == m_height)
+          rebalance_leaf(*p, idx);
+        else
+          rebalance_inner(*p, idx);
+        n = p;
+      }
+
+      if (m_height != 0 && m_root->m_size == 0)
+      {
+        auto *root = static_cast<inner*>(m_root);
+        m_root = root->m_children[0];
+        --m_height;
+        delete root;
+      }
+      return true;
+    }
+
+    /** @brief Remove the element at @p it */
+    iterator erase(iterator it)
+    {
+      Key key = it.key();
+      erase(key);
+      return lower_bound(key);
+    }
+
+    /** @brief Remove all elements */
+    void clear() noexcept
+    {
+      if (m_height != 0)
+      {
+        auto *p = static_cast<inner*>(m_root);
+        for (std::size_t i = 1; i <= p->m_size; ++i)
+          destroy(p->m_children[i], m_height - 1);
+
+        // Keep the first leaf as root to avoid allocation
+        node *first = p->m_children[0];
+        for (auto h = m_height - 1; h != 0; --h)
+        {
+          auto *q = static_cast<inner*>(first);
+          for (std::size_t i = 1; i <= q->m_size; ++i)
+            destroy(q->m_children[i], h - 1);
+          first = q->m_children[0];
+          delete q;
+        }
+        delete p;
+        m_root = first;
+        m_height = 0;
+      }
+      m_first = m_last = static_cast<leaf*>(m_root);
+      m_first->m_size = 0;
+      m_first->m_prev = m_first->m_next = nullptr;
+      m_size = 0;
+    }
+
+    /** @brief Swap all elements with another index @p t */
+    void swap(btree &t) noexcept
+    {
+      std::swap(m_root, t.m_root);
+      std::swap(m_first, t.m_first);
+      std::swap(m_last, t.m_last);
+      std::swap(m_height, t.m_height);
+      std::swap(m_size, t.m_size);
+    }
+
+  private:
+    /** @brief An inner node in the path from root and the child taken */
+    struct path_entry
+    {
+      inner *node;
+      std::size_t index;
+    };
+
+    using path_type = path_entry[max_height];
+
+    /** @brief Nodes allocated in advance for insertion */
+    class spare_nodes
+    {
+    public:
+      spare_nodes(std::size_t splits, bool new_root)
+        : m_leaf(nullptr)
+        , m_count(0)
+      {
+        if (splits == 0)
+          return;
+        try
+        {
+          m_leaf = new leaf();
+          for (std::size_t i = 1; i < splits + (new_root ? 1 : 0); ++i)
+            m_inners[m_count++] = new inner();
+        }
+        catch (...)
+        {
+          release();
+          throw;
+        }
+      }
+
+      ~spare_nodes() noexcept
+      { release(); }
+
+      spare_nodes(const spare_nodes &) = delete;
+
+      spare_nodes &operator = (const spare_nodes &) = delete;
+
+      leaf *get_leaf() noexcept
+      {
+        auto *ret = m_leaf;
+        m_leaf = nullptr;
+        return ret;
+      }
+
+      inner *get_inner() noexcept
+      {
+        assert (m_count != 0);
+        return m_inners[--m_count];
+      }
+
+    private:
+      void release() noexcept
+      {
+        delete m_leaf;
+        while (m_count != 0)
+          delete m_inners[--m_count];
+      }
+
+      leaf *m_leaf;
+      inner *m_inners[max_height];
+      std::size_t m_count;
+    };
+
+    /** @brief Count keys in node that are less than @p key */
+    static std::size_t lower_position(const node &n, const Key &key)
+    {
+      if (std::is_arithmetic<Key>::value)
+      {
+        std::size_t ret = 0;
+        for (std::size_t i = 0; i < n.m_size; ++i)
+          ret += cmper(n.m_keys[i], key);
+        return ret;
+      }
+      return std::lower_bound(n.m_keys, n.m_keys + n.m_size, key, cmper)
+        - n.m_keys;
+    }
+
+    /** @brief Count keys in node that are not greater than @p key */
+    static std::size_t upper_position(const node &n, const Key &key)
+    {
+      if (std::is_arithmetic<Key>::value)
+      {
+        std::size_t ret = 0;
+        for (std::size_t i = 0; i < n.m_size; ++i)
+          ret += !cmper(key, n.m_keys[i]);
+        return ret;
+      }
+      return std::upper_bound(n.m_keys, n.m_keys + n.m_size, key, cmper)
+        - n.m_keys;
+    }
+
+    leaf *find_leaf(const Key &key) const
+    {
+      auto *n = m_root;
+      for (auto h = m_height; h != 0; --h)
+        n = static_cast<inner*>(n)->m_children[upper_position(*n, key)];
+      return static_cast<leaf*>(n);
+    }
+
+    leaf *find_leaf(const Key &key, path_type &path) const
+    {
+      auto *n = m_root;
+      for (std::size_t level = 0; level != m_height; ++level)
+      {
+        auto *p = static_cast<inner*>(n);
+        auto idx = upper_position(*p, key);
+        path[level].node = p;
+        path[level].index = idx;
+        n = p->m_children[idx];
+      }
+      return static_cast<leaf*>(n);
+    }
+
+    static void insert_to_leaf(leaf &l, std::size_t pos, Key &key,
+        Type &value)
+    {
+      std::move_backward(l.m_keys + pos, l.m_keys + l.m_size,
+          l.m_keys + l.m_size + 1);
+      std::move_backward(l.m_values + pos, l.m_values + l.m_size,
+          l.m_values + l.m_size + 1);
+      l.m_keys[pos] = std::move(key);
+      l.m_values[pos] = &value;
+      ++l.m_size;
+    }
+
+    /** @brief Insert @p key and the child after it at @p idx */
+    static void insert_to_inner(inner &p, std::size_t idx, Key &key,
+        node *child)
+    {
+      std::move_backward(p.m_keys + idx, p.m_keys + p.m_size,
+          p.m_keys + p.m_size + 1);
+      std::move_backward(p.m_children + idx + 1,
+          p.m_children + p.m_size + 1, p.m_children + p.m_size + 2);
+      p.m_keys[idx] = std::move(key);
+      p.m_children[idx + 1] = child;
+      ++p.m_size;
+    }
+
+    /** @brief Move the upper half of a full leaf @p l to an empty one */
+    void split_leaf(leaf &l, leaf &r) noexcept
+    {
+      auto half = Capacity / 2;
+      std::move(l.m_keys + half, l.m_keys + Capacity, r.m_keys);
+      std::copy(l.m_values + half, l.m_values + Capacity, r.m_values);
+      r.m_size = Capacity - half;
+      l.m_size = half;
+
+      r.m_prev = &l;
+      r.m_next = l.m_next;
+      if (l.m_next != nullptr)
+        l.m_next->m_prev = &r;
+      else
+        m_last = &r;
+      l.m_next = &r;
+    }
+
+    /**
+     * @brief Insert @p key and @p child at @p idx to a full inner node @p p
+     * and move the upper half to @p q
+     * @param key Key to insert, receives the separator between @p p and @p q
+     */
+    static void split_inner(inner &p, std::size_t idx, Key &key,
+        node *child, inner &q)
+    {
+      Key keys[Capacity + 1];
+      node *children[Capacity + 2];
+      std::move(p.m_keys, p.m_keys + idx, keys);
+      keys[idx] = std::move(key);
+      std::move(p.m_keys + idx, p.m_keys + Capacity, keys + idx + 1);
+      std::copy(p.m_children, p.m_children + idx + 1, children);
+      children[idx + 1] = child;
+      std::copy(p.m_children + idx + 1, p.m_children + Capacity + 1,
+          children + idx + 2);
+
+      auto half = (Capacity + 1) / 2;
+      std::move(keys, keys + half, p.m_keys);
+      std::copy(children, children + half + 1, p.m_children);
+      p.m_size = half;
+
+      key = std::move(keys[half]);
+
+      std::move(keys + half + 1, keys + Capacity + 1, q.m_keys);
+      std::copy(children + half + 1, children + Capacity + 2, q.m_children);
+      q.m_size = Capacity - half;
+    }
+
+    /** @brief Borrow from or merge with a sibling of an underflow leaf */
+    void rebalance_leaf(inner &p, std::size_t idx) noexcept
+    {
+      // Always work on a pair of adjacent siblings l and r
+      auto i = idx == 0 ? 0 : idx - 1;
+      auto &l = *static_cast<leaf*>(p.m_children[i]);
+      auto &r = *static_cast<leaf*>(p.m_children[i + 1]);
+
+      if (l.m_size + r.m_size >= 2 * min_size)
+      {
+        // Borrow one element from the sibling which is not underflow
+        if (l.m_size > r.m_size)
+        {
+          std::move_backward(r.m_keys, r.m_keys + r.m_size,
+              r.m_keys + r.m_size + 1);
+          std::move_backward(r.m_values, r.m_values + r.m_size,
+              r.m_values + r.m_size + 1);
+          --l.m_size;
+          r.m_keys[0] = std::move(l.m_keys[l.m_size]);
+          r.m_values[0] = l.m_values[l.m_size];
+          ++r.m_size;
+        }
+        else
+        {
+          l.m_keys[l.m_size] = std::move(r.m_keys[0]);
+          l.m_values[l.m_size] = r.m_values[0];
+          ++l.m_size;
+          std::move(r.m_keys + 1, r.m_keys + r.m_size, r.m_keys);
+          std::move(r.m_values + 1, r.m_values + r.m_size, r.m_values);
+          --r.m_size;
+        }
+        p.m_keys[i] = r.m_keys[0];
+        return;
+      }
+
+      std::move(r.m_keys, r.m_keys + r.m_size, l.m_keys + l.m_size);
+      std::copy(r.m_values, r.m_values + r.m_size, l.m_values + l.m_size);
+      l.m_size += r.m_size;
+      l.m_next = r.m_next;
+      if (r.m_next != nullptr)
+        r.m_next->m_prev = &l;
+      else
+        m_last = &l;
+      remove_from_inner(p, i);
+      delete &r;
+    }
+
+    /** @brief Borrow from or merge with a sibling of an underflow node */
+    static void rebalance_inner(inner &p, std::size_t idx) noexcept
+    {
+      auto i = idx == 0 ? 0 : idx - 1;
+      auto &l = *static_cast<inner*>(p.m_children[i]);
+      auto &r = *static_cast<inner*>(p.m_children[i + 1]);
+
+      if (l.m_size + r.m_size >= 2 * min_size)
+      {
+        // Rotate one key through the separator in parent
+        if (l.m_size > r.m_size)
+        {
+          std::move_backward(r.m_keys, r.m_keys + r.m_size,
+              r.m_keys + r.m_size + 1);
+          std::move_backward(r.m_children, r.m_children + r.m_size + 1,
+              r.m_children + r.m_size + 2);
+          r.m_keys[0] = std::move(p.m_keys[i]);
+          r.m_children[0] = l.m_children[l.m_size];
+          p.m_keys[i] = std::move(l.m_keys[l.m_size - 1]);
+          --l.m_size;
+          ++r.m_size;
+        }
+        else
+        {
+          l.m_keys[l.m_size] = std::move(p.m_keys[i]);
+          l.m_children[l.m_size + 1] = r.m_children[0];
+          p.m_keys[i] = std::move(r.m_keys[0]);
+          std::move(r.m_keys + 1, r.m_keys + r.m_size, r.m_keys);
+          std::move(r.m_children + 1, r.m_children + r.m_size + 1,
+              r.m_children);
+          ++l.m_size;
+          --r.m_size;
+        }
+        return;
+      }
+
+      l.m_keys[l.m_size] = std::move(p.m_keys[i]);
+      std::move(r.m_keys, r.m_keys + r.m_size, l.m_keys + l.m_size + 1);
+      std::copy(r.m_children, r.m_children + r.m_size + 1,
+          l.m_children + l.m_size + 1);
+      l.m_size += r.m_size + 1;
+      remove_from_inner(p, i);
+      delete &r;
+    }
+
+    /** @brief Remove the key at @p i and the child after it */
+    static void remove_from_inner(inner &p, std::size_t i) noexcept
+    {
+      std::move(p.m_keys + i + 1, p.m_keys + p.m_size, p.m_keys + i);
+      std::move(p.m_children + i + 2, p.m_children + p.m_size + 1,
+          p.m_children + i + 1);
+      --p.m_size;
+    }
+
+    static void destroy(node *n, std::size_t height) noexcept
+    {
+      if (height == 0)
+      {
+        delete static_cast<leaf*>(n);
+        return;
+      }
+      auto *p = static_cast<inner*>(n);
+      for (std::size_t i = 0; i <= p->m_size; ++i)
+        destroy(p->m_children[i], height - 1);
+      delete p;
+    }
+
+    static Comparator cmper;
+
+    node *m_root;
+    leaf *m_first;
+    leaf *m_last;
+    std::size_t m_height;
+    std::size_t m_size;
+  };
+
+  template<typename Key, typename Type, typename Comparator,
+    std::size_t Capacity>
+  Comparator btree<Key, Type, Comparator, Capacity>::cmper;
+}
+
+#endif
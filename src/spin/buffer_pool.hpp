@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_BUFFER_POOL_HPP_INCLUDED__
+#define __SPIN_BUFFER_POOL_HPP_INCLUDED__
+
+#include <spin/environment.hpp>
+#include <spin/intruse/slist.hpp>
+#include <spin/intruse/atomic_stack.hpp>
+#include <spin/utils.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace spin
+{
+  class buffer_pool;
+
+  namespace detail
+  {
+    /**
+     * @brief Descriptor of a pooled block, kept apart from the block so that
+     * blocks are densely packed in arena
+     */
+    struct buffer_block : public intruse::slist_node<buffer_block>
+    {
+      std::atomic<std::uint32_t> refs;
+      std::uint32_t size_class;
+      buffer_pool *pool;
+      char *data;
+    };
+  }
+
+  /**
+   * @brief Reference counted slice of a block allocated from buffer_pool
+   *
+   * Copies and slices share the block, which goes back to its pool when the
+   * last of them is destroyed, in whichever thread.
+   */
+  class __SPIN_EXPORT__ buffer
+  {
+    friend class buffer_pool;
+  public:
+    /** @brief Construct an empty buffer referencing no block */
+    buffer() noexcept
+      : m_block(nullptr)
+      , m_data(nullptr)
+      , m_size(0)
+    { }
+
+    buffer(const buffer &b) noexcept
+      : m_block(b.m_block)
+      , m_data(b.m_data)
+      , m_size(b.m_size)
+    {
+      if (m_block)
+        m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    buffer(buffer &&b) noexcept
+      : m_block(b.m_block)
+      , m_data(b.m_data)
+      , m_size(b.m_size)
+    {
+      b.m_block = nullptr;
+      b.m_data = nullptr;
+      b.m_size = 0;
+    }
+
+    buffer &operator = (buffer b) noexcept
+    {
+      swap(b);
+      return *this;
+    }
+
+    ~buffer() noexcept
+    { reset(); }
+
+    /** @brief Drop the reference to the block */
+    void reset() noexcept;
+
+    void swap(buffer &b) noexcept
+    {
+      std::swap(m_block, b.m_block);
+      std::swap(m_data, b.m_data);
+      std::swap(m_size, b.m_size);
+    }
+
+    char *data() const noexcept
+    { return m_data; }
+
+    std::size_t size() const noexcept
+    { return m_size; }
+
+    bool empty() const noexcept
+    { return m_size == 0; }
+
+    explicit operator bool () const noexcept
+    { return m_block != nullptr; }
+
+    /** @brief Get number of bytes from data() to the end of block */
+    std::size_t capacity() const noexcept;
+
+    /** @brief Get size of the whole block, 0 if empty */
+    std::size_t block_size() const noexcept;
+
+    /** @brief Get number of buffers sharing the block */
+    std::size_t use_count() const noexcept
+    { return m_block ? m_block->refs.load(std::memory_order_relaxed) : 0; }
+
+    /**
+     * @brief Get a slice sharing the block
+     * @throws std::out_of_range if the slice exceeds this buffer
+     */
+    buffer slice(std::size_t offset, std::size_t size) const;
+
+    /**
+     * @brief Change the size without touching content
+     * @throws std::length_error if @a size exceeds capacity()
+     */
+    void resize(std::size_t size);
+
+    /**
+     * @brief Drop @a n bytes from the front, e.g. the parsed part
+     * @throws std::out_of_range if @a n exceeds size()
+     */
+    void consume(std::size_t n);
+
+  private:
+    buffer(detail::buffer_block *block, std::size_t size) noexcept
+      : m_block(block)
+      , m_data(block->data)
+      , m_size(size)
+    { }
+
+    detail::buffer_block *m_block;
+    char *m_data;
+    std::size_t m_size;
+  };
+
+  /** @brief Occupancy of a buffer_pool */
+  struct buffer_pool_statistics
+  {
+    struct size_class
+    {
+      /** @brief Size of each block */
+      std::size_t block_size;
+
+      /** @brief Number of blocks carved from arenas */
+      std::size_t blocks;
+
+      /** @brief Number of blocks in free list */
+      std::size_t free_blocks;
+
+      /** @brief Number of blocks released by other threads not reclaimed */
+      std::size_t remote_blocks;
+
+      /** @brief Number of blocks referenced by buffers */
+      std::size_t used_blocks;
+    };
+
+    size_class classes[3];
+
+    /** @brief Number of arenas mapped */
+    std::size_t arenas;
+
+    /** @brief Number of arenas backed by explicit huge pages */
+    std::size_t huge_page_arenas;
+
+    /** @brief Bytes of memory mapped */
+    std::size_t reserved_bytes;
+  };
+
+  /**
+   * @brief Pool of fixed size I/O buffers of 4 KiB, 16 KiB and 64 KiB
+   *
+   * Blocks are carved from 2 MiB arenas, which are backed by huge pages if
+   * possible, and recycled through intrusive free lists, one per size
+   * class. A pool is owned by a scheduler and allocates in the thread where
+   * the scheduler runs. Buffers released by other threads are pushed to a
+   * lock-free stack, and taken back to the free lists in one batch when a
+   * free list runs out or #reclaim is called.
+   *
+   * All buffers must be released before the pool is destroyed.
+   */
+  class __SPIN_EXPORT__ buffer_pool
+  {
+    friend class buffer;
+  public:
+    static constexpr std::size_t size_class_count = 3;
+
+    static constexpr std::size_t arena_size = std::size_t(2) << 20;
+
+    /**
+     * @brief Constructor
+     * @param huge_pages Try to back arenas with explicit huge pages, or
+     * advise the kernel to back them with transparent huge pages
+     */
+    explicit buffer_pool(bool huge_pages = true);
+
+    ~buffer_pool() noexcept;
+
+    buffer_pool(const buffer_pool &) = delete;
+
+    buffer_pool &operator = (const buffer_pool &) = delete;
+
+    /**
+     * @brief Allocate a buffer of the smallest size class that can hold
+     * @a size bytes, the size of buffer returned is the block size
+     * @throws std::length_error if @a size is larger than 64 KiB
+     * @throws std::bad_alloc if failed to map an arena
+     */
+    buffer allocate(std::size_t size);
+
+    /**
+     * @brief Take back buffers released by other threads
+     * @returns Number of blocks reclaimed
+     */
+    std::size_t reclaim() noexcept;
+
+    /** @brief Get occupancy, should be called in the owner thread */
+    buffer_pool_statistics get_statistics() const noexcept;
+
+    /**
+     * @brief Get the smallest size class that can hold @a size bytes,
+     * size_class_count if @a size is too large
+     */
+    static std::size_t get_size_class(std::size_t size) noexcept
+    {
+      std::size_t ret = 0;
+      while (ret != size_class_count && size > get_block_size(ret))
+        ++ret;
+      return ret;
+    }
+
+    /** @brief Get block size of a size class */
+    static std::size_t get_block_size(std::size_t size_class) noexcept
+    { return std::size_t(4096) << (2 * size_class); }
+
+  private:
+    struct arena;
+
+    void release(detail::buffer_block &block) noexcept;
+
+    void grow(std::size_t size_class);
+
+    const bool m_huge_pages;
+    std::thread::id m_owner;
+    std::vector<std::unique_ptr<arena>> m_arenas;
+    std::size_t m_huge_page_arenas;
+    intruse::slist<detail::buffer_block> m_free[size_class_count];
+    std::size_t m_free_count[size_class_count];
+    std::size_t m_block_count[size_class_count];
+    char m_padding_0[cache_line_size];
+
+    // Shared with releasing threads
+    intruse::atomic_stack<detail::buffer_block> m_remote;
+    std::atomic_size_t m_remote_count[size_class_count];
+    char m_padding_1[cache_line_size];
+  };
+
+  inline void buffer::reset() noexcept
+  {
+    if (m_block != nullptr
+        && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      m_block->pool->release(*m_block);
+    m_block = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+  }
+
+  inline std::size_t buffer::block_size() const noexcept
+  {
+    return m_block == nullptr ? 0
+      : buffer_pool::get_block_size(m_block->size_class);
+  }
+
+  inline std::size_t buffer::capacity() const noexcept
+  {
+    return m_block == nullptr ? 0
+      : block_size() - static_cast<std::size_t>(m_data - m_block->data);
+  }
+}
+
+#endif
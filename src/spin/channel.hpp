@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_CHANNEL_HPP_INCLUDED__
+#define __SPIN_CHANNEL_HPP_INCLUDED__
+
+#include <spin/event_source.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/routine.hpp>
+#include <spin/task.hpp>
+#include <spin/utils.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace spin
+{
+  namespace detail
+  {
+    inline std::size_t round_up_to_power_of_two(std::size_t x) noexcept
+    {
+      std::size_t ret = 1;
+      while (ret < x)
+        ret <<= 1;
+      return ret;
+    }
+  }
+
+  /**
+   * @brief Bounded single-producer single-consumer ring buffer
+   *
+   * Producer and consumer indexes are kept on separate cache lines, and
+   * each side caches the index of the other side so that it's only
+   * reloaded when the ring looks full or empty.
+   */
+  template<typename T>
+  class spsc_ring
+  {
+    using slot_type = typename std::aligned_storage<sizeof(T),
+          alignof(T)>::type;
+  public:
+
+    /**
+     * @brief Construct a ring
+     * @param capacity Minimum number of elements the ring can hold, it's
+     * rounded up to power of two
+     */
+    explicit spsc_ring(std::size_t capacity)
+      : m_mask(detail::round_up_to_power_of_two(capacity) - 1)
+      , m_slots(new slot_type[m_mask + 1])
+      , m_head(0)
+      , m_cached_tail(0)
+      , m_tail(0)
+      , m_cached_head(0)
+    { }
+
+    ~spsc_ring()
+    { consume(m_mask + 1, [](T &) noexcept {}); }
+
+    spsc_ring(const spsc_ring &) = delete;
+
+    spsc_ring &operator = (const spsc_ring &) = delete;
+
+    /** @brief Get the capacity of the ring */
+    std::size_t capacity() const noexcept
+    { return m_mask + 1; }
+
+    /**
+     * @brief Push an element, must be called by the only producer
+     * @returns false if the ring is full
+     */
+    template<typename U>
+    bool try_push(U &&u)
+    {
+      auto tail = m_tail.load(std::memory_order_relaxed);
+      if (tail - m_cached_head > m_mask)
+      {
+        m_cached_head = m_head.load(std::memory_order_acquire);
+        if (tail - m_cached_head > m_mask)
+          return false;
+      }
+      new (&m_slots[tail & m_mask]) T(std::forward<U>(u));
+      m_tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Pop at most @a max elements and pass them to @a consumer, must
+     * be called by the only consumer
+     * @returns Number of elements popped
+     */
+    template<typename Consumer>
+    std::size_t consume(std::size_t max, Consumer &&consumer)
+    {
+      auto head = m_head.load(std::memory_order_relaxed);
+      if (m_cached_tail - head < max)
+        m_cached_tail = m_tail.load(std::memory_order_acquire);
+      auto n = std::min(max, m_cached_tail - head);
+      std::size_t i = 0;
+
+      // Publish consumed slots once per batch, even if consumer throws
+      auto guard = make_block_guard([&] () noexcept
+          { m_head.store(head + i, std::memory_order_release); });
+      while (i != n)
+      {
+        T &slot = reinterpret_cast<T&>(m_slots[(head + i) & m_mask]);
+        T x(std::move(slot));
+        slot.~T();
+        ++i;
+        consumer(x);
+      }
+      return n;
+    }
+
+  private:
+    const std::size_t m_mask;
+    const std::unique_ptr<slot_type[]> m_slots;
+    char m_padding_0[cache_line_size];
+
+    // Written by consumer
+    std::atomic_size_t m_head;
+    std::size_t m_cached_tail;
+    char m_padding_1[cache_line_size];
+
+    // Written by producer
+    std::atomic_size_t m_tail;
+    std::size_t m_cached_head;
+    char m_padding_2[cache_line_size];
+  };
+
+  /**
+   * @brief Bounded multiple-producer single-consumer ring buffer
+   *
+   * Each slot carries a sequence number telling whether it's ready for
+   * producer or for consumer, producers claim slots by advancing the shared
+   * tail index with compare and swap.
+   */
+  template<typename T>
+  class mpsc_ring
+  {
+    struct slot_type
+    {
+      std::atomic_size_t sequence;
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
+    };
+
+  public:
+
+    /**
+     * @brief Construct a ring
+     * @param capacity Minimum number of elements the ring can hold, it's
+     * rounded up to power of two
+     */
+    explicit mpsc_ring(std::size_t capacity)
+      : m_mask(detail::round_up_to_power_of_two(capacity) - 1)
+      , m_slots(new slot_type[m_mask + 1])
+      , m_head(0)
+      , m_tail(0)
+    {
+      for (std::size_t i = 0; i <= m_mask; ++i)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~mpsc_ring()
+    { consume(m_mask + 1, [](T &) noexcept {}); }
+
+    mpsc_ring(const mpsc_ring &) = delete;
+
+    mpsc_ring &operator = (const mpsc_ring &) = delete;
+
+    /** @brief Get the capacity of the ring */
+    std::size_t capacity() const noexcept
+    { return m_mask + 1; }
+
+    /**
+     * @brief Push an element, may be called by any thread
+     * @returns false if the ring is full
+     */
+    template<typename U>
+    bool try_push(U &&u)
+    {
+      auto tail = m_tail.load(std::memory_order_relaxed);
+      slot_type *slot;
+      for ( ; ; )
+      {
+        slot = &m_slots[tail & m_mask];
+        auto seq = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq - tail);
+        if (diff == 0)
+        {
+          if (m_tail.compare_exchange_weak(tail, tail + 1,
+                std::memory_order_relaxed))
+            break;
+        }
+        else if (diff < 0)
+          return false;
+        else
+          tail = m_tail.load(std::memory_order_relaxed);
+      }
+
+      // A claimed slot must be published or the consumer stalls on it
+      // forever, so constructing the element may not throw
+      static_assert(std::is_nothrow_constructible<T, U&&>::value,
+          "Element of mpsc_ring must be nothrow constructible");
+      new (&slot->value) T(std::forward<U>(u));
+      slot->sequence.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Pop at most @a max elements and pass them to @a consumer, must
+     * be called by the only consumer
+     * @returns Number of elements popped
+     */
+    template<typename Consumer>
+    std::size_t consume(std::size_t max, Consumer &&consumer)
+    {
+      std::size_t n = 0;
+      while (n != max)
+      {
+        slot_type &slot = m_slots[m_head & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1)
+          break;
+        T &value = reinterpret_cast<T&>(slot.value);
+        T x(std::move(value));
+        value.~T();
+        slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        ++m_head;
+        ++n;
+        consumer(x);
+      }
+      return n;
+    }
+
+  private:
+    const std::size_t m_mask;
+    const std::unique_ptr<slot_type[]> m_slots;
+    char m_padding_0[cache_line_size];
+
+    // Owned by consumer
+    std::size_t m_head;
+    char m_padding_1[cache_line_size];
+
+    // Shared by producers
+    std::atomic_size_t m_tail;
+    char m_padding_2[cache_line_size];
+  };
+
+  /**
+   * @brief Receiving side of a channel, integrated into the scheduler of
+   * consumer as an event_source
+   *
+   * Producers only write to the eventfd when the consumer is not already
+   * notified, so a burst of messages costs one write. The consumer drains
+   * at most a batch of messages per iteration of scheduler, and dispatch
+   * itself as a task to drain the rest in next iteration. Messages are
+   * handled in a task rather than in the event callback, so that an
+   * exception thrown by the handler propagates out of scheduler::run.
+   */
+  class __SPIN_EXPORT__ channel_base : public event_source
+  {
+  protected:
+    channel_base(scheduler &s, std::size_t batch_size);
+
+    virtual ~channel_base() = default;
+
+    /** @brief Wake up the consumer, called after messages were pushed */
+    void notify();
+
+    /** @brief Consume at most @a max messages */
+    virtual std::size_t consume(std::size_t max) = 0;
+
+    void on_emit() noexcept override;
+
+  private:
+    void drain();
+
+    scheduler &m_scheduler;
+    const std::size_t m_batch_size;
+    task m_drain_task;
+    char m_padding_0[cache_line_size];
+    std::atomic_bool m_notified;
+    char m_padding_1[cache_line_size];
+  };
+
+  /**
+   * @brief A typed bounded channel delivering messages to a scheduler
+   * @tparam T Type of message
+   * @tparam Ring spsc_ring<T> or mpsc_ring<T>
+   */
+  template<typename T, typename Ring>
+  class basic_channel : public channel_base
+  {
+  public:
+
+    /**
+     * @brief Construct a channel
+     * @param s The scheduler of the consumer
+     * @param capacity Minimum number of messages the channel can hold
+     * @param handler Called in the thread of @a s for each message; if it
+     * throws, the exception propagates out of scheduler::run, and messages
+     * left are handled once it's called again
+     * @param batch_size Maximum number of messages handled per iteration
+     * of @a s
+     */
+    basic_channel(scheduler &s, std::size_t capacity,
+        routine<T &> handler, std::size_t batch_size = 64)
+      : channel_base(s, batch_size)
+      , m_ring(capacity)
+      , m_handler(std::move(handler))
+    { }
+
+    ~basic_channel() = default;
+
+    /**
+     * @brief Send a message
+     * @returns false if the channel is full
+     */
+    template<typename U>
+    bool try_send(U &&u)
+    {
+      if (!m_ring.try_push(std::forward<U>(u)))
+        return false;
+      notify();
+      return true;
+    }
+
+    /**
+     * @brief Send messages in [first, last) and wake up consumer once
+     * @returns Iterator to the first message not sent because the channel
+     * is full
+     */
+    template<typename Iterator>
+    Iterator try_send(Iterator first, Iterator last)
+    {
+      bool sent = false;
+      for ( ; first != last && m_ring.try_push(*first); ++first)
+        sent = true;
+      if (sent)
+        notify();
+      return first;
+    }
+
+    /** @brief Get the capacity of this channel */
+    std::size_t capacity() const noexcept
+    { return m_ring.capacity(); }
+
+  protected:
+    std::size_t consume(std::size_t max) override
+    { return m_ring.consume(max, [this](T &x) { m_handler(x); }); }
+
+  private:
+    Ring m_ring;
+    routine<T &> m_handler;
+  };
+
+  /** @brief Channel with exactly one sending thread */
+  template<typename T>
+  using spsc_channel = basic_channel<T, spsc_ring<T>>;
+
+  /** @brief Channel with any number of sending threads */
+  template<typename T>
+  using mpsc_channel = basic_channel<T, mpsc_ring<T>>;
+}
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_DATAGRAM_SOCKET_HPP_INCLUDED__
+#define __SPIN_DATAGRAM_SOCKET_HPP_INCLUDED__
+
+#include <spin/event_source.hpp>
+#include <spin/routine.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/socket.hpp>
+#include <spin/task.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace spin
+{
+  /** @brief A received datagram, only valid in the receive handler */
+  struct datagram
+  {
+    /** @brief Payload, may be modified by the handler */
+    char *data;
+
+    /** @brief Size of payload */
+    std::size_t size;
+
+    /**
+     * @brief Size of each segment if the kernel coalesced several datagrams
+     * from the same source with GRO, the last one may be shorter; 0 if
+     * the payload is a single datagram
+     */
+    std::size_t segment_size;
+
+    /** @brief Address of the sender */
+    const socket_address *source;
+
+    /** @brief The datagram was larger than the receive buffer */
+    bool truncated;
+  };
+
+  /**
+   * @brief UDP socket integrated into scheduler
+   *
+   * On each readable edge, datagrams are drained with recvmmsg into an
+   * array of buffers allocated up front and handed to the receive handler
+   * batch by batch, within the budget of io_event_source. Datagrams sent
+   * are copied into a send queue and flushed with sendmmsg in next iteration
+   * of the scheduler, or immediately when the queue is full, within the
+   * same budget.
+   *
+   * If the kernel supports it, consecutive datagrams of the same size to
+   * the same destination are sent as one message with UDP_SEGMENT (GSO),
+   * and datagrams received may be coalesced with UDP_GRO.
+   *
+   * The receive handler runs in a task rather than in the event callback,
+   * so that an exception thrown by it propagates out of scheduler::run;
+   * datagrams left are received once it's called again. The socket must
+   * not be destroyed in the handler.
+   */
+  class __SPIN_EXPORT__ datagram_socket : public io_event_source
+  {
+  public:
+    struct options
+    {
+      options() noexcept
+        : batch_size(32)
+        , buffer_size(2048)
+        , gro(false)
+        , gso(false)
+        , reuse_port(false)
+      { }
+
+      /** @brief Number of datagrams per recvmmsg and per sendmmsg */
+      std::size_t batch_size;
+
+      /**
+       * @brief Size of each receive buffer, which is also the maximum size
+       * of a datagram sent; consider 65535 with GRO
+       */
+      std::size_t buffer_size;
+
+      /** @brief Try to enable UDP_GRO */
+      bool gro;
+
+      /** @brief Try to coalesce datagrams sent with UDP_SEGMENT */
+      bool gso;
+
+      /** @brief Set SO_REUSEPORT before bind */
+      bool reuse_port;
+    };
+
+    /** @brief Handler called with a batch of datagrams received */
+    using receive_handler = routine<datagram_socket &, datagram *,
+          std::size_t>;
+
+    /**
+     * @brief Construct a socket bound to @a local
+     * @throws std::system_error if failed to create or bind the socket
+     */
+    datagram_socket(scheduler &s, const socket_address &local,
+        receive_handler handler, const options &opt = options());
+
+    ~datagram_socket() noexcept;
+
+    /** @brief Set the default destination and filter the sources */
+    void connect(const socket_address &peer);
+
+    /** @brief Get the address this socket is bound to */
+    socket_address get_local_address() const;
+
+    /**
+     * @brief Queue a datagram to @a to
+     * @returns false if the queue is still full after an attempt to flush,
+     * e.g. the socket buffer is full
+     * @throws std::length_error if @a size is larger than buffer_size
+     */
+    bool send(const void *data, std::size_t size, const socket_address &to);
+
+    /** @brief Queue a datagram to the connected peer */
+    bool send(const void *data, std::size_t size);
+
+    /**
+     * @brief Send queued datagrams now
+     * @returns Number of datagrams left in queue
+     */
+    std::size_t flush() noexcept;
+
+    /** @brief Get number of datagrams queued */
+    std::size_t get_pending_count() const noexcept
+    { return m_pending_count; }
+
+    bool is_gro_enabled() const noexcept
+    { return m_gro; }
+
+    bool is_gso_enabled() const noexcept
+    { return m_gso; }
+
+  protected:
+    void on_readable() noexcept override;
+
+    void on_writable() noexcept override;
+
+    void on_error() noexcept override;
+
+  private:
+    union control_buffer
+    {
+      ::cmsghdr header;
+      char data[CMSG_SPACE(sizeof(int))];
+    };
+
+    /** @brief A queued message, may carry several segments with GSO */
+    struct outgoing
+    {
+      socket_address destination;
+      std::size_t segment_size;
+      std::size_t segments;
+    };
+
+    bool enqueue(const void *data, std::size_t size,
+        const socket_address *to);
+
+    /**
+     * @brief Receive a batch and pass it to handler
+     * @returns Number of bytes received, or -1 if drained
+     */
+    std::ptrdiff_t receive_batch();
+
+    /**
+     * @brief Send a batch from the head of queue
+     * @returns Number of bytes sent, or -1 if the queue is empty or the
+     * socket buffer is full
+     */
+    std::ptrdiff_t send_batch() noexcept;
+
+    scheduler &m_scheduler;
+    receive_handler m_handler;
+    const std::size_t m_batch_size;
+    const std::size_t m_buffer_size;
+    bool m_gro;
+    bool m_gso;
+
+    // Receive side, headers point to the buffers for the whole lifetime
+    std::unique_ptr<char[]> m_receive_buffer;
+    std::vector<::mmsghdr> m_receive_headers;
+    std::vector<::iovec> m_receive_iovecs;
+    std::vector<socket_address> m_sources;
+    std::vector<control_buffer> m_receive_control;
+    std::vector<datagram> m_datagrams;
+
+    // Send side, payloads are packed in m_send_buffer
+    std::unique_ptr<char[]> m_send_buffer;
+    std::size_t m_send_buffer_used;
+    std::vector<::mmsghdr> m_send_headers;
+    std::vector<::iovec> m_send_iovecs;
+    std::vector<outgoing> m_outgoings;
+    std::vector<control_buffer> m_send_control;
+    std::size_t m_send_head;
+    std::size_t m_send_tail;
+    std::size_t m_pending_count;
+    task m_flush_task;
+    task m_receive_task;
+  };
+}
+
+#endif
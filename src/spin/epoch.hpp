@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_EPOCH_HPP_INCLUDED__
+#define __SPIN_EPOCH_HPP_INCLUDED__
+
+#include <spin/environment.hpp>
+#include <spin/routine.hpp>
+
+#include <cstddef>
+
+namespace spin
+{
+  /**
+   * @brief Epoch based memory reclamation
+   *
+   * Readers of a lock-free structure hold an epoch::guard as long as they
+   * may reference its nodes. Writers unlink a node and retire it with a
+   * callback, which is invoked only after every thread that might observe
+   * the node has passed a quiescent state.
+   *
+   * A thread which holds an epoch::registration, as threads running
+   * scheduler::run and threads of thread_pool do, is regarded as observing
+   * shared nodes until it announces a quiescent state, so its guards cost
+   * only a thread local increment. Other threads announce their epoch on
+   * entering the outermost guard.
+   *
+   * The record of a thread is allocated on its first use of epoch, so
+   * entering a guard or a registration may throw std::bad_alloc, while
+   * leaving them never throws.
+   */
+  class __SPIN_EXPORT__ epoch
+  {
+  public:
+
+    /** @brief Read-side critical section, guards may be nested */
+    class guard
+    {
+    public:
+      guard()
+      { enter(); }
+
+      ~guard() noexcept
+      { leave(); }
+
+      guard(const guard &) = delete;
+
+      guard &operator = (const guard &) = delete;
+    };
+
+    /**
+     * @brief Register current thread as one that announces quiescent states
+     * periodically with epoch::quiescent, registrations may be nested
+     */
+    class registration
+    {
+    public:
+      registration()
+      { register_thread(); }
+
+      ~registration() noexcept
+      { unregister_thread(); }
+
+      registration(const registration &) = delete;
+
+      registration &operator = (const registration &) = delete;
+    };
+
+    epoch() = delete;
+
+    /** @brief Enter a read-side critical section */
+    static void enter();
+
+    /** @brief Leave a read-side critical section */
+    static void leave() noexcept;
+
+    /** @brief Test if current thread is in a read-side critical section */
+    static bool is_active();
+
+    /**
+     * @brief Announce that current thread holds no reference to shared
+     * nodes, then invoke callbacks whose grace period has elapsed. It's
+     * ignored in a read-side critical section.
+     */
+    static void quiescent();
+
+    /**
+     * @brief Announce that current thread is going to block, it does not
+     * delay reclamation until epoch::online is called
+     */
+    static void offline();
+
+    /** @brief Announce that a registered thread is back from blocking */
+    static void online();
+
+    /**
+     * @brief Defer @a callback until all threads which might observe the
+     * retired object have passed a quiescent state
+     *
+     * Callbacks are queued per thread and invoked by the retiring thread,
+     * in epoch::quiescent, epoch::reclaim, or in this function if too many
+     * of them are pending. Callbacks left by a thread which has exited or
+     * gone offline are invoked by any thread reclaiming. Callbacks must not
+     * throw.
+     */
+    static void retire(routine<> callback);
+
+    /**
+     * @brief Try to advance the global epoch and invoke callbacks whose
+     * grace period has elapsed
+     * @returns Number of callbacks invoked
+     */
+    static std::size_t reclaim();
+
+    /**
+     * @brief Wait for a grace period, then invoke callbacks retired before
+     * by current thread or left by other threads, must not be called in a
+     * read-side critical section
+     */
+    static void synchronize();
+
+  private:
+    static void register_thread();
+
+    static void unregister_thread() noexcept;
+  };
+}
+
+#endif
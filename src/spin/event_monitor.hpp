@@ -20,6 +20,10 @@
 
 #include <spin/system.hpp>
 #include <spin/routine.hpp>
+#include <spin/statistics.hpp>
+#include <spin/watchdog.hpp>
+
+#include <typeinfo>
 
 namespace spin
 {
@@ -35,11 +39,35 @@ namespace spin
 
     void interrupt();
 
-    void wait(bool allow_blocking);
+    /**
+     * @brief Wait for events and dispatch them to their event sources
+     * @param allow_blocking Whether to block until an event arrives
+     * @param statistics Where to account events and time spent waiting,
+     * may be nullptr
+     * @param probe Where to record event callback dispatching for watchdog,
+     * may be nullptr
+     */
+    void wait(bool allow_blocking,
+        statistics_counters *statistics = nullptr,
+        watchdog_probe *probe = nullptr);
 
   private:
+    /**
+     * @brief Registered to epoll for a device, with its owner whose type
+     * is reported to watchdog while the callback runs
+     */
+    struct callback
+    {
+      routine<int> function;
+      const void *owner;
+      const std::type_info &(*get_owner_type)(const void *owner);
+
+      template<typename Owner>
+      static const std::type_info &type_of(const void *owner)
+      { return typeid(*static_cast<const Owner *>(owner)); }
+    };
 
-    routine<int> m_interrupt_callback;
+    callback m_interrupt_callback;
     system_handle m_interrupter;
     system_handle m_monitor;
   };
@@ -20,7 +20,9 @@
 
 #include <spin/scheduler.hpp>
 
+#include <cstddef>
 #include <memory>
+#include <utility>
 
 namespace spin
 {
@@ -44,9 +46,18 @@ namespace spin
   private:
     std::shared_ptr<event_monitor> m_monitor;
     system_handle m_device;
-    routine<int> m_callback;
+    event_monitor::callback m_callback;
   };
 
+  /**
+   * @brief Device of input or output registered edge-triggered
+   *
+   * As an edge is only reported once, the device must be drained until it
+   * would block. To keep a busy device from starving others, subclasses
+   * drain with #drain_readable and #drain_writable, which stop once the
+   * budget of an edge is used up and continue from next iteration of the
+   * scheduler as a task.
+   */
   class __SPIN_EXPORT__ io_event_source
   {
     friend class event_monitor;
@@ -55,6 +66,22 @@ namespace spin
     struct writeonly_t {} writeonly;
     struct readwrite_t {} readwrite;
 
+    /** @brief Work allowed per edge, whichever runs out first */
+    struct budget
+    {
+      budget(std::size_t b = std::size_t(1) << 20, std::size_t i = 64)
+        noexcept
+        : bytes(b)
+        , iterations(i)
+      { }
+
+      /** @brief Number of bytes transferred */
+      std::size_t bytes;
+
+      /** @brief Number of steps, e.g. system calls */
+      std::size_t iterations;
+    };
+
     io_event_source (const io_event_source &) = delete;
     io_event_source (io_event_source &&) = delete;
 
@@ -63,6 +90,20 @@ namespace spin
 
     const system_handle &get_device() const
     { return m_device; }
+
+    /**
+     * @brief Set the budget of each edge, a limit of zero is taken as one
+     * as no progress could be made otherwise
+     */
+    void set_budget(const budget &b) noexcept
+    {
+      m_budget.bytes = b.bytes == 0 ? 1 : b.bytes;
+      m_budget.iterations = b.iterations == 0 ? 1 : b.iterations;
+    }
+
+    const budget &get_budget() const noexcept
+    { return m_budget; }
+
   protected:
     io_event_source(scheduler &schd, system_handle device, readonly_t);
     io_event_source(scheduler &schd, system_handle device, writeonly_t);
@@ -73,12 +114,65 @@ namespace spin
     virtual void on_writable() noexcept;
     virtual void on_error() noexcept;
 
+    /**
+     * @brief Drain for a readable edge
+     * @param step Called repeatedly, returns number of bytes transferred,
+     * or a negative value once the device would block or is closed
+     * @returns false if the budget is used up, and #on_readable will be
+     * called again by a task as if there is another edge; the same if
+     * @a step throws, once the scheduler runs again
+     */
+    template<typename Step>
+    bool drain_readable(Step &&step)
+    { return drain(std::forward<Step>(step), m_readable_task); }
+
+    /** @brief Drain for a writable edge, see #drain_readable */
+    template<typename Step>
+    bool drain_writable(Step &&step)
+    { return drain(std::forward<Step>(step), m_writable_task); }
+
   private:
     io_event_source(scheduler &schd, system_handle device, int events);
 
+    template<typename Step>
+    bool drain(Step &&step, task &continuation)
+    {
+      std::size_t bytes = 0;
+      for (std::size_t i = 0; i < m_budget.iterations
+          && bytes < m_budget.bytes; ++i)
+      {
+        std::ptrdiff_t n;
+        try
+        {
+          n = step();
+        }
+        catch (...)
+        {
+          // The edge is not drained yet
+          if (continuation.is_canceled())
+            m_scheduler.dispatch(continuation);
+          throw;
+        }
+        if (n < 0)
+        {
+          // Drained, a continuation is no longer needed
+          continuation.cancel();
+          return true;
+        }
+        bytes += static_cast<std::size_t>(n);
+      }
+      if (continuation.is_canceled())
+        m_scheduler.dispatch(continuation);
+      return false;
+    }
+
     std::shared_ptr<event_monitor> m_monitor;
     system_handle m_device;
-    routine<int> m_callback;
+    event_monitor::callback m_callback;
+    scheduler &m_scheduler;
+    budget m_budget;
+    task m_readable_task;
+    task m_writable_task;
   };
 
 }
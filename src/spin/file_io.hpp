@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_FILE_IO_HPP_INCLUDED__
+#define __SPIN_FILE_IO_HPP_INCLUDED__
+
+#include <spin/event_monitor.hpp>
+#include <spin/routine.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/system.hpp>
+#include <spin/task.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace spin
+{
+  /** @brief Alignment of memory, file offset and size required by O_DIRECT */
+  struct direct_io_alignment
+  {
+    /** @brief Alignment of memory buffers */
+    std::size_t memory;
+
+    /** @brief Alignment of file offsets and sizes */
+    std::size_t offset;
+  };
+
+  /**
+   * @brief Query alignment for O_DIRECT of a file with statx, 4096 for both
+   * if the kernel or the file system can't tell
+   */
+  direct_io_alignment __SPIN_EXPORT__ get_direct_io_alignment(
+      const system_handle &file) noexcept;
+
+  /** @brief Round @a x down to a multiple of @a alignment, a power of two */
+  inline std::uint64_t align_down(std::uint64_t x, std::size_t alignment)
+    noexcept
+  { return x & ~static_cast<std::uint64_t>(alignment - 1); }
+
+  /** @brief Round @a x up to a multiple of @a alignment, a power of two */
+  inline std::uint64_t align_up(std::uint64_t x, std::size_t alignment)
+    noexcept
+  { return align_down(x + alignment - 1, alignment); }
+
+  /** @brief Test if a transfer may be done with O_DIRECT */
+  inline bool is_direct_io_aligned(const void *data, std::size_t size,
+      std::uint64_t offset, const direct_io_alignment &a) noexcept
+  {
+    return reinterpret_cast<std::uintptr_t>(data) % a.memory == 0
+      && size % a.offset == 0 && offset % a.offset == 0;
+  }
+
+  /** @brief Deleter of memory returned by #allocate_aligned */
+  struct aligned_deleter
+  {
+    void operator () (char *p) const noexcept
+    { std::free(p); }
+  };
+
+  using aligned_memory = std::unique_ptr<char[], aligned_deleter>;
+
+  /**
+   * @brief Allocate memory aligned for O_DIRECT
+   * @throws std::bad_alloc if failed
+   */
+  aligned_memory __SPIN_EXPORT__ allocate_aligned(std::size_t size,
+      std::size_t alignment);
+
+  /**
+   * @brief Asynchronous I/O of regular files for a scheduler
+   *
+   * Regular files are always readable and writable to epoll, so a loop
+   * reading them would block in pread. Operations here are executed on an
+   * io_uring if the kernel supports it: they're queued into the submission
+   * ring and submitted with one io_uring_enter in next iteration of the
+   * scheduler, and completions are reaped when an eventfd registered to
+   * the ring turns readable. Otherwise they're executed by a bounded set of
+   * I/O threads, each of them executes one operation at a time and posts
+   * completions to the scheduler in batches. Either way, handlers of
+   * completed operations are delivered to the scheduler as one batch of
+   * tasks.
+   *
+   * Operations must be requested, and buffers registered, in the thread
+   * running the scheduler, as the io_uring and requests queued for it are
+   * not guarded by any lock. Buffers must be kept valid until the handler
+   * is called. Handlers of operations not completed when this object is
+   * destroyed are not called.
+   */
+  class __SPIN_EXPORT__ file_io
+  {
+  public:
+    /**
+     * @brief Called with number of bytes transferred, or 0 for #fsync and
+     * #fallocate, and the error if failed
+     */
+    using completion_handler = routine<std::size_t, const std::error_code &>;
+
+    enum class backend
+    {
+      io_uring,
+      threads
+    };
+
+    struct options
+    {
+      options() noexcept
+        : queue_depth(128)
+        , threads(4)
+        , use_io_uring(true)
+      { }
+
+      /**
+       * @brief Number of entries of the io_uring, also the maximum number
+       * of operations in flight; more are queued until some complete
+       */
+      unsigned queue_depth;
+
+      /** @brief Number of I/O threads if io_uring is not used */
+      unsigned threads;
+
+      /** @brief Try io_uring before falling back to I/O threads */
+      bool use_io_uring;
+    };
+
+    /**
+     * @brief Construct for scheduler @a s, which will not return from
+     * scheduler::run while this object exists
+     * @throws std::system_error if failed
+     */
+    file_io(scheduler &s, const options &opt = options());
+
+    ~file_io() noexcept;
+
+    file_io(const file_io &) = delete;
+
+    file_io &operator = (const file_io &) = delete;
+
+    /** @brief Get the backend executing operations */
+    backend get_backend() const noexcept
+    { return m_ring ? backend::io_uring : backend::threads; }
+
+    /** @brief Read at most @a size bytes at @a offset of @a file */
+    void pread(const system_handle &file, void *data, std::size_t size,
+        std::uint64_t offset, completion_handler handler);
+
+    /** @brief Write at most @a size bytes at @a offset of @a file */
+    void pwrite(const system_handle &file, const void *data,
+        std::size_t size, std::uint64_t offset, completion_handler handler);
+
+    /**
+     * @brief Flush @a file to storage
+     * @param data_only Skip metadata not needed to read data, like
+     * fdatasync
+     */
+    void fsync(const system_handle &file, bool data_only,
+        completion_handler handler);
+
+    /** @brief Manipulate space of @a file, see fallocate(2) for @a mode */
+    void fallocate(const system_handle &file, int mode,
+        std::uint64_t offset, std::uint64_t length,
+        completion_handler handler);
+
+    /**
+     * @brief Register buffers, replacing those registered before
+     *
+     * With io_uring, the kernel pins and maps registered buffers once, and
+     * #pread and #pwrite within one of them skip mapping it on every
+     * operation. Ignored by I/O threads. Operations queued but not
+     * submitted yet are matched against buffers registered at submission.
+     * @note No operation on buffers registered before may be in flight
+     * @throws std::system_error if failed, e.g. RLIMIT_MEMLOCK exceeded
+     */
+    void register_buffers(const ::iovec *buffers, std::size_t count);
+
+    /** @brief Unregister all buffers, see #register_buffers */
+    void unregister_buffers() noexcept;
+
+  private:
+    struct request;
+    class ring;
+    class completion_source;
+
+    void submit(request *r);
+
+    void flush() noexcept;
+
+    void reap() noexcept;
+
+    void thread_routine() noexcept;
+
+    int find_registered_buffer(const void *data, std::size_t size) const
+      noexcept;
+
+    scheduler &m_scheduler;
+    std::unique_ptr<ring> m_ring;
+    std::unique_ptr<completion_source> m_completion_source;
+    std::shared_ptr<event_monitor> m_monitor;
+
+    // Registered buffers sorted by address
+    std::vector<::iovec> m_buffers;
+
+    // Requests not submitted to the ring yet, or not taken by I/O threads
+    task::queue_type m_backlog;
+    task m_flush_task;
+
+    // For I/O threads, m_backlog is guarded by m_mutex; for io_uring, it's
+    // only touched in the thread of the scheduler
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_exited;
+    std::vector<std::thread> m_threads;
+  };
+}
+
+#endif
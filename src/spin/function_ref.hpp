@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_FUNCTION_REF_HPP_INCLUDED__
+#define __SPIN_FUNCTION_REF_HPP_INCLUDED__
+
+#include <spin/environment.hpp>
+
+#include <utility>
+#include <memory>
+#include <type_traits>
+
+namespace spin
+{
+  template<typename>
+  class function_ref;
+
+  /**
+   * @brief Non-owning reference to a callable object
+   * @tparam Result The return type of the referenced callable
+   * @tparam Arguments The argument types of the referenced callable
+   *
+   * Different from spin::function, function_ref does not own or copy the
+   * callable it refers to, so there is no manager to be called on
+   * construction, copy or destruction, and a call costs exactly one indirect
+   * call through an invoker that is selected at compile time.
+   *
+   * @note User is responsible to ensure the referenced callable outlives
+   * this function_ref, that is, function_ref is suitable for parameters but
+   * not for storage
+   */
+  template<typename Result, typename ...Arguments>
+  class function_ref<Result (Arguments...)>
+  {
+    union storage_type
+    {
+      void *object;
+      Result (*function)(Arguments...);
+    };
+
+    using invoker_type = Result (*)(storage_type, Arguments...);
+
+    template<typename T, typename = void>
+    struct is_compatible_callable
+      : std::false_type
+    { };
+
+    template<typename T>
+    struct is_compatible_callable<T, typename std::enable_if<
+        std::is_void<Result>::value
+        || std::is_convertible<decltype(std::declval<T &>()(
+            std::declval<Arguments>()...)), Result>::value>::type>
+      : std::integral_constant<bool,
+          !std::is_same<typename std::decay<T>::type, function_ref>::value
+          && !std::is_function<typename std::remove_reference<T>::type>::value>
+    { };
+
+  public:
+
+    /**
+     * @brief Refer to a callable object
+     * @param callable The callable to be referred to, which must outlive
+     * this function_ref
+     */
+    template<typename Callable, typename = typename std::enable_if<
+      is_compatible_callable<Callable>::value>::type>
+    function_ref(Callable &&callable) noexcept
+      : m_storage()
+      , m_invoker(&invoke_object<typename std::remove_reference<Callable>::type>)
+    {
+      m_storage.object = const_cast<void *>(
+          static_cast<const void *>(std::addressof(callable)));
+    }
+
+    /** @brief Refer to a plain function */
+    function_ref(Result (*function)(Arguments...)) noexcept
+      : m_storage()
+      , m_invoker(&invoke_function)
+    { m_storage.function = function; }
+
+    function_ref(const function_ref &) noexcept = default;
+
+    function_ref &operator = (const function_ref &) noexcept = default;
+
+    ~function_ref() = default;
+
+    /** @brief Call the referenced callable */
+    Result operator () (Arguments... arguments) const
+    { return m_invoker(m_storage, std::forward<Arguments>(arguments)...); }
+
+    /** @brief Swap with another function_ref */
+    void swap(function_ref &other) noexcept
+    {
+      std::swap(m_storage, other.m_storage);
+      std::swap(m_invoker, other.m_invoker);
+    }
+
+  private:
+
+    template<typename T>
+    static Result invoke_object(storage_type storage, Arguments... arguments)
+    { return (*static_cast<T *>(storage.object))(std::forward<Arguments>(arguments)...); }
+
+    static Result invoke_function(storage_type storage, Arguments... arguments)
+    { return storage.function(std::forward<Arguments>(arguments)...); }
+
+    storage_type m_storage;
+    invoker_type m_invoker;
+  };
+
+  template<typename T>
+  void swap(function_ref<T> &lhs, function_ref<T> &rhs) noexcept
+  { lhs.swap(rhs); }
+}
+
+#endif
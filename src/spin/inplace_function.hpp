@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INPLACE_FUNCTION_HPP_INCLUDED__
+#define __SPIN_INPLACE_FUNCTION_HPP_INCLUDED__
+
+#include <spin/function.hpp>
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <typeinfo>
+#include <type_traits>
+
+namespace spin
+{
+  template<typename Signature, std::size_t Capacity = 4 * sizeof(void*),
+    std::size_t Alignment = alignof(void*)>
+  class inplace_function;
+
+  /**
+   * @brief Polymorphic function wrapper with fixed inplace storage
+   * @tparam Result The return type of the wrapped callable
+   * @tparam Arguments The argument types of the wrapped callable
+   * @tparam Capacity Size of the inplace storage in bytes
+   * @tparam Alignment Alignment of the inplace storage
+   *
+   * The callable is always stored in the object itself, a callable that
+   * does not fit is rejected at compile time, so that inplace_function
+   * never allocates. Each stored type is described by a static table of
+   * operations and the object holds a single pointer to it; a call is one
+   * load of the table plus one indirect call, there is no manager switch
+   * and no separate invoker pointer to be kept in sync.
+   */
+  template<typename Result, typename ...Arguments,
+    std::size_t Capacity, std::size_t Alignment>
+  class inplace_function<Result (Arguments...), Capacity, Alignment>
+  {
+    using storage_type
+      = typename std::aligned_storage<Capacity, Alignment>::type;
+
+    struct vtable_type
+    {
+      Result (*invoke)(storage_type &, Arguments...);
+      void (*copy)(storage_type &, const storage_type &);
+      void (*relocate)(storage_type &, storage_type &) noexcept;
+      void (*destroy)(storage_type &) noexcept;
+      const std::type_info &(*target_type)() noexcept;
+    };
+
+    template<typename T>
+    struct operations
+    {
+      static Result invoke(storage_type &s, Arguments... arguments)
+      {
+        return (*reinterpret_cast<T*>(&s))(
+            std::forward<Arguments>(arguments)...);
+      }
+
+      static void copy(storage_type &dst, const storage_type &src)
+      { new (&dst) T(*reinterpret_cast<const T*>(&src)); }
+
+      static void relocate(storage_type &dst, storage_type &src) noexcept
+      {
+        T &x = *reinterpret_cast<T*>(&src);
+        new (&dst) T(std::move(x));
+        x.~T();
+      }
+
+      static void destroy(storage_type &s) noexcept
+      { reinterpret_cast<T*>(&s)->~T(); }
+
+      static const std::type_info &target_type() noexcept
+      { return typeid(T); }
+
+      static const vtable_type vtable;
+    };
+
+    struct empty_operations
+    {
+      static Result invoke(storage_type &, Arguments...)
+      { throw bad_function_call(); }
+
+      static void copy(storage_type &, const storage_type &)
+      { }
+
+      static void relocate(storage_type &, storage_type &) noexcept
+      { }
+
+      static void destroy(storage_type &) noexcept
+      { }
+
+      static const std::type_info &target_type() noexcept
+      { return typeid(void); }
+
+      static const vtable_type vtable;
+    };
+
+    template<typename T>
+    using enable_if_callable = typename std::enable_if<
+      !std::is_same<typename std::decay<T>::type, inplace_function>::value
+      && (std::is_void<Result>::value
+        || std::is_convertible<typename std::result_of<
+          typename std::decay<T>::type &(Arguments...)>::type, Result>::value)
+      >::type;
+
+  public:
+
+    /** @brief Construct an empty inplace_function */
+    inplace_function() noexcept
+      : m_vtable(&empty_operations::vtable)
+    { }
+
+    /** @brief Construct an empty inplace_function */
+    inplace_function(std::nullptr_t) noexcept
+      : inplace_function()
+    { }
+
+    /**
+     * @brief Construct with a callable
+     * @note The callable must fit into Capacity bytes and be nothrow move
+     * constructible, otherwise the construction is ill-formed
+     */
+    template<typename T, typename = enable_if_callable<T>>
+    inplace_function(T &&t)
+      noexcept(std::is_nothrow_constructible<typename std::decay<T>::type,
+        T&&>::value)
+      : m_vtable(&operations<typename std::decay<T>::type>::vtable)
+    {
+      using functor = typename std::decay<T>::type;
+      static_assert(sizeof(functor) <= Capacity,
+          "The callable is too large for this inplace_function");
+      static_assert(Alignment % alignof(functor) == 0,
+          "The callable is over aligned for this inplace_function");
+      static_assert(std::is_nothrow_move_constructible<functor>::value,
+          "The callable must be nothrow move constructible");
+      new (&m_storage) functor(std::forward<T>(t));
+    }
+
+    inplace_function(const inplace_function &other)
+      : m_vtable(other.m_vtable)
+    { m_vtable->copy(m_storage, other.m_storage); }
+
+    inplace_function(inplace_function &&other) noexcept
+      : m_vtable(other.m_vtable)
+    {
+      m_vtable->relocate(m_storage, other.m_storage);
+      other.m_vtable = &empty_operations::vtable;
+    }
+
+    ~inplace_function()
+    { m_vtable->destroy(m_storage); }
+
+    inplace_function &operator = (const inplace_function &other)
+    {
+      if (this != &other)
+      {
+        inplace_function tmp(other);
+        swap(tmp);
+      }
+      return *this;
+    }
+
+    inplace_function &operator = (inplace_function &&other) noexcept
+    {
+      if (this != &other)
+      {
+        m_vtable->destroy(m_storage);
+        m_vtable = other.m_vtable;
+        m_vtable->relocate(m_storage, other.m_storage);
+        other.m_vtable = &empty_operations::vtable;
+      }
+      return *this;
+    }
+
+    inplace_function &operator = (std::nullptr_t) noexcept
+    {
+      m_vtable->destroy(m_storage);
+      m_vtable = &empty_operations::vtable;
+      return *this;
+    }
+
+    template<typename T, typename = enable_if_callable<T>>
+    inplace_function &operator = (T &&t)
+    {
+      inplace_function tmp(std::forward<T>(t));
+      swap(tmp);
+      return *this;
+    }
+
+    /** @brief Call the stored callable, throw bad_function_call if empty */
+    Result operator () (Arguments... arguments) const
+    {
+      return m_vtable->invoke(m_storage,
+          std::forward<Arguments>(arguments)...);
+    }
+
+    /** @brief Test if a callable is stored */
+    explicit operator bool () const noexcept
+    { return m_vtable != &empty_operations::vtable; }
+
+    /** @brief Get type_info of the stored callable, typeid(void) if empty */
+    const std::type_info &target_type() const noexcept
+    { return m_vtable->target_type(); }
+
+    /** @brief Get pointer to the stored callable if its type is T */
+    template<typename T>
+    T *target() noexcept
+    {
+      if (m_vtable != &operations<T>::vtable)
+        return nullptr;
+      return reinterpret_cast<T*>(&m_storage);
+    }
+
+    /** @brief Get pointer to the stored callable if its type is T */
+    template<typename T>
+    const T *target() const noexcept
+    {
+      if (m_vtable != &operations<T>::vtable)
+        return nullptr;
+      return reinterpret_cast<const T*>(&m_storage);
+    }
+
+    /** @brief Swap with another inplace_function */
+    void swap(inplace_function &other) noexcept
+    {
+      if (this == &other)
+        return;
+      storage_type tmp;
+      m_vtable->relocate(tmp, m_storage);
+      other.m_vtable->relocate(m_storage, other.m_storage);
+      m_vtable->relocate(other.m_storage, tmp);
+      std::swap(m_vtable, other.m_vtable);
+    }
+
+  private:
+    const vtable_type *m_vtable;
+    mutable storage_type m_storage;
+  };
+
+  template<typename Result, typename ...Arguments,
+    std::size_t Capacity, std::size_t Alignment>
+  template<typename T>
+  const typename inplace_function<Result (Arguments...), Capacity, Alignment>
+    ::vtable_type
+  inplace_function<Result (Arguments...), Capacity, Alignment>
+    ::operations<T>::vtable =
+  {
+    &operations<T>::invoke,
+    &operations<T>::copy,
+    &operations<T>::relocate,
+    &operations<T>::destroy,
+    &operations<T>::target_type
+  };
+
+  template<typename Result, typename ...Arguments,
+    std::size_t Capacity, std::size_t Alignment>
+  const typename inplace_function<Result (Arguments...), Capacity, Alignment>
+    ::vtable_type
+  inplace_function<Result (Arguments...), Capacity, Alignment>
+    ::empty_operations::vtable =
+  {
+    &empty_operations::invoke,
+    &empty_operations::copy,
+    &empty_operations::relocate,
+    &empty_operations::destroy,
+    &empty_operations::target_type
+  };
+
+  template<typename Signature, std::size_t Capacity, std::size_t Alignment>
+  void swap(inplace_function<Signature, Capacity, Alignment> &lhs,
+      inplace_function<Signature, Capacity, Alignment> &rhs) noexcept
+  { lhs.swap(rhs); }
+
+  template<typename Signature, std::size_t Capacity, std::size_t Alignment>
+  bool operator == (const inplace_function<Signature, Capacity, Alignment> &f,
+      std::nullptr_t) noexcept
+  { return !f; }
+
+  template<typename Signature, std::size_t Capacity, std::size_t Alignment>
+  bool operator != (const inplace_function<Signature, Capacity, Alignment> &f,
+      std::nullptr_t) noexcept
+  { return static_cast<bool>(f); }
+}
+
+#endif
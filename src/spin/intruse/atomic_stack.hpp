@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INTRUSE_ATOMIC_STACK_HPP_INCLUDED__
+#define __SPIN_INTRUSE_ATOMIC_STACK_HPP_INCLUDED__
+
+#include <spin/intruse/slist.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+namespace spin
+{
+  namespace intruse
+  {
+    /**
+     * @brief Lock-free intrusive stack of slist_node
+     *
+     * The top pointer is tagged with a counter which is bumped by every
+     * modification, so that a pop racing with pops and pushes of the same
+     * node fails its compare and swap instead of corrupting the stack. On
+     * 64-bit platforms the pointer takes the low 48 bits and the tag takes
+     * the high 16 bits, which assumes user space addresses fit in 48 bits,
+     * as they do on x86-64 and AArch64 unless an address above is asked
+     * for explicitly, e.g. by a hint to mmap with 5-level paging.
+     *
+     * The bottom node links to a static sentinel rather than nullptr, so
+     * that every node in the stack is seen linked by slist_node::is_linked.
+     *
+     * A pop reads the link of the top node, so nodes popped by one thread
+     * may not be destroyed while other threads may be popping, unless
+     * they are destroyed through epoch::retire.
+     */
+    template<typename T, typename Tag>
+    class atomic_stack
+    {
+      using tagged_type = std::uint64_t;
+
+      static_assert(sizeof(void *) == 4 || sizeof(void *) == 8,
+          "atomic_stack requires 32-bit or 64-bit pointers");
+
+      static constexpr unsigned pointer_bits = sizeof(void *) == 8 ? 48 : 32;
+
+      static constexpr tagged_type pointer_mask
+        = (tagged_type(1) << pointer_bits) - 1;
+
+    public:
+      using value_type = T;
+      using reference = T &;
+      using pointer = T *;
+      using node_type = slist_node<T, Tag>;
+      using list_type = slist<T, Tag>;
+
+      atomic_stack() noexcept
+        : m_top(reinterpret_cast<std::uintptr_t>(get_end()))
+      { }
+
+      /** @brief Destructor, unlink all nodes */
+      ~atomic_stack() noexcept
+      { pop_all(); }
+
+      atomic_stack(const atomic_stack &) = delete;
+
+      atomic_stack &operator = (const atomic_stack &) = delete;
+
+      bool empty() const noexcept
+      {
+        return get_pointer(m_top.load(std::memory_order_acquire))
+          == get_end();
+      }
+
+      /** @brief Push an unlinked node, may be called by any thread */
+      void push(reference ref) noexcept
+      {
+        node_type &n = ref;
+        assert (!node_type::is_linked(n));
+        push(&n, &n);
+      }
+
+      /**
+       * @brief Push all nodes of @a l at once, the front of @a l becomes
+       * the top
+       */
+      void push(list_type &l) noexcept
+      {
+        if (l.empty())
+          return;
+        node_type *first = l.m_head.next(), *last = l.m_tail;
+        last->set_next(nullptr);
+        l.m_head.set_next(&l.m_head);
+        l.m_tail = &l.m_head;
+        push(first, last);
+      }
+
+      /**
+       * @brief Pop the top node, may be called by any thread
+       * @returns nullptr if the stack is empty
+       */
+      pointer pop() noexcept
+      {
+        auto top = m_top.load(std::memory_order_acquire);
+        node_type *n;
+        do
+        {
+          n = get_pointer(top);
+          if (n == get_end())
+            return nullptr;
+        }
+        while (!m_top.compare_exchange_weak(top,
+              make_tagged(n->next(), top), std::memory_order_acquire,
+              std::memory_order_acquire));
+        n->set_next(nullptr);
+        return static_cast<pointer>(n);
+      }
+
+      /**
+       * @brief Pop all nodes at once, may be called by any thread
+       * @returns The popped nodes, the former top is at front
+       */
+      list_type pop_all() noexcept
+      {
+        auto top = m_top.load(std::memory_order_relaxed);
+        while (get_pointer(top) != get_end()
+            && !m_top.compare_exchange_weak(top, make_tagged(get_end(), top),
+              std::memory_order_acquire, std::memory_order_relaxed))
+          ;
+
+        list_type ret;
+        node_type *first = get_pointer(top);
+        if (first != get_end())
+        {
+          node_type *last = first;
+          while (last->next() != get_end())
+            last = last->next();
+          ret.assign(first, last);
+        }
+        return ret;
+      }
+
+    private:
+      /** @brief The sentinel linked by the bottom node */
+      static node_type *get_end() noexcept
+      { return &s_end; }
+
+      static node_type *get_pointer(tagged_type x) noexcept
+      {
+        return reinterpret_cast<node_type *>(
+            static_cast<std::uintptr_t>(x & pointer_mask));
+      }
+
+      /** @brief Tag @a n with the tag of @a prev plus one */
+      static tagged_type make_tagged(node_type *n, tagged_type prev) noexcept
+      {
+        assert ((reinterpret_cast<std::uintptr_t>(n) & ~pointer_mask) == 0);
+        return (reinterpret_cast<std::uintptr_t>(n) & pointer_mask)
+          | (((prev >> pointer_bits) + 1) << pointer_bits);
+      }
+
+      /** @brief Push chain from @a first to @a last */
+      void push(node_type *first, node_type *last) noexcept
+      {
+        auto top = m_top.load(std::memory_order_relaxed);
+        do
+          last->set_next(get_pointer(top));
+        while (!m_top.compare_exchange_weak(top, make_tagged(first, top),
+              std::memory_order_release, std::memory_order_relaxed));
+      }
+
+      static node_type s_end;
+      std::atomic<tagged_type> m_top;
+    };
+
+    template<typename T, typename Tag>
+    typename atomic_stack<T, Tag>::node_type atomic_stack<T, Tag>::s_end;
+  }
+}
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INTRUSE_CONCURRENT_SKIPLIST_HPP_INCLUDED__
+#define __SPIN_INTRUSE_CONCURRENT_SKIPLIST_HPP_INCLUDED__
+
+#include <spin/epoch.hpp>
+#include <spin/functional.hpp>
+#include <spin/routine.hpp>
+#include <spin/utils.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+namespace spin
+{
+  namespace intruse
+  {
+    template<typename Index, typename Type, typename Tag = Type,
+      typename Comparator = less<Index>>
+    class concurrent_skiplist;
+
+    /**
+     * @brief Node of concurrent_skiplist
+     *
+     * The index is immutable since readers compare it without any lock. The
+     * tower of forward links is allocated when the node is inserted, and is
+     * released after the node is erased and its grace period has elapsed,
+     * the node may not be destructed or inserted again before that.
+     */
+    template<typename Index, typename Type, typename Tag = Type>
+    class concurrent_skiplist_node
+    {
+      template<typename, typename, typename, typename>
+      friend class concurrent_skiplist;
+    public:
+
+      explicit concurrent_skiplist_node(Index index)
+        : m_index(std::move(index))
+        , m_height(0)
+        , m_next(nullptr)
+      { }
+
+      ~concurrent_skiplist_node() noexcept
+      { assert(m_next == nullptr); }
+
+      concurrent_skiplist_node(const concurrent_skiplist_node &) = delete;
+
+      concurrent_skiplist_node &operator = (const concurrent_skiplist_node &)
+        = delete;
+
+      static const Index &get_index(const concurrent_skiplist_node &node)
+        noexcept
+      { return node.m_index; }
+
+      /**
+       * @brief Test if a node is linked into a list, or is erased but not
+       * yet reclaimed
+       */
+      static bool is_linked(const concurrent_skiplist_node &node) noexcept
+      { return node.m_next != nullptr; }
+
+    private:
+      const Index m_index;
+      std::size_t m_height;
+      std::atomic<concurrent_skiplist_node *> *m_next;
+    };
+
+    /**
+     * @brief Ordered index with lock-free readers and serialized writers
+     *
+     * Lookups and iteration never lock nor write to shared memory, but they
+     * must be performed in an epoch::guard and the returned nodes are only
+     * valid in that guard. Writers are serialized by a mutex, an inserted
+     * node is published level by level from bottom, so a reader either
+     * reaches it or skips it. An erased node keeps its forward links for the
+     * readers still on it, and is reclaimed through epoch::retire.
+     */
+    template<typename Index, typename Type, typename Tag,
+      typename Comparator>
+    class concurrent_skiplist
+    {
+      using node_type = concurrent_skiplist_node<Index, Type, Tag>;
+      using link_type = std::atomic<node_type *>;
+    public:
+
+      /** @brief Maximum height of tower, enough for 4^16 nodes */
+      static constexpr std::size_t max_height = 16;
+
+      concurrent_skiplist() noexcept
+        : m_height(1)
+        , m_padding()
+        , m_mutex()
+        , m_size(0)
+        , m_seed(0x9e3779b97f4a7c15ULL)
+      {
+        for (auto &link : m_head)
+          link.store(nullptr, std::memory_order_relaxed);
+      }
+
+      /**
+       * @brief Destruct the list, no reader may access it any more, nodes
+       * still linked are released immediately
+       */
+      ~concurrent_skiplist() noexcept
+      {
+        auto *x = m_head[0].load(std::memory_order_relaxed);
+        while (x != nullptr)
+        {
+          auto *next = x->m_next[0].load(std::memory_order_relaxed);
+          release(*x);
+          x = next;
+        }
+      }
+
+      concurrent_skiplist(const concurrent_skiplist &) = delete;
+
+      concurrent_skiplist &operator = (const concurrent_skiplist &) = delete;
+
+      /** @brief Find the node with index equal to @a index, or nullptr */
+      Type *find(const Index &index) const
+      {
+        auto *x = search(index);
+        if (x == nullptr || cmper(index, x->m_index))
+          return nullptr;
+        return cast(x);
+      }
+
+      /** @brief Find the first node with index not less than @a index */
+      Type *lower_bound(const Index &index) const
+      { return cast(search(index)); }
+
+      /** @brief Find the first node with index greater than @a index */
+      Type *upper_bound(const Index &index) const
+      {
+        auto *x = search(index);
+        if (x != nullptr && !cmper(index, x->m_index))
+          x = x->m_next[0].load(std::memory_order_acquire);
+        return cast(x);
+      }
+
+      /** @brief Get the first node, or nullptr if list is empty */
+      Type *front() const noexcept
+      { return cast(m_head[0].load(std::memory_order_acquire)); }
+
+      /** @brief Get the node next to @a x, or nullptr if @a x is the last */
+      static Type *next(const Type &x) noexcept
+      {
+        const node_type &n = x;
+        return cast(n.m_next[0].load(std::memory_order_acquire));
+      }
+
+      /** @brief Test if this list is empty */
+      bool empty() const noexcept
+      { return m_head[0].load(std::memory_order_acquire) == nullptr; }
+
+      /** @brief Get the number of nodes, may be stale for readers */
+      std::size_t size() const noexcept
+      { return m_size.load(std::memory_order_relaxed); }
+
+      /**
+       * @brief Insert a node
+       * @returns false if there is already a node with equivalent index
+       */
+      bool insert(Type &x)
+      {
+        node_type &n = x;
+        assert(n.m_next == nullptr);
+        std::lock_guard<std::mutex> guard(m_mutex);
+        link_type *preds[max_height];
+        auto *succ = search_for_update(n.m_index, preds);
+        if (succ != nullptr && !cmper(n.m_index, succ->m_index))
+          return false;
+
+        auto height = random_height();
+        auto *tower = new link_type[height];
+        for (std::size_t i = 0; i < height; ++i)
+          tower[i].store(preds[i]->load(std::memory_order_relaxed),
+              std::memory_order_relaxed);
+        n.m_height = height;
+        n.m_next = tower;
+
+        for (std::size_t i = 0; i < height; ++i)
+          preds[i]->store(&n, std::memory_order_release);
+        if (height > m_height.load(std::memory_order_relaxed))
+          m_height.store(height, std::memory_order_release);
+        m_size.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+
+      /**
+       * @brief Erase a node
+       * @param x The node to be erased
+       * @param on_reclaimed Called after the grace period of @a x, since
+       * then @a x may be destructed or inserted again
+       * @returns false if @a x is not in this list
+       */
+      bool erase(Type &x, routine<> on_reclaimed = routine<>())
+      {
+        node_type &n = x;
+        {
+          std::lock_guard<std::mutex> guard(m_mutex);
+          if (n.m_next == nullptr)
+            return false;
+          link_type *preds[max_height];
+          if (search_for_update(n.m_index, preds) != &n)
+            return false;
+
+          // Unlinking from the bottom level is the point of erasure
+          for (auto i = n.m_height; i-- != 0; )
+            preds[i]->store(n.m_next[i].load(std::memory_order_relaxed),
+                std::memory_order_release);
+
+          auto height = m_height.load(std::memory_order_relaxed);
+          while (height > 1
+              && m_head[height - 1].load(std::memory_order_relaxed) == nullptr)
+            --height;
+          m_height.store(height, std::memory_order_relaxed);
+          m_size.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        node_type *p = &n;
+        epoch::retire([p, on_reclaimed] {
+          release(*p);
+          on_reclaimed();
+        });
+        return true;
+      }
+
+    private:
+      static Type *cast(node_type *x) noexcept
+      { return static_cast<Type *>(x); }
+
+      static void release(node_type &n) noexcept
+      {
+        delete[] n.m_next;
+        n.m_next = nullptr;
+        n.m_height = 0;
+      }
+
+      /** @brief Find the first node not less than @a index */
+      node_type *search(const Index &index) const
+      {
+        assert(epoch::is_active());
+        const link_type *links = m_head;
+        node_type *x = nullptr;
+        for (auto i = m_height.load(std::memory_order_acquire); i-- != 0; )
+        {
+          x = links[i].load(std::memory_order_acquire);
+          while (x != nullptr && cmper(x->m_index, index))
+          {
+            links = x->m_next;
+            x = links[i].load(std::memory_order_acquire);
+          }
+        }
+        return x;
+      }
+
+      /**
+       * @brief Find the first node not less than @a index, and the link to
+       * be updated at each level, called by writer only
+       */
+      node_type *search_for_update(const Index &index, link_type **preds)
+      {
+        link_type *links = m_head;
+        node_type *x = nullptr;
+        for (auto i = max_height; i-- != 0; )
+        {
+          x = links[i].load(std::memory_order_relaxed);
+          while (x != nullptr && cmper(x->m_index, index))
+          {
+            links = x->m_next;
+            x = links[i].load(std::memory_order_relaxed);
+          }
+          preds[i] = &links[i];
+        }
+        return x;
+      }
+
+      /** @brief Geometric distribution with p = 1/4 */
+      std::size_t random_height() noexcept
+      {
+        m_seed ^= m_seed << 13;
+        m_seed ^= m_seed >> 7;
+        m_seed ^= m_seed << 17;
+        std::size_t height = 1;
+        for (auto bits = m_seed; height < max_height && (bits & 3) == 0;
+            bits >>= 2)
+          ++height;
+        return height;
+      }
+
+      static Comparator cmper;
+
+      // Read by readers
+      link_type m_head[max_height];
+      std::atomic_size_t m_height;
+      char m_padding[cache_line_size];
+
+      // Owned by writers
+      std::mutex m_mutex;
+      std::atomic_size_t m_size;
+      std::uint64_t m_seed;
+    };
+
+    template<typename Index, typename Type, typename Tag, typename Comparator>
+    constexpr std::size_t
+    concurrent_skiplist<Index, Type, Tag, Comparator>::max_height;
+
+    template<typename Index, typename Type, typename Tag, typename Comparator>
+    Comparator concurrent_skiplist<Index, Type, Tag, Comparator>::cmper;
+  }
+}
+
+#endif
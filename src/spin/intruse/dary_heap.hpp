@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INTRUSE_DARY_HEAP_HPP_INCLUDED__
+#define __SPIN_INTRUSE_DARY_HEAP_HPP_INCLUDED__
+
+#include <spin/functional.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace spin
+{
+  namespace intruse
+  {
+    template<typename Index, typename Type, typename Tag = void,
+      typename Comparator = less<Index>, std::size_t Arity = 4>
+    class dary_heap_node;
+
+    template<typename Index, typename Type, typename Tag = void,
+      typename Comparator = less<Index>, std::size_t Arity = 4>
+    class dary_heap;
+
+    /**
+     * @brief Node of dary_heap
+     *
+     * A node records its position in the heap array, so it can be removed
+     * or repositioned in logarithmic time; it unlinks itself from the heap
+     * when it's destructed.
+     */
+    template<typename Index, typename Type, typename Tag,
+      typename Comparator, std::size_t Arity>
+    class dary_heap_node
+    {
+      friend class dary_heap<Index, Type, Tag, Comparator, Arity>;
+      using heap_type = dary_heap<Index, Type, Tag, Comparator, Arity>;
+
+    public:
+      explicit dary_heap_node(Index index)
+        noexcept(std::is_nothrow_move_constructible<Index>::value)
+        : m_index(std::move(index))
+        , m_heap(nullptr)
+        , m_position(0)
+      { }
+
+      /** @brief Move constructor, @a n is replaced by this node */
+      dary_heap_node(dary_heap_node &&n)
+        noexcept(std::is_nothrow_move_constructible<Index>::value)
+        : m_index(std::move(n.m_index))
+        , m_heap(n.m_heap)
+        , m_position(n.m_position)
+      {
+        if (m_heap != nullptr)
+          m_heap->m_entries[m_position].m_node = this;
+        n.m_heap = nullptr;
+      }
+
+      dary_heap_node(const dary_heap_node &) = delete;
+
+      dary_heap_node &operator = (const dary_heap_node &) = delete;
+
+      ~dary_heap_node() noexcept
+      { unlink(*this); }
+
+      static const Index &get_index(const dary_heap_node &node) noexcept
+      { return node.m_index; }
+
+      /** @brief Test if a node is linked into a heap */
+      static bool is_linked(const dary_heap_node &node) noexcept
+      { return node.m_heap != nullptr; }
+
+      /**
+       * @brief Unlink a node from its heap
+       * @returns Whether the node was linked
+       */
+      static bool unlink(dary_heap_node &node) noexcept;
+
+      /**
+       * @brief Update index of a node, and reposition it if it's linked
+       * @returns The old index
+       */
+      static Index update_index(dary_heap_node &node, Index index);
+
+    private:
+      Index m_index;
+      heap_type *m_heap;
+      std::size_t m_position;
+    };
+
+    /**
+     * @brief Intrusive d-ary heap with index, the least node is at top
+     *
+     * Indexes are copied into the heap array beside pointers to the nodes,
+     * so comparisons during sifting don't touch the nodes. push and update
+     * take O(log n) time but usually stop early, top takes constant time,
+     * pop and erase take O(d log n / log d) time. With the default arity,
+     * children of a node with 8-byte index fit in one cache line. The array
+     * only reallocates when it grows, reserve() avoids that.
+     */
+    template<typename Index, typename Type, typename Tag,
+      typename Comparator, std::size_t Arity>
+    class dary_heap
+    {
+      static_assert(Arity >= 2, "Arity of dary_heap must be at least 2");
+      friend class dary_heap_node<Index, Type, Tag, Comparator, Arity>;
+
+    public:
+      using node_type = dary_heap_node<Index, Type, Tag, Comparator, Arity>;
+      using value_type = Type;
+      using reference = value_type &;
+      using const_reference = const value_type &;
+      using size_type = std::size_t;
+
+      dary_heap() = default;
+
+      /** @brief Move constructor, takes linear time */
+      dary_heap(dary_heap &&h) noexcept
+        : m_entries(std::move(h.m_entries))
+      {
+        h.m_entries.clear();
+        adopt();
+      }
+
+      dary_heap(const dary_heap &) = delete;
+
+      dary_heap &operator = (dary_heap &&h) noexcept
+      {
+        if (&h != this)
+        {
+          clear();
+          m_entries.swap(h.m_entries);
+          adopt();
+        }
+        return *this;
+      }
+
+      dary_heap &operator = (const dary_heap &) = delete;
+
+      ~dary_heap() noexcept
+      { clear(); }
+
+      bool empty() const noexcept
+      { return m_entries.empty(); }
+
+      size_type size() const noexcept
+      { return m_entries.size(); }
+
+      /** @brief Preallocate the array for @a n nodes */
+      void reserve(size_type n)
+      { m_entries.reserve(n); }
+
+      /** @brief Get the least node */
+      reference top() noexcept
+      { return cast(m_entries.front().m_node); }
+
+      /** @brief Get the least node */
+      const_reference top() const noexcept
+      { return cast(m_entries.front().m_node); }
+
+      /**
+       * @brief Insert a node, which will be unlinked first
+       * @throws std::bad_alloc if the array failed to grow, the heap and
+       * the node are left unchanged
+       */
+      void push(Type &x)
+      {
+        node_type &n = x;
+        if (m_entries.size() == m_entries.capacity())
+          m_entries.reserve(m_entries.size() * 2 + 1);
+        node_type::unlink(n);
+        m_entries.push_back(entry(n.m_index, &n));
+        n.m_heap = this;
+        sift_up(m_entries.size() - 1);
+      }
+
+      /** @brief Unlink the least node */
+      void pop() noexcept
+      { erase_at(0); }
+
+      /** @brief Unlink a node in this heap */
+      void erase(Type &x) noexcept
+      { erase_at(static_cast<node_type &>(x).m_position); }
+
+      /**
+       * @brief Update index of a node in this heap
+       * @returns The old index
+       */
+      Index update_index(Type &x, Index index)
+      { return node_type::update_index(x, std::move(index)); }
+
+      /** @brief Unlink all nodes */
+      void clear() noexcept
+      {
+        for (auto &e : m_entries)
+          e.m_node->m_heap = nullptr;
+        m_entries.clear();
+      }
+
+      void swap(dary_heap &h) noexcept
+      {
+        m_entries.swap(h.m_entries);
+        adopt();
+        h.adopt();
+      }
+
+    private:
+      struct entry
+      {
+        entry(const Index &index, node_type *node)
+          : m_index(index)
+          , m_node(node)
+        { }
+
+        Index m_index;
+        node_type *m_node;
+      };
+
+      static reference cast(node_type *n) noexcept
+      { return static_cast<Type &>(*n); }
+
+      /** @brief Point all nodes to this heap */
+      void adopt() noexcept
+      {
+        for (auto &e : m_entries)
+          e.m_node->m_heap = this;
+      }
+
+      /** @brief Store @a e at @a pos */
+      void place(std::size_t pos, entry &&e) noexcept
+      {
+        e.m_node->m_position = pos;
+        m_entries[pos] = std::move(e);
+      }
+
+      /** @brief Move entry at @a pos up until its parent is not greater */
+      void sift_up(std::size_t pos) noexcept
+      {
+        entry e(std::move(m_entries[pos]));
+        while (pos > 0)
+        {
+          auto parent = (pos - 1) / Arity;
+          if (!cmper(e.m_index, m_entries[parent].m_index))
+            break;
+          place(pos, std::move(m_entries[parent]));
+          pos = parent;
+        }
+        place(pos, std::move(e));
+      }
+
+      /** @brief Move entry at @a pos down until no child is less */
+      void sift_down(std::size_t pos) noexcept
+      {
+        entry e(std::move(m_entries[pos]));
+        auto size = m_entries.size();
+        for ( ; ; )
+        {
+          auto first = pos * Arity + 1;
+          if (first >= size)
+            break;
+          auto last = first + Arity < size ? first + Arity : size;
+          auto least = first;
+          for (auto i = first + 1; i < last; ++i)
+            if (cmper(m_entries[i].m_index, m_entries[least].m_index))
+              least = i;
+          if (!cmper(m_entries[least].m_index, e.m_index))
+            break;
+          place(pos, std::move(m_entries[least]));
+          pos = least;
+        }
+        place(pos, std::move(e));
+      }
+
+      /** @brief Restore the heap property after entry at @a pos changed */
+      void fix(std::size_t pos) noexcept
+      {
+        if (pos > 0 && cmper(m_entries[pos].m_index,
+              m_entries[(pos - 1) / Arity].m_index))
+          sift_up(pos);
+        else
+          sift_down(pos);
+      }
+
+      /** @brief Unlink the node at @a pos */
+      void erase_at(std::size_t pos) noexcept
+      {
+        m_entries[pos].m_node->m_heap = nullptr;
+        auto last = m_entries.size() - 1;
+        if (pos != last)
+        {
+          place(pos, std::move(m_entries[last]));
+          m_entries.pop_back();
+          fix(pos);
+        }
+        else
+          m_entries.pop_back();
+      }
+
+      static Comparator cmper;
+
+      std::vector<entry> m_entries;
+    };
+
+    template<typename Index, typename Type, typename Tag,
+      typename Comparator, std::size_t Arity>
+    Comparator dary_heap<Index, Type, Tag, Comparator, Arity>::cmper;
+
+    template<typename Index, typename Type, typename Tag,
+      typename Comparator, std::size_t Arity>
+    bool dary_heap_node<Index, Type, Tag, Comparator, Arity>
+      ::unlink(dary_heap_node &node) noexcept
+    {
+      if (node.m_heap == nullptr)
+        return false;
+      node.m_heap->erase_at(node.m_position);
+      return true;
+    }
+
+    template<typename Index, typename Type, typename Tag,
+      typename Comparator, std::size_t Arity>
+    Index dary_heap_node<Index, Type, Tag, Comparator, Arity>
+      ::update_index(dary_heap_node &node, Index index)
+    {
+      std::swap(index, node.m_index);
+      if (node.m_heap != nullptr)
+      {
+        auto &e = node.m_heap->m_entries[node.m_position];
+        e.m_index = node.m_index;
+        node.m_heap->fix(node.m_position);
+      }
+      return index;
+    }
+
+  }
+}
+
+#endif
@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INTRUSE_HASH_TABLE_HPP_INCLUDED__
+#define __SPIN_INTRUSE_HASH_TABLE_HPP_INCLUDED__
+
+#include <spin/environment.hpp>
+#include <spin/functional.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace spin
+{
+  namespace intruse
+  {
+    template<typename Index, typename Type, typename ...Tags>
+    class hash_table_node;
+
+    template<typename Index, typename Type, typename Tag, bool IsConst>
+    class hash_table_iterator;
+
+    template<typename Index, typename Type, typename Tag = void,
+      typename Hash = std::hash<Index>, typename KeyEqual = equals_to<Index>>
+    class hash_table;
+
+    /**
+     * @brief hash_table_node specialization for void index type, which
+     * links a node into one hash_table and hides the implementation detail
+     *
+     * Buckets are singly linked chains, but each node keeps the address of
+     * the pointer pointing to it so that it can unlink itself in constant
+     * time. Each node also caches the hash value of its index, so that
+     * rehashing never calls the hash function again.
+     */
+    template<>
+    class __SPIN_EXPORT__ hash_table_node<void, void>
+    {
+      template<typename, typename, typename...>
+      friend class hash_table_node;
+
+      template<typename, typename, typename, typename, typename>
+      friend class hash_table;
+
+      template<typename, typename, typename, bool>
+      friend class hash_table_iterator;
+
+    public:
+      class table;
+
+      template<typename Tag>
+      class link;
+
+      template<typename Index>
+      class index_holder;
+
+      template<typename ...Tags>
+      struct links;
+
+      /** @brief Test if a node is linked into a table */
+      static bool is_linked(const hash_table_node &node) noexcept
+      { return node.m_pprev != nullptr; }
+
+      /**
+       * @brief Unlink a node from its table
+       * @returns Whether the node was linked
+       */
+      static bool unlink(hash_table_node &node) noexcept;
+
+    protected:
+
+      /** @brief Default constructor */
+      hash_table_node() noexcept
+        : m_next(nullptr)
+        , m_pprev(nullptr)
+        , m_table(nullptr)
+        , m_hash(0)
+      { }
+
+      /** @brief Move constructor, @a n is replaced by this node */
+      hash_table_node(hash_table_node &&n) noexcept;
+
+      /** @brief Assign operator overload for rvalue */
+      hash_table_node &operator = (hash_table_node &&n) noexcept;
+
+      hash_table_node(const hash_table_node &) = delete;
+
+      hash_table_node &operator = (const hash_table_node &) = delete;
+
+      /** @brief Destructor, unlink this node if it's linked */
+      ~hash_table_node() noexcept
+      { unlink(*this); }
+
+    private:
+      /** @brief Replace linked node @a n with this unlinked node */
+      void take_place(hash_table_node &n) noexcept;
+
+      hash_table_node *m_next;
+      hash_table_node **m_pprev;
+      table *m_table;
+      std::size_t m_hash;
+    };
+
+    /**
+     * @brief Buckets of a hash_table
+     *
+     * The number of buckets is doubled when the number of nodes exceeds it.
+     * Rather than rehashing all nodes at once, the old buckets are kept and
+     * each following insertion moves a few of them to the new buckets, and
+     * the move is finished before the table needs to grow again. A lookup
+     * searches the old bucket if it's not moved yet, or the new one.
+     */
+    class __SPIN_EXPORT__ hash_table_node<void, void>::table
+    {
+      template<typename, typename, typename, typename, typename>
+      friend class hash_table;
+
+      template<typename, typename, typename, bool>
+      friend class hash_table_iterator;
+
+      friend class hash_table_node<void, void>;
+
+    public:
+      table() noexcept;
+
+      /** @brief Move constructor, linear to number of nodes */
+      table(table &&t) noexcept;
+
+      table(const table &) = delete;
+
+      table &operator = (const table &) = delete;
+
+      ~table() noexcept;
+
+      /** @brief Swap two tables, linear to number of nodes */
+      void swap(table &t) noexcept;
+
+      /** @brief Get number of nodes */
+      std::size_t size() const noexcept
+      { return m_size; }
+
+      /** @brief Get number of buckets nodes are inserted into */
+      std::size_t bucket_count() const noexcept
+      { return m_buckets ? std::size_t(1) << m_bits : 0; }
+
+      /** @brief Test if buckets are being moved */
+      bool is_rehashing() const noexcept
+      { return m_old_buckets != nullptr; }
+
+      /** @brief Get the first node of the chain that @a hash belongs to */
+      hash_table_node *chain(std::size_t hash) const noexcept;
+
+      /**
+       * @brief Link a node with specified hash value
+       * @throws std::bad_alloc if buckets can't grow, and nothing is changed
+       */
+      void link(hash_table_node &node, std::size_t hash);
+
+      /** @brief Make the table have at least @a count buckets */
+      void rehash(std::size_t count);
+
+      /** @brief Unlink all nodes */
+      void clear() noexcept;
+
+      /** @brief Get the first node in iteration order */
+      hash_table_node *first() const noexcept;
+
+      /** @brief Get the node after @a node in iteration order */
+      hash_table_node *next(const hash_table_node &node) const noexcept;
+
+    private:
+      static std::size_t bucket_index(std::size_t hash, unsigned bits)
+        noexcept;
+
+      /** @brief Get the bucket the node with @a hash is linked into */
+      hash_table_node **bucket(std::size_t hash) const noexcept;
+
+      /** @brief Find first non-empty bucket since @a index of @a buckets */
+      hash_table_node *scan(hash_table_node **buckets, unsigned bits,
+          std::size_t index) const noexcept;
+
+      /** @brief Move at most @a n old buckets to new buckets */
+      void migrate(std::size_t n) noexcept;
+
+      /** @brief Start moving to @a 2^bits new buckets */
+      void grow(unsigned bits);
+
+      /** @brief Make all nodes refer to this table */
+      void adopt() noexcept;
+
+      hash_table_node **m_buckets;
+      hash_table_node **m_old_buckets;
+      unsigned m_bits;
+      unsigned m_old_bits;
+      std::size_t m_rehash_index;
+      std::size_t m_size;
+    };
+
+    /** @brief Node linked into hash_table with @a Tag */
+    template<typename Tag>
+    class hash_table_node<void, void>::link : public hash_table_node<void, void>
+    {
+    protected:
+      link() = default;
+
+      link(link &&) = default;
+
+      link &operator = (link &&) = default;
+
+      ~link() = default;
+    };
+
+    template<typename ...Tags>
+    struct hash_table_node<void, void>::links
+      : public hash_table_node<void, void>::link<Tags>...
+    { };
+
+    template<>
+    struct hash_table_node<void, void>::links<>
+      : public hash_table_node<void, void>::link<void>
+    { };
+
+    template<typename Index>
+    class hash_table_node<void, void>::index_holder
+    {
+    public:
+      index_holder(Index index)
+        noexcept(std::is_nothrow_move_constructible<Index>::value)
+        : m_index(std::move(index))
+      { }
+
+      static const Index &get_index(const index_holder &x) noexcept
+      { return x.m_index; }
+
+    private:
+      Index m_index;
+    };
+
+    /**
+     * @brief Node of hash_table
+     *
+     * A type can be linked into several hash tables at the same time with
+     * different tags, for example
+     *
+     * @code
+     *  struct session
+     *    : public spin::intruse::hash_table_node<int, session, by_id, by_fd>
+     *  { };
+     *
+     *  spin::intruse::hash_table<int, session, by_id> sessions_by_id;
+     *  spin::intruse::hash_table<int, session, by_fd> sessions_by_fd;
+     * @endcode
+     *
+     * Without tag the node is linked into hash_table<Index, Type>. The index
+     * may not be changed while the node is linked, and the node unlinks
+     * itself from all tables when destructed.
+     */
+    template<typename Index, typename Type, typename ...Tags>
+    class hash_table_node
+      : public hash_table_node<void, void>::index_holder<Index>
+      , public hash_table_node<void, void>::links<Tags...>
+    {
+      using index_holder = hash_table_node<void, void>::index_holder<Index>;
+      using links = hash_table_node<void, void>::links<Tags...>;
+
+      template<typename Tag>
+      using link = hash_table_node<void, void>::link<Tag>;
+
+    public:
+      hash_table_node(Index index)
+        noexcept(std::is_nothrow_move_constructible<Index>::value)
+        : index_holder(std::move(index))
+        , links()
+      { }
+
+      hash_table_node(hash_table_node &&node)
+        noexcept(std::is_nothrow_move_constructible<Index>::value)
+        : index_holder(std::move(node))
+        , links(std::move(node))
+      { }
+
+      ~hash_table_node() = default;
+
+      /** @brief Test if a node is linked into the table of @a Tag */
+      template<typename Tag = void>
+      static bool is_linked(const hash_table_node &node) noexcept
+      {
+        const link<Tag> &ref = node;
+        return hash_table_node<void, void>::is_linked(ref);
+      }
+
+      /** @brief Unlink a node from the table of @a Tag */
+      template<typename Tag = void>
+      static bool unlink(hash_table_node &node) noexcept
+      {
+        link<Tag> &ref = node;
+        return hash_table_node<void, void>::unlink(ref);
+      }
+    };
+
+    template<typename Index, typename Type, typename Tag, bool IsConst>
+    class hash_table_iterator
+    {
+      template<typename, typename, typename, typename, typename>
+      friend class hash_table;
+
+      template<typename, typename, typename, bool>
+      friend class hash_table_iterator;
+
+      using core_type = hash_table_node<void, void>;
+      using table_type = core_type::table;
+      using link_type = core_type::link<Tag>;
+
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = Type;
+      using difference_type = std::ptrdiff_t;
+      using pointer = typename std::conditional<IsConst,
+            const Type *, Type *>::type;
+      using reference = typename std::conditional<IsConst,
+            const Type &, Type &>::type;
+
+      hash_table_iterator() noexcept
+        : m_table(nullptr)
+        , m_node(nullptr)
+      { }
+
+      /** @brief Conversion from iterator to const_iterator */
+      template<bool B, typename = typename std::enable_if<IsConst && !B>::type>
+      hash_table_iterator(const hash_table_iterator<Index, Type, Tag, B> &i)
+        noexcept
+        : m_table(i.m_table)
+        , m_node(i.m_node)
+      { }
+
+      reference operator * () const noexcept
+      { return static_cast<reference>(static_cast<link_type &>(*m_node)); }
+
+      pointer operator -> () const noexcept
+      { return &**this; }
+
+      hash_table_iterator &operator ++ () noexcept
+      {
+        m_node = m_table->next(*m_node);
+        return *this;
+      }
+
+      hash_table_iterator operator ++ (int) noexcept
+      {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+
+      bool operator == (const hash_table_iterator &i) const noexcept
+      { return m_node == i.m_node; }
+
+      bool operator != (const hash_table_iterator &i) const noexcept
+      { return m_node != i.m_node; }
+
+    private:
+      hash_table_iterator(const table_type *t, core_type *n) noexcept
+        : m_table(t)
+        , m_node(n)
+      { }
+
+      const table_type *m_table;
+      core_type *m_node;
+    };
+
+    /**
+     * @brief Intrusive hash table
+     *
+     * Nodes are never allocated by the table, only the bucket array is, so
+     * an insertion allocates only when the table grows, and the table grows
+     * incrementally without rehashing all nodes at once. Indexes are unique
+     * in a table.
+     * @see hash_table_node
+     */
+    template<typename Index, typename Type, typename Tag, typename Hash,
+      typename KeyEqual>
+    class hash_table
+    {
+      using core_type = hash_table_node<void, void>;
+      using link_type = core_type::link<Tag>;
+      using index_holder = core_type::index_holder<Index>;
+
+    public:
+      using iterator = hash_table_iterator<Index, Type, Tag, false>;
+      using const_iterator = hash_table_iterator<Index, Type, Tag, true>;
+      using value_type = Type;
+      using reference = value_type &;
+      using const_reference = const value_type &;
+      using size_type = std::size_t;
+
+      hash_table() noexcept
+        : m_table()
+      { }
+
+      /** @brief Move constructor, linear to number of nodes */
+      hash_table(hash_table &&t) noexcept
+        : m_table(std::move(t.m_table))
+      { }
+
+      hash_table(const hash_table &) = delete;
+
+      hash_table &operator = (hash_table &&t) noexcept
+      {
+        if (&t != this)
+        {
+          clear();
+          m_table.swap(t.m_table);
+        }
+        return *this;
+      }
+
+      hash_table &operator = (const hash_table &) = delete;
+
+      ~hash_table() = default;
+
+      iterator begin() noexcept
+      { return iterator(&m_table, m_table.first()); }
+
+      iterator end() noexcept
+      { return iterator(&m_table, nullptr); }
+
+      const_iterator begin() const noexcept
+      { return const_iterator(&m_table, m_table.first()); }
+
+      const_iterator end() const noexcept
+      { return const_iterator(&m_table, nullptr); }
+
+      const_iterator cbegin() const noexcept
+      { return begin(); }
+
+      const_iterator cend() const noexcept
+      { return end(); }
+
+      bool empty() const noexcept
+      { return m_table.size() == 0; }
+
+      size_type size() const noexcept
+      { return m_table.size(); }
+
+      size_type bucket_count() const noexcept
+      { return m_table.bucket_count(); }
+
+      /** @brief Get an iterator to the node with @a index, or end() */
+      iterator find(const Index &index)
+      { return iterator(&m_table, search(index)); }
+
+      /** @brief Get an iterator to the node with @a index, or end() */
+      const_iterator find(const Index &index) const
+      { return const_iterator(&m_table, search(index)); }
+
+      /** @brief Count nodes with @a index, which is either 0 or 1 */
+      size_type count(const Index &index) const
+      { return search(index) != nullptr; }
+
+      /**
+       * @brief Insert a node
+       * @returns Iterator to the inserted node, or the node with the same
+       * index and false
+       */
+      std::pair<iterator, bool> insert(Type &x)
+      {
+        link_type &node = x;
+        auto hash = hasher(index_of(node));
+        auto *found = search(index_of(node), hash);
+        if (found != nullptr)
+          return std::make_pair(iterator(&m_table, found), false);
+        core_type::unlink(node);
+        m_table.link(node, hash);
+        return std::make_pair(iterator(&m_table, &node), true);
+      }
+
+      /** @brief Unlink the node at @a i, returns the next iterator */
+      iterator erase(const_iterator i) noexcept
+      {
+        auto *next = m_table.next(*i.m_node);
+        core_type::unlink(*i.m_node);
+        return iterator(&m_table, next);
+      }
+
+      /** @brief Unlink the node with @a index, returns number of nodes erased */
+      size_type erase(const Index &index)
+      {
+        auto *found = search(index);
+        if (found == nullptr)
+          return 0;
+        core_type::unlink(*found);
+        return 1;
+      }
+
+      /** @brief Unlink all nodes */
+      void clear() noexcept
+      { m_table.clear(); }
+
+      /** @brief Make the table hold @a count nodes without growing */
+      void reserve(size_type count)
+      { m_table.rehash(count); }
+
+      void swap(hash_table &t) noexcept
+      { m_table.swap(t.m_table); }
+
+    private:
+      static const Index &index_of(const core_type &node) noexcept
+      {
+        const index_holder &ref = static_cast<const Type &>(
+            static_cast<const link_type &>(node));
+        return index_holder::get_index(ref);
+      }
+
+      core_type *search(const Index &index) const
+      { return search(index, hasher(index)); }
+
+      core_type *search(const Index &index, std::size_t hash) const
+      {
+        for (auto *p = m_table.chain(hash); p != nullptr; p = p->m_next)
+          if (p->m_hash == hash && key_equal(index_of(*p), index))
+            return p;
+        return nullptr;
+      }
+
+      static Hash hasher;
+      static KeyEqual key_equal;
+
+      core_type::table m_table;
+    };
+
+    template<typename Index, typename Type, typename Tag, typename Hash,
+      typename KeyEqual>
+    Hash hash_table<Index, Type, Tag, Hash, KeyEqual>::hasher;
+
+    template<typename Index, typename Type, typename Tag, typename Hash,
+      typename KeyEqual>
+    KeyEqual hash_table<Index, Type, Tag, Hash, KeyEqual>::key_equal;
+  }
+}
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INTRUSE_INTERVAL_TREE_HPP_INCLUDED__
+#define __SPIN_INTRUSE_INTERVAL_TREE_HPP_INCLUDED__
+
+#include <spin/intruse/rbtree.hpp>
+
+namespace spin
+{
+  namespace intruse
+  {
+    template<typename Point, typename Type,
+      typename Tag = void, typename Comparator = less<Point>>
+    class interval_tree_node;
+
+    template<typename Point, typename Type,
+      typename Tag = void, typename Comparator = less<Point>>
+    class interval_tree;
+
+    /**
+     * @brief Node of interval_tree, representing half-open interval
+     * [low, high)
+     *
+     * The low endpoint is the index of the underlying rbtree, and each node
+     * keeps the greatest high endpoint in its subtree.
+     * @tparam Point Type of endpoints
+     * @tparam Type The type which inheriats this node
+     * @tparam Tag Tag of the underlying rbtree_node
+     * @tparam Comparator Comparator of endpoints
+     * @see interval_tree
+     */
+    template<typename Point, typename Type, typename Tag, typename Comparator>
+    class interval_tree_node
+      : public rbtree_node<Point, Type, Tag, augmented<Comparator,
+          interval_tree_node<Point, Type, Tag, Comparator>>>
+    {
+      friend class interval_tree<Point, Type, Tag, Comparator>;
+
+      using base_node = rbtree_node<Point, Type, Tag, augmented<Comparator,
+          interval_tree_node<Point, Type, Tag, Comparator>>>;
+
+    public:
+
+      /** @brief Construct an interval [low, high) */
+      interval_tree_node(Point low, Point high)
+        : base_node(std::move(low))
+        , m_high(high)
+        , m_max(std::move(high))
+      { }
+
+      /** @brief Get the low endpoint of an interval */
+      static const Point &get_low(const interval_tree_node &node) noexcept
+      { return base_node::get_index(node); }
+
+      /** @brief Get the high endpoint of an interval */
+      static const Point &get_high(const interval_tree_node &node) noexcept
+      { return node.m_high; }
+
+      /** @brief Recompute the greatest high endpoint of subtree */
+      static void update(Type &x, const Type *l, const Type *r) noexcept
+      {
+        interval_tree_node &node = x;
+        node.m_max = node.m_high;
+        if (l != nullptr && cmper(node.m_max, get_max(*l)))
+          node.m_max = get_max(*l);
+        if (r != nullptr && cmper(node.m_max, get_max(*r)))
+          node.m_max = get_max(*r);
+      }
+
+    private:
+
+      static const Point &get_max(const interval_tree_node &node) noexcept
+      { return node.m_max; }
+
+      static Comparator cmper;
+
+      Point m_high;
+      Point m_max;
+    };
+
+    template<typename Point, typename Type, typename Tag, typename Comparator>
+    Comparator interval_tree_node<Point, Type, Tag, Comparator>::cmper;
+
+    /**
+     * @brief Intrusive interval tree
+     *
+     * It's a rbtree ordered by the low endpoints and augmented with the
+     * greatest high endpoint of each subtree, so that subtrees which can't
+     * contain any matching interval are skipped. Reporting k intervals
+     * visits O(min(n, (k + 1) log n)) nodes, and testing if any interval
+     * matches takes O(log n).
+     *
+     * @tparam Point Type of endpoints
+     * @tparam Type The type which inheriats interval_tree_node
+     * @tparam Tag Tag of the underlying rbtree_node
+     * @tparam Comparator Comparator of endpoints
+     * @see interval_tree_node
+     */
+    template<typename Point, typename Type, typename Tag, typename Comparator>
+    class interval_tree
+    {
+      using interval_node_type = interval_tree_node<Point, Type, Tag,
+            Comparator>;
+
+      using tree_type = rbtree<Point, Type, Tag,
+            augmented<Comparator, interval_node_type>>;
+
+    public:
+      using iterator        = typename tree_type::iterator;
+      using const_iterator  = typename tree_type::const_iterator;
+      using value_type      = Type;
+      using size_type       = typename tree_type::size_type;
+
+      /** @brief Default constructor */
+      interval_tree() noexcept
+        : m_tree()
+      { }
+
+      /** @brief Move constructor */
+      interval_tree(interval_tree &&t) noexcept
+        : m_tree(std::move(t.m_tree))
+      { }
+
+      interval_tree(const interval_tree &) = delete;
+
+      interval_tree &operator = (const interval_tree &) = delete;
+
+      ~interval_tree() = default;
+
+      /** @brief Test if this tree is empty */
+      bool empty() const noexcept
+      { return m_tree.empty(); }
+
+      /** @brief Count the intervals in this tree */
+      size_type size() const noexcept
+      { return m_tree.size(); }
+
+      /** @brief Get an iterator to the interval with least low endpoint */
+      iterator begin() noexcept
+      { return m_tree.begin(); }
+
+      /** @brief Get an iterator to the position after the last interval */
+      iterator end() noexcept
+      { return m_tree.end(); }
+
+      /** @brief Insert an interval, duplicated intervals are allowed */
+      iterator insert(Type &x) noexcept(noexcept(std::declval<tree_type&>()
+            .insert(x, policy_backmost)))
+      { return m_tree.insert(x, policy_backmost); }
+
+      /** @brief Remove an interval from this tree */
+      void erase(iterator i) noexcept
+      { m_tree.erase(i); }
+
+      /** @brief Remove all intervals */
+      void clear() noexcept
+      { m_tree.clear(); }
+
+      /**
+       * @brief Find the interval with least low endpoint among those which
+       *        overlap with [@p lo, @p hi)
+       * @returns Iterator to the interval, or end() if there is none
+       */
+      iterator find_overlap(const Point &lo, const Point &hi)
+      {
+        auto *n = get_root();
+        while (n != nullptr)
+        {
+          // If left subtree has an interval end after lo but none of them
+          // overlaps, then all intervals on the right begin after hi
+          if (n->m_has_l && cmper(lo, get_max(n->m_l)))
+            n = n->m_l;
+          else if (!cmper(get_low(n), hi))
+            break;
+          else if (cmper(lo, get_high(n)))
+            return iterator(n);
+          else
+            n = n->m_has_r ? n->m_r : nullptr;
+        }
+        return end();
+      }
+
+      /**
+       * @brief Call @p visitor for each interval overlapping with
+       *        [@p lo, @p hi), in order of low endpoints
+       * @param visitor Functor accepting Type&, it must not modify this tree
+       */
+      template<typename Visitor>
+      void overlap(const Point &lo, const Point &hi, Visitor &&visitor)
+      {
+        auto *root = get_root();
+        if (root != nullptr)
+          visit(root, lo, hi, false, visitor);
+      }
+
+      /**
+       * @brief Call @p visitor for each interval containing @p p, in order
+       *        of low endpoints
+       * @param visitor Functor accepting Type&, it must not modify this tree
+       */
+      template<typename Visitor>
+      void stab(const Point &p, Visitor &&visitor)
+      {
+        auto *root = get_root();
+        if (root != nullptr)
+          visit(root, p, p, true, visitor);
+      }
+
+    private:
+      using node_type = typename tree_type::node_type;
+
+      rbtree_node<void, void> *get_root() noexcept
+      {
+        node_type &ref = *m_tree.end();
+        rbtree_node<void, void> &container = ref;
+        return container.get_root_node_from_container_node();
+      }
+
+      static Type &get_value(rbtree_node<void, void> *n) noexcept
+      { return static_cast<Type&>(*static_cast<node_type*>(n)); }
+
+      static const Point &get_low(rbtree_node<void, void> *n) noexcept
+      { return interval_node_type::get_low(get_value(n)); }
+
+      static const Point &get_high(rbtree_node<void, void> *n) noexcept
+      { return interval_node_type::get_high(get_value(n)); }
+
+      static const Point &get_max(rbtree_node<void, void> *n) noexcept
+      { return interval_node_type::get_max(get_value(n)); }
+
+      /**
+       * @brief Visit intervals in subtree of n which end after lo and begin
+       * before hi, or not after hi if closed is true
+       */
+      template<typename Visitor>
+      static void visit(rbtree_node<void, void> *n, const Point &lo,
+          const Point &hi, bool closed, Visitor &visitor)
+      {
+        if (!cmper(lo, get_max(n)))
+          return;
+
+        if (n->m_has_l)
+          visit(n->m_l, lo, hi, closed, visitor);
+
+        // Intervals on the right begin even later
+        if (closed ? cmper(hi, get_low(n)) : !cmper(get_low(n), hi))
+          return;
+
+        if (cmper(lo, get_high(n)))
+          visitor(get_value(n));
+
+        if (n->m_has_r)
+          visit(n->m_r, lo, hi, closed, visitor);
+      }
+
+      static Comparator cmper;
+
+      tree_type m_tree;
+    };
+
+    template<typename Point, typename Type, typename Tag, typename Comparator>
+    Comparator interval_tree<Point, Type, Tag, Comparator>::cmper;
+  }
+}
+
+#endif
@@ -20,6 +20,7 @@
 
 #include <spin/functional.hpp>
 
+#include <cstddef>
 #include <iterator>
 #include <type_traits>
 
@@ -27,16 +28,115 @@ namespace spin
 {
   namespace intruse
   {
+    /** @brief Policy of list whose size() walks through all nodes */
+    struct list_policy_uncounted {};
+
+    /**
+     * @brief Policy of list whose size() takes constant time
+     *
+     * Each node keeps a pointer to the counter of its list, so that it can
+     * be unlinked without knowing the list. As the pointers have to be
+     * updated, splice and swap take linear time in number of nodes moved.
+     */
+    struct list_policy_counted {};
+
     /* Forward declaration */
-    template<typename Inheriator, typename Tag = Inheriator> class list;
-    template<typename Inheriator, typename Tag = Inheriator> class list_node;
-    template<typename Inheriator, typename Tag> class list_iterator;
+    template<typename Inheriator, typename Tag = Inheriator,
+      typename Policy = list_policy_uncounted> class list;
+    template<typename Inheriator, typename Tag = Inheriator,
+      typename Policy = list_policy_uncounted> class list_node;
+    template<typename Inheriator, typename Tag, typename Policy>
+      class list_iterator;
+    template<typename Inheriator, typename Tag, typename Policy>
+      class list_const_iterator;
+
+    namespace detail
+    {
+      template<typename Policy> class list_counter;
+      template<typename Policy> class list_counted_node;
+
+      /** @brief Nothing is counted for list_policy_uncounted */
+      template<>
+      class list_counter<list_policy_uncounted>
+      {
+      protected:
+        static constexpr bool counted = false;
+      };
+
+      template<>
+      class list_counted_node<list_policy_uncounted>
+      {
+      protected:
+        void attach(list_counter<list_policy_uncounted> &) noexcept
+        { }
+
+        void detach() noexcept
+        { }
+
+        void swap_counter(list_counted_node &) noexcept
+        { }
+      };
+
+      /** @brief Number of nodes of a list with list_policy_counted */
+      template<>
+      class list_counter<list_policy_counted>
+      {
+        friend class list_counted_node<list_policy_counted>;
+      protected:
+        static constexpr bool counted = true;
+
+        list_counter() noexcept
+          : m_count(0)
+        { }
+
+        std::size_t get() const noexcept
+        { return m_count; }
 
-    template<typename Inheriator, typename Tag>
-    class list_node
+      private:
+        std::size_t m_count;
+      };
+
+      template<>
+      class list_counted_node<list_policy_counted>
+      {
+      protected:
+        list_counted_node() noexcept
+          : m_counter(nullptr)
+        { }
+
+        /** @brief Count this node in @a c, and not in previous counter */
+        void attach(list_counter<list_policy_counted> &c) noexcept
+        {
+          if (m_counter == &c)
+            return;
+          detach();
+          m_counter = &c;
+          ++c.m_count;
+        }
+
+        void detach() noexcept
+        {
+          if (m_counter == nullptr)
+            return;
+          --m_counter->m_count;
+          m_counter = nullptr;
+        }
+
+        void swap_counter(list_counted_node &n) noexcept
+        { std::swap(m_counter, n.m_counter); }
+
+      private:
+        list_counter<list_policy_counted> *m_counter;
+      };
+    }
+
+    template<typename Inheriator, typename Tag, typename Policy>
+    class list_node : private detail::list_counted_node<Policy>
     {
-      friend class ::spin::intruse::list<Inheriator, Tag>;
-      friend class ::spin::intruse::list_iterator<Inheriator, Tag>;
+      friend class ::spin::intruse::list<Inheriator, Tag, Policy>;
+      friend class ::spin::intruse::list_iterator<Inheriator, Tag, Policy>;
+      friend class
+        ::spin::intruse::list_const_iterator<Inheriator, Tag, Policy>;
     public:
 
       /**
@@ -60,6 +160,7 @@ namespace spin
         }
         node.m_prev = nullptr;
         node.m_next = nullptr;
+        node.detach();
         return ret;
       }
 
@@ -112,6 +213,7 @@ namespace spin
 
         std::swap(lhs.m_prev, rhs.m_prev);
         std::swap(lhs.m_next, rhs.m_next);
+        lhs.swap_counter(rhs);
       }
 
 
@@ -124,7 +226,7 @@ namespace spin
       list_node *m_next;
     };
 
-    template<typename Inheriator, typename Tag>
+    template<typename Inheriator, typename Tag, typename Policy>
     class list_iterator
     {
     public:
@@ -135,7 +237,7 @@ namespace spin
       using pointer           = Inheriator *;
       using difference_type   = std::ptrdiff_t;
       using iterator_category = std::bidirectional_iterator_tag;
-      using node_type         = list_node<Inheriator, Tag>;
+      using node_type         = list_node<Inheriator, Tag, Policy>;
 
       explicit list_iterator (node_type *node) noexcept
         : m_node (node)
@@ -186,7 +288,7 @@ namespace spin
       node_type *m_node;
     };
 
-    template<typename Inheriator, typename Tag>
+    template<typename Inheriator, typename Tag, typename Policy>
     class list_const_iterator
     {
     public:
@@ -196,7 +298,7 @@ namespace spin
       using reference         = const Inheriator &;
       using pointer           = const Inheriator *;
       using difference_type   = std::ptrdiff_t;
-      using node_type         = list_node<Inheriator, Tag>;
+      using node_type         = list_node<Inheriator, Tag, Policy>;
 
 
       list_const_iterator (const node_type *node) noexcept
@@ -266,19 +368,22 @@ namespace spin
      * @tparam T the type (as well as its derived type) this list can hold
      * @tparam Tag, the tag of list_node for T, which used to avoid conflict
      * when T inheriate multriple list_node.
+     * @tparam Policy list_policy_uncounted or list_policy_counted, decides
+     * whether size() takes linear or constant time.
      *
      * Different from std::list, intrusive list dost not allocate memory
      * internally to hold elements, but require containing type, say T derived
      * from list_node<T, Tag=T>.
      */
-    template<typename T, typename Tag>
-    class list
+    template<typename T, typename Tag, typename Policy>
+    class list : private detail::list_counter<Policy>
     {
+      using counter_type = detail::list_counter<Policy>;
     public:
 
       // Nested type, similar with STL
-      using iterator                = list_iterator<T, Tag>;
-      using const_iterator          = list_const_iterator<T, Tag>;
+      using iterator                = list_iterator<T, Tag, Policy>;
+      using const_iterator          = list_const_iterator<T, Tag, Policy>;
       using reverse_iterator        = std::reverse_iterator<iterator>;
       using const_reverse_iterator  = std::reverse_iterator<const_iterator>;
       using value_type              = T;
@@ -288,7 +393,7 @@ namespace spin
       using const_reference         = const T &;
       using size_type               = size_t;
       using difference_type         = std::ptrdiff_t;
-      using node_type               = list_node<T, Tag>;
+      using node_type               = list_node<T, Tag, Policy>;
 
       /** @brief Default constructor */
       list () noexcept
@@ -325,7 +430,10 @@ namespace spin
 
       /** @brief Move assign operator */
       list &operator = (list &&other) noexcept
-      { swap(other); }
+      {
+        swap(other);
+        return *this;
+      }
 
       list(const list &) = delete;
 
@@ -337,13 +445,12 @@ namespace spin
       bool empty() const noexcept
       { return m_head.m_next == &m_tail; }
 
+      /**
+       * @brief Get number of elements, takes constant time for
+       * list_policy_counted and linear time otherwise
+       */
       size_type size() const noexcept
-      {
-        size_type s = 0;
-        iterator i = begin();
-        while (i++ != end()) s++;
-        return s;
-      }
+      { return count(std::integral_constant<bool, counter_type::counted>()); }
 
       // Access
 
@@ -406,6 +513,8 @@ namespace spin
       void insert(iterator pos, reference ref) noexcept
       {
         node_type &nref = ref;
+        if (&nref == &(*pos))
+          return;
 
         // Unlink first
         node_type::unlink(nref);
@@ -413,6 +522,7 @@ namespace spin
         nref.m_prev->m_next = &nref;
         pos->m_prev = &nref;
         nref.m_next = &(*pos);
+        nref.attach(*this);
       }
 
 
@@ -544,6 +654,9 @@ namespace spin
           std::swap(lhs->m_head.m_next, rhs->m_head.m_next);
           std::swap(lhs->m_tail.m_prev, rhs->m_tail.m_prev);
         }
+
+        lhs->adopt(lhs->begin(), lhs->end());
+        rhs->adopt(rhs->begin(), rhs->end());
       }
 
       /** @brief Reverse the order of this list */
@@ -569,6 +682,7 @@ namespace spin
           auto *tmp = ptr->m_next;
           ptr->m_next = nullptr;
           ptr->m_prev = nullptr;
+          ptr->detach();
           ptr = tmp;
         }
 
@@ -611,50 +725,71 @@ namespace spin
         y.m_next = &(*pos);
         b->m_prev->m_next = &(*b);
         y.m_next->m_prev = &y;
+        adopt(b, pos);
       }
 
       /**
        * @brief Sort this list with specified strict weak ordering comparer
        * @param cmp The specified weak ordering comparer
+       *
+       * It's a stable natural merge sort which doesn't allocate memory.
+       * Runs are collected from the input, short runs are extended to
+       * min_sort_run nodes by insertion, and runs are merged like a binary
+       * counter. Only the next pointers are maintained while merging, the
+       * previous pointers are fixed up by the last merge, which visits all
+       * nodes anyway. Sorted or reversely sorted input takes linear time.
+       *
+       * If @a cmp throws, the list keeps all of its nodes: in the original
+       * order if it's thrown before the last merge, as previous pointers
+       * are still intact, otherwise in unspecified order.
        */
       template<typename StrictWeakOrderingComparator>
         void sort(StrictWeakOrderingComparator &&cmp)
           noexcept(noexcept(cmp(std::declval<T>(), std::declval<T>())))
         {
-          if (empty() || ++begin() == end()) return;
+          if (empty() || m_head.m_next->m_next == &m_tail) return;
 
-          // Copy from libstdc++, seems it's merge sort
+          // Detach nodes as a null terminated chain
+          node_type *p = m_head.m_next;
+          m_tail.m_prev->m_next = nullptr;
 
-          list carry;
-          list tmp[64];
-          list *fill = &tmp[0];
-          list *counter;
+          // bins[i] holds a sorted chain merged from 2^i runs, nodes in
+          // higher bins come earlier in the input
+          node_type *bins[64] = {};
+          std::size_t fill = 0;
 
-          do
+          // Until the last merge, previous pointers are still intact to
+          // restore the list if cmp throws
+          struct restore_guard
           {
-            T &n = *begin();
-            node_type::unlink(n);
-            carry.insert(carry.begin(), n);
+            list *self;
+            ~restore_guard() { if (self) self->relink_by_prev(); }
+          } guard { this };
+
+          while (p != nullptr)
+          {
+            node_type *run = p;
+            p = cut_run(run, cmp);
 
-            for (counter = &tmp[0];
-                counter != fill && !counter->empty();
-                ++counter)
+            std::size_t i = 0;
+            for ( ; i < fill && bins[i] != nullptr; ++i)
             {
-              counter->merge(carry,
-                  std::forward<StrictWeakOrderingComparator>(cmp));
-              counter->swap(carry);
+              run = merge_chain(bins[i], run, cmp);
+              bins[i] = nullptr;
             }
-
-            carry.swap(*counter);
-            if (counter == fill)
+            if (i == fill)
               ++fill;
+            bins[i] = run;
           }
-          while(!empty());
 
-          for (counter = &tmp[1]; counter != fill; ++counter)
-            counter->merge(*(counter - 1),
-                std::forward<StrictWeakOrderingComparator>(cmp));
-          swap(*(fill - 1));
+          // The highest bin is never empty
+          node_type *rest = nullptr;
+          for (std::size_t i = 0; i + 1 < fill; ++i)
+            if (bins[i] != nullptr)
+              rest = rest == nullptr ? bins[i]
+                : merge_chain(bins[i], rest, cmp);
+          guard.self = nullptr;
+          merge_and_link(bins[fill - 1], rest, cmp);
         }
 
       /** @brief Sort elements in this list with spin::less */
@@ -773,14 +908,192 @@ namespace spin
 
 
     private:
+
+      /** @brief Runs shorter than this are extended by insertion */
+      static constexpr std::size_t min_sort_run = 8;
+
+      template<typename Comparator>
+      static bool less_node(Comparator &cmp, node_type *a, node_type *b)
+      { return cmp(static_cast<T &>(*a), static_cast<T &>(*b)); }
+
+      /**
+       * @brief Cut a sorted run from the front of null terminated chain
+       * @a run, strictly descending run is reversed
+       * @returns The rest of the chain
+       */
+      template<typename Comparator>
+      static node_type *cut_run(node_type *&run, Comparator &cmp)
+      {
+        node_type *last = run, *p = run->m_next;
+        std::size_t n = 1;
+        if (p != nullptr && less_node(cmp, p, run))
+        {
+          run->m_next = nullptr;
+          do
+          {
+            node_type *next = p->m_next;
+            p->m_next = run;
+            run = p;
+            p = next;
+            ++n;
+          }
+          while (p != nullptr && less_node(cmp, p, run));
+        }
+        else
+        {
+          while (p != nullptr && !less_node(cmp, p, last))
+          {
+            last = p;
+            p = p->m_next;
+            ++n;
+          }
+          last->m_next = nullptr;
+        }
+
+        // Extend a short run, each node is inserted after nodes not
+        // greater than it to keep stability
+        for ( ; n < min_sort_run && p != nullptr; ++n)
+        {
+          node_type *x = p;
+          p = p->m_next;
+          node_type **pos = &run;
+          while (*pos != nullptr && !less_node(cmp, x, *pos))
+            pos = &(*pos)->m_next;
+          x->m_next = *pos;
+          *pos = x;
+        }
+        return p;
+      }
+
+      /**
+       * @brief Merge two sorted null terminated chains, nodes of @a a come
+       * first for equal nodes
+       */
+      template<typename Comparator>
+      static node_type *merge_chain(node_type *a, node_type *b,
+          Comparator &cmp)
+      {
+        node_type *head, **tail = &head;
+        for ( ; ; )
+        {
+          if (less_node(cmp, b, a))
+          {
+            *tail = b;
+            tail = &b->m_next;
+            if ((b = *tail) == nullptr)
+            {
+              *tail = a;
+              break;
+            }
+          }
+          else
+          {
+            *tail = a;
+            tail = &a->m_next;
+            if ((a = *tail) == nullptr)
+            {
+              *tail = b;
+              break;
+            }
+          }
+        }
+        return head;
+      }
+
+      /**
+       * @brief Merge two sorted null terminated chains as the content of
+       * this list, and fix up previous pointers
+       */
+      template<typename Comparator>
+      void merge_and_link(node_type *a, node_type *b, Comparator &cmp)
+      {
+        node_type *prev = &m_head;
+
+        // Whatever left in a and b, also if cmp throws, is appended as it is
+        struct link_guard
+        {
+          list *self;
+          node_type *&prev, *&a, *&b;
+          ~link_guard() { self->link_chain(self->link_chain(prev, a), b); }
+        } guard { this, prev, a, b };
+
+        while (a != nullptr && b != nullptr)
+        {
+          node_type *x;
+          if (less_node(cmp, b, a))
+          {
+            x = b;
+            b = b->m_next;
+          }
+          else
+          {
+            x = a;
+            a = a->m_next;
+          }
+          prev->m_next = x;
+          x->m_prev = prev;
+          prev = x;
+        }
+      }
+
+      /**
+       * @brief Link null terminated chain @a x after @a prev, and close the
+       * list with tail
+       * @returns The last node linked
+       */
+      node_type *link_chain(node_type *prev, node_type *x) noexcept
+      {
+        for ( ; x != nullptr; x = x->m_next)
+        {
+          prev->m_next = x;
+          x->m_prev = prev;
+          prev = x;
+        }
+        prev->m_next = &m_tail;
+        m_tail.m_prev = prev;
+        return prev;
+      }
+
+      /**
+       * @brief Restore next pointers from previous pointers, which are not
+       * touched by sort until the last merge
+       */
+      void relink_by_prev() noexcept
+      {
+        for (node_type *x = &m_tail; x != &m_head; x = x->m_prev)
+          x->m_prev->m_next = x;
+      }
+
+      size_type count(std::true_type) const noexcept
+      { return counter_type::get(); }
+
+      size_type count(std::false_type) const noexcept
+      {
+        size_type s = 0;
+        for (auto *p = m_head.m_next; p != &m_tail; p = p->m_next) s++;
+        return s;
+      }
+
+      /** @brief Count nodes in [b, e) in this list, if they are counted */
+      void adopt(iterator b, iterator e) noexcept
+      {
+        if (!counter_type::counted)
+          return;
+        while (b != e)
+        {
+          node_type &n = *b++;
+          n.attach(*this);
+        }
+      }
+
       node_type m_head;
       node_type m_tail;
     };
 
 
-    template<typename T, typename Tag>
-      inline bool operator == (const list<T, Tag> &x,
-          const list<T, Tag> &y) noexcept
+    template<typename T, typename Tag, typename Policy>
+      inline bool operator == (const list<T, Tag, Policy> &x,
+          const list<T, Tag, Policy> &y) noexcept
       {
         auto i = x.begin(), j = y.begin();
         auto m = x.end(), n = y.end();
@@ -791,33 +1104,33 @@ namespace spin
         return i == m && j == n;
       }
 
-    template<typename T, typename Tag>
-      inline bool operator != (const list<T, Tag> &x,
-          const list<T, Tag> &y) noexcept
+    template<typename T, typename Tag, typename Policy>
+      inline bool operator != (const list<T, Tag, Policy> &x,
+          const list<T, Tag, Policy> &y) noexcept
       { return !(x == y); }
 
-    template<typename T, typename Tag>
-      inline bool operator < (const list<T, Tag> &x,
-          const list<T, Tag> &y) noexcept
+    template<typename T, typename Tag, typename Policy>
+      inline bool operator < (const list<T, Tag, Policy> &x,
+          const list<T, Tag, Policy> &y) noexcept
       {
         if (&x == &y) return false;
         return std::lexicographical_compare(x.begin(), x.end(),
             y.begin(), y.end());
       }
 
-    template<typename T, typename Tag>
-      inline bool operator <= (const list<T, Tag> &x,
-          const list<T, Tag> &y) noexcept
+    template<typename T, typename Tag, typename Policy>
+      inline bool operator <= (const list<T, Tag, Policy> &x,
+          const list<T, Tag, Policy> &y) noexcept
       { return !(y < x); }
 
-    template<typename T, typename Tag>
-      inline bool operator > (const list<T, Tag> &x,
-          const list<T, Tag> &y) noexcept
+    template<typename T, typename Tag, typename Policy>
+      inline bool operator > (const list<T, Tag, Policy> &x,
+          const list<T, Tag, Policy> &y) noexcept
       { return y < x; }
 
-    template<typename T, typename Tag>
-      inline bool operator >= (const list<T, Tag> &x,
-          const list<T, Tag> &y) noexcept
+    template<typename T, typename Tag, typename Policy>
+      inline bool operator >= (const list<T, Tag, Policy> &x,
+          const list<T, Tag, Policy> &y) noexcept
       { return !(y > x); }
 
   }
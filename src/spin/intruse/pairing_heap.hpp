@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INTRUSE_PAIRING_HEAP_HPP_INCLUDED__
+#define __SPIN_INTRUSE_PAIRING_HEAP_HPP_INCLUDED__
+
+#include <spin/functional.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace spin
+{
+  namespace intruse
+  {
+    template<typename Index, typename Type, typename Tag = void,
+      typename Comparator = less<Index>>
+    class pairing_heap_node;
+
+    template<typename Index, typename Type, typename Tag = void,
+      typename Comparator = less<Index>>
+    class pairing_heap;
+
+    /**
+     * @brief pairing_heap_node specialization for void index type, used as
+     * base class of all the other pairing_heap_node and the container node
+     * of pairing_heap
+     *
+     * Children of a node are kept in a list, where the first child points
+     * back to its parent and the others point back to their previous
+     * sibling, so a node can be cut off in constant time. The root is the
+     * only child of the container node.
+     */
+    template<>
+    class pairing_heap_node<void, void>
+    {
+      template<typename, typename, typename, typename>
+      friend class pairing_heap_node;
+
+      template<typename, typename, typename, typename>
+      friend class pairing_heap;
+
+    protected:
+      /** @brief Auxilary class used for @a pairing_heap_node(container_tag) */
+      struct container_tag {};
+
+      /** @brief Initialize this node as container node */
+      pairing_heap_node(container_tag) noexcept
+        : m_child(nullptr)
+        , m_next(nullptr)
+        , m_prev(nullptr)
+        , m_is_container(true)
+      { }
+
+      /** @brief Default constructor */
+      pairing_heap_node() noexcept
+        : m_child(nullptr)
+        , m_next(nullptr)
+        , m_prev(nullptr)
+        , m_is_container(false)
+      { }
+
+      /** @brief Move constructor, @a n is replaced by this node */
+      pairing_heap_node(pairing_heap_node &&n) noexcept
+        : pairing_heap_node()
+      {
+        m_is_container = n.m_is_container;
+        take_place(n);
+      }
+
+      pairing_heap_node(const pairing_heap_node &) = delete;
+
+      pairing_heap_node &operator = (const pairing_heap_node &) = delete;
+
+      ~pairing_heap_node() = default;
+
+      /** @brief Test if a node is linked into a heap */
+      bool is_linked() const noexcept
+      { return m_prev != nullptr; }
+
+      /** @brief Test if a node is the root of a heap */
+      bool is_root() const noexcept
+      { return m_prev != nullptr && m_prev->m_is_container; }
+
+      /** @brief Replace @a n by this unlinked node */
+      void take_place(pairing_heap_node &n) noexcept
+      {
+        m_child = n.m_child;
+        if (m_child != nullptr)
+          m_child->m_prev = this;
+        if (n.m_prev != nullptr)
+          replace(n, this);
+        n.m_child = nullptr;
+        n.m_next = nullptr;
+        n.m_prev = nullptr;
+      }
+
+      /**
+       * @brief Put @a x, which may be nullptr, in place of @a n in its
+       * sibling list, the children of @a n are left untouched
+       */
+      static void replace(pairing_heap_node &n, pairing_heap_node *x) noexcept
+      {
+        auto *prev = n.m_prev;
+        auto *next = n.m_next;
+        if (prev->m_child == &n)
+          prev->m_child = x != nullptr ? x : next;
+        else
+          prev->m_next = x != nullptr ? x : next;
+
+        if (x != nullptr)
+        {
+          x->m_prev = prev;
+          x->m_next = next;
+          if (next != nullptr)
+            next->m_prev = x;
+        }
+        else if (next != nullptr)
+          next->m_prev = prev;
+        n.m_next = nullptr;
+        n.m_prev = nullptr;
+      }
+
+      /** @brief Make @a child the first child of @a parent */
+      static void adopt(pairing_heap_node &parent, pairing_heap_node &child)
+        noexcept
+      {
+        child.m_next = parent.m_child;
+        if (child.m_next != nullptr)
+          child.m_next->m_prev = &child;
+        child.m_prev = &parent;
+        parent.m_child = &child;
+      }
+
+      /** @brief Unlink all nodes of the heap of this container node */
+      void clear() noexcept
+      {
+        auto *list = m_child;
+        m_child = nullptr;
+        while (list != nullptr)
+        {
+          auto *n = list;
+          list = n->m_next;
+          if (auto *c = n->m_child)
+          {
+            auto *last = c;
+            while (last->m_next != nullptr)
+              last = last->m_next;
+            last->m_next = list;
+            list = c;
+          }
+          n->m_child = nullptr;
+          n->m_next = nullptr;
+          n->m_prev = nullptr;
+        }
+      }
+
+      /** @brief Count nodes of the heap of this container node */
+      std::size_t count() const noexcept
+      {
+        std::size_t ret = 0;
+        const pairing_heap_node *n = m_child;
+        while (n != nullptr)
+        {
+          ++ret;
+          if (n->m_child != nullptr)
+          {
+            n = n->m_child;
+            continue;
+          }
+
+          // Climb until a node has next sibling
+          while (n->m_next == nullptr)
+          {
+            while (n->m_prev->m_child != n)
+              n = n->m_prev;
+            n = n->m_prev;
+            if (n->m_is_container)
+              return ret;
+          }
+          n = n->m_next;
+        }
+        return ret;
+      }
+
+      pairing_heap_node *m_child;
+      pairing_heap_node *m_next;
+      pairing_heap_node *m_prev;
+      bool m_is_container;
+    };
+
+    /**
+     * @brief Node of pairing_heap
+     *
+     * A node unlinks itself from the heap when it's destructed. Nodes can
+     * be linked into several heaps with different tags.
+     */
+    template<typename Index, typename Type, typename Tag, typename Comparator>
+    class pairing_heap_node : public pairing_heap_node<void, void>
+    {
+      friend class pairing_heap<Index, Type, Tag, Comparator>;
+      using core_type = pairing_heap_node<void, void>;
+
+    public:
+      explicit pairing_heap_node(Index index)
+        noexcept(std::is_nothrow_move_constructible<Index>::value)
+        : core_type()
+        , m_index(std::move(index))
+      { }
+
+      pairing_heap_node(pairing_heap_node &&n)
+        noexcept(std::is_nothrow_move_constructible<Index>::value)
+        : core_type(std::move(n))
+        , m_index(std::move(n.m_index))
+      { }
+
+      ~pairing_heap_node() noexcept
+      { unlink(*this); }
+
+      static const Index &get_index(const pairing_heap_node &node) noexcept
+      { return node.m_index; }
+
+      /** @brief Test if a node is linked into a heap */
+      static bool is_linked(const pairing_heap_node &node) noexcept
+      { return node.core_type::is_linked(); }
+
+      /**
+       * @brief Unlink a node from its heap in amortized logarithmic time,
+       * without knowing the heap
+       * @returns Whether the node was linked
+       */
+      static bool unlink(pairing_heap_node &node) noexcept
+      {
+        if (!node.core_type::is_linked())
+          return false;
+
+        // Children are not less than the node, nor than its parent, so
+        // they can take the place of the node
+        auto *children = merge_pairs(node.m_child);
+        node.m_child = nullptr;
+        core_type::replace(node, children);
+        return true;
+      }
+
+    private:
+      static const Index &index_of(const core_type *n) noexcept
+      { return static_cast<const pairing_heap_node *>(n)->m_index; }
+
+      /** @brief Link two roots, returns the new root */
+      static core_type *link(core_type *a, core_type *b) noexcept
+      {
+        if (cmper(index_of(b), index_of(a)))
+          std::swap(a, b);
+        core_type::adopt(*a, *b);
+        return a;
+      }
+
+      /** @brief Combine a list of siblings into one tree with two passes */
+      static core_type *merge_pairs(core_type *first) noexcept
+      {
+        if (first == nullptr)
+          return nullptr;
+
+        // Link siblings in pairs from left to right, the results are
+        // chained in reverse order
+        core_type *pairs = nullptr;
+        while (first != nullptr)
+        {
+          auto *a = first;
+          auto *b = a->m_next;
+          first = b != nullptr ? b->m_next : nullptr;
+          a->m_next = nullptr;
+          a->m_prev = nullptr;
+          if (b != nullptr)
+          {
+            b->m_next = nullptr;
+            b->m_prev = nullptr;
+            a = link(a, b);
+          }
+          a->m_next = pairs;
+          pairs = a;
+        }
+
+        // Then link them from right to left
+        auto *root = pairs;
+        pairs = pairs->m_next;
+        root->m_next = nullptr;
+        while (pairs != nullptr)
+        {
+          auto *next = pairs->m_next;
+          pairs->m_next = nullptr;
+          root = link(root, pairs);
+          pairs = next;
+        }
+        return root;
+      }
+
+      static Comparator cmper;
+
+      Index m_index;
+    };
+
+    template<typename Index, typename Type, typename Tag, typename Comparator>
+    Comparator pairing_heap_node<Index, Type, Tag, Comparator>::cmper;
+
+    /**
+     * @brief Intrusive pairing heap, the least node is at top
+     *
+     * push, top, decreasing the index of a node and merge take constant
+     * time; pop, erase and increasing the index take amortized logarithmic
+     * time.
+     */
+    template<typename Index, typename Type, typename Tag, typename Comparator>
+    class pairing_heap
+    {
+      using core_type = pairing_heap_node<void, void>;
+
+    public:
+      using node_type = pairing_heap_node<Index, Type, Tag, Comparator>;
+      using value_type = Type;
+      using reference = value_type &;
+      using const_reference = const value_type &;
+      using size_type = std::size_t;
+
+      pairing_heap() noexcept
+        : m_container(core_type::container_tag())
+      { }
+
+      /** @brief Move constructor */
+      pairing_heap(pairing_heap &&h) noexcept
+        : m_container(std::move(h.m_container))
+      { }
+
+      pairing_heap(const pairing_heap &) = delete;
+
+      pairing_heap &operator = (pairing_heap &&h) noexcept
+      {
+        if (&h != this)
+        {
+          clear();
+          m_container.take_place(h.m_container);
+        }
+        return *this;
+      }
+
+      pairing_heap &operator = (const pairing_heap &) = delete;
+
+      ~pairing_heap() noexcept
+      { clear(); }
+
+      bool empty() const noexcept
+      { return m_container.m_child == nullptr; }
+
+      /** @brief Count nodes in linear time */
+      size_type size() const noexcept
+      { return m_container.count(); }
+
+      /** @brief Get the least node */
+      reference top() noexcept
+      { return cast(m_container.m_child); }
+
+      /** @brief Get the least node */
+      const_reference top() const noexcept
+      { return cast(m_container.m_child); }
+
+      /** @brief Insert a node, which will be unlinked first */
+      void push(Type &x) noexcept
+      {
+        node_type &n = x;
+        node_type::unlink(n);
+        meld(&n);
+      }
+
+      /** @brief Unlink the least node */
+      void pop() noexcept
+      { node_type::unlink(top()); }
+
+      /** @brief Unlink a node in this heap */
+      void erase(Type &x) noexcept
+      { node_type::unlink(x); }
+
+      /**
+       * @brief Update index of a node in this heap, returns the old index
+       * @note It takes constant time if the index is decreased
+       */
+      Index update_index(Type &x, Index index)
+      {
+        node_type &n = x;
+        std::swap(index, n.m_index);
+        if (!node_type::is_linked(n))
+          return index;
+
+        if (node_type::cmper(n.m_index, index))
+        {
+          // The subtree is still ordered, cut it and link it with the root
+          if (!n.is_root())
+          {
+            core_type::replace(n, nullptr);
+            meld(&n);
+          }
+        }
+        else if (node_type::cmper(index, n.m_index))
+        {
+          node_type::unlink(n);
+          meld(&n);
+        }
+        return index;
+      }
+
+      /** @brief Move all nodes of @a h into this heap in constant time */
+      void merge(pairing_heap &h) noexcept
+      {
+        auto *root = h.m_container.m_child;
+        if (root == nullptr || &h == this)
+          return;
+        core_type::replace(*root, nullptr);
+        meld(root);
+      }
+
+      /** @brief Unlink all nodes in linear time */
+      void clear() noexcept
+      { m_container.clear(); }
+
+      void swap(pairing_heap &h) noexcept
+      {
+        pairing_heap tmp(std::move(h));
+        h.m_container.take_place(m_container);
+        m_container.take_place(tmp.m_container);
+      }
+
+    private:
+      static reference cast(core_type *n) noexcept
+      { return static_cast<Type &>(static_cast<node_type &>(*n)); }
+
+      static const_reference cast(const core_type *n) noexcept
+      { return static_cast<const Type &>(static_cast<const node_type &>(*n)); }
+
+      /** @brief Link a tree with the root of this heap */
+      void meld(core_type *tree) noexcept
+      {
+        auto *root = m_container.m_child;
+        if (root == nullptr)
+        {
+          core_type::adopt(m_container, *tree);
+          return;
+        }
+        core_type::replace(*root, nullptr);
+        core_type::adopt(m_container, *node_type::link(root, tree));
+      }
+
+      core_type m_container;
+    };
+  }
+}
+
+#endif
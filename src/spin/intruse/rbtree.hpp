@@ -21,6 +21,7 @@
 #include <spin/environment.hpp>
 #include <spin/functional.hpp>
 
+#include <cstddef>
 #include <iterator>
 #include <type_traits>
 #include <cassert>
@@ -50,6 +51,39 @@ namespace spin
       typename Tag = void, typename Comparator = less<Index>>
     class rbtree;
 
+    /**
+     * @brief Comparator wrapper which enables order statistic
+     *
+     * Using it as the comparator of a tag makes the nodes of that tag track
+     * the size of their subtrees, so that rbtree::rank, rbtree::select and
+     * rbtree::count_range work in logarithmic time. Trees with any other
+     * comparator don't pay for it.
+     * @tparam Comparator The underlying comparator
+     */
+    template<typename Comparator = less<void>>
+    struct order_statistic : public Comparator
+    { };
+
+    /**
+     * @brief Comparator wrapper which maintains user defined summary of
+     * subtrees
+     *
+     * Using it as the comparator of a tag makes the tree call
+     * <tt>Augment::update(Type &node, const Type *left, const Type *right)
+     * </tt> whenever children of a node change, where left and right are
+     * the children of node or nullptr, so that node can recompute the
+     * summary of its subtree, which is stored in Type by user.
+     * @note A node must be unlinked before the data its summary depends on
+     * is changed
+     * @tparam Comparator The underlying comparator
+     * @tparam Augment Class with static update function as above
+     */
+    template<typename Comparator, typename Augment>
+    struct augmented : public Comparator
+    {
+      using augment = Augment;
+    };
+
     /**
      * @brief rbtree_node specialization for void index type, used as base class
      * of all the other rbtree_node, and hide the implementation detail
@@ -72,6 +106,9 @@ namespace spin
       template<typename, typename, typename, typename>
       friend class rbtree_const_iterator;
 
+      template<typename, typename, typename, typename>
+      friend class interval_tree;
+
     protected:
 
       /** @brief Auxilary class used for @a rbtree_node(container_tag) */
@@ -300,6 +337,49 @@ namespace spin
       static void insert_override(rbtree_node *prev,
           rbtree_node *next, rbtree_node *node) noexcept;
 
+      /**
+       * @brief Link a sorted chain of nodes into an empty tree in linear time
+       * @param container The container node of an empty tree
+       * @param chain The first node of the chain, nodes are unlinked and
+       * chained in order via m_r
+       * @param n Number of nodes in the chain
+       * @note The resulting tree is perfectly balanced, only nodes in the
+       * deepest level are red if that level is not full
+       */
+      static void link_sorted(rbtree_node *container,
+          rbtree_node *chain, std::size_t n) noexcept;
+
+      /**
+       * @brief Unlink all nodes of a tree in linear time
+       * @param container The container node of the tree
+       * @param make_chain Whether chain the unlinked nodes in order via m_r
+       * @returns The first node unlinked, or nullptr if tree is empty
+       */
+      static rbtree_node *unlink_all(rbtree_node *container,
+          bool make_chain) noexcept;
+
+      /**
+       * @brief Split a tree before a node in logarithmic time
+       * @param container The container node of the tree
+       * @param node The node from which all nodes are moved, or container to
+       * move nothing
+       * @param right The container node of an empty tree, which receives
+       * node and all nodes after it
+       */
+      static void split(rbtree_node *container, rbtree_node *node,
+          rbtree_node *right) noexcept;
+
+      /**
+       * @brief Move all nodes of a tree after the last node of another one in
+       * logarithmic time
+       * @param left The container node of the tree to be appended
+       * @param right The container node of the tree whose nodes are moved,
+       * it becomes empty
+       * @note User code should ensure that no node in @p right should be
+       * ordered before any node in @p left
+       */
+      static void join(rbtree_node *left, rbtree_node *right) noexcept;
+
       /**
        * @brief Search the position where specified index is suitable to be
        * @tparam Index the Index type of rbtree
@@ -350,69 +430,25 @@ namespace spin
 
         if (result != rresult)
           return std::make_pair(p, p);
-        else if (result)
-        {
-          while (!p->m_p->m_is_container)
-          {
-            if (p == p->m_p->m_l)
-            {
-              auto x = cmp(p->m_p);
-              auto y = rcmp(p->m_p);
-              if (x != y)
-                return std::make_pair(p->m_p, p->m_p);
-              else if (x)
-              {
-                p = p->m_p;
-                continue;
-              }
-            }
 
-            if (!p->m_r->m_is_container)
-            {
-              auto x = cmp(p->m_r);
-              auto y = rcmp(p->m_r);
-              if (x != y)
-                return std::make_pair(p->m_r, p->m_r);
-              if (x)
-                p = p->m_r;
-              else
-                break;
-            }
-            else
-              return std::make_pair(p, p->m_r);
-          }
-        }
-        else
+        // Climb up until the subtree of p covers index. Climbing from a
+        // right child to a parent less than p, or from a left child to a
+        // parent greater than p, doesn't change the side where index is, so
+        // comparison is only needed for the other direction
+        while (!p->m_p->m_is_container)
         {
-          while (!p->m_p->m_is_container)
+          auto *q = p->m_p;
+          bool is_left = q->m_has_l && q->m_l == p;
+          if (is_left == result)
           {
-            if (p == p->m_p->m_r)
-            {
-              auto x = cmp(p->m_p);
-              auto y = rcmp(p->m_p);
-              if (x != y)
-                return std::make_pair(p->m_p, p->m_p);
-              else if (x)
-              {
-                p = p->m_p;
-                continue;
-              }
-            }
-
-            if (!p->m_l->m_is_container)
-            {
-              auto x = cmp(p->m_l);
-              auto y = rcmp(p->m_l);
-              if (x != y)
-                return std::make_pair(p->m_l, p->m_l);
-              if (x)
-                p = p->m_l;
-              else
-                break;
-            }
-            else
-              return std::make_pair(p->m_l, p);
+            auto x = cmp(q);
+            auto y = rcmp(q);
+            if (x != y)
+              return std::make_pair(q, q);
+            if (x != result)
+              break;
           }
+          p = q;
         }
 
         for ( ; ; )
@@ -486,60 +522,25 @@ namespace spin
 
         if (result != rresult)
           return std::make_pair(p, p);
-        else if (result)
-        {
-          while (!p->m_p->m_is_container)
-          {
-            if (p == p->m_p->m_l)
-            {
-              auto x = cmp(p->m_p);
-              auto y = rcmp(p->m_p);
-              if (x != y) return std::make_pair(p->m_p, p->m_p);
-              else if (x)
-              {
-                p = p->m_p;
-                continue;
-              }
-            }
 
-            if (!p->m_r->m_is_container)
-            {
-              auto x = cmp(p->m_r);
-              auto y = rcmp(p->m_r);
-              if (x != y) return std::make_pair(p->m_r, p->m_r);
-              if (x) p = p->m_r;
-              else break;
-            }
-            else
-              return std::make_pair(p, p->m_r);
-          }
-        }
-        else
+        // Climb up until the subtree of p covers index. Climbing from a
+        // right child to a parent less than p, or from a left child to a
+        // parent greater than p, doesn't change the side where index is, so
+        // comparison is only needed for the other direction
+        while (!p->m_p->m_is_container)
         {
-          while (!p->m_p->m_is_container)
+          auto *q = p->m_p;
+          bool is_left = q->m_has_l && q->m_l == p;
+          if (is_left == result)
           {
-            if (p == p->m_p->m_r)
-            {
-              auto x = cmp(p->m_p);
-              auto y = rcmp(p->m_p);
-              if (x != y) return std::make_pair(p->m_p, p->m_p);
-              else if (x)
-              {
-                p = p->m_p;
-                continue;
-              }
-            }
-
-            if (!p->m_l->m_is_container)
-            {
-              auto x = cmp(p->m_l);
-              auto y = rcmp(p->m_l);
-              if (x != y) return std::make_pair(p->m_l, p->m_l);
-              if (x) p = p->m_l;
-              else break;
-            }
-            else return std::make_pair(p->m_l, p);
+            auto x = cmp(q);
+            auto y = rcmp(q);
+            if (x != y)
+              return std::make_pair(q, q);
+            if (x != result)
+              break;
           }
+          p = q;
         }
 
         for ( ; ; )
@@ -770,13 +771,53 @@ namespace spin
 
     private:
 
+      /** @brief Recompute the summary of subtree of this node, if any */
+      void __SPIN_INTERNAL__ update_summary() noexcept;
+
+      /** @brief Recompute summary of node and all its ancestors */
+      static void __SPIN_INTERNAL__
+      propagate_summary(rbtree_node *node) noexcept;
+
       /** @brief Rebalance a node after insertion */
       static void __SPIN_INTERNAL__
       rebalance_for_insertion(rbtree_node *node) noexcept;
 
-      /** @brief Rebalance the tree after unlink */
+      /**
+       * @brief Rebalance the tree after unlink
+       * @param parent Parent of the unlinked node
+       * @param is_left Whether the unlinked node was the left child
+       */
+      static void __SPIN_INTERNAL__
+      rebalance_for_unlink(rbtree_node *parent, bool is_left) noexcept;
+
+      /**
+       * @brief Count black nodes in the path from @p root to leaf
+       * @param root Root of a subtree, or nullptr for an empty one
+       */
+      static std::size_t __SPIN_INTERNAL__
+      black_height(const rbtree_node *root) noexcept;
+
+      /**
+       * @brief Join two detached subtrees with a node between them
+       * @param l Root of the left subtree with black color, or nullptr
+       * @param lh Black height of @p l
+       * @param k The node which become the only node between two subtrees
+       * @param r Root of the right subtree with black color, or nullptr
+       * @param rh Black height of @p r
+       * @param h Receives black height of the resulting subtree
+       * @returns Root of the resulting subtree, which is black
+       * @note It takes time proportional to the difference of black heights.
+       * Threads pointing out of the subtrees are left untouched, except that
+       * k is threaded to its parent if it becomes a leaf
+       */
+      static __SPIN_INTERNAL__ rbtree_node *
+      join_subtrees(rbtree_node *l, std::size_t lh, rbtree_node *k,
+          rbtree_node *r, std::size_t rh, std::size_t &h) noexcept;
+
+      /** @brief Make a detached subtree the tree of a container */
       static void __SPIN_INTERNAL__
-      rebalance_for_unlink(rbtree_node *node) noexcept;
+      set_container(rbtree_node *container, rbtree_node *root,
+          rbtree_node *front, rbtree_node *back) noexcept;
 
       /** @brief Transfer link to another */
       void __SPIN_INTERNAL__ transfer_link(rbtree_node &node) noexcept;
@@ -784,10 +825,9 @@ namespace spin
       /**
        * @brief Swap two nodes in the tree
        * @note This will generally break the order or nodes, so it's declared
-       * privately
+       * privately; it's exported as rbtree::swap calls it inline
        */
-      static void __SPIN_INTERNAL__
-      swap_nodes(rbtree_node &lhs, rbtree_node &rhs) noexcept;
+      static void swap_nodes(rbtree_node &lhs, rbtree_node &rhs) noexcept;
 
       rbtree_node *m_p;
       rbtree_node *m_l;
@@ -796,10 +836,23 @@ namespace spin
       bool m_has_r;
       bool m_is_red;
       bool m_is_container;
+      bool m_is_counted;
+      bool m_is_augmented;
 
       /********************* Meta programming stuff **********************/
     public:
 
+      class counted_node;
+
+      class augmented_node;
+
+      /** @brief Select the base class of node according to comparator */
+      template<typename Comparator>
+      struct select_node_base
+      {
+        using type = rbtree_node<void, void>;
+      };
+
       template<typename Tag, typename Comparator>
       struct args
       {
@@ -974,10 +1027,141 @@ namespace spin
 
     };
 
+    /**
+     * @brief Base class of nodes with order statistic, which tracks the
+     * number of nodes in its subtree
+     * @see order_statistic
+     */
+    class __SPIN_EXPORT__ rbtree_node<void, void>::counted_node
+      : public rbtree_node<void, void>
+    {
+      friend class rbtree_node<void, void>;
+
+      template<typename, typename, typename...>
+      friend class rbtree_node;
+
+      template<typename, typename, typename, typename>
+      friend class rbtree;
+
+    protected:
+
+      /** @brief Initialize this node as container node */
+      counted_node(container_tag tag) noexcept
+        : rbtree_node(tag)
+        , m_count(0)
+      { m_is_counted = true; }
+
+      /** @brief Default constructor */
+      counted_node() noexcept
+        : rbtree_node()
+        , m_count(1)
+      { m_is_counted = true; }
+
+      /** @brief Move constructor */
+      counted_node(counted_node &&n) noexcept
+        : rbtree_node(std::move(n))
+        , m_count(n.m_count)
+      { m_is_counted = true; }
+
+      /** @brief Assign operator overload for rvalue */
+      counted_node &operator = (counted_node &&n) noexcept
+      {
+        rbtree_node::operator = (std::move(n));
+        m_count = n.m_count;
+        return *this;
+      }
+
+      ~counted_node() = default;
+
+      /** @brief Get number of nodes in the subtree of a child node */
+      static std::size_t count(const rbtree_node *node, bool exists) noexcept
+      { return exists ? static_cast<const counted_node *>(node)->m_count : 0; }
+
+      /** @brief Get number of nodes in the tree via container node */
+      static std::size_t size(const rbtree_node *container) noexcept;
+
+      /**
+       * @brief Get number of nodes before this node, or size of the tree if
+       * this node is container node
+       */
+      std::size_t rank() const noexcept;
+
+      /**
+       * @brief Get the node with specified rank
+       * @returns The node, or container node if k is not less than size of
+       * the tree
+       */
+      static rbtree_node *select(rbtree_node *container, std::size_t k)
+        noexcept;
+
+    private:
+      std::size_t m_count;
+    };
+
+    template<typename Comparator>
+    struct rbtree_node<void, void>::select_node_base<order_statistic<Comparator>>
+    {
+      using type = rbtree_node<void, void>::counted_node;
+    };
+
+    /**
+     * @brief Base class of nodes with user defined summary, which keeps the
+     * function that recomputes the summary
+     * @see augmented
+     */
+    class rbtree_node<void, void>::augmented_node
+      : public rbtree_node<void, void>
+    {
+      friend class rbtree_node<void, void>;
+
+      template<typename, typename, typename...>
+      friend class rbtree_node;
+
+    protected:
+      using update_function = void (*)(rbtree_node<void, void> &);
+
+      /** @brief Initialize this node as container node */
+      augmented_node(container_tag tag) noexcept
+        : rbtree_node(tag)
+        , m_update(nullptr)
+      { m_is_augmented = true; }
+
+      /** @brief Default constructor */
+      augmented_node() noexcept
+        : rbtree_node()
+        , m_update(nullptr)
+      { m_is_augmented = true; }
+
+      /** @brief Move constructor */
+      augmented_node(augmented_node &&n) noexcept
+        : rbtree_node(std::move(n))
+        , m_update(n.m_update)
+      { m_is_augmented = true; }
+
+      /** @brief Assign operator overload for rvalue */
+      augmented_node &operator = (augmented_node &&n) noexcept
+      {
+        rbtree_node::operator = (std::move(n));
+        m_update = n.m_update;
+        return *this;
+      }
+
+      ~augmented_node() = default;
+
+    private:
+      update_function m_update;
+    };
+
+    template<typename Comparator, typename Augment>
+    struct rbtree_node<void, void>::select_node_base<augmented<Comparator, Augment>>
+    {
+      using type = rbtree_node<void, void>::augmented_node;
+    };
+
     template<typename Index, typename Type, typename Tag, typename Comparator>
     class rbtree_node<Index, Type,
           rbtree_node<void, void>::args<Tag, Comparator>>
-      : public rbtree_node<void, void>
+      : public rbtree_node<void, void>::select_node_base<Comparator>::type
     {
       friend class rbtree<Index, Type, Tag, Comparator>;
       friend class rbtree_iterator<Index, Type, Tag, Comparator>;
@@ -1001,13 +1185,43 @@ namespace spin
         return rbtree_node<void, void>::index_holder<Index>::internal_get_index(ref);
       }
 
+      using node_base = typename rbtree_node<void, void>
+        ::select_node_base<Comparator>::type;
+
+      // Base class depends on Comparator, bring in the core algorithms
+      using rbtree_node<void, void>::search;
+      using rbtree_node<void, void>::boundry;
+      using rbtree_node<void, void>::insert_between;
+      using rbtree_node<void, void>::insert_unique;
+      using rbtree_node<void, void>::insert_override;
+
       rbtree_node(rbtree_node<void, void>::container_tag tag)
-        : rbtree_node<void, void>(tag)
+        : node_base(tag)
       {}
 
+      static void attach_update_function(rbtree_node<void, void> &) noexcept
+      { }
+
+      static void attach_update_function(
+          rbtree_node<void, void>::augmented_node &node) noexcept
+      { node.m_update = &update_summary; }
+
+      /** @brief Call Augment::update with this node and its children */
+      static void update_summary(rbtree_node<void, void> &node) noexcept
+      {
+        auto child = [](rbtree_node<void, void> *p, bool exists) noexcept
+          -> const Type *
+        { return exists ? &static_cast<const Type&>(*internal_cast(p)) : nullptr; };
+
+        Comparator::augment::update(static_cast<Type&>(*internal_cast(&node)),
+            child(node.m_l, node.m_has_l), child(node.m_r, node.m_has_r));
+      }
+
     public:
 
-      rbtree_node() = default;
+      rbtree_node() noexcept
+        : node_base()
+      { attach_update_function(*this); }
 
       /** @brief whether instance Comparator would throw exception when
        * comparing index*/
@@ -1256,6 +1470,37 @@ namespace spin
         return &node;
       }
 
+      /**
+       * @brief Insert a node right before @p pos if it's where the node
+       * should be placed to, in amortized constant time
+       * @param pos A node attached to a tree, or container node for the end
+       * @param node The node to be inserted
+       * @param equal_prev Whether node may follow a node with the same index
+       * @param equal_next Whether node may precede a node with the same index
+       * @returns Whether the node is inserted
+       */
+      static bool insert_before_hint(rbtree_node<void, void> &pos,
+          rbtree_node &node, bool equal_prev, bool equal_next)
+          noexcept(is_comparator_noexcept)
+      {
+        auto *next = &pos;
+        auto *prev = pos.prev();
+        const Index &index = internal_get_index(node);
+
+        if (!prev->m_is_container && (equal_prev
+              ? cmper(index, index_fetcher(*prev))
+              : !cmper(index_fetcher(*prev), index)))
+          return false;
+
+        if (!next->m_is_container && (equal_next
+              ? cmper(index_fetcher(*next), index)
+              : !cmper(index, index_fetcher(*next))))
+          return false;
+
+        insert_between(prev, next, &node);
+        return true;
+      }
+
       static rbtree_node *internal_cast(rbtree_node<void, void> *x) noexcept
       { return static_cast<rbtree_node *>(x); }
 
@@ -1742,15 +1987,57 @@ namespace spin
       bool empty() const noexcept
       { return m_container_node.is_empty_container_node(); }
 
-      /** @brief Count the elements in this tree */
+      /**
+       * @brief Count the elements in this tree
+       * @note It's constant time if Comparator is order_statistic, or linear
+       * time otherwise
+       */
       size_type size() const noexcept
       {
+        if (is_counted)
+          return counted_node::size(&m_container_node);
+
         size_type s = 0;
         auto b = begin(), e = end();
         while (++b != e) ++s;
         return s;
       }
 
+      // Order statistic, only available if Comparator is order_statistic
+
+      /**
+       * @brief Count the elements before @p it
+       * @returns The rank of @p it, or size of this tree if @p it is end()
+       */
+      size_type rank(iterator it) const noexcept
+      {
+        static_assert(is_counted, "Order statistic is not enabled");
+        node_type &ref = *it;
+        const counted_node &node = ref;
+        return node.rank();
+      }
+
+      /**
+       * @brief Get the element with specified rank
+       * @returns Iterator to the @p k th smallest element counting from zero,
+       *          or end() if @p k is not less than size of this tree
+       */
+      iterator select(size_type k) noexcept
+      {
+        static_assert(is_counted, "Order statistic is not enabled");
+        return iterator(counted_node::select(&m_container_node, k));
+      }
+
+      /** @brief Count the elements whose index is in [@p lo, @p hi) */
+      size_type count_range(const Index &lo, const Index &hi)
+          noexcept(node_type::is_comparator_noexcept)
+      {
+        static_assert(is_counted, "Order statistic is not enabled");
+        if (!node_type::cmper(lo, hi))
+          return 0;
+        return rank(lower_bound(hi)) - rank(lower_bound(lo));
+      }
+
       // Access
 
       /**
@@ -2317,7 +2604,7 @@ namespace spin
        *          is returned
        */
       iterator insert(value_type &e) noexcept(node_type::is_comparator_noexcept)
-      { return insert(end(), e, policy_unique); }
+      { return insert(e, policy_unique); }
 
 
       /**
@@ -2330,7 +2617,7 @@ namespace spin
        */
       iterator insert(value_type &e, policy_unique_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return insert(end(), e, p); }
+      { return iterator(node_type::insert(m_container_node, e, p)); }
 
       /**
        * @brief Insert an element into this tree, unlink other elements that is
@@ -2340,7 +2627,7 @@ namespace spin
        */
       iterator insert(value_type &val, policy_override_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return insert(end(), val, p); }
+      { return iterator(node_type::insert(m_container_node, val, p)); }
 
 
       /**
@@ -2351,7 +2638,7 @@ namespace spin
        */
       iterator insert(value_type &val, policy_frontmost_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return insert(end(), val, p); }
+      { return iterator(node_type::insert(m_container_node, val, p)); }
 
       /**
        * @brief Insert an element into this tree after any elements that
@@ -2361,7 +2648,7 @@ namespace spin
        */
       iterator insert(value_type &val, policy_backmost_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return insert(end(), val, p); }
+      { return iterator(node_type::insert(m_container_node, val, p)); }
 
       /**
        * @brief Insert an element into this tree at the nearest position
@@ -2370,14 +2657,14 @@ namespace spin
        */
       iterator insert(value_type &val, policy_nearest_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return insert(end(), val, p); }
+      { return iterator(node_type::insert(m_container_node, val, p)); }
 
       /**
        * @brief Insert an element into this tree, with unique policy
        * @param e The element will be inserted
-       * @param hint Search is start from this position other than the root
-       *             of tree, may affects performance depends on the position
-       *             between search result and @p hint
+       * @param hint If @p e should be placed right before this position, it's
+       *             inserted in amortized constant time, otherwise search is
+       *             started from this position other than the root of tree
        * @returns If the element is successfuly inserted into this tree,
        *          the iterator for @p e is returned, otherwise, the
        *          iterator for the element which conflict with this element
@@ -2391,9 +2678,9 @@ namespace spin
       /**
        * @brief Insert an element into this tree
        * @param e The element will be inserted
-       * @param hint Search is start from this position other than the root
-       *             of tree, may affects performance depends on the position
-       *             between search result and @p hint
+       * @param hint If @p e should be placed right before this position, it's
+       *             inserted in amortized constant time, otherwise search is
+       *             started from this position other than the root of tree
        * @returns If the element is successfuly inserted into this tree,
        *          the iterator for @p e is returned, otherwise, the
        *          iterator for the element which conflict with this element
@@ -2401,61 +2688,58 @@ namespace spin
        */
       iterator insert(iterator hint, value_type &val, policy_unique_t p)
           noexcept(node_type::is_comparator_noexcept)
-      {
-        node_type &ref = *hint;
-        return iterator(node_type::insert(ref, val, p));
-      }
+      { return insert_with_hint(hint, val, p, false, false); }
 
       /**
        * @brief Insert an element into this tree, unlink other elements that is
        *        conflict with this element
        * @param e The element will be inserted
-       * @param hint Search is start from this position other than the root
-       *             of tree, may affects performance depends on the position
-       *             between search result and @p hint
+       * @param hint If @p e should be placed right before this position, it's
+       *             inserted in amortized constant time, otherwise search is
+       *             started from this position other than the root of tree
        * @returns Returns an iterator for @p e
        */
       iterator insert(iterator hint, value_type &val, policy_override_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return iterator(node_type::insert(*hint, val, p)); }
+      { return insert_with_hint(hint, val, p, false, false); }
 
       /**
        * @brief Insert an element into this tree before any elements that
        *        their index are equals to index of @p e
        * @param e The element will be inserted
-       * @param hint Search is start from this position other than the root
-       *             of tree, may affects performance depends on the position
-       *             between search result and @p hint
+       * @param hint If @p e should be placed right before this position, it's
+       *             inserted in amortized constant time, otherwise search is
+       *             started from this position other than the root of tree
        * @returns Returns an iterator for @p e
        */
       iterator insert(iterator hint, value_type &val, policy_frontmost_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return iterator(node_type::insert(*hint, val, p)); }
+      { return insert_with_hint(hint, val, p, false, true); }
 
       /**
        * @brief Insert an element into this tree after any elements that
        *        their index are equals to index of @p e
        * @param e The element will be inserted
-       * @param hint Search is start from this position other than the root
-       *             of tree, may affects performance depends on the position
-       *             between search result and @p hint
+       * @param hint If @p e should be placed right before this position, it's
+       *             inserted in amortized constant time, otherwise search is
+       *             started from this position other than the root of tree
        * @returns Returns an iterator for @p e
        */
       iterator insert(iterator hint, value_type &val, policy_backmost_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return iterator(node_type::insert(*hint, val, p)); }
+      { return insert_with_hint(hint, val, p, true, false); }
 
       /**
        * @brief Insert an element into this tree at the nearest position
        * @param e The element will be inserted
-       * @param hint Search is start from this position other than the root
-       *             of tree, may affects performance depends on the position
-       *             between search result and @p hint
+       * @param hint If @p e should be placed right before this position, it's
+       *             inserted in amortized constant time, otherwise search is
+       *             started from this position other than the root of tree
        * @returns Returns an iterator for @p e
        */
       iterator insert(iterator hint, value_type &val, policy_nearest_t p)
           noexcept(node_type::is_comparator_noexcept)
-      { return iterator(node_type::insert(*hint, val, p)); }
+      { return insert_with_hint(hint, val, p, true, true); }
 
       /**
        * @brief Insert all elements from iterator range [\p b, \p e) into this
@@ -2719,8 +3003,156 @@ namespace spin
 
       /** @brief Remove all the elements in this tree */
       void clear() noexcept
-        // Can be optimize
-      { erase(begin(), end()); }
+      { rbtree_node<void, void>::unlink_all(&m_container_node, false); }
+
+      /**
+       * @brief Replace all elements with the elements in [first, last) in
+       * linear time
+       * @note Elements in the range must be distinct and already in the order
+       * of this tree, and the range must not be traversed via the links that
+       * this tree uses. The resulting tree is perfectly balanced.
+       */
+      template<typename InputIterator>
+      void assign_sorted(InputIterator first, InputIterator last) noexcept
+      {
+        clear();
+        rbtree_node<void, void> *chain = nullptr;
+        std::size_t n = make_chain(first, last, chain);
+        rbtree_node<void, void>::link_sorted(&m_container_node, chain, n);
+      }
+
+      /**
+       * @brief Append elements in [first, last) after the last element in
+       * amortized linear time
+       * @note Elements in the range must be distinct and already in the order
+       * of this tree, and none of them may be less than the last element of
+       * this tree, so no comparison is made. If this tree is empty it's
+       * equivalent to #assign_sorted.
+       */
+      template<typename InputIterator>
+      void append_sorted(InputIterator first, InputIterator last) noexcept
+      {
+        rbtree_node<void, void> *chain = nullptr;
+        std::size_t n = make_chain(first, last, chain);
+        if (empty())
+          rbtree_node<void, void>::link_sorted(&m_container_node, chain, n);
+        else
+        {
+          // Insertion at the back rebalances in amortized constant time
+          auto *back = m_container_node.m_r;
+          while (chain != nullptr)
+          {
+            auto *node = chain;
+            chain = node->m_r;
+            node->m_r = nullptr;
+            back->insert_to_right(node);
+            back = node;
+          }
+        }
+      }
+
+      /**
+       * @brief Move elements from @p it to the last one to the tree @p right
+       * in logarithmic time
+       * @param it Position of the first element to be moved
+       * @param right An empty tree
+       */
+      void split(iterator it, rbtree &right) noexcept
+      {
+        node_type &ref = *it;
+        rbtree_node<void, void>::split(&m_container_node, &ref,
+            &right.m_container_node);
+      }
+
+      /**
+       * @brief Move elements whose index is not less than @p val to the tree
+       * @p right in logarithmic time
+       * @param val The value of index where this tree is split
+       * @param right An empty tree
+       */
+      void split(const Index &val, rbtree &right)
+          noexcept(node_type::is_comparator_noexcept)
+      { split(lower_bound(val), right); }
+
+      /**
+       * @brief Move all elements of the tree @p right after the last element
+       * of this tree in logarithmic time
+       * @note None of elements in @p right may be less than the last element
+       * of this tree, so no comparison is made
+       */
+      void join(rbtree &right) noexcept
+      {
+        rbtree_node<void, void>::join(&m_container_node,
+            &right.m_container_node);
+      }
+
+      /**
+       * @brief Move all elements of the tree @p t into this tree
+       *
+       * If index ranges of two trees don't overlap they're joined in
+       * logarithmic time, otherwise elements are merged in order and relinked
+       * in linear time. Elements of this tree precede the elements of @p t
+       * that have equivalent index.
+       * @note If comparator throws, no element is lost: the elements merged
+       * so far and the rest of this tree are left in this tree, and the rest
+       * of @p t in @p t
+       */
+      void merge(rbtree &t) noexcept(node_type::is_comparator_noexcept)
+      {
+        auto *lhs = &m_container_node, *rhs = &t.m_container_node;
+        if (t.empty())
+          return;
+        if (empty() || !cmp(rhs->m_l, lhs->m_r))
+          return join(t);
+        if (cmp(rhs->m_r, lhs->m_l))
+        {
+          t.join(*this);
+          return swap(t);
+        }
+
+        auto *x = rbtree_node<void, void>::unlink_all(lhs, true);
+        auto *y = rbtree_node<void, void>::unlink_all(rhs, true);
+        rbtree_node<void, void> *chain = nullptr;
+        rbtree_node<void, void> **tail = &chain;
+        std::size_t n = 0;
+
+        // Nodes merged so far precede the rest of both chains, so if cmp
+        // throws they're relinked with the rest of x, and y on its own
+        struct relink_guard
+        {
+          rbtree_node<void, void> *lhs, *rhs, *&chain, *&x, *&y;
+          rbtree_node<void, void> **&tail;
+          std::size_t &n;
+
+          ~relink_guard()
+          {
+            if (lhs == nullptr)
+              return;
+            std::size_t m = 0;
+            for (*tail = x; *tail != nullptr; tail = &(*tail)->m_r)
+              ++n;
+            for (auto *p = y; p != nullptr; p = p->m_r)
+              ++m;
+            rbtree_node<void, void>::link_sorted(lhs, chain, n);
+            rbtree_node<void, void>::link_sorted(rhs, y, m);
+          }
+        } guard { lhs, rhs, chain, x, y, tail, n };
+
+        while (x != nullptr && y != nullptr)
+        {
+          auto *&p = cmp(y, x) ? y : x;
+          *tail = p;
+          tail = &p->m_r;
+          p = p->m_r;
+          ++n;
+        }
+        guard.lhs = nullptr;
+
+        for (*tail = x != nullptr ? x : y; *tail != nullptr;
+            tail = &(*tail)->m_r)
+          ++n;
+        rbtree_node<void, void>::link_sorted(lhs, chain, n);
+      }
 
       /** @brief Return a reference to the index comparator */
       static const Comparator &index_comparator() noexcept
@@ -2728,6 +3160,63 @@ namespace spin
 
 
     private:
+      using counted_node = rbtree_node<void, void>::counted_node;
+
+      static constexpr bool is_counted
+        = std::is_base_of<counted_node, node_type>::value;
+
+      /**
+       * @brief Insert an element right before @p hint if it's ordered, or
+       * search from @p hint otherwise
+       * @param equal_prev Whether @p val may follow an element with the same
+       * index
+       * @param equal_next Whether @p val may precede an element with the
+       * same index
+       */
+      template<typename Policy>
+      static iterator insert_with_hint(iterator hint, value_type &val,
+          Policy p, bool equal_prev, bool equal_next)
+          noexcept(node_type::is_comparator_noexcept)
+      {
+        node_type &ref = *hint;
+        node_type &node = val;
+        if (node_type::insert_before_hint(ref, node, equal_prev, equal_next))
+          return iterator(&node);
+        return iterator(node_type::insert(ref, val, p));
+      }
+
+      /** @brief Test if index of node @p x is less than that of node @p y */
+      static bool cmp(const rbtree_node<void, void> *x,
+          const rbtree_node<void, void> *y)
+          noexcept(node_type::is_comparator_noexcept)
+      {
+        return node_type::cmper(node_type::index_fetcher(*x),
+            node_type::index_fetcher(*y));
+      }
+
+      /**
+       * @brief Unlink elements in [first, last) and chain them in order via
+       * m_r for rbtree_node<void, void>::link_sorted
+       * @returns Number of elements chained
+       */
+      template<typename InputIterator>
+      static std::size_t make_chain(InputIterator first, InputIterator last,
+          rbtree_node<void, void> *&chain) noexcept
+      {
+        std::size_t n = 0;
+        rbtree_node<void, void> **tail = &chain;
+        for ( ; first != last; ++first)
+        {
+          node_type &node = *first;
+          node.unlink_checked();
+          *tail = &node;
+          tail = &node.m_r;
+          ++n;
+        }
+        *tail = nullptr;
+        return n;
+      }
+
       node_type m_container_node;
     };
 
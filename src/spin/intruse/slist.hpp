@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_INTRUSE_SLIST_HPP_INCLUDED__
+#define __SPIN_INTRUSE_SLIST_HPP_INCLUDED__
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+namespace spin
+{
+  namespace intruse
+  {
+    /* Forward declaration */
+    template<typename Inheriator, typename Tag = Inheriator> class slist;
+    template<typename Inheriator, typename Tag = Inheriator> class slist_node;
+    template<typename Inheriator, typename Tag, bool IsConst>
+      class slist_iterator;
+    template<typename Inheriator, typename Tag = Inheriator>
+      class atomic_stack;
+
+    /**
+     * @brief Node of slist and atomic_stack, which carries one pointer
+     *
+     * A node can't unlink itself since its predecessor is unknown, so it
+     * must be unlinked before it's destructed. The link is atomic so that
+     * a node can be popped from atomic_stack while it's being pushed
+     * again, all accesses from slist are relaxed.
+     */
+    template<typename Inheriator, typename Tag>
+    class slist_node
+    {
+      friend class ::spin::intruse::slist<Inheriator, Tag>;
+      friend class ::spin::intruse::slist_iterator<Inheriator, Tag, false>;
+      friend class ::spin::intruse::slist_iterator<Inheriator, Tag, true>;
+      friend class ::spin::intruse::atomic_stack<Inheriator, Tag>;
+    public:
+
+      /** @brief Test if a node is linked into a slist */
+      static bool is_linked(const slist_node &node) noexcept
+      { return node.next() != nullptr; }
+
+      slist_node() noexcept
+        : m_next(nullptr)
+      { }
+
+      ~slist_node() noexcept
+      { assert (!is_linked(*this)); }
+
+      slist_node(const slist_node &) = delete;
+
+      slist_node &operator = (const slist_node &) = delete;
+
+    private:
+      slist_node *next() const noexcept
+      { return m_next.load(std::memory_order_relaxed); }
+
+      void set_next(slist_node *n) noexcept
+      { m_next.store(n, std::memory_order_relaxed); }
+
+      std::atomic<slist_node *> m_next;
+    };
+
+    template<typename Inheriator, typename Tag, bool IsConst>
+    class slist_iterator
+    {
+      friend class ::spin::intruse::slist<Inheriator, Tag>;
+
+      template<typename, typename, bool>
+      friend class slist_iterator;
+
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type        = Inheriator;
+      using difference_type   = std::ptrdiff_t;
+      using pointer           = typename std::conditional<IsConst,
+            const Inheriator *, Inheriator *>::type;
+      using reference         = typename std::conditional<IsConst,
+            const Inheriator &, Inheriator &>::type;
+      using node_type         = slist_node<Inheriator, Tag>;
+
+      slist_iterator() noexcept
+        : m_node(nullptr)
+      { }
+
+      /** @brief Conversion from iterator to const_iterator */
+      template<bool B, typename = typename std::enable_if<IsConst && !B>::type>
+      slist_iterator(const slist_iterator<Inheriator, Tag, B> &i) noexcept
+        : m_node(i.m_node)
+      { }
+
+      reference operator * () const noexcept
+      { return static_cast<reference>(*m_node); }
+
+      pointer operator -> () const noexcept
+      { return &**this; }
+
+      slist_iterator &operator ++ () noexcept
+      {
+        m_node = m_node->next();
+        return *this;
+      }
+
+      slist_iterator operator ++ (int) noexcept
+      {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+
+      bool operator == (const slist_iterator &i) const noexcept
+      { return m_node == i.m_node; }
+
+      bool operator != (const slist_iterator &i) const noexcept
+      { return m_node != i.m_node; }
+
+    private:
+      explicit slist_iterator(const node_type *n) noexcept
+        : m_node(const_cast<node_type *>(n))
+      { }
+
+      node_type *m_node;
+    };
+
+    /**
+     * @brief Intrusive singly linked list
+     *
+     * Nodes are linked in a circle through a sentinel node, and the list
+     * keeps a pointer to the last node, so that both push_front and
+     * push_back take constant time. A node is unlinked by pop_front or
+     * erase_after, and must be unlinked before it's linked again.
+     */
+    template<typename T, typename Tag>
+    class slist
+    {
+      friend class ::spin::intruse::atomic_stack<T, Tag>;
+    public:
+
+      // Nested type, similar with STL
+      using iterator                = slist_iterator<T, Tag, false>;
+      using const_iterator          = slist_iterator<T, Tag, true>;
+      using value_type              = T;
+      using pointer                 = T *;
+      using reference               = T &;
+      using const_pointer           = const T *;
+      using const_reference         = const T &;
+      using size_type               = std::size_t;
+      using difference_type         = std::ptrdiff_t;
+      using node_type               = slist_node<T, Tag>;
+
+      /** @brief Default constructor */
+      slist() noexcept
+        : m_head()
+        , m_tail(&m_head)
+      { m_head.set_next(&m_head); }
+
+      /** @brief Destructor */
+      ~slist() noexcept
+      {
+        clear();
+        m_head.set_next(nullptr);
+      }
+
+      /** @brief Move constructor */
+      slist(slist &&other) noexcept
+        : slist()
+      { swap(other); }
+
+      /** @brief Move assign operator */
+      slist &operator = (slist &&other) noexcept
+      {
+        swap(other);
+        return *this;
+      }
+
+      slist(const slist &) = delete;
+
+      slist &operator = (const slist &) = delete;
+
+      // Capacity
+
+      bool empty() const noexcept
+      { return m_head.next() == &m_head; }
+
+      /** @brief Count elements in linear time */
+      size_type size() const noexcept
+      {
+        size_type s = 0;
+        for (auto *p = m_head.next(); p != &m_head; p = p->next()) s++;
+        return s;
+      }
+
+      // Access
+
+      reference front() noexcept
+      { return *begin(); }
+
+      const_reference front() const noexcept
+      { return *begin(); }
+
+      reference back() noexcept
+      { return static_cast<reference>(*m_tail); }
+
+      const_reference back() const noexcept
+      { return static_cast<const_reference>(*m_tail); }
+
+      /**
+       * @brief Get iterator before the first element, which equals to end()
+       * as nodes are linked in a circle
+       */
+      iterator before_begin() noexcept
+      { return iterator(&m_head); }
+
+      const_iterator before_begin() const noexcept
+      { return const_iterator(&m_head); }
+
+      iterator begin() noexcept
+      { return iterator(m_head.next()); }
+
+      const_iterator begin() const noexcept
+      { return const_iterator(m_head.next()); }
+
+      const_iterator cbegin() const noexcept
+      { return const_iterator(m_head.next()); }
+
+      iterator end() noexcept
+      { return iterator(&m_head); }
+
+      const_iterator end() const noexcept
+      { return const_iterator(&m_head); }
+
+      const_iterator cend() const noexcept
+      { return const_iterator(&m_head); }
+
+      // Modifier
+
+      /**
+       * @brief Insert an unlinked element after specified position
+       * @returns Iterator to the inserted element
+       */
+      iterator insert_after(iterator pos, reference ref) noexcept
+      {
+        node_type &n = ref;
+        assert (!node_type::is_linked(n));
+        n.set_next(pos.m_node->next());
+        pos.m_node->set_next(&n);
+        if (pos.m_node == m_tail)
+          m_tail = &n;
+        return iterator(&n);
+      }
+
+      /**
+       * @brief Unlink the element after specified position
+       * @returns Iterator to the element following the erased one
+       */
+      iterator erase_after(iterator pos) noexcept
+      {
+        node_type *n = pos.m_node->next();
+        pos.m_node->set_next(n->next());
+        if (n == m_tail)
+          m_tail = pos.m_node;
+        n->set_next(nullptr);
+        return iterator(pos.m_node->next());
+      }
+
+      /** @brief Insert an unlinked element to the front of this list */
+      void push_front(reference ref) noexcept
+      { insert_after(before_begin(), ref); }
+
+      /** @brief Insert an unlinked element to the back of this list */
+      void push_back(reference ref) noexcept
+      { insert_after(iterator(m_tail), ref); }
+
+      /** @brief Unlink the first element */
+      void pop_front() noexcept
+      { erase_after(before_begin()); }
+
+      /** @brief Transfer all elements of @a l to the back of this list */
+      void splice_back(slist &l) noexcept
+      {
+        if (l.empty() || &l == this)
+          return;
+        node_type *first = l.m_head.next(), *last = l.m_tail;
+        l.assign(nullptr, nullptr);
+        if (empty())
+          assign(first, last);
+        else
+        {
+          m_tail->set_next(first);
+          last->set_next(&m_head);
+          m_tail = last;
+        }
+      }
+
+      /** @brief Reverse the order of this list */
+      void reverse() noexcept
+      {
+        node_type *first = m_head.next();
+        if (first == &m_head)
+          return;
+
+        node_type *prev = &m_head, *p = first;
+        while (p != &m_head)
+        {
+          node_type *next = p->next();
+          p->set_next(prev);
+          prev = p;
+          p = next;
+        }
+        m_head.set_next(prev);
+        m_tail = first;
+      }
+
+      /** @brief Swap elements with another list */
+      void swap(slist &l) noexcept
+      {
+        if (&l == this)
+          return;
+        node_type *first = empty() ? nullptr : m_head.next(), *last = m_tail;
+        if (l.empty())
+          assign(nullptr, nullptr);
+        else
+          assign(l.m_head.next(), l.m_tail);
+        l.assign(first, last);
+      }
+
+      /** @brief Unlink all elements from this list */
+      void clear() noexcept
+      {
+        node_type *p = m_head.next();
+        while (p != &m_head)
+        {
+          node_type *next = p->next();
+          p->set_next(nullptr);
+          p = next;
+        }
+        assign(nullptr, nullptr);
+      }
+
+    private:
+
+      /** @brief Make this list hold chain from @a first to @a last */
+      void assign(node_type *first, node_type *last) noexcept
+      {
+        if (first == nullptr)
+        {
+          m_head.set_next(&m_head);
+          m_tail = &m_head;
+        }
+        else
+        {
+          m_head.set_next(first);
+          last->set_next(&m_head);
+          m_tail = last;
+        }
+      }
+
+      node_type m_head;
+      node_type *m_tail;
+    };
+  }
+}
+
+#endif
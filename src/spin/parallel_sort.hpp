@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_PARALLEL_SORT_HPP_INCLUDED__
+#define __SPIN_PARALLEL_SORT_HPP_INCLUDED__
+
+#include <spin/intruse/list.hpp>
+#include <spin/thread_pool.hpp>
+#include <spin/utils.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace spin
+{
+  namespace detail
+  {
+    /**
+     * @brief Run @a f(i) for each i in [0, n) on @a pool and the calling
+     * thread, returns after all of them are done
+     *
+     * The calling thread runs the jobs not yet picked up by the pool
+     * itself, so it never waits for a job which is not running, even if
+     * it's called from a thread of the pool. If queueing a job throws, the
+     * jobs queued are canceled, or waited for if already running, before
+     * the exception propagates.
+     */
+    template<typename Function>
+    void parallel_for(thread_pool &pool, std::size_t n, Function &f)
+    {
+      struct state
+      {
+        state(std::size_t n, Function &f)
+          : m_claimed(new std::atomic_bool[n])
+          , m_function(f)
+          , m_mutex()
+          , m_done()
+          , m_remaining(n)
+          , m_error()
+        {
+          for (std::size_t i = 0; i < n; ++i)
+            m_claimed[i].store(false, std::memory_order_relaxed);
+        }
+
+        void run(std::size_t i) noexcept
+        {
+          if (m_claimed[i].exchange(true, std::memory_order_acquire))
+            return;
+
+          std::exception_ptr error;
+          try
+          { m_function(i); }
+          catch (...)
+          { error = std::current_exception(); }
+          finish(error);
+        }
+
+        void cancel(std::size_t i) noexcept
+        {
+          if (!m_claimed[i].exchange(true, std::memory_order_acquire))
+            finish(std::exception_ptr());
+        }
+
+        void finish(std::exception_ptr error) noexcept
+        {
+          std::lock_guard<std::mutex> guard(m_mutex);
+          if (error && !m_error)
+            m_error = error;
+          if (--m_remaining == 0)
+            m_done.notify_one();
+        }
+
+        void wait()
+        {
+          std::unique_lock<std::mutex> guard(m_mutex);
+          m_done.wait(guard, [this] { return m_remaining == 0; });
+        }
+
+        std::unique_ptr<std::atomic_bool[]> m_claimed;
+        Function &m_function;
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+        std::size_t m_remaining;
+        std::exception_ptr m_error;
+      };
+
+      // Jobs left in the queue of pool may outlive this call, but none of
+      // them calls f afterwards as all are claimed by then
+      auto s = std::make_shared<state>(n, f);
+      try
+      {
+        for (std::size_t i = 1; i < n; ++i)
+          pool.enqueue([s, i] { s->run(i); });
+      }
+      catch (...)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+          s->cancel(i);
+        s->wait();
+        throw;
+      }
+      for (std::size_t i = 0; i < n; ++i)
+        s->run(i);
+
+      s->wait();
+      if (s->m_error)
+        std::rethrow_exception(s->m_error);
+    }
+  }
+
+  /**
+   * @brief Sort an intrusive list with chunks sorted on a thread_pool
+   *
+   * The list is cut into one chunk per thread of @a pool plus one, but
+   * not smaller than @a min_chunk_size nodes. Chunks are sorted with
+   * intruse::list::sort in parallel, then merged pairwise, also in
+   * parallel. The result is stable. If @a cmp throws, the list keeps all
+   * of its nodes in unspecified order.
+   *
+   * Each job sorts or merges with its own copy of @a cmp, but copies are
+   * called concurrently, so any state they share must be thread safe.
+   */
+  template<typename T, typename Tag, typename Policy, typename Comparator>
+  void parallel_sort(intruse::list<T, Tag, Policy> &l, Comparator cmp,
+      thread_pool &pool, std::size_t min_chunk_size = 16384)
+  {
+    using list_type = intruse::list<T, Tag, Policy>;
+    auto size = l.size();
+    std::size_t chunk_count = pool.get_max_thread_count() + 1;
+    if (min_chunk_size == 0)
+      min_chunk_size = 1;
+    if (size / min_chunk_size < chunk_count)
+      chunk_count = size / min_chunk_size;
+    if (chunk_count <= 1)
+    {
+      l.sort(cmp);
+      return;
+    }
+
+    std::vector<list_type> chunks(chunk_count);
+    for (std::size_t i = 0; i + 1 < chunk_count; ++i)
+    {
+      auto e = l.begin();
+      std::advance(e, size / chunk_count);
+      chunks[i].splice(chunks[i].end(), l.begin(), e);
+    }
+    chunks.back().splice(chunks.back().end(), l);
+
+    // Nodes are moved back even if comparator throws
+    auto guard = make_block_guard([&] () noexcept
+        {
+          for (auto &c : chunks)
+            l.splice(l.end(), c);
+        });
+
+    auto sort_chunk = [&](std::size_t i)
+    {
+      Comparator c(cmp);
+      chunks[i].sort(c);
+    };
+    detail::parallel_for(pool, chunk_count, sort_chunk);
+
+    // Earlier chunk is merged with later one for stability
+    for (std::size_t step = 1; step < chunk_count; step *= 2)
+    {
+      auto merge_chunk = [&](std::size_t i)
+      {
+        i *= step * 2;
+        if (i + step < chunk_count)
+        {
+          Comparator c(cmp);
+          chunks[i].merge(chunks[i + step], c);
+        }
+      };
+      detail::parallel_for(pool, (chunk_count + step * 2 - 1) / (step * 2),
+          merge_chunk);
+    }
+  }
+
+  /** @brief Sort an intrusive list on the thread_pool singleton */
+  template<typename T, typename Tag, typename Policy, typename Comparator>
+  void parallel_sort(intruse::list<T, Tag, Policy> &l, Comparator cmp)
+  { parallel_sort(l, std::move(cmp), *thread_pool::get_instance()); }
+
+  /** @brief Sort an intrusive list with spin::less on a thread_pool */
+  template<typename T, typename Tag, typename Policy>
+  void parallel_sort(intruse::list<T, Tag, Policy> &l)
+  { parallel_sort(l, less<T>()); }
+}
+
+#endif
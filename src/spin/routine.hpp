@@ -54,6 +54,8 @@
 #include <exception>
 #include <typeinfo>
 #include <memory>
+#include <cstring>
+#include <functional>
 
 
 namespace spin
@@ -488,6 +490,17 @@ namespace spin
     }
 
 
+    // hint the processor to fetch the functor before it is called. the first
+    // word of the padding is the functor pointer if it was heap allocated,
+    // otherwise it's functor data and the prefetch is just wasted, which is
+    // harmless as a prefetch never faults
+    void prefetch() const noexcept
+    {
+      const void * p;
+      std::memcpy(&p, &manager_storage.functor, sizeof(p));
+      __builtin_prefetch(p);
+    }
+
     const std::type_info & target_type() const noexcept
     {
       return *static_cast<std::type_info *>(manager_storage.manager(nullptr, nullptr, detail::call_type_id));
@@ -23,24 +23,31 @@
 #include <spin/spin_lock.hpp>
 #include <spin/utils.hpp>
 #include <spin/event_monitor.hpp>
+#include <spin/statistics.hpp>
+#include <spin/watchdog.hpp>
 
 #include <mutex>
 #include <memory>
+#include <atomic>
+#include <cstddef>
 
 namespace spin
 {
+  class buffer_pool;
+
   /**
    * @brief scheduler schedules task execution and event handling
    */
   class __SPIN_EXPORT__ scheduler
   {
+    friend class watchdog;
   public:
 
     /** @brief Default constructor */
     scheduler();
 
-    /** @brief Default destructor */
-    ~scheduler() = default;
+    /** @brief Destructor, unwatch this scheduler if it is watched */
+    ~scheduler();
 
     scheduler(const scheduler &) = delete;
 
@@ -93,6 +100,9 @@ namespace spin
     {
       std::lock_guard<spin_lock> guard(m_lock);
       m_posted_queue.push_back(t);
+#ifdef SPIN_ENABLE_STATISTICS
+      statistics_counters::add(m_statistics.posts);
+#endif
       interrupt();
     }
 
@@ -107,6 +117,9 @@ namespace spin
     {
       std::lock_guard<spin_lock> guard(m_lock);
       m_posted_queue.splice(m_posted_queue.end(), std::move(q));
+#ifdef SPIN_ENABLE_STATISTICS
+      statistics_counters::add(m_statistics.posts);
+#endif
       interrupt();
     }
 
@@ -138,13 +151,53 @@ namespace spin
      */
     std::shared_ptr<event_monitor> get_event_monitor();
 
+    /**
+     * @brief Get the buffer_pool of this scheduler, created on first call
+     * @note Call this function and allocate buffers in the thread where the
+     * scheduler is running; buffers must be released before the scheduler
+     * is destroyed
+     */
+    buffer_pool &get_buffer_pool();
+
+    /**
+     * @brief Get the number of tasks executed in the latest iteration of #run
+     * @note This function is safe to be called from another thread
+     */
+    std::size_t get_last_iteration_task_count() const noexcept
+    { return m_last_iteration_task_count.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get a snapshot of runtime statistics of this scheduler
+     * @note This function is safe to be called from another thread
+     * @see #is_statistics_enabled
+     */
+    scheduler_statistics get_statistics() const noexcept;
+
+    /**
+     * @brief Reset all statistics counters to zero
+     * @note This function is safe to be called from another thread
+     */
+    void reset_statistics() noexcept;
+
+    /**
+     * @brief Test if libspin is built with statistics collecting, if not,
+     * all counters stay zero
+     */
+    static bool is_statistics_enabled() noexcept;
+
   private:
 
     std::weak_ptr<event_monitor> m_event_monitor_ptr;
+    std::unique_ptr<buffer_pool> m_buffer_pool;
     task::queue_type m_dispatched_queue;
     task::queue_type m_posted_queue;
     spin_lock m_lock;
     std::atomic_bool m_running;
+    std::atomic_size_t m_last_iteration_task_count;
+#ifdef SPIN_ENABLE_STATISTICS
+    statistics_counters m_statistics;
+#endif
+    watchdog_probe m_watchdog_probe;
   };
 }
 
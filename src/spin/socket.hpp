@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2013 LAN Xingcan
+ * Copyright (C) 2014 LAN Xingcan
  * All right reserved
  *
  * Permission to use, copy, modify, and/or distribute this software for any
@@ -18,97 +18,119 @@
 #ifndef __SPIN_SOCKET_HPP_INCLUDED__
 #define __SPIN_SOCKET_HPP_INCLUDED__
 
-#include <spin/scheduler.hpp>
+#include <spin/system.hpp>
 
-#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <sys/socket.h>
 
 namespace spin
 {
-#if 0
-  template<typename Protocol>
-  class stream_socket_acceptor;
-
-  template<typename Protocol>
-  class stream_socket;
-
-  template<typename Protocol>
-  class stream_socket_acceptor
-  {
-  public:
-
-    using address_type = void; //TODO:
-    using peer_handler = std::function<void(stream_socket)>;
-    using error_handler = std::function<void(std::exception_ptr)>;
-
-    stream_socket_acceptor(handler handle, address_type listen_addr);
-
-    ~stream_socket_acceptor();
-
-    void close();
-  private:
-    system_handle m_acceptor_handle;
-  };
-
-  template<typename Protocol>
-  class stream_socket
+  /** @brief Storage of an address of any socket family */
+  class __SPIN_EXPORT__ socket_address
   {
-    friend class stream_socket_acceptor<Protocol>;
   public:
+    /** @brief Construct an empty address of AF_UNSPEC */
+    socket_address() noexcept;
+
+    /** @brief Copy from a system address */
+    socket_address(const ::sockaddr *addr, ::socklen_t size);
+
+    /**
+     * @brief Construct an IPv4 or IPv6 address from numeric host
+     * @throws std::invalid_argument if @a host is not a numeric address
+     */
+    static socket_address from_ip(const std::string &host,
+        std::uint16_t port);
+
+    /**
+     * @brief Construct a Unix domain address bound to a file system path
+     * @throws std::invalid_argument if @a path is too long
+     */
+    static socket_address from_unix_path(const std::string &path);
+
+    /**
+     * @brief Construct a Unix domain address in the abstract namespace of
+     * Linux, which is not visible in file system and vanishes with socket
+     * @throws std::invalid_argument if @a name is too long
+     */
+    static socket_address from_abstract_name(const std::string &name);
+
+    /** @brief Get the address family, e.g. AF_INET */
+    int get_family() const noexcept
+    { return m_size == 0 ? AF_UNSPEC : m_storage.ss_family; }
+
+    /** @brief Get the port of an IPv4 or IPv6 address, 0 for others */
+    std::uint16_t get_port() const noexcept;
+
+    const ::sockaddr *get_data() const noexcept
+    { return reinterpret_cast<const ::sockaddr *>(&m_storage); }
+
+    ::sockaddr *get_data() noexcept
+    { return reinterpret_cast<::sockaddr *>(&m_storage); }
+
+    ::socklen_t get_size() const noexcept
+    { return m_size; }
+
+    /** @brief Set the size after the storage is filled by system call */
+    void set_size(::socklen_t size) noexcept
+    { m_size = size; }
+
+    /** @brief Get the size of the storage */
+    static constexpr ::socklen_t get_capacity() noexcept
+    { return sizeof(::sockaddr_storage); }
+
+    /**
+     * @brief Format the address for human, e.g. 127.0.0.1:80; abstract
+     * Unix domain addresses are prefixed by '@'
+     */
+    std::string to_string() const;
+
+    friend bool operator == (const socket_address &x,
+        const socket_address &y) noexcept
+    {
+      return x.m_size == y.m_size
+        && std::memcmp(&x.m_storage, &y.m_storage, x.m_size) == 0;
+    }
+
+    friend bool operator != (const socket_address &x,
+        const socket_address &y) noexcept
+    { return !(x == y); }
 
-    using acceptor = stream_socket_acceptor<Protocol>;
-    using address_type = typename acceptor::address_type;
-
-    stream_socket();
-
-    ~stream_socket();
   private:
-
-    system_handle m_socket_handle;
+    ::sockaddr_storage m_storage;
+    ::socklen_t m_size;
   };
 
-  class __SPIN_EXPORT__ stream_socket_peer
-  {
-    friend class stream_socket_server;
-  public:
-    ~stream_socket_peer() noexcept;
-
-    stream_socket_peer(stream_socket_peer &&peer) noexcept = default;
-    stream_socket_peer &operator = (stream_socket_peer &&peer) noexcept = default;
-
-    stream_socket_peer(const stream_socket_peer &peer) = delete;
-    stream_socket_peer &operator = (const stream_socket_peer &peer) = delete;
-
-    stream_socket_peer(scheduler &loop, system_handle socket);
-
-    void read(char buff[], size_t size, std::function<void(size_t)> cb);
-
-    void write(const char buff[], size_t size, std::function<void(size_t)> cb);
-
-  private:
-    class detail;
-    system_handle m_handle;
-    std::unique_ptr<detail> m_detail;;
-  };
-
-
-
-  class __SPIN_EXPORT__ stream_socket_listener
-  {
-  public:
-    stream_socket_listener(scheduler &loop, system_handle h);
-    ~stream_socket_listener() noexcept;
-
-    std::function<void(std::unique_ptr<stream_socket_peer>)>
-    accept(std::function<void(std::unique_ptr<stream_socket_peer>)> cb);
-  protected:
-
-    class detail;
-    system_handle m_handle;
-    std::unique_ptr<detail> m_detail;
-  };
-  timerfd_settime
-
-#endif
+  /**
+   * @brief Create a non-blocking and close-on-exec socket
+   * @throws std::system_error if failed
+   */
+  system_handle __SPIN_EXPORT__ open_socket(int family, int type,
+      int protocol = 0);
+
+  /**
+   * @brief Create a pair of connected Unix domain sockets, non-blocking and
+   * close-on-exec
+   * @throws std::system_error if failed
+   */
+  std::pair<system_handle, system_handle> __SPIN_EXPORT__ open_socket_pair(
+      int type);
+
+  /** @brief Set an integer socket option, throws std::system_error if failed */
+  void __SPIN_EXPORT__ set_socket_option(const system_handle &socket,
+      int level, int name, int value);
+
+  /** @brief Get the address a socket is bound to */
+  socket_address __SPIN_EXPORT__ get_local_address(
+      const system_handle &socket);
+
+  /** @brief Get the address of the peer a socket is connected to */
+  socket_address __SPIN_EXPORT__ get_peer_address(
+      const system_handle &socket);
 }
 
 #endif
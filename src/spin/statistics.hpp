@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_STATISTICS_HPP_INCLUDED__
+#define __SPIN_STATISTICS_HPP_INCLUDED__
+
+#include <spin/environment.hpp>
+#include <spin/config.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+namespace spin
+{
+  /**
+   * @brief Histogram of durations with power-of-two nanosecond buckets
+   *
+   * Bucket i counts durations in [2^i, 2^(i+1)) nanoseconds, except that
+   * bucket 0 also counts durations shorter than 1ns and the last bucket
+   * counts everything beyond.
+   */
+  class histogram
+  {
+    friend class statistics_counters;
+  public:
+    static constexpr std::size_t bucket_count = 40;
+
+    histogram() noexcept
+      : m_buckets()
+    { }
+
+    /** @brief Record a duration */
+    void record(std::chrono::nanoseconds duration) noexcept
+    { ++m_buckets[get_bucket_index(duration)]; }
+
+    /** @brief Get the index of the bucket counting duration */
+    static std::size_t get_bucket_index(std::chrono::nanoseconds duration)
+      noexcept
+    {
+      auto ns = duration.count();
+      std::size_t i = 0;
+      if (ns > 1)
+        i = 63 - __builtin_clzll(static_cast<unsigned long long>(ns));
+      return i < bucket_count ? i : bucket_count - 1;
+    }
+
+    /** @brief Get the number of durations recorded in bucket i */
+    std::uint64_t get_bucket(std::size_t i) const noexcept
+    { return m_buckets[i]; }
+
+    /** @brief Get the lower bound of durations counted by bucket i */
+    static std::chrono::nanoseconds get_bucket_lower_bound(std::size_t i)
+      noexcept
+    { return std::chrono::nanoseconds(i == 0 ? 0 : 1ll << i); }
+
+    /** @brief Get the number of all recorded durations */
+    std::uint64_t get_count() const noexcept
+    {
+      std::uint64_t count = 0;
+      for (auto x : m_buckets)
+        count += x;
+      return count;
+    }
+
+    /** @brief Clear all buckets */
+    void reset() noexcept
+    { m_buckets.fill(0); }
+
+  private:
+    std::array<std::uint64_t, bucket_count> m_buckets;
+  };
+
+  /**
+   * @brief Runtime statistics of a scheduler and its event_monitor
+   *
+   * Counters are only collected if libspin is configured with
+   * --enable-statistics, otherwise they stay zero.
+   * @see scheduler::get_statistics
+   */
+  struct scheduler_statistics
+  {
+    /** @brief Iterations of the scheduler loop */
+    std::uint64_t iterations = 0;
+
+    /** @brief Tasks executed */
+    std::uint64_t tasks = 0;
+
+    /** @brief Events harvested from epoll_wait, interrupts excluded */
+    std::uint64_t events = 0;
+
+    /** @brief Calls to epoll_wait */
+    std::uint64_t waits = 0;
+
+    /** @brief Calls to epoll_wait that were allowed to block */
+    std::uint64_t blocking_waits = 0;
+
+    /** @brief Wakeups by scheduler::interrupt */
+    std::uint64_t interrupts = 0;
+
+    /** @brief Calls to scheduler::post */
+    std::uint64_t posts = 0;
+
+    /** @brief Time spent per task */
+    histogram task_time;
+
+    /** @brief Time spent per epoll_wait */
+    histogram wait_time;
+  };
+
+  /**
+   * @brief Live counters behind scheduler_statistics
+   *
+   * Counters are relaxed atomics, so a snapshot may be loaded from any
+   * thread while the scheduler is running, though it is not consistent
+   * across counters.
+   */
+  class statistics_counters
+  {
+  public:
+    using counter = std::atomic<std::uint64_t>;
+    using buckets = std::array<counter, histogram::bucket_count>;
+
+    statistics_counters() noexcept
+      : iterations(0)
+      , tasks(0)
+      , events(0)
+      , waits(0)
+      , blocking_waits(0)
+      , interrupts(0)
+      , posts(0)
+      , task_time()
+      , wait_time()
+    { }
+
+    statistics_counters(const statistics_counters &) = delete;
+
+    statistics_counters &operator = (const statistics_counters &) = delete;
+
+    /** @brief Add n to counter c */
+    static void add(counter &c, std::uint64_t n = 1) noexcept
+    { c.fetch_add(n, std::memory_order_relaxed); }
+
+    /** @brief Record a duration to histogram h */
+    static void record(buckets &h, std::chrono::nanoseconds duration) noexcept
+    { add(h[histogram::get_bucket_index(duration)]); }
+
+    /** @brief Load a snapshot of all counters */
+    scheduler_statistics load() const noexcept
+    {
+      scheduler_statistics ret;
+      ret.iterations = iterations.load(std::memory_order_relaxed);
+      ret.tasks = tasks.load(std::memory_order_relaxed);
+      ret.events = events.load(std::memory_order_relaxed);
+      ret.waits = waits.load(std::memory_order_relaxed);
+      ret.blocking_waits = blocking_waits.load(std::memory_order_relaxed);
+      ret.interrupts = interrupts.load(std::memory_order_relaxed);
+      ret.posts = posts.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i != histogram::bucket_count; ++i)
+      {
+        ret.task_time.m_buckets[i]
+          = task_time[i].load(std::memory_order_relaxed);
+        ret.wait_time.m_buckets[i]
+          = wait_time[i].load(std::memory_order_relaxed);
+      }
+      return ret;
+    }
+
+    /** @brief Reset all counters to zero */
+    void reset() noexcept
+    {
+      for (auto *c : { &iterations, &tasks, &events, &waits,
+          &blocking_waits, &interrupts, &posts })
+        c->store(0, std::memory_order_relaxed);
+      for (std::size_t i = 0; i != histogram::bucket_count; ++i)
+      {
+        task_time[i].store(0, std::memory_order_relaxed);
+        wait_time[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    counter iterations;
+    counter tasks;
+    counter events;
+    counter waits;
+    counter blocking_waits;
+    counter interrupts;
+    counter posts;
+    buckets task_time;
+    buckets wait_time;
+  };
+}
+
+#endif
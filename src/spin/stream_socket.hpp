@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_STREAM_SOCKET_HPP_INCLUDED__
+#define __SPIN_STREAM_SOCKET_HPP_INCLUDED__
+
+#include <spin/buffer_pool.hpp>
+#include <spin/event_source.hpp>
+#include <spin/routine.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/socket.hpp>
+#include <spin/task.hpp>
+
+#include <cstddef>
+#include <system_error>
+#include <vector>
+
+namespace spin
+{
+  /**
+   * @brief Connected byte stream socket, e.g. TCP or Unix domain stream
+   *
+   * No buffer is held while the connection is idle. When the socket turns
+   * readable, data is read into a 64 KiB block borrowed from the buffer_pool
+   * of the scheduler, which is the same hot block edge after edge unless
+   * someone keeps it, and passed to the receive handler. The handler
+   * consumes what it has parsed, and only the rest is kept, copied into the
+   * smallest block that fits, until more data arrives. Reading stops once
+   * the budget of io_event_source is used up, and continues in next
+   * iteration of the scheduler.
+   *
+   * Data sent is queued in pooled buffers and written with as few sendmsg
+   * calls as possible in next iteration of the scheduler, within the same
+   * budget.
+   *
+   * Handlers run in tasks rather than in the event callback, so that an
+   * exception thrown by them propagates out of scheduler::run; data not
+   * consumed is kept, and reading continues once it's called again. The
+   * close handler is the last call into the socket, which may be destroyed
+   * at the end of it, along with the handler; but not in the receive
+   * handler.
+   */
+  class __SPIN_EXPORT__ stream_socket : public io_event_source
+  {
+  public:
+    /**
+     * @brief Handler called with data received, it should consume the
+     * parsed part of @a data, and may keep slices of it
+     */
+    using receive_handler = routine<stream_socket &, buffer &>;
+
+    /**
+     * @brief Handler called once the socket is closed, the error code is
+     * empty if the peer shut down
+     */
+    using close_handler = routine<stream_socket &, const std::error_code &>;
+
+    /** @brief Take over a connected socket, e.g. one accepted by acceptor */
+    stream_socket(scheduler &s, system_handle socket,
+        receive_handler on_receive, close_handler on_close);
+
+    /**
+     * @brief Start connecting to @a peer, data sent is queued until the
+     * connection is established; failure is reported to the close handler
+     * @throws std::system_error if failed to create the socket or to start
+     * connecting
+     */
+    stream_socket(scheduler &s, const socket_address &peer,
+        receive_handler on_receive, close_handler on_close);
+
+    ~stream_socket() noexcept;
+
+    bool is_open() const noexcept
+    { return !m_closed; }
+
+    /** @brief Queue a copy of data */
+    void send(const void *data, std::size_t size);
+
+    /** @brief Queue a buffer without copying, e.g. a slice received */
+    void send(buffer data);
+
+    /**
+     * @brief Write queued data now
+     * @returns Number of bytes left in queue
+     */
+    std::size_t flush() noexcept;
+
+    /** @brief Get number of bytes queued */
+    std::size_t get_pending_bytes() const noexcept
+    { return m_send_bytes; }
+
+    /** @brief Get number of bytes received but not consumed */
+    std::size_t get_buffered_bytes() const noexcept
+    { return m_received.size(); }
+
+  protected:
+    void on_readable() noexcept override;
+
+    void on_writable() noexcept override;
+
+  private:
+    /** @brief Drain the readable edge, run by a task */
+    void receive();
+
+    /**
+     * @brief Read once and pass data to handler
+     * @returns Number of bytes read, or -1 if drained or closed
+     */
+    std::ptrdiff_t read_once();
+
+    /** @brief Keep data not consumed in @a b until more arrives */
+    void keep_received(buffer &b);
+
+    /**
+     * @brief Write once from the head of queue
+     * @returns Number of bytes written, or -1 if the queue is empty, the
+     * socket buffer is full or the socket is closed
+     */
+    std::ptrdiff_t write_once() noexcept;
+
+    /**
+     * @brief Shut down the socket and dispatch the close handler, members
+     * are still valid once it returns
+     */
+    void close(const std::error_code &error) noexcept;
+
+    void schedule_flush() noexcept;
+
+    scheduler &m_scheduler;
+    receive_handler m_on_receive;
+    close_handler m_on_close;
+    bool m_connecting;
+    bool m_closed;
+    std::error_code m_close_error;
+    task m_receive_task;
+    task m_close_task;
+
+    // Data not consumed by the handler, empty while idle
+    buffer m_received;
+
+    // Buffers to write from m_send_head, the last one may be appended if
+    // it's allocated by this socket
+    std::vector<buffer> m_send_queue;
+    std::size_t m_send_head;
+    std::size_t m_send_bytes;
+    bool m_send_tail_writable;
+    task m_flush_task;
+  };
+}
+
+#endif
@@ -66,6 +66,14 @@ namespace spin
     bool cancel() noexcept
     { return list_node<task>::unlink(*this); }
 
+    /** @brief Get type_info of the callable of this task */
+    const std::type_info &target_type() const noexcept
+    { return m_routine.target_type(); }
+
+    /** @brief Hint the processor to fetch the routine of this task */
+    void prefetch() const noexcept
+    { m_routine.prefetch(); }
+
   private:
 
     routine<> m_routine;
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_UNIX_SOCKET_HPP_INCLUDED__
+#define __SPIN_UNIX_SOCKET_HPP_INCLUDED__
+
+#include <spin/event_source.hpp>
+#include <spin/routine.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/socket.hpp>
+#include <spin/task.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace spin
+{
+  /** @brief A received message, only valid in the receive handler */
+  struct unix_message
+  {
+    /** @brief Payload, a chunk of the byte stream for SOCK_STREAM */
+    char *data;
+
+    /** @brief Size of payload */
+    std::size_t size;
+
+    /**
+     * @brief Descriptors passed with SCM_RIGHTS, the handler may move them
+     * out, the rest are closed after the handler returns
+     */
+    system_handle *handles;
+
+    /** @brief Number of descriptors passed */
+    std::size_t handle_count;
+
+    /**
+     * @brief The message was larger than the receive buffer, or some
+     * descriptors were discarded because there were too many
+     */
+    bool truncated;
+  };
+
+  /**
+   * @brief Connected Unix domain socket of SOCK_STREAM or SOCK_SEQPACKET
+   *
+   * On each readable edge, messages are drained with recvmmsg, a batch at
+   * a time within the budget of io_event_source, and passed to the receive
+   * handler. Messages sent are queued and flushed in next iteration of the
+   * scheduler within the same budget: with sendmmsg for SOCK_SEQPACKET, or
+   * gathered into as few sendmsg calls as possible for SOCK_STREAM where a
+   * partial write may happen.
+   *
+   * Receiving end of file, or failing to send, shuts down the socket and
+   * calls the close handler once. As recvmmsg can't tell them apart, a
+   * SOCK_SEQPACKET message of zero length without descriptors is taken as
+   * end of file too.
+   *
+   * Handlers run in tasks rather than in the event callback, so that an
+   * exception thrown by them propagates out of scheduler::run; messages
+   * left are received once it's called again. The close handler is the
+   * last call into the socket, which may be destroyed at the end of it,
+   * along with the handler; but not in the receive handler.
+   */
+  class __SPIN_EXPORT__ unix_socket : public io_event_source
+  {
+  public:
+    struct options
+    {
+      options() noexcept
+        : batch_size(16)
+        , buffer_size(4096)
+        , max_handles(8)
+      { }
+
+      /** @brief Number of messages per recvmmsg, and queued for sending */
+      std::size_t batch_size;
+
+      /** @brief Size of each receive buffer */
+      std::size_t buffer_size;
+
+      /** @brief Maximum number of descriptors received per message */
+      std::size_t max_handles;
+    };
+
+    /** @brief Handler called with a batch of messages received */
+    using receive_handler = routine<unix_socket &, unix_message *,
+          std::size_t>;
+
+    /**
+     * @brief Handler called once the socket is closed, the error code is
+     * empty if the peer shut down
+     */
+    using close_handler = routine<unix_socket &, const std::error_code &>;
+
+    /**
+     * @brief Take over a connected socket, e.g. one accepted by acceptor or
+     * created by open_socket_pair
+     */
+    unix_socket(scheduler &s, system_handle socket,
+        receive_handler on_receive, close_handler on_close,
+        const options &opt = options());
+
+    /**
+     * @brief Connect to @a peer
+     * @param type SOCK_STREAM or SOCK_SEQPACKET
+     * @throws std::system_error if failed to connect, including EAGAIN if
+     * the backlog of the listening socket is full
+     */
+    unix_socket(scheduler &s, const socket_address &peer, int type,
+        receive_handler on_receive, close_handler on_close,
+        const options &opt = options());
+
+    ~unix_socket() noexcept;
+
+    /** @brief Test if the socket is still open */
+    bool is_open() const noexcept
+    { return !m_closed; }
+
+    /** @brief Get SOCK_STREAM or SOCK_SEQPACKET */
+    int get_type() const noexcept
+    { return m_type; }
+
+    /**
+     * @brief Queue a message with descriptors to pass
+     *
+     * Descriptors are duplicated, so the caller is free to close them
+     * once this function returns.
+     * @returns false if the queue is still full after an attempt to
+     * flush, or the socket is closed
+     * @throws std::length_error if @a size is larger than the queue can
+     * hold, or there are more than max_handles descriptors
+     */
+    bool send(const void *data, std::size_t size,
+        const system_handle *handles = nullptr, std::size_t handle_count = 0);
+
+    /**
+     * @brief Send queued messages now
+     * @returns Number of messages left in queue
+     */
+    std::size_t flush() noexcept;
+
+    /** @brief Get number of messages queued */
+    std::size_t get_pending_count() const noexcept
+    { return m_send_tail - m_send_head; }
+
+  protected:
+    void on_readable() noexcept override;
+
+    void on_writable() noexcept override;
+
+  private:
+    /**
+     * @brief Shut down the socket and dispatch the close handler, members
+     * are still valid once it returns
+     */
+    void close(const std::error_code &error) noexcept;
+
+    /**
+     * @brief Receive a batch and pass it to handler
+     * @returns Number of bytes received, or -1 if drained or closed
+     */
+    std::ptrdiff_t receive_batch();
+
+    /** @brief Complete @a n messages from the head of the send queue */
+    void pop_sent(std::size_t n) noexcept;
+
+    /**
+     * @brief Send once from the head of queue
+     * @returns Number of bytes sent, or -1 if the queue is empty, the socket
+     * buffer is full or the socket is closed
+     */
+    std::ptrdiff_t send_stream() noexcept;
+
+    /** @brief Send a batch from the head of queue, see #send_stream */
+    std::ptrdiff_t send_seqpacket() noexcept;
+
+    scheduler &m_scheduler;
+    receive_handler m_on_receive;
+    close_handler m_on_close;
+    const int m_type;
+    const std::size_t m_batch_size;
+    const std::size_t m_buffer_size;
+    const std::size_t m_max_handles;
+    const std::size_t m_control_size;
+    bool m_closed;
+    std::error_code m_close_error;
+    task m_receive_task;
+    task m_close_task;
+
+    // Receive side, headers point to the buffers for the whole lifetime
+    std::unique_ptr<char[]> m_receive_buffer;
+    std::unique_ptr<char[]> m_receive_control;
+    std::vector<::mmsghdr> m_receive_headers;
+    std::vector<::iovec> m_receive_iovecs;
+    std::vector<system_handle> m_received_handles;
+    std::vector<unix_message> m_messages;
+
+    // Send side, payloads are packed in m_send_buffer, descriptors are
+    // kept open until they are sent
+    std::unique_ptr<char[]> m_send_buffer;
+    std::size_t m_send_buffer_used;
+    std::unique_ptr<char[]> m_send_control;
+    std::vector<::mmsghdr> m_send_headers;
+    std::vector<::iovec> m_send_iovecs;
+    std::vector<std::vector<system_handle>> m_send_handles;
+    std::size_t m_send_head;
+    std::size_t m_send_tail;
+    task m_flush_task;
+  };
+}
+
+#endif
@@ -24,11 +24,15 @@
 #include <spin/intruse/list.hpp>
 #include <spin/intruse/rbtree.hpp>
 
+#include <cstddef>
 #include <utility>
 
 
 namespace spin
 {
+  /** @brief Assumed size of cache line, used to pad shared data apart */
+  constexpr std::size_t cache_line_size = 64;
+
   template<typename Callable>
   class block_guard
   {
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_WATCHDOG_HPP_INCLUDED__
+#define __SPIN_WATCHDOG_HPP_INCLUDED__
+
+#include <spin/environment.hpp>
+#include <spin/routine.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+#include <pthread.h>
+
+namespace spin
+{
+  class scheduler;
+  class watchdog;
+
+  /** @brief Kind of activity that a scheduler is performing */
+  enum class watchdog_activity
+  {
+    task,
+    event
+  };
+
+  /** @brief Description of an activity which exceeded the threshold */
+  struct watchdog_report
+  {
+    /**
+     * @brief The scheduler where the activity is running, valid until the
+     * handler returns
+     */
+    const scheduler *source;
+
+    /** @brief Whether it's a task or an event callback */
+    watchdog_activity activity;
+
+    /**
+     * @brief Type of the callable of a task, or of the event source whose
+     * callback is being executed
+     */
+    const std::type_info *target_type;
+
+    /** @brief Time elapsed since the activity started */
+    std::chrono::nanoseconds elapsed;
+
+    /**
+     * @brief Symbolized stack of the loop thread when the activity is
+     * detected, empty if backtrace capturing is disabled
+     */
+    std::vector<std::string> backtrace;
+  };
+
+  /**
+   * @brief Records the activity of a scheduler so that a watchdog can
+   * inspect it from another thread
+   *
+   * Each scheduler embeds a probe. The loop thread writes it with a
+   * sequence lock only while the scheduler is watched, so that recording
+   * an activity costs a clock read and a few relaxed stores and never
+   * blocks.
+   */
+  class watchdog_probe
+  {
+    friend class watchdog;
+  public:
+
+    explicit watchdog_probe(scheduler &source) noexcept
+      : m_source(source)
+      , m_owner(nullptr)
+      , m_sequence(0)
+      , m_start(0)
+      , m_target_type(nullptr)
+      , m_activity(watchdog_activity::task)
+      , m_thread()
+      , m_reported_sequence(0)
+    { }
+
+    watchdog_probe(const watchdog_probe &) = delete;
+
+    watchdog_probe &operator = (const watchdog_probe &) = delete;
+
+    /** @brief Get the watchdog watching this probe, or nullptr */
+    watchdog *get_owner() const noexcept
+    { return m_owner.load(std::memory_order_acquire); }
+
+    /** @brief Test if this probe is being watched */
+    bool is_watched() const noexcept
+    { return m_owner.load(std::memory_order_relaxed) != nullptr; }
+
+    /** @brief Mark start of an activity in loop thread */
+    void enter(watchdog_activity activity,
+        const std::type_info &target_type) noexcept
+    {
+      auto now = std::chrono::steady_clock::now().time_since_epoch();
+      auto seq = m_sequence.load(std::memory_order_relaxed);
+      m_sequence.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      m_start.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now).count(), std::memory_order_relaxed);
+      m_target_type.store(&target_type, std::memory_order_relaxed);
+      m_activity.store(activity, std::memory_order_relaxed);
+      m_thread.store(::pthread_self(), std::memory_order_relaxed);
+      m_sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /** @brief Mark end of the current activity in loop thread */
+    void leave() noexcept
+    {
+      auto seq = m_sequence.load(std::memory_order_relaxed);
+      m_sequence.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      m_start.store(0, std::memory_order_relaxed);
+      m_sequence.store(seq + 2, std::memory_order_release);
+    }
+
+  private:
+    scheduler &m_source;
+    std::atomic<watchdog *> m_owner;
+    std::atomic<std::uint64_t> m_sequence;
+    std::atomic<std::int64_t> m_start;
+    std::atomic<const std::type_info *> m_target_type;
+    std::atomic<watchdog_activity> m_activity;
+    std::atomic<pthread_t> m_thread;
+    std::uint64_t m_reported_sequence;
+  };
+
+  /**
+   * @brief Detect tasks and event callbacks that run for too long
+   *
+   * A watchdog owns a monitoring thread which periodically inspects the
+   * schedulers being watched, so that a loop wedged in a task is still
+   * detected. Each activity that runs longer than the threshold is reported
+   * once, on the monitoring thread, with the type of its callable and
+   * optionally a backtrace of the loop thread.
+   *
+   * A report is handled before its scheduler is unwatched or destroyed,
+   * and before its loop thread returns from scheduler::run, which wait for
+   * it if needed; so the handler must not wait for any of them in turn,
+   * though it may unwatch the scheduler being reported.
+   *
+   * @note Backtrace is captured by interrupting the loop thread with
+   * #get_backtrace_signal, the signal handler is installed when the first
+   * watchdog with backtrace capturing enabled is created. Symbol names are
+   * only available for exported symbols unless the program is linked with
+   * -rdynamic.
+   */
+  class __SPIN_EXPORT__ watchdog
+  {
+    friend class scheduler;
+  public:
+
+    /**
+     * @brief Construct and start the monitoring thread
+     * @param threshold Activities running longer than it are reported
+     * @param handler Called in the monitoring thread for each report
+     * @param capture_backtrace Whether to capture backtrace of the loop
+     */
+    watchdog(std::chrono::nanoseconds threshold,
+        routine<const watchdog_report &> handler,
+        bool capture_backtrace = false);
+
+    /** @brief Stop the monitoring thread and unwatch all schedulers */
+    ~watchdog() noexcept;
+
+    watchdog(const watchdog &) = delete;
+
+    watchdog &operator = (const watchdog &) = delete;
+
+    /**
+     * @brief Start watching a scheduler
+     * @throws std::logic_error if the scheduler is watched by another
+     * watchdog
+     * @note The scheduler unwatches itself on destruction, so a watchdog
+     * should outlive the schedulers it watches
+     */
+    void watch(scheduler &s);
+
+    /** @brief Stop watching a scheduler */
+    void unwatch(scheduler &s) noexcept;
+
+    /** @brief Get the signal used to capture backtrace of a loop thread */
+    static int get_backtrace_signal() noexcept;
+
+  private:
+
+    void monitor_routine();
+
+    bool inspect(watchdog_probe &probe, std::int64_t now,
+        watchdog_report &report, pthread_t &thread);
+
+    /** @brief Wait until reports of @a probe are handled */
+    void settle(watchdog_probe &probe) noexcept;
+
+    /**
+     * @brief Drop reports of @a probe not handled yet, and wait until the
+     * one being handled is done
+     */
+    void forget(watchdog_probe &probe, std::unique_lock<std::mutex> &guard)
+      noexcept;
+
+    std::chrono::nanoseconds m_threshold;
+    routine<const watchdog_report &> m_handler;
+    bool m_capture_backtrace;
+    bool m_exited;
+    std::mutex m_mutex;
+    std::condition_variable m_exit;
+    std::condition_variable m_handled;
+    std::list<watchdog_probe *> m_probes;
+
+    // Probes of reports not handled yet, nullptr once settled
+    std::vector<watchdog_probe *> m_pending;
+    watchdog_probe *m_handling;
+    std::thread m_thread;
+  };
+}
+
+#endif
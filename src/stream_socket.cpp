@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/stream_socket.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+
+namespace spin
+{
+  namespace
+  {
+    /** @brief Largest block, also the limit of data not consumed */
+    const std::size_t max_block_size = buffer_pool::get_block_size(
+        buffer_pool::size_class_count - 1);
+
+    /** @brief Least room to read into before moving to a larger block */
+    constexpr std::size_t min_read_size = 4096;
+
+    /** @brief Maximum number of buffers written per sendmsg */
+    constexpr std::size_t max_gather = 64;
+
+    system_handle connect_stream_socket(const socket_address &peer)
+    {
+      system_handle ret = open_socket(peer.get_family(), SOCK_STREAM);
+      if (::connect(ret.get_raw_handle(), peer.get_data(), peer.get_size())
+          == -1 && errno != EINPROGRESS)
+        throw_exception_for_last_error();
+      return ret;
+    }
+
+    std::error_code last_error() noexcept
+    { return std::error_code(errno, std::system_category()); }
+  }
+
+  stream_socket::stream_socket(scheduler &s, system_handle socket,
+      receive_handler on_receive, close_handler on_close)
+    : io_event_source(s, std::move(socket), readwrite)
+    , m_scheduler(s)
+    , m_on_receive(std::move(on_receive))
+    , m_on_close(std::move(on_close))
+    , m_connecting(false)
+    , m_closed(false)
+    , m_close_error()
+    , m_receive_task([this] { receive(); })
+    , m_close_task([this] { m_on_close(*this, m_close_error); })
+    , m_received()
+    , m_send_queue()
+    , m_send_head(0)
+    , m_send_bytes(0)
+    , m_send_tail_writable(false)
+    , m_flush_task([this] { flush(); })
+  { }
+
+  stream_socket::stream_socket(scheduler &s, const socket_address &peer,
+      receive_handler on_receive, close_handler on_close)
+    : stream_socket(s, connect_stream_socket(peer), std::move(on_receive),
+        std::move(on_close))
+  {
+    // Cleared by the first writable edge, which comes right away if the
+    // connection is already established
+    m_connecting = true;
+  }
+
+  stream_socket::~stream_socket() noexcept
+  {
+    m_flush_task.cancel();
+    m_receive_task.cancel();
+    m_close_task.cancel();
+  }
+
+  void stream_socket::send(const void *data, std::size_t size)
+  {
+    if (m_closed)
+      return;
+    auto *p = static_cast<const char *>(data);
+    buffer_pool &pool = m_scheduler.get_buffer_pool();
+    while (size != 0)
+    {
+      if (!m_send_tail_writable
+          || m_send_queue.back().capacity() == m_send_queue.back().size())
+      {
+        m_send_queue.reserve(m_send_queue.size() + 1);
+        buffer b = pool.allocate(std::min(size, max_block_size));
+        b.resize(0);
+        m_send_queue.push_back(std::move(b));
+        m_send_tail_writable = true;
+      }
+      buffer &tail = m_send_queue.back();
+      std::size_t n = std::min(size, tail.capacity() - tail.size());
+      std::memcpy(tail.data() + tail.size(), p, n);
+      tail.resize(tail.size() + n);
+      m_send_bytes += n;
+      p += n;
+      size -= n;
+    }
+    schedule_flush();
+  }
+
+  void stream_socket::send(buffer data)
+  {
+    if (m_closed || data.empty())
+      return;
+    m_send_bytes += data.size();
+    m_send_queue.push_back(std::move(data));
+    m_send_tail_writable = false;
+    schedule_flush();
+  }
+
+  void stream_socket::schedule_flush() noexcept
+  {
+    if (m_flush_task.is_canceled())
+      m_scheduler.dispatch(m_flush_task);
+  }
+
+  std::size_t stream_socket::flush() noexcept
+  {
+    if (m_closed || m_connecting)
+      return m_send_bytes;
+
+    drain_writable([this] { return write_once(); });
+
+    if (m_send_head == m_send_queue.size())
+    {
+      // Don't hold a large queue for an idle connection
+      if (m_send_queue.capacity() > max_gather)
+        std::vector<buffer>().swap(m_send_queue);
+      m_send_queue.clear();
+      m_send_head = 0;
+      m_send_tail_writable = false;
+      m_flush_task.cancel();
+    }
+    return m_send_bytes;
+  }
+
+  std::ptrdiff_t stream_socket::write_once() noexcept
+  {
+    int fd = get_device().get_raw_handle();
+    while (m_send_head != m_send_queue.size())
+    {
+      ::iovec iov[max_gather];
+      std::size_t count = std::min(max_gather,
+          m_send_queue.size() - m_send_head);
+      std::size_t total = 0;
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        iov[i].iov_base = m_send_queue[m_send_head + i].data();
+        iov[i].iov_len = m_send_queue[m_send_head + i].size();
+        total += iov[i].iov_len;
+      }
+      ::msghdr hdr;
+      std::memset(&hdr, 0, sizeof(hdr));
+      hdr.msg_iov = iov;
+      hdr.msg_iovlen = count;
+
+      ::ssize_t n = ::sendmsg(fd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n == -1)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          close(last_error());
+        return -1;
+      }
+
+      std::size_t written = static_cast<std::size_t>(n);
+      m_send_bytes -= written;
+      while (written != 0)
+      {
+        buffer &front = m_send_queue[m_send_head];
+        if (written < front.size())
+        {
+          front.consume(written);
+          break;
+        }
+        written -= front.size();
+        front.reset();
+        m_send_head++;
+      }
+      // Written partially, the socket buffer is full
+      if (static_cast<std::size_t>(n) != total)
+        return -1;
+      return n;
+    }
+    return -1;
+  }
+
+  void stream_socket::close(const std::error_code &error) noexcept
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+    ::shutdown(get_device().get_raw_handle(), SHUT_RDWR);
+    m_received.reset();
+    std::vector<buffer>().swap(m_send_queue);
+    m_send_head = 0;
+    m_send_bytes = 0;
+    m_send_tail_writable = false;
+    m_flush_task.cancel();
+    m_receive_task.cancel();
+    // The handler may destroy the socket, so it's called by a task with
+    // nothing else to do afterwards
+    m_close_error = error;
+    m_scheduler.dispatch(m_close_task);
+  }
+
+  void stream_socket::on_readable() noexcept
+  {
+    // The task is executed in this iteration too
+    if (!m_closed && m_receive_task.is_canceled())
+      m_scheduler.dispatch(m_receive_task);
+  }
+
+  void stream_socket::receive()
+  {
+    try
+    {
+      drain_readable([this] { return read_once(); });
+    }
+    catch (std::bad_alloc &)
+    {
+      // No block to read into, or the handler ran out of memory
+      close(std::make_error_code(std::errc::not_enough_memory));
+    }
+  }
+
+  std::ptrdiff_t stream_socket::read_once()
+  {
+    int fd = get_device().get_raw_handle();
+    buffer_pool &pool = m_scheduler.get_buffer_pool();
+    while (!m_closed)
+    {
+      // Read into a free block, or after data not consumed yet, moving it
+      // to a larger block if there isn't much room left
+      buffer b;
+      if (!m_received)
+      {
+        b = pool.allocate(max_block_size);
+        b.resize(0);
+      }
+      else if (m_received.capacity() - m_received.size() >= min_read_size)
+        b = std::move(m_received);
+      else if (m_received.size() == max_block_size)
+      {
+        close(std::make_error_code(std::errc::no_buffer_space));
+        return -1;
+      }
+      else
+      {
+        b = pool.allocate(std::min(m_received.size() + min_read_size,
+              max_block_size));
+        std::memcpy(b.data(), m_received.data(), m_received.size());
+        b.resize(m_received.size());
+        m_received.reset();
+      }
+
+      std::size_t offset = b.size();
+      std::size_t room = b.capacity() - offset;
+      ::ssize_t n = ::recv(fd, b.data() + offset, room, 0);
+      if (n == -1)
+      {
+        // Saved as allocating may change errno
+        int error = errno;
+        keep_received(b);
+        if (error == EINTR)
+          continue;
+        if (error != EAGAIN && error != EWOULDBLOCK)
+          close(std::error_code(error, std::system_category()));
+        return -1;
+      }
+      if (n == 0)
+      {
+        close(std::error_code());
+        return -1;
+      }
+
+      b.resize(offset + static_cast<std::size_t>(n));
+      try
+      {
+        m_on_receive(*this, b);
+      }
+      catch (...)
+      {
+        m_received = std::move(b);
+        throw;
+      }
+      if (m_closed)
+        return -1;
+
+      keep_received(b);
+
+      // A short read doesn't mean the socket is drained, end of file may
+      // follow the data under the same edge; only EAGAIN tells so
+      return n;
+    }
+    return -1;
+  }
+
+  void stream_socket::keep_received(buffer &b)
+  {
+    // Keep the rest in the smallest block that fits, so that the large
+    // block goes back to pool
+    if (b.empty())
+      return;
+    if (buffer_pool::get_block_size(buffer_pool::get_size_class(b.size()))
+        < b.block_size())
+    {
+      buffer rest = m_scheduler.get_buffer_pool().allocate(b.size());
+      std::memcpy(rest.data(), b.data(), b.size());
+      rest.resize(b.size());
+      m_received = std::move(rest);
+    }
+    else
+      m_received = std::move(b);
+  }
+
+  void stream_socket::on_writable() noexcept
+  {
+    if (m_connecting && !m_closed)
+    {
+      int error = 0;
+      ::socklen_t size = sizeof(error);
+      if (::getsockopt(get_device().get_raw_handle(), SOL_SOCKET, SO_ERROR,
+            &error, &size) == -1)
+        error = errno;
+      if (error != 0)
+      {
+        close(std::error_code(error, std::system_category()));
+        return;
+      }
+      m_connecting = false;
+    }
+    if (m_send_bytes != 0)
+      flush();
+  }
+}
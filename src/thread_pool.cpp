@@ -16,6 +16,7 @@
  */
 
 #include <spin/thread_pool.hpp>
+#include <spin/epoch.hpp>
 
 namespace spin
 {
@@ -67,6 +68,7 @@ namespace spin
 
   void thread_pool::thread_routine()
   {
+    epoch::registration registration;
     for ( ; ; )
     {
       routine<> current;
@@ -90,7 +92,9 @@ namespace spin
           m_idle_thread_count++;
           if (m_idle_thread_count == m_max_thread_count)
             m_idle.notify_one();
+          epoch::offline();
           m_task.wait(thread_pool_guard);
+          epoch::online();
           m_idle_thread_count--;
         }
       }
@@ -101,6 +105,7 @@ namespace spin
       m_queued_tasks.pop_front();
       thread_pool_guard.unlock();
       current();
+      epoch::quiescent();
     }
   }
 
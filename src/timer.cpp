@@ -123,6 +123,9 @@ namespace spin
   template<typename Clock>
   void timer_service<Clock>::on_emit() noexcept
   {
+    // One-shot timers release this service once they expire, keep it
+    // alive until this function returns
+    auto self = this->shared_from_this();
     auto now = timer::clock::now();
     task::queue_type l;
 
@@ -302,7 +305,13 @@ namespace spin
     {
       auto next_tp = timer::get_index(*this);
       m_missed_counter += adjust_time_point<Clock>(next_tp, now, m_interval);
-      timer::update_index(*this, std::move(next_tp), intruse::policy_backmost);
+
+      // A periodic timer is usually re-armed later than all others, try
+      // the back of queue first so it's linked in amortized constant time
+      auto &queue = m_timer_service->m_deadline_timer_queue;
+      timer::unlink(*this);
+      timer::update_index(*this, std::move(next_tp));
+      queue.insert(queue.end(), *this, intruse::policy_backmost);
     }
   }
 
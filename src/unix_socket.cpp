@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/unix_socket.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+
+namespace spin
+{
+  namespace
+  {
+    system_handle connect_unix_socket(const socket_address &peer, int type)
+    {
+      system_handle ret = open_socket(AF_UNIX, type);
+      if (::connect(ret.get_raw_handle(), peer.get_data(), peer.get_size())
+          == -1)
+        throw_exception_for_last_error();
+      return ret;
+    }
+
+    int get_socket_type(const system_handle &socket)
+    {
+      int type;
+      ::socklen_t size = sizeof(type);
+      if (::getsockopt(socket.get_raw_handle(), SOL_SOCKET, SO_TYPE, &type,
+            &size) == -1)
+        throw_exception_for_last_error();
+      if (type != SOCK_STREAM && type != SOCK_SEQPACKET)
+        throw std::invalid_argument("Not a stream or seqpacket socket");
+      return type;
+    }
+
+    std::error_code last_error() noexcept
+    { return std::error_code(errno, std::system_category()); }
+  }
+
+  unix_socket::unix_socket(scheduler &s, system_handle socket,
+      receive_handler on_receive, close_handler on_close,
+      const options &opt)
+    : io_event_source(s, std::move(socket), readwrite)
+    , m_scheduler(s)
+    , m_on_receive(std::move(on_receive))
+    , m_on_close(std::move(on_close))
+    , m_type(get_socket_type(get_device()))
+    , m_batch_size(opt.batch_size)
+    , m_buffer_size(opt.buffer_size)
+    , m_max_handles(opt.max_handles)
+    , m_control_size(opt.max_handles == 0 ? 0
+        : CMSG_SPACE(sizeof(int) * opt.max_handles))
+    , m_closed(false)
+    , m_close_error()
+    , m_receive_task([this]
+        { drain_readable([this] { return receive_batch(); }); })
+    , m_close_task([this] { m_on_close(*this, m_close_error); })
+    , m_receive_buffer(new char[opt.batch_size * opt.buffer_size])
+    , m_receive_control(new char[opt.batch_size * m_control_size])
+    , m_receive_headers(opt.batch_size)
+    , m_receive_iovecs(opt.batch_size)
+    , m_received_handles()
+    , m_messages(opt.batch_size)
+    , m_send_buffer(new char[opt.batch_size * opt.buffer_size])
+    , m_send_buffer_used(0)
+    , m_send_control(new char[opt.batch_size * m_control_size])
+    , m_send_headers(opt.batch_size)
+    , m_send_iovecs(opt.batch_size)
+    , m_send_handles(opt.batch_size)
+    , m_send_head(0)
+    , m_send_tail(0)
+    , m_flush_task([this] { flush(); })
+  {
+    if (m_batch_size == 0 || m_buffer_size == 0)
+      throw std::invalid_argument("Batch size and buffer size must be "
+          "positive");
+
+    // Reserved so that receiving doesn't allocate; padding of the control
+    // buffer may leave room for more descriptors than max_handles, and the
+    // kernel fills it
+    if (m_control_size != 0)
+      m_received_handles.reserve(m_batch_size
+          * ((m_control_size - CMSG_LEN(0)) / sizeof(int)));
+
+    for (std::size_t i = 0; i < m_batch_size; ++i)
+    {
+      m_receive_iovecs[i].iov_base = &m_receive_buffer[i * m_buffer_size];
+      m_receive_iovecs[i].iov_len = m_buffer_size;
+      ::msghdr &hdr = m_receive_headers[i].msg_hdr;
+      std::memset(&hdr, 0, sizeof(hdr));
+      hdr.msg_iov = &m_receive_iovecs[i];
+      hdr.msg_iovlen = 1;
+      if (m_control_size != 0)
+        hdr.msg_control = &m_receive_control[i * m_control_size];
+      std::memset(&m_send_headers[i].msg_hdr, 0, sizeof(::msghdr));
+    }
+  }
+
+  unix_socket::unix_socket(scheduler &s, const socket_address &peer,
+      int type, receive_handler on_receive, close_handler on_close,
+      const options &opt)
+    : unix_socket(s, connect_unix_socket(peer, type), std::move(on_receive),
+        std::move(on_close), opt)
+  { }
+
+  unix_socket::~unix_socket() noexcept
+  {
+    m_flush_task.cancel();
+    m_receive_task.cancel();
+    m_close_task.cancel();
+  }
+
+  bool unix_socket::send(const void *data, std::size_t size,
+      const system_handle *handles, std::size_t handle_count)
+  {
+    const std::size_t capacity = m_batch_size * m_buffer_size;
+    if (size > capacity)
+      throw std::length_error("Message is larger than send queue");
+    if (handle_count > m_max_handles)
+      throw std::length_error("Too many descriptors in a message");
+    if (m_closed)
+      return false;
+
+    if (m_send_tail == m_batch_size || m_send_buffer_used + size > capacity)
+      if (flush() != 0 || m_closed)
+        return false;
+
+    std::vector<system_handle> duplicates;
+    duplicates.reserve(handle_count);
+    for (std::size_t k = 0; k < handle_count; ++k)
+      duplicates.emplace_back(::fcntl, handles[k].get_raw_handle(),
+          F_DUPFD_CLOEXEC, 0);
+
+    std::size_t i = m_send_tail;
+    char *payload = &m_send_buffer[m_send_buffer_used];
+    std::memcpy(payload, data, size);
+    m_send_buffer_used += size;
+    m_send_iovecs[i].iov_base = payload;
+    m_send_iovecs[i].iov_len = size;
+
+    ::msghdr &hdr = m_send_headers[i].msg_hdr;
+    hdr.msg_iov = &m_send_iovecs[i];
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = nullptr;
+    hdr.msg_controllen = 0;
+    if (handle_count != 0)
+    {
+      hdr.msg_control = &m_send_control[i * m_control_size];
+      hdr.msg_controllen = CMSG_SPACE(sizeof(int) * handle_count);
+      ::cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int) * handle_count);
+      int *fds = reinterpret_cast<int *>(CMSG_DATA(cmsg));
+      for (std::size_t k = 0; k < handle_count; ++k)
+        fds[k] = duplicates[k].get_raw_handle();
+    }
+    m_send_handles[i] = std::move(duplicates);
+
+    m_send_tail++;
+    if (m_flush_task.is_canceled())
+      m_scheduler.dispatch(m_flush_task);
+    return true;
+  }
+
+  std::size_t unix_socket::flush() noexcept
+  {
+    if (!m_closed)
+      drain_writable([this]
+          {
+            return m_type == SOCK_STREAM ? send_stream() : send_seqpacket();
+          });
+
+    if (m_send_head == m_send_tail)
+    {
+      m_send_head = m_send_tail = 0;
+      m_send_buffer_used = 0;
+      m_flush_task.cancel();
+    }
+    return m_send_tail - m_send_head;
+  }
+
+  std::ptrdiff_t unix_socket::send_seqpacket() noexcept
+  {
+    int fd = get_device().get_raw_handle();
+    while (m_send_head != m_send_tail)
+    {
+      int n = ::sendmmsg(fd, &m_send_headers[m_send_head],
+          static_cast<unsigned>(m_send_tail - m_send_head),
+          MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n == -1)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          close(last_error());
+        return -1;
+      }
+
+      std::ptrdiff_t bytes = 0;
+      for (int i = 0; i < n; ++i)
+        bytes += static_cast<std::ptrdiff_t>(
+            m_send_iovecs[m_send_head + i].iov_len);
+      pop_sent(static_cast<std::size_t>(n));
+      return bytes;
+    }
+    return -1;
+  }
+
+  std::ptrdiff_t unix_socket::send_stream() noexcept
+  {
+    int fd = get_device().get_raw_handle();
+    while (m_send_head != m_send_tail)
+    {
+      // Gather messages into one sendmsg until the next one carrying
+      // descriptors, as they are attached to the first byte written
+      std::size_t end = m_send_head + 1;
+      while (end != m_send_tail && m_send_handles[end].empty()
+          && end - m_send_head < IOV_MAX)
+        ++end;
+
+      ::msghdr hdr = m_send_headers[m_send_head].msg_hdr;
+      hdr.msg_iov = &m_send_iovecs[m_send_head];
+      hdr.msg_iovlen = end - m_send_head;
+      ::ssize_t n = ::sendmsg(fd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n == -1)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          close(last_error());
+        return -1;
+      }
+
+      std::size_t written = static_cast<std::size_t>(n);
+      std::size_t completed = 0;
+      while (m_send_head + completed != end
+          && written >= m_send_iovecs[m_send_head + completed].iov_len)
+        written -= m_send_iovecs[m_send_head + completed++].iov_len;
+      pop_sent(completed);
+
+      if (m_send_head != end)
+      {
+        // Written partially, the socket buffer is full
+        ::iovec &iov = m_send_iovecs[m_send_head];
+        iov.iov_base = static_cast<char *>(iov.iov_base) + written;
+        iov.iov_len -= written;
+        if (written != 0)
+        {
+          ::msghdr &rest = m_send_headers[m_send_head].msg_hdr;
+          rest.msg_control = nullptr;
+          rest.msg_controllen = 0;
+          m_send_handles[m_send_head].clear();
+        }
+        return -1;
+      }
+      return n;
+    }
+    return -1;
+  }
+
+  void unix_socket::pop_sent(std::size_t n) noexcept
+  {
+    for ( ; n != 0; --n)
+      m_send_handles[m_send_head++].clear();
+  }
+
+  void unix_socket::close(const std::error_code &error) noexcept
+  {
+    if (m_closed)
+      return;
+    m_closed = true;
+    ::shutdown(get_device().get_raw_handle(), SHUT_RDWR);
+    pop_sent(m_send_tail - m_send_head);
+    m_send_head = m_send_tail = 0;
+    m_send_buffer_used = 0;
+    m_flush_task.cancel();
+    m_receive_task.cancel();
+    // The handler may destroy the socket, so it's called by a task with
+    // nothing else to do afterwards
+    m_close_error = error;
+    m_scheduler.dispatch(m_close_task);
+  }
+
+  void unix_socket::on_readable() noexcept
+  {
+    // The task is executed in this iteration too
+    if (!m_closed && m_receive_task.is_canceled())
+      m_scheduler.dispatch(m_receive_task);
+  }
+
+  std::ptrdiff_t unix_socket::receive_batch()
+  {
+    int fd = get_device().get_raw_handle();
+    while (!m_closed)
+    {
+      for (std::size_t i = 0; i < m_batch_size; ++i)
+      {
+        ::msghdr &hdr = m_receive_headers[i].msg_hdr;
+        hdr.msg_controllen = m_control_size;
+        hdr.msg_flags = 0;
+      }
+
+      int n = ::recvmmsg(fd, m_receive_headers.data(),
+          static_cast<unsigned>(m_batch_size),
+          MSG_DONTWAIT | MSG_CMSG_CLOEXEC, nullptr);
+      if (n == -1)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          close(last_error());
+        return -1;
+      }
+
+      std::size_t count = 0;
+      std::ptrdiff_t bytes = 0;
+      bool eof = false;
+      for ( ; count < static_cast<std::size_t>(n); ++count)
+      {
+        ::msghdr &hdr = m_receive_headers[count].msg_hdr;
+        unix_message &m = m_messages[count];
+        std::size_t first = m_received_handles.size();
+        for (::cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+            cmsg = CMSG_NXTHDR(&hdr, cmsg))
+          if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+          {
+            std::size_t k = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char *p = CMSG_DATA(cmsg);
+            for ( ; k != 0; --k, p += sizeof(int))
+            {
+              int passed;
+              std::memcpy(&passed, p, sizeof(int));
+              m_received_handles.emplace_back(passed);
+            }
+          }
+
+        m.data = &m_receive_buffer[count * m_buffer_size];
+        m.size = m_receive_headers[count].msg_len;
+        m.handles = nullptr;
+        m.handle_count = m_received_handles.size() - first;
+        m.truncated = (hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0;
+        if (m.size == 0 && m.handle_count == 0)
+        {
+          eof = true;
+          break;
+        }
+        bytes += static_cast<std::ptrdiff_t>(m.size);
+      }
+
+      // Point to descriptors once all are collected, as the vector may
+      // have been reallocated meanwhile
+      std::size_t offset = 0;
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        unix_message &m = m_messages[i];
+        m.handles = m.handle_count == 0 ? nullptr
+          : m_received_handles.data() + offset;
+        offset += m.handle_count;
+      }
+
+      if (count != 0)
+      {
+        try
+        {
+          m_on_receive(*this, m_messages.data(), count);
+        }
+        catch (...)
+        {
+          m_received_handles.clear();
+          throw;
+        }
+      }
+      m_received_handles.clear();
+
+      // A short batch doesn't mean the socket is drained, recvmmsg also
+      // returns early if an error is pending; only EAGAIN tells so
+      if (eof)
+        close(std::error_code());
+      else
+        return bytes;
+    }
+    return -1;
+  }
+
+  void unix_socket::on_writable() noexcept
+  {
+    if (get_pending_count() != 0)
+      flush();
+  }
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/watchdog.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/system.hpp>
+#include <spin/utils.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <execinfo.h>
+#include <signal.h>
+
+namespace spin
+{
+  namespace
+  {
+    constexpr int backtrace_depth = 64;
+
+    /**
+     * @brief The backtrace being captured
+     *
+     * It's static rather than on stack of the requester so that a signal
+     * handler which runs after the requester gave up does not write to a
+     * dead object.
+     */
+    struct backtrace_request
+    {
+      void *frames[backtrace_depth];
+      int size;
+      std::atomic_bool done;
+    };
+
+    backtrace_request s_request;
+    std::atomic_bool s_request_pending(false);
+    std::mutex s_request_mutex;
+    std::once_flag s_handler_installed;
+
+    void backtrace_handler(int)
+    {
+      int saved_errno = errno;
+      if (s_request_pending.exchange(false, std::memory_order_acquire))
+      {
+        s_request.size = ::backtrace(s_request.frames, backtrace_depth);
+        s_request.done.store(true, std::memory_order_release);
+      }
+      errno = saved_errno;
+    }
+
+    void install_backtrace_handler()
+    {
+      // backtrace may allocate on its first call while loading libgcc, do it
+      // here rather than in the signal handler
+      void *frame;
+      ::backtrace(&frame, 1);
+
+      struct sigaction action;
+      action.sa_handler = &backtrace_handler;
+      action.sa_flags = SA_RESTART;
+      ::sigemptyset(&action.sa_mask);
+      if (::sigaction(watchdog::get_backtrace_signal(), &action, nullptr))
+        throw_exception_for_last_error();
+    }
+
+    std::vector<std::string> capture_backtrace(pthread_t thread)
+    {
+      std::vector<std::string> ret;
+      std::lock_guard<std::mutex> guard(s_request_mutex);
+      s_request.done.store(false, std::memory_order_relaxed);
+      s_request_pending.store(true, std::memory_order_release);
+      if (::pthread_kill(thread, watchdog::get_backtrace_signal()) != 0)
+      {
+        s_request_pending.store(false, std::memory_order_relaxed);
+        return ret;
+      }
+
+      // The loop thread may have signals blocked, don't wait for too long
+      for (int i = 0; i < 100; ++i)
+      {
+        if (s_request.done.load(std::memory_order_acquire))
+          break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      if (s_request_pending.exchange(false, std::memory_order_relaxed)
+          || !s_request.done.load(std::memory_order_acquire))
+        return ret;
+
+      char **symbols = ::backtrace_symbols(s_request.frames, s_request.size);
+      if (symbols == nullptr)
+        return ret;
+      auto guard_symbols = make_block_guard([symbols] () noexcept
+          { std::free(symbols); });
+      ret.assign(symbols, symbols + s_request.size);
+      return ret;
+    }
+
+    std::int64_t steady_now() noexcept
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+  }
+
+  watchdog::watchdog(std::chrono::nanoseconds threshold,
+      routine<const watchdog_report &> handler, bool capture_backtrace)
+    : m_threshold(threshold)
+    , m_handler(std::move(handler))
+    , m_capture_backtrace(capture_backtrace)
+    , m_exited(false)
+    , m_mutex()
+    , m_exit()
+    , m_handled()
+    , m_probes()
+    , m_pending()
+    , m_handling(nullptr)
+    , m_thread()
+  {
+    if (m_capture_backtrace)
+      std::call_once(s_handler_installed, &install_backtrace_handler);
+    m_thread = std::thread(&watchdog::monitor_routine, this);
+  }
+
+  watchdog::~watchdog() noexcept
+  {
+    std::unique_lock<std::mutex> guard(m_mutex);
+    m_exited = true;
+    m_pending.clear();
+    guard.unlock();
+    m_exit.notify_all();
+    m_handled.notify_all();
+    m_thread.join();
+
+    // Still owned meanwhile, so that a loop returning waits for the report
+    // being handled
+    guard.lock();
+    for (auto *p : m_probes)
+      p->m_owner.store(nullptr, std::memory_order_release);
+    m_probes.clear();
+  }
+
+  void watchdog::watch(scheduler &s)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    watchdog_probe &probe = s.m_watchdog_probe;
+    watchdog *expected = nullptr;
+    if (!probe.m_owner.compare_exchange_strong(expected, this))
+    {
+      if (expected == this)
+        return;
+      throw std::logic_error("The scheduler is watched by another watchdog");
+    }
+    probe.m_reported_sequence = probe.m_sequence.load(
+        std::memory_order_relaxed);
+    m_probes.push_back(&probe);
+  }
+
+  void watchdog::unwatch(scheduler &s) noexcept
+  {
+    std::unique_lock<std::mutex> guard(m_mutex);
+    watchdog_probe &probe = s.m_watchdog_probe;
+    auto i = std::find(m_probes.begin(), m_probes.end(), &probe);
+    if (i == m_probes.end())
+      return;
+    probe.m_owner.store(nullptr, std::memory_order_release);
+    m_probes.erase(i);
+    forget(probe, guard);
+  }
+
+  void watchdog::settle(watchdog_probe &probe) noexcept
+  {
+    std::unique_lock<std::mutex> guard(m_mutex);
+    if (std::this_thread::get_id() != m_thread.get_id())
+      m_handled.wait(guard, [&]
+          {
+            return m_handling != &probe && std::find(m_pending.begin(),
+                m_pending.end(), &probe) == m_pending.end();
+          });
+  }
+
+  void watchdog::forget(watchdog_probe &probe,
+      std::unique_lock<std::mutex> &guard) noexcept
+  {
+    std::replace(m_pending.begin(), m_pending.end(), &probe,
+        static_cast<watchdog_probe *>(nullptr));
+    // Unless the handler itself unwatches the scheduler being reported
+    if (std::this_thread::get_id() != m_thread.get_id())
+      m_handled.wait(guard, [&] { return m_handling != &probe; });
+  }
+
+  int watchdog::get_backtrace_signal() noexcept
+  {
+    return SIGRTMIN;
+  }
+
+  bool watchdog::inspect(watchdog_probe &probe, std::int64_t now,
+      watchdog_report &report, pthread_t &thread)
+  {
+    auto seq = probe.m_sequence.load(std::memory_order_acquire);
+    auto start = probe.m_start.load(std::memory_order_relaxed);
+    auto type = probe.m_target_type.load(std::memory_order_relaxed);
+    auto activity = probe.m_activity.load(std::memory_order_relaxed);
+    thread = probe.m_thread.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // the probe is being written, check it again in next round
+    if ((seq & 1) != 0
+        || seq != probe.m_sequence.load(std::memory_order_relaxed))
+      return false;
+
+    if (start == 0 || seq == probe.m_reported_sequence
+        || now - start < m_threshold.count())
+      return false;
+
+    probe.m_reported_sequence = seq;
+    report.source = &probe.m_source;
+    report.activity = activity;
+    report.target_type = type;
+    report.elapsed = std::chrono::nanoseconds(now - start);
+    return true;
+  }
+
+  void watchdog::monitor_routine()
+  {
+    auto period = std::max(m_threshold / 4,
+        std::chrono::nanoseconds(std::chrono::milliseconds(1)));
+    std::unique_lock<std::mutex> guard(m_mutex);
+    std::vector<watchdog_report> reports;
+    std::vector<pthread_t> threads;
+
+    while (!m_exited)
+    {
+      m_exit.wait_for(guard, period);
+      if (m_exited)
+        break;
+
+      auto now = steady_now();
+      for (auto *p : m_probes)
+      {
+        watchdog_report report;
+        pthread_t thread;
+        if (inspect(*p, now, report, thread))
+        {
+          reports.push_back(std::move(report));
+          threads.push_back(thread);
+          m_pending.push_back(p);
+        }
+      }
+
+      // Handler may watch or unwatch schedulers, and capturing backtrace
+      // may take a while, which would block them; the scheduler and its
+      // loop thread are kept alive meanwhile by settle and forget
+      for (std::size_t i = 0; i < reports.size() && !m_exited; ++i)
+      {
+        if (m_pending[i] == nullptr)
+          continue;
+        m_handling = m_pending[i];
+        guard.unlock();
+        if (m_capture_backtrace)
+          reports[i].backtrace = capture_backtrace(threads[i]);
+        m_handler(reports[i]);
+        guard.lock();
+        m_handling = nullptr;
+        m_pending[i] = nullptr;
+        m_handled.notify_all();
+      }
+      reports.clear();
+      threads.clear();
+      m_pending.clear();
+    }
+  }
+}
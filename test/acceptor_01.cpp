@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/acceptor.hpp>
+#include <spin/timer.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+  /** @brief Connect with a blocking socket, completed by kernel backlog */
+  spin::system_handle connect_to(const spin::socket_address &address)
+  {
+    spin::system_handle ret(::socket, address.get_family(), SOCK_STREAM, 0);
+    int result = ::connect(ret.get_raw_handle(), address.get_data(),
+        address.get_size());
+    assert(result == 0);
+    (void) result;
+    return ret;
+  }
+
+  /** @brief Worker schedulers running in their own threads */
+  struct worker_set
+  {
+    explicit worker_set(std::size_t n)
+      : schedulers(n)
+      , threads()
+    {
+      for (auto &s : schedulers)
+      {
+        auto monitor = s.get_event_monitor();
+        threads.emplace_back([&s, monitor] { s.run(); });
+      }
+    }
+
+    ~worker_set()
+    {
+      for (auto &s : schedulers)
+        s.stop(true);
+      for (auto &t : threads)
+        t.join();
+    }
+
+    std::vector<spin::scheduler *> pointers()
+    {
+      std::vector<spin::scheduler *> ret;
+      for (auto &s : schedulers)
+        ret.push_back(&s);
+      return ret;
+    }
+
+    std::vector<spin::scheduler> schedulers;
+    std::vector<std::thread> threads;
+  };
+}
+
+void check_accept()
+{
+  constexpr std::size_t N = 5;
+  spin::scheduler loop;
+  std::vector<spin::system_handle> accepted;
+  spin::acceptor listener(loop, spin::socket_address::from_ip("127.0.0.1", 0),
+      [&](spin::system_handle &h)
+      {
+        accepted.push_back(std::move(h));
+        if (accepted.size() == N)
+          loop.stop();
+      });
+  auto address = listener.get_local_address();
+  assert(address.get_port() != 0);
+
+  std::vector<spin::system_handle> clients;
+  for (std::size_t i = 0; i < N; ++i)
+    clients.push_back(connect_to(address));
+  loop.run();
+  assert(accepted.size() == N);
+}
+
+/** @brief Connections are balanced, and follow releases */
+void check_distribution(spin::distributing_acceptor::policy p)
+{
+  constexpr std::size_t W = 3;
+  constexpr std::size_t N = 30;
+  spin::scheduler loop;
+  worker_set workers(W);
+  std::vector<std::thread::id> ids;
+  for (auto &t : workers.threads)
+    ids.push_back(t.get_id());
+
+  std::atomic_size_t total(0);
+  std::atomic_size_t expected(N);
+  std::atomic_size_t counts[W];
+  for (auto &c : counts)
+    c.store(0);
+  spin::task stopper([&] { loop.stop(); });
+
+  spin::distributing_acceptor listener(loop,
+      spin::socket_address::from_ip("127.0.0.1", 0), workers.pointers(),
+      [&](spin::system_handle &h, std::size_t worker)
+      {
+        // Delivered in the thread of the worker
+        assert(std::this_thread::get_id() == ids[worker]);
+        assert(h);
+        counts[worker]++;
+        if (++total == expected)
+          loop.post(stopper);
+      }, p);
+  assert(listener.get_worker_count() == W);
+
+  std::vector<spin::system_handle> clients;
+  for (std::size_t i = 0; i < N; ++i)
+    clients.push_back(connect_to(listener.get_local_address()));
+  loop.run();
+  for (std::size_t i = 0; i < W; ++i)
+  {
+    assert(counts[i] == N / W);
+    assert(listener.get_connection_count(i) == N / W);
+  }
+
+  for (std::size_t i = 0; i < 5; ++i)
+    listener.release(1);
+  assert(listener.get_connection_count(1) == N / W - 5);
+  expected += 5;
+  for (std::size_t i = 0; i < 5; ++i)
+    clients.push_back(connect_to(listener.get_local_address()));
+  loop.run();
+
+  if (p == spin::distributing_acceptor::policy::least_connections)
+  {
+    assert(counts[0] == N / W);
+    assert(counts[1] == N / W + 5);
+    assert(counts[2] == N / W);
+  }
+  else
+    assert(counts[0] + counts[1] + counts[2] == N + 5);
+}
+
+/** @brief Listeners sharing a port with SO_REUSEPORT accept them all */
+void check_reuse_port()
+{
+  constexpr std::size_t N = 20;
+  spin::scheduler loop;
+  spin::acceptor::options opt;
+  opt.reuse_port = true;
+  std::size_t accepted[2] = { 0, 0 };
+  std::vector<spin::system_handle> connections;
+  auto handler = [&](std::size_t i)
+  {
+    return [&, i](spin::system_handle &h)
+    {
+      accepted[i]++;
+      connections.push_back(std::move(h));
+      if (accepted[0] + accepted[1] == N)
+        loop.stop();
+    };
+  };
+
+  spin::acceptor first(loop, spin::socket_address::from_ip("127.0.0.1", 0),
+      handler(0), opt);
+  spin::acceptor second(loop, first.get_local_address(), handler(1), opt);
+  assert(first.get_local_address() == second.get_local_address());
+
+  std::vector<spin::system_handle> clients;
+  for (std::size_t i = 0; i < N; ++i)
+    clients.push_back(connect_to(first.get_local_address()));
+  loop.run();
+  assert(accepted[0] + accepted[1] == N);
+}
+
+/**
+ * @brief Connections left in backlog while out of descriptors are accepted
+ * once descriptors are available again, without another edge
+ */
+void check_out_of_descriptors()
+{
+  constexpr std::size_t N = 3;
+  spin::scheduler loop;
+  std::vector<spin::system_handle> connections;
+  spin::acceptor listener(loop, spin::socket_address::from_ip("127.0.0.1", 0),
+      [&](spin::system_handle &h)
+      {
+        connections.push_back(std::move(h));
+        if (connections.size() == N)
+          loop.stop();
+      });
+  std::vector<spin::system_handle> clients;
+  for (std::size_t i = 0; i < N; ++i)
+    clients.push_back(connect_to(listener.get_local_address()));
+
+  ::rlimit saved;
+  assert(::getrlimit(RLIMIT_NOFILE, &saved) == 0);
+  spin::steady_timer restore(loop, [&]
+      { assert(::setrlimit(RLIMIT_NOFILE, &saved) == 0); },
+      spin::steady_timer::clock::now() + std::chrono::milliseconds(50));
+  spin::steady_timer timeout(loop, [&] { loop.stop(); },
+      spin::steady_timer::clock::now() + std::chrono::seconds(5));
+
+  // Lower the limit to the lowest free descriptor, so that none is left
+  ::rlimit tight = saved;
+  {
+    spin::system_handle lowest(::dup(0));
+    tight.rlim_cur = static_cast<rlim_t>(lowest.get_raw_handle());
+  }
+  assert(::setrlimit(RLIMIT_NOFILE, &tight) == 0);
+
+  loop.run();
+  assert(connections.size() == N);
+}
+
+int main()
+{
+  check_accept();
+  check_distribution(spin::distributing_acceptor::policy::round_robin);
+  check_distribution(spin::distributing_acceptor::policy::least_connections);
+  check_reuse_port();
+  check_out_of_descriptors();
+}
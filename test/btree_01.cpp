@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/btree.hpp>
+#include <cassert>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct item
+{
+  int id;
+};
+
+/** @brief Key whose copy throws once a number of copies is used up */
+struct fragile_key
+{
+  static int copies_left;
+
+  fragile_key(int v = 0) noexcept
+    : v(v)
+  { }
+
+  fragile_key(const fragile_key &k)
+    : v(k.v)
+  { check_copy(); }
+
+  fragile_key(fragile_key &&k) noexcept = default;
+
+  fragile_key &operator = (const fragile_key &k)
+  {
+    check_copy();
+    v = k.v;
+    return *this;
+  }
+
+  fragile_key &operator = (fragile_key &&k) noexcept = default;
+
+  static void check_copy()
+  {
+    if (copies_left >= 0 && copies_left-- == 0)
+      throw copies_left;
+  }
+
+  friend bool operator < (const fragile_key &x, const fragile_key &y)
+  { return x.v < y.v; }
+
+  friend bool operator == (const fragile_key &x, const fragile_key &y)
+  { return x.v == y.v; }
+
+  int v;
+};
+
+int fragile_key::copies_left = -1;
+
+template<typename Index, typename Key>
+void check(const Index &index, const std::map<Key, item*> &expected)
+{
+  assert (index.size() == expected.size());
+  assert (index.empty() == expected.empty());
+  auto i = index.begin();
+  for (auto &x : expected)
+  {
+    assert (i != index.end());
+    assert (i.key() == x.first);
+    assert (&*i == x.second);
+    ++i;
+  }
+  assert (i == index.end());
+
+  // Walk backward as well
+  for (auto j = expected.rbegin(); j != expected.rend(); ++j)
+  {
+    --i;
+    assert (i.key() == j->first);
+  }
+  assert (i == index.begin());
+}
+
+template<std::size_t Capacity>
+void random_test(unsigned seed)
+{
+  const int max = 2000;
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> dist(0, max - 1);
+  std::vector<item> items(max);
+  for (int i = 0; i < max; i++)
+    items[i].id = i;
+
+  spin::btree<int, item, spin::less<int>, Capacity> index;
+  std::map<int, item*> expected;
+
+  for (int round = 0; round < 20000; round++)
+  {
+    int k = dist(rng);
+    auto i = index.find(k);
+    auto j = expected.find(k);
+    assert ((i == index.end()) == (j == expected.end()));
+
+    if (rng() % 2)
+    {
+      auto r = index.insert(k, items[k]);
+      assert (r.second == (j == expected.end()));
+      assert (r.first.key() == k && &*r.first == &items[k]);
+      expected.emplace(k, &items[k]);
+    }
+    else
+    {
+      assert (index.erase(k) == (j != expected.end()));
+      expected.erase(k);
+    }
+
+    auto lb = index.lower_bound(k), ub = index.upper_bound(k);
+    auto elb = expected.lower_bound(k), eub = expected.upper_bound(k);
+    assert ((lb == index.end()) == (elb == expected.end()));
+    assert (lb == index.end() || lb.key() == elb->first);
+    assert ((ub == index.end()) == (eub == expected.end()));
+    assert (ub == index.end() || ub.key() == eub->first);
+
+    if (round % 1000 == 0)
+      check(index, expected);
+  }
+  check(index, expected);
+
+  // Erase by iterator in order until empty
+  auto i = index.begin();
+  while (i != index.end())
+  {
+    int key = i.key();
+    auto ret = index.erase(i);
+    expected.erase(key);
+    assert (ret == index.lower_bound(key));
+    i = ret;
+  }
+  check(index, expected);
+
+  for (int k = 0; k < max; k++)
+    index.insert(k, items[k]);
+  index.clear();
+  check(index, expected);
+  index.insert(1, items[1]);
+  expected.emplace(1, &items[1]);
+  check(index, expected);
+}
+
+/** @brief A key failing to copy leaves the index unchanged */
+void fragile_test()
+{
+  const int max = 500;
+  std::mt19937 rng(5);
+  std::vector<item> items(max);
+  spin::btree<fragile_key, item, spin::less<fragile_key>, 4> index;
+  std::map<fragile_key, item*> expected;
+
+  for (int round = 0; round < 5000; round++)
+  {
+    int k = int(rng() % max);
+    bool thrown = false;
+    fragile_key::copies_left = int(rng() % 3);
+    try
+    {
+      index.insert(k, items[k]);
+    }
+    catch (int)
+    {
+      thrown = true;
+    }
+    fragile_key::copies_left = -1;
+    if (!thrown)
+      expected.emplace(k, &items[k]);
+    if (round % 100 == 0)
+      check(index, expected);
+  }
+  check(index, expected);
+}
+
+int main()
+{
+  fragile_test();
+  random_test<4>(1);
+  random_test<5>(2);
+  random_test<16>(3);
+  random_test<spin::detail::btree_default_capacity<int>()>(4);
+
+  // Keys that are not arithmetic are searched with binary search
+  std::vector<item> items(100);
+  spin::btree<std::string, item> index;
+  std::map<std::string, item*> expected;
+  for (int i = 0; i < 100; i++)
+  {
+    auto key = std::to_string(i * 7 % 100);
+    index.insert(key, items[i]);
+    expected.emplace(key, &items[i]);
+  }
+  check(index, expected);
+  assert (index.find("42") != index.end());
+  assert (index.find("420") == index.end());
+
+  spin::btree<std::string, item> moved(std::move(index));
+  assert (index.empty());
+  check(moved, expected);
+  return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/buffer_pool.hpp>
+#include <spin/scheduler.hpp>
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+void check_size_classes()
+{
+  spin::buffer_pool pool(false);
+  assert(pool.allocate(1).size() == 4096);
+  assert(pool.allocate(4096).size() == 4096);
+  assert(pool.allocate(4097).size() == 16384);
+  assert(pool.allocate(65536).size() == 65536);
+
+  bool thrown = false;
+  try
+  {
+    pool.allocate(65537);
+  }
+  catch (std::length_error &)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  auto s = pool.get_statistics();
+  assert(s.arenas == 3);
+  assert(s.reserved_bytes == 3 * spin::buffer_pool::arena_size);
+  for (auto &c : s.classes)
+  {
+    assert(c.blocks == spin::buffer_pool::arena_size / c.block_size);
+    assert(c.free_blocks == c.blocks);
+    assert(c.used_blocks == 0);
+  }
+}
+
+void check_slices()
+{
+  spin::buffer_pool pool(false);
+  spin::buffer b = pool.allocate(100);
+  assert(b.use_count() == 1);
+  std::memcpy(b.data(), "hello world", 11);
+  b.resize(11);
+  assert(b.size() == 11);
+
+  spin::buffer world = b.slice(6, 5);
+  assert(b.use_count() == 2);
+  assert(std::memcmp(world.data(), "world", 5) == 0);
+  assert(world.capacity() == 4096 - 6);
+
+  spin::buffer hello = b;
+  hello.resize(5);
+  b.reset();
+  assert(!b && b.use_count() == 0);
+  assert(hello.use_count() == 2);
+  assert(pool.get_statistics().classes[0].used_blocks == 1);
+
+  hello.consume(1);
+  assert(std::memcmp(hello.data(), "ello", 4) == 0);
+
+  bool thrown = false;
+  try
+  {
+    hello.slice(2, 3);
+  }
+  catch (std::out_of_range &)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  hello.reset();
+  world = spin::buffer();
+  auto s = pool.get_statistics();
+  assert(s.classes[0].used_blocks == 0);
+  assert(s.classes[0].free_blocks == s.classes[0].blocks);
+
+  // The block released last is reused first
+  auto *data = pool.allocate(1).data();
+  assert(pool.allocate(1).data() == data);
+}
+
+void check_growth()
+{
+  spin::buffer_pool pool(false);
+  std::vector<spin::buffer> buffers;
+  std::size_t per_arena = spin::buffer_pool::arena_size / 4096;
+  for (std::size_t i = 0; i < per_arena + 1; ++i)
+    buffers.push_back(pool.allocate(4096));
+  auto s = pool.get_statistics();
+  assert(s.arenas == 2);
+  assert(s.classes[0].used_blocks == per_arena + 1);
+  assert(s.classes[0].free_blocks == per_arena - 1);
+  buffers.clear();
+  assert(pool.get_statistics().classes[0].used_blocks == 0);
+}
+
+/** @brief Buffers released in other threads go back in batch */
+void check_remote_release()
+{
+  constexpr std::size_t N = 1000;
+  spin::scheduler loop;
+  spin::buffer_pool &pool = loop.get_buffer_pool();
+  assert(&pool == &loop.get_buffer_pool());
+
+  std::vector<spin::buffer> buffers;
+  for (std::size_t i = 0; i < N; ++i)
+    buffers.push_back(pool.allocate(16384));
+  std::size_t blocks = pool.get_statistics().classes[1].blocks;
+
+  std::thread t([&]
+      {
+        // Keep a slice alive in this thread for a while
+        spin::buffer last = buffers.back().slice(0, 1);
+        buffers.clear();
+      });
+  t.join();
+
+  auto s = pool.get_statistics();
+  assert(s.classes[1].remote_blocks == N);
+  assert(s.classes[1].used_blocks == 0);
+  assert(pool.reclaim() == N);
+  s = pool.get_statistics();
+  assert(s.classes[1].remote_blocks == 0);
+  assert(s.classes[1].free_blocks == blocks);
+
+  // Allocation takes released blocks back rather than growing
+  for (std::size_t i = 0; i < N; ++i)
+    buffers.push_back(pool.allocate(16384));
+  std::thread([&] { buffers.clear(); }).join();
+  for (std::size_t i = 0; i < N; ++i)
+    buffers.push_back(pool.allocate(16384));
+  assert(pool.get_statistics().classes[1].blocks == blocks);
+  buffers.clear();
+}
+
+int main()
+{
+  check_size_classes();
+  check_slices();
+  check_growth();
+  check_remote_release();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/channel.hpp>
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+constexpr std::size_t N = 100000;
+
+void check_spsc()
+{
+  spin::scheduler loop;
+  std::size_t count = 0;
+  std::size_t expected = 0;
+  spin::spsc_channel<std::size_t> channel(loop, 100,
+      [&](std::size_t &x)
+      {
+        // messages arrive in order
+        assert(x == expected);
+        expected++;
+        if (++count == N)
+          loop.stop();
+      });
+  assert(channel.capacity() == 128);
+
+  std::thread producer([&]
+      {
+        for (std::size_t i = 0; i < N; )
+          if (channel.try_send(i))
+            i++;
+          else
+            std::this_thread::yield();
+      });
+  loop.run();
+  producer.join();
+  assert(count == N);
+}
+
+void check_mpsc()
+{
+  constexpr std::size_t producers = 4;
+  spin::scheduler loop;
+  std::size_t count = 0;
+  std::vector<std::size_t> expected(producers, 0);
+  spin::mpsc_channel<std::pair<std::size_t, std::size_t>> channel(loop, 256,
+      [&](std::pair<std::size_t, std::size_t> &x)
+      {
+        // messages from a producer arrive in order
+        assert(x.second == expected[x.first]);
+        expected[x.first]++;
+        if (++count == N * producers)
+          loop.stop();
+      }, 16);
+
+  std::vector<std::thread> threads;
+  for (std::size_t p = 0; p < producers; ++p)
+    threads.emplace_back([&channel, p]
+        {
+          std::vector<std::pair<std::size_t, std::size_t>> burst;
+          for (std::size_t i = 0; i < N; )
+          {
+            burst.clear();
+            for (std::size_t j = 0; j < 8 && i + j < N; ++j)
+              burst.emplace_back(p, i + j);
+            auto sent = channel.try_send(burst.begin(), burst.end())
+              - burst.begin();
+            i += sent;
+            if (sent == 0)
+              std::this_thread::yield();
+          }
+        });
+  loop.run();
+  for (auto &t : threads)
+    t.join();
+  assert(count == N * producers);
+}
+
+void check_pending_messages_destroyed()
+{
+  spin::scheduler loop;
+  auto p = std::make_shared<int>(0);
+  {
+    spin::spsc_channel<std::shared_ptr<int>> channel(loop, 4,
+        [](std::shared_ptr<int> &) { });
+    assert(channel.try_send(p));
+    assert(channel.try_send(p));
+    assert(p.use_count() == 3);
+  }
+  assert(p.use_count() == 1);
+}
+
+void check_throwing_handler()
+{
+  spin::scheduler loop;
+  std::size_t count = 0;
+  spin::spsc_channel<int> channel(loop, 8,
+      [&](int &x)
+      {
+        if (x < 0)
+          throw std::runtime_error("bad message");
+        if (++count == 2)
+          loop.stop();
+      });
+  assert(channel.try_send(1));
+  assert(channel.try_send(-1));
+  assert(channel.try_send(2));
+
+  bool thrown = false;
+  try
+  {
+    loop.run();
+  }
+  catch (std::runtime_error &)
+  {
+    thrown = true;
+  }
+  assert(thrown && count == 1);
+
+  // The message after the bad one is still delivered
+  loop.run();
+  assert(count == 2);
+}
+
+int main()
+{
+  check_spsc();
+  check_mpsc();
+  check_pending_messages_destroyed();
+  check_throwing_handler();
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/intruse/concurrent_skiplist.hpp>
+#include <atomic>
+#include <cassert>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+struct item : spin::intruse::concurrent_skiplist_node<int, item>
+{
+  item(int id)
+    : concurrent_skiplist_node(id)
+    , alive(1)
+    , reclaimed(true)
+  { }
+
+  std::atomic_int alive;
+  std::atomic_bool reclaimed;
+};
+
+using index_type = spin::intruse::concurrent_skiplist<int, item>;
+
+void check(const index_type &index, const std::set<int> &expected)
+{
+  spin::epoch::guard guard;
+  assert (index.size() == expected.size());
+  assert (index.empty() == expected.empty());
+  auto *x = index.front();
+  for (int k : expected)
+  {
+    assert (x != nullptr && item::get_index(*x) == k);
+    x = index_type::next(*x);
+  }
+  assert (x == nullptr);
+}
+
+void sequential_test()
+{
+  const int max = 1000;
+  std::mt19937 rng(1);
+  std::vector<item*> items;
+  for (int i = 0; i < max; i++)
+    items.push_back(new item(i));
+
+  index_type index;
+  std::set<int> expected;
+  for (int round = 0; round < 20000; round++)
+  {
+    int k = rng() % max;
+    bool present = expected.count(k) != 0;
+    if (rng() % 2)
+    {
+      if (!present && !item::is_linked(*items[k]))
+      {
+        assert (index.insert(*items[k]));
+        expected.insert(k);
+      }
+      else if (present)
+      {
+        item duplicated(k);
+        assert (!index.insert(duplicated));
+      }
+    }
+    else
+    {
+      assert (index.erase(*items[k]) == present);
+      expected.erase(k);
+    }
+
+    spin::epoch::guard guard;
+    auto *f = index.find(k);
+    assert ((f != nullptr) == (expected.count(k) != 0));
+    assert (f == nullptr || f == items[k]);
+    auto *lb = index.lower_bound(k);
+    auto elb = expected.lower_bound(k);
+    assert (lb == nullptr ? elb == expected.end() : *elb == lb->get_index(*lb));
+    auto *ub = index.upper_bound(k);
+    auto eub = expected.upper_bound(k);
+    assert (ub == nullptr ? eub == expected.end() : *eub == ub->get_index(*ub));
+  }
+  check(index, expected);
+
+  // Nodes are linked until they're reclaimed
+  for (int k : expected)
+    index.erase(*items[k]);
+  expected.clear();
+  check(index, expected);
+  spin::epoch::synchronize();
+  for (auto *x : items)
+  {
+    assert (!item::is_linked(*x));
+    delete x;
+  }
+}
+
+void concurrent_test()
+{
+  const int max = 256;
+  const int readers = 4;
+  std::vector<item*> items;
+  for (int i = 0; i < max; i++)
+    items.push_back(new item(i));
+
+  index_type index;
+  std::atomic_bool stop(false);
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; r++)
+    threads.emplace_back([&, r] {
+      std::mt19937 rng(r);
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        spin::epoch::guard guard;
+        int k = rng() % max;
+        auto *x = index.find(k);
+        assert (x == nullptr || (x == items[k] && x->alive.load() == 1));
+
+        // Index must be strictly increasing even while nodes are erased
+        int last = -1;
+        for (x = index.front(); x != nullptr; x = index_type::next(*x))
+        {
+          assert (x->alive.load() == 1);
+          assert (item::get_index(*x) > last);
+          last = item::get_index(*x);
+        }
+      }
+    });
+
+  auto erase = [&index](item &x) {
+    return index.erase(x, [&x] {
+        x.alive.store(0);
+        x.reclaimed.store(true, std::memory_order_release);
+      });
+  };
+
+  std::mt19937 rng(42);
+  int inserted = 0;
+  while (inserted < max * 4)
+  {
+    item &x = *items[rng() % max];
+    if (x.reclaimed.load(std::memory_order_acquire))
+    {
+      x.reclaimed.store(false, std::memory_order_relaxed);
+      x.alive.store(1);
+      assert (index.insert(x));
+      inserted++;
+    }
+    else if (!erase(x) && spin::epoch::reclaim() == 0)
+      std::this_thread::yield();
+  }
+
+  stop.store(true);
+  for (auto &t : threads)
+    t.join();
+  for (auto *x : items)
+    erase(*x);
+  spin::epoch::synchronize();
+  for (auto *x : items)
+  {
+    assert (x->reclaimed.load() && !item::is_linked(*x));
+    delete x;
+  }
+}
+
+int main()
+{
+  sequential_test();
+  concurrent_test();
+  return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/datagram_socket.hpp>
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+namespace
+{
+  spin::socket_address loopback()
+  { return spin::socket_address::from_ip("127.0.0.1", 0); }
+}
+
+void check_socket_address()
+{
+  auto v4 = spin::socket_address::from_ip("127.0.0.1", 8080);
+  assert(v4.get_family() == AF_INET);
+  assert(v4.get_port() == 8080);
+  assert(v4.to_string() == "127.0.0.1:8080");
+
+  auto v6 = spin::socket_address::from_ip("::1", 53);
+  assert(v6.get_family() == AF_INET6);
+  assert(v6.to_string() == "[::1]:53");
+  assert(v4 != v6);
+  assert(v4 == spin::socket_address::from_ip("127.0.0.1", 8080));
+  assert(spin::socket_address().get_family() == AF_UNSPEC);
+
+  bool thrown = false;
+  try
+  {
+    spin::socket_address::from_ip("localhost", 80);
+  }
+  catch (std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+/** @brief Datagrams sent in one iteration arrive in order and are echoed */
+void check_echo(bool offload)
+{
+  constexpr std::size_t N = 1000;
+  spin::scheduler loop;
+  spin::datagram_socket::options opt;
+  opt.batch_size = 16;
+  opt.gro = offload;
+  opt.gso = offload;
+  if (offload)
+    opt.buffer_size = 65536;
+
+  std::size_t expected = 0;
+  std::size_t echoed = 0;
+
+  spin::datagram_socket server(loop, loopback(),
+      [](spin::datagram_socket &s, spin::datagram *d, std::size_t n)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          assert(!d[i].truncated);
+          auto segment = d[i].segment_size ? d[i].segment_size : d[i].size;
+          for (std::size_t off = 0; off < d[i].size; off += segment)
+            while (!s.send(d[i].data + off,
+                  std::min(segment, d[i].size - off), *d[i].source))
+              ;
+        }
+      }, opt);
+
+  spin::datagram_socket client(loop, loopback(),
+      [&](spin::datagram_socket &, spin::datagram *d, std::size_t n)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          auto segment = d[i].segment_size ? d[i].segment_size : d[i].size;
+          for (std::size_t off = 0; off < d[i].size; off += segment)
+          {
+            std::size_t x;
+            assert(std::min(segment, d[i].size - off) == sizeof(x));
+            std::memcpy(&x, d[i].data + off, sizeof(x));
+            assert(x == expected);
+            expected++;
+          }
+        }
+        echoed = expected;
+        if (echoed == N)
+          loop.stop();
+      }, opt);
+
+  client.connect(server.get_local_address());
+  assert(client.get_local_address().get_port() != 0);
+
+  // Keep the number in flight below the socket buffer
+  spin::task sender;
+  std::size_t sent = 0;
+  sender.reset_routine([&]
+      {
+        for (std::size_t i = 0; i < 64 && sent < N; ++i, ++sent)
+          assert(client.send(&sent, sizeof(sent)));
+        if (sent < N)
+          loop.dispatch(sender);
+      });
+  loop.dispatch(sender);
+  loop.run();
+  assert(echoed == N);
+  assert(client.get_pending_count() == 0);
+}
+
+/** @brief Sending more than a batch flushes the queue synchronously */
+void check_flush()
+{
+  spin::scheduler loop;
+  spin::datagram_socket::options opt;
+  opt.batch_size = 4;
+  opt.buffer_size = 16;
+  std::vector<std::string> received;
+
+  spin::datagram_socket receiver(loop, loopback(),
+      [&](spin::datagram_socket &, spin::datagram *d, std::size_t n)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+          received.emplace_back(d[i].data, d[i].size);
+        if (received.size() == 10)
+          loop.stop();
+      }, opt);
+
+  spin::datagram_socket sender(loop, loopback(),
+      [](spin::datagram_socket &, spin::datagram *, std::size_t) { }, opt);
+
+  auto to = receiver.get_local_address();
+  for (int i = 0; i < 10; ++i)
+  {
+    std::string s(static_cast<std::size_t>(i), 'a' + i);
+    assert(sender.send(s.data(), s.size(), to));
+  }
+  assert(sender.get_pending_count() == 2);
+
+  bool thrown = false;
+  try
+  {
+    std::string s(17, 'x');
+    sender.send(s.data(), s.size(), to);
+  }
+  catch (std::length_error &)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(sender.get_pending_count() == 2);
+
+  assert(sender.flush() == 0);
+  loop.run();
+  assert(received.size() == 10);
+  for (int i = 0; i < 10; ++i)
+    assert(received[i] == std::string(static_cast<std::size_t>(i), 'a' + i));
+}
+
+/**
+ * @brief An exception of the handler propagates out of scheduler::run, and
+ * datagrams left are received once it runs again
+ */
+void check_handler_exception()
+{
+  spin::scheduler loop;
+  spin::datagram_socket::options opt;
+  opt.batch_size = 1;
+  std::string received;
+
+  spin::datagram_socket receiver(loop, loopback(),
+      [&](spin::datagram_socket &, spin::datagram *d, std::size_t n)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          if (d[i].data[0] == '1')
+            throw std::runtime_error("bad datagram");
+          received.push_back(d[i].data[0]);
+        }
+        if (received.size() == 2)
+          loop.stop();
+      }, opt);
+
+  spin::datagram_socket sender(loop, loopback(),
+      [](spin::datagram_socket &, spin::datagram *, std::size_t) { });
+  auto to = receiver.get_local_address();
+  for (const char *s : { "0", "1", "2" })
+    assert(sender.send(s, 1, to));
+  assert(sender.flush() == 0);
+
+  bool thrown = false;
+  try
+  {
+    loop.run();
+  }
+  catch (std::runtime_error &)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(received == "0");
+
+  loop.run();
+  assert(received == "02");
+}
+
+int main()
+{
+  check_socket_address();
+  check_echo(false);
+  check_echo(true);
+  check_flush();
+  check_handler_exception();
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/epoch.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/task.hpp>
+#include <spin/thread_pool.hpp>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct object
+{
+  object(int v)
+    : value(v)
+    , alive(true)
+  { }
+
+  const int value;
+  std::atomic_bool alive;
+};
+
+std::atomic<object *> shared_object(nullptr);
+std::atomic_int retired(0);
+std::atomic_int reclaimed(0);
+std::mutex objects_mutex;
+std::vector<object *> objects;
+
+void replace(int value)
+{
+  auto *x = new object(value);
+  {
+    std::lock_guard<std::mutex> guard(objects_mutex);
+    objects.push_back(x);
+  }
+  auto *old = shared_object.exchange(x);
+  if (old == nullptr)
+    return;
+  retired++;
+  spin::epoch::retire([old] {
+    old->alive.store(false, std::memory_order_relaxed);
+    reclaimed++;
+  });
+}
+
+void read_object()
+{
+  // Let writers run while the object is referenced
+  auto *x = shared_object.load(std::memory_order_acquire);
+  assert (x->alive.load(std::memory_order_relaxed));
+  std::this_thread::yield();
+  assert (x->alive.load(std::memory_order_relaxed));
+  assert (x->value >= 0);
+}
+
+void stress_test()
+{
+  replace(0);
+  std::atomic_bool stop(false);
+  std::vector<std::thread> threads;
+
+  // Readers entering a guard for each read
+  for (int i = 0; i < 2; i++)
+    threads.emplace_back([&] {
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        spin::epoch::guard guard;
+        read_object();
+        spin::epoch::guard nested;
+        read_object();
+      }
+    });
+
+  // Registered readers announcing quiescent state between reads, and going
+  // offline sometimes
+  for (int i = 0; i < 2; i++)
+    threads.emplace_back([&, i] {
+      spin::epoch::registration registration;
+      std::mt19937 rng(i);
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        for (int j = 0; j < 16; j++)
+        {
+          spin::epoch::guard guard;
+          read_object();
+        }
+        spin::epoch::quiescent();
+        if (rng() % 16 == 0)
+        {
+          spin::epoch::offline();
+          std::this_thread::yield();
+          spin::epoch::online();
+        }
+      }
+    });
+
+  // Writers, which exit with callbacks pending
+  std::vector<std::thread> writers;
+  for (int i = 0; i < 2; i++)
+    writers.emplace_back([] {
+      for (int j = 0; j < 20000; j++)
+      {
+        replace(j);
+        if (j % 64 == 0)
+          spin::epoch::reclaim();
+      }
+    });
+
+  for (auto &t : writers)
+    t.join();
+  stop.store(true);
+  for (auto &t : threads)
+    t.join();
+
+  replace(0);
+  spin::epoch::synchronize();
+  assert (reclaimed.load() == retired.load());
+}
+
+void scheduler_test()
+{
+  // Quiescent state is announced in each iteration of scheduler, callbacks
+  // retired by tasks are invoked without reclaiming explicitly
+  spin::scheduler s;
+  bool invoked = false;
+  int iterations = 0;
+  spin::task t;
+  t.reset_routine([&] {
+    if (iterations++ == 0)
+      spin::epoch::retire([&] { invoked = true; });
+    if (!invoked && iterations < 100)
+      s.dispatch(t);
+  });
+  std::thread thread([&] {
+    s.dispatch(t);
+    s.run();
+  });
+  thread.join();
+  assert (invoked);
+}
+
+void thread_pool_test()
+{
+  // Callbacks left by a blocking thread are invoked by others
+  auto pool = spin::thread_pool::get_instance();
+  std::atomic_bool invoked(false);
+  pool->enqueue([&] {
+    spin::epoch::retire([&] { invoked = true; });
+  });
+  pool->wait();
+  spin::epoch::synchronize();
+  assert (invoked.load());
+}
+
+int main()
+{
+  stress_test();
+  scheduler_test();
+  thread_pool_test();
+
+  for (auto *x : objects)
+    delete x;
+  return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/scheduler.hpp>
+#include <vector>
+#include <cassert>
+
+void check_execution_order()
+{
+  spin::scheduler loop;
+  const std::size_t n = 1000;
+  std::vector<std::size_t> order;
+  std::vector<spin::task> tasks;
+  tasks.reserve(n);
+  for (std::size_t i = 0; i < n; ++i)
+    tasks.emplace_back([&order, i] { order.push_back(i); });
+  for (auto &t : tasks)
+    loop.dispatch(t);
+
+  loop.run();
+
+  assert(order.size() == n);
+  for (std::size_t i = 0; i < n; ++i)
+    assert(order[i] == i);
+  assert(loop.get_last_iteration_task_count() == n);
+}
+
+void check_cancel_in_same_batch()
+{
+  spin::scheduler loop;
+  std::size_t count = 0;
+  std::vector<spin::task> tasks(10);
+  for (auto &t : tasks)
+    t.reset_routine([&count] { ++count; });
+  tasks[0].reset_routine([&] { ++count; tasks[1].cancel(); tasks[5].cancel(); });
+  // re-dispatched task must run once, at the end of the queue
+  tasks[2].reset_routine([&] { ++count; tasks[3].cancel(); loop.dispatch(tasks[3]); });
+  for (auto &t : tasks)
+    loop.dispatch(t);
+
+  loop.run();
+
+  assert(count == 8);
+  for (auto &t : tasks)
+    assert(t.is_canceled());
+}
+
+int main()
+{
+  check_execution_order();
+  check_cancel_in_same_batch();
+}
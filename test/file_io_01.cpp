@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/file_io.hpp>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+  constexpr std::size_t chunk_size = 4096;
+  constexpr std::size_t chunk_count = 16;
+  constexpr std::size_t file_size = chunk_size * chunk_count;
+
+  /** @brief Open an anonymous temporary file */
+  spin::system_handle open_temporary_file(int flags)
+  {
+    const char *dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/file_io_XXXXXX";
+    int fd = ::mkostemp(&path[0], flags | O_CLOEXEC);
+    if (fd == -1)
+      return spin::system_handle(-1);
+    ::unlink(path.c_str());
+    return spin::system_handle(fd);
+  }
+
+  spin::file_io::options make_options(bool use_io_uring)
+  {
+    spin::file_io::options opt;
+    opt.use_io_uring = use_io_uring;
+    opt.queue_depth = 4;
+    opt.threads = 3;
+    return opt;
+  }
+}
+
+/**
+ * @brief Chunks written concurrently through registered buffers are synced
+ * and read back, with every handler called in the thread of scheduler
+ */
+void check_read_write(bool use_io_uring)
+{
+  spin::scheduler loop;
+  spin::file_io io(loop, make_options(use_io_uring));
+  assert(use_io_uring
+      || io.get_backend() == spin::file_io::backend::threads);
+
+  spin::system_handle file = open_temporary_file(0);
+  assert(file);
+  auto memory = spin::allocate_aligned(file_size * 2, chunk_size);
+  char *out = memory.get();
+  char *in = memory.get() + file_size;
+  ::iovec buffer = { memory.get(), file_size * 2 };
+  io.register_buffers(&buffer, 1);
+  for (std::size_t i = 0; i < file_size; ++i)
+    out[i] = static_cast<char>(i * 7 + i / chunk_size);
+  std::memset(in, 0, file_size);
+
+  auto thread = std::this_thread::get_id();
+  std::size_t remaining = chunk_count;
+  bool done = false;
+
+  auto read_back = [&]
+  {
+    remaining = chunk_count;
+    for (std::size_t i = 0; i < chunk_count; ++i)
+      io.pread(file, in + i * chunk_size, chunk_size, i * chunk_size,
+          [&](std::size_t n, const std::error_code &e)
+          {
+            assert(std::this_thread::get_id() == thread);
+            assert(!e && n == chunk_size);
+            if (--remaining != 0)
+              return;
+
+            // Reading at end of file transfers nothing
+            io.pread(file, in, chunk_size, file_size,
+                [&](std::size_t n, const std::error_code &e)
+                {
+                  assert(!e && n == 0);
+                  done = true;
+                  loop.stop();
+                });
+          });
+  };
+
+  io.fallocate(file, 0, 0, file_size,
+      [&](std::size_t n, const std::error_code &e)
+      {
+        assert(!e && n == 0);
+        for (std::size_t i = 0; i < chunk_count; ++i)
+          io.pwrite(file, out + i * chunk_size, chunk_size, i * chunk_size,
+              [&](std::size_t n, const std::error_code &e)
+              {
+                assert(std::this_thread::get_id() == thread);
+                assert(!e && n == chunk_size);
+                if (--remaining == 0)
+                  io.fsync(file, true,
+                      [&](std::size_t, const std::error_code &e)
+                      {
+                        assert(!e);
+                        read_back();
+                      });
+              });
+      });
+
+  loop.run();
+  assert(done);
+  assert(std::memcmp(in, out, file_size) == 0);
+  io.unregister_buffers();
+}
+
+/** @brief Errors are reported to the handler */
+void check_error(bool use_io_uring)
+{
+  spin::scheduler loop;
+  spin::file_io io(loop, make_options(use_io_uring));
+  spin::system_handle dir(::open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  assert(dir);
+  char data[16];
+  bool done = false;
+  io.pread(dir, data, sizeof(data), 0,
+      [&](std::size_t n, const std::error_code &e)
+      {
+        assert(n == 0);
+        assert(e == std::errc::is_a_directory);
+        done = true;
+        loop.stop();
+      });
+  loop.run();
+  assert(done);
+}
+
+/** @brief Transfers aligned by the helpers are accepted with O_DIRECT */
+void check_direct_io(bool use_io_uring)
+{
+  assert(spin::align_down(8191, 4096) == 4096);
+  assert(spin::align_up(4097, 4096) == 8192);
+  assert(spin::align_up(4096, 4096) == 4096);
+
+  spin::system_handle file = open_temporary_file(O_DIRECT);
+  // Not supported by the file system, e.g. tmpfs of old kernels
+  if (!file)
+    return;
+
+  auto a = spin::get_direct_io_alignment(file);
+  assert(a.memory != 0 && (a.memory & (a.memory - 1)) == 0);
+  assert(a.offset != 0 && (a.offset & (a.offset - 1)) == 0);
+
+  std::size_t size = spin::align_up(1000, a.offset);
+  auto out = spin::allocate_aligned(size, a.memory);
+  auto in = spin::allocate_aligned(size, a.memory);
+  assert(spin::is_direct_io_aligned(out.get(), size, a.offset, a));
+  assert(!spin::is_direct_io_aligned(out.get(), size, 1, a)
+      || a.offset == 1);
+  std::memset(out.get(), 'x', size);
+
+  spin::scheduler loop;
+  spin::file_io io(loop, make_options(use_io_uring));
+  bool done = false;
+  io.pwrite(file, out.get(), size, a.offset,
+      [&](std::size_t n, const std::error_code &e)
+      {
+        assert(!e && n == size);
+        io.pread(file, in.get(), size, a.offset,
+            [&](std::size_t n, const std::error_code &e)
+            {
+              assert(!e && n == size);
+              done = true;
+              loop.stop();
+            });
+      });
+  loop.run();
+  assert(done);
+  assert(std::memcmp(in.get(), out.get(), size) == 0);
+}
+
+/**
+ * @brief Operations queued before buffers are registered again use the
+ * buffers registered when they're submitted
+ */
+void check_register_queued(bool use_io_uring)
+{
+  spin::scheduler loop;
+  spin::file_io io(loop, make_options(use_io_uring));
+  spin::system_handle file = open_temporary_file(0);
+  assert(file);
+  auto first = spin::allocate_aligned(chunk_size, chunk_size);
+  auto second = spin::allocate_aligned(chunk_size, chunk_size);
+  ::iovec buffer = { first.get(), chunk_size };
+  io.register_buffers(&buffer, 1);
+  std::memset(first.get(), 'x', chunk_size);
+
+  bool done = false;
+  io.pwrite(file, first.get(), chunk_size, 0,
+      [&](std::size_t n, const std::error_code &e)
+      {
+        assert(!e && n == chunk_size);
+        done = true;
+        loop.stop();
+      });
+
+  // The index the write would have got now refers to another buffer
+  buffer.iov_base = second.get();
+  io.register_buffers(&buffer, 1);
+  loop.run();
+  assert(done);
+  io.unregister_buffers();
+}
+
+/** @brief Operations not completed are dropped on destruction */
+void check_destroy_pending(bool use_io_uring)
+{
+  spin::scheduler loop;
+  spin::system_handle file = open_temporary_file(0);
+  char data[chunk_size] = { };
+  {
+    spin::file_io io(loop, make_options(use_io_uring));
+    for (int i = 0; i < 64; ++i)
+      io.pwrite(file, data, sizeof(data), 0,
+          [](std::size_t, const std::error_code &) { });
+  }
+}
+
+int main()
+{
+  for (bool use_io_uring : { true, false })
+  {
+    check_read_write(use_io_uring);
+    check_error(use_io_uring);
+    check_direct_io(use_io_uring);
+    check_register_queued(use_io_uring);
+    check_destroy_pending(use_io_uring);
+  }
+}
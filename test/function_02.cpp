@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/function_ref.hpp>
+#include <spin/inplace_function.hpp>
+
+#include <memory>
+#include <cassert>
+
+static int twice(int x)
+{
+  return x * 2;
+}
+
+static int call_ref(spin::function_ref<int(int)> f, int x)
+{
+  return f(x);
+}
+
+int main()
+{
+  // function_ref
+  int base = 10;
+  auto add = [&base](int x) { return base + x; };
+  assert(call_ref(add, 1) == 11);
+  base = 20;
+  assert(call_ref(add, 1) == 21);
+  assert(call_ref(twice, 4) == 8);
+  assert(call_ref(&twice, 5) == 10);
+
+  spin::function_ref<int(int)> r1 = add;
+  spin::function_ref<int(int)> r2 = twice;
+  r1.swap(r2);
+  assert(r1(3) == 6);
+  assert(r2(3) == 23);
+
+  // inplace_function
+  using inplace = spin::inplace_function<int(int)>;
+  inplace f;
+  assert(!f);
+  assert(f.target_type() == typeid(void));
+  bool thrown = false;
+  try { f(1); } catch (const spin::bad_function_call &) { thrown = true; }
+  assert(thrown);
+
+  f = add;
+  assert(f);
+  assert(f(2) == 22);
+  assert(f.target_type() == typeid(add));
+  assert(f.target<decltype(add)>() != nullptr);
+  assert(f.target<int(*)(int)>() == nullptr);
+
+  inplace g = twice;
+  assert(g(7) == 14);
+  assert(*g.target<int(*)(int)>() == &twice);
+
+  swap(f, g);
+  assert(f(1) == 2);
+  assert(g(1) == 21);
+
+  // copy and move keep ownership balanced
+  std::shared_ptr<int> p = std::make_shared<int>(5);
+  {
+    inplace h = [p](int x) { return *p + x; };
+    assert(p.use_count() == 2);
+    inplace c = h;
+    assert(p.use_count() == 3);
+    assert(c(1) == 6);
+    inplace m = std::move(c);
+    assert(!c);
+    assert(p.use_count() == 3);
+    assert(m(2) == 7);
+    m = nullptr;
+    assert(p.use_count() == 2);
+    h = g;
+    assert(p.use_count() == 1);
+    assert(h(0) == 20);
+  }
+  assert(p.use_count() == 1);
+
+  static_assert(sizeof(inplace) == sizeof(void*) * 5,
+      "inplace_function should be a vtable pointer plus its storage");
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/intruse/hash_table.hpp>
+#include <cassert>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct by_id;
+struct by_name;
+
+struct item : spin::intruse::hash_table_node<int, item>
+{
+  item(int id)
+    : hash_table_node(id)
+  { }
+};
+
+struct session
+  : spin::intruse::hash_table_node<int, session, by_id, by_name>
+{
+  session(int id)
+    : hash_table_node(id)
+  { }
+};
+
+// A hash function putting everything in few chains
+struct poor_hash
+{
+  std::size_t operator () (int x) const noexcept
+  { return x % 4; }
+};
+
+template<typename Table>
+void check(const Table &table, const std::unordered_map<int, item*> &expected)
+{
+  assert (table.size() == expected.size());
+  assert (table.empty() == expected.empty());
+  std::set<int> visited;
+  for (auto &x : table)
+  {
+    auto i = expected.find(item::get_index(x));
+    assert (i != expected.end() && i->second == &x);
+    assert (visited.insert(item::get_index(x)).second);
+  }
+  assert (visited.size() == expected.size());
+}
+
+template<typename Table>
+void random_test(unsigned seed)
+{
+  const int max = 3000;
+  std::mt19937 rng(seed);
+  std::vector<item> items;
+  items.reserve(max);
+  for (int i = 0; i < max; i++)
+    items.emplace_back(i);
+
+  Table table;
+  std::unordered_map<int, item*> expected;
+  for (int round = 0; round < 30000; round++)
+  {
+    int k = rng() % max;
+    bool present = expected.count(k) != 0;
+    switch (rng() % 4)
+    {
+    case 0:
+    case 1:
+      {
+        auto r = table.insert(items[k]);
+        assert (r.second == !present);
+        assert (&*r.first == &items[k]);
+        expected.emplace(k, &items[k]);
+        break;
+      }
+    case 2:
+      assert (table.erase(k) == (present ? 1u : 0u));
+      expected.erase(k);
+      break;
+    default:
+      // Unlink via node
+      assert (item::unlink(items[k]) == present);
+      expected.erase(k);
+      break;
+    }
+
+    assert (table.count(k) == expected.count(k));
+    auto i = table.find(k);
+    assert ((i == table.end()) == (expected.count(k) == 0));
+    if (round % 1000 == 0)
+      check(table, expected);
+  }
+  check(table, expected);
+
+  // Erase while iterating
+  for (auto i = table.begin(); i != table.end(); )
+  {
+    if (item::get_index(*i) % 2)
+    {
+      expected.erase(item::get_index(*i));
+      i = table.erase(i);
+    }
+    else
+      ++i;
+  }
+  check(table, expected);
+
+  // Move
+  Table moved(std::move(table));
+  assert (table.empty());
+  check(moved, expected);
+  for (auto &x : expected)
+    assert (item::is_linked(*x.second));
+  table = std::move(moved);
+  check(table, expected);
+  moved.insert(items[1]);
+  table.swap(moved);
+  assert (table.size() == 1 && &*table.begin() == &items[1]);
+  check(moved, expected);
+  moved.clear();
+  for (auto &x : items)
+    assert (!item::is_linked(x) || &x == &items[1]);
+}
+
+void growth_test()
+{
+  // Buckets are moved incrementally, lookups succeed in the middle
+  const int max = 100000;
+  std::vector<item> items;
+  items.reserve(max);
+  spin::intruse::hash_table<int, item> table;
+  std::size_t growths = 0;
+  for (int i = 0; i < max; i++)
+  {
+    items.emplace_back(i);
+    auto buckets = table.bucket_count();
+    table.insert(items.back());
+    if (table.bucket_count() != buckets)
+      growths++;
+    assert (table.bucket_count() >= table.size() / 2);
+    if (i % 97 == 0)
+      for (int j = 0; j <= i; j += 13)
+        assert (&*table.find(j) == &items[j]);
+  }
+  assert (growths > 10);
+
+  // Destructed nodes unlink themselves
+  while (items.size() > max / 2)
+    items.pop_back();
+  assert (table.size() == max / 2);
+  for (int i = 0; i < max; i++)
+    assert (table.count(i) == (i < max / 2 ? 1u : 0u));
+
+  spin::intruse::hash_table<int, item> reserved;
+  reserved.reserve(1000);
+  auto buckets = reserved.bucket_count();
+  assert (buckets >= 1000);
+  for (int i = 0; i < 1000; i++)
+    reserved.insert(items[i]);
+  assert (reserved.bucket_count() == buckets);
+
+  // Nodes are moved from the other table with the same tag
+  assert (table.size() == max / 2 - 1000);
+}
+
+void multi_tag_test()
+{
+  spin::intruse::hash_table<int, session, by_id> by_id_table;
+  spin::intruse::hash_table<int, session, by_name> by_name_table;
+  std::vector<session> sessions;
+  sessions.reserve(100);
+  for (int i = 0; i < 100; i++)
+  {
+    sessions.emplace_back(i);
+    by_id_table.insert(sessions.back());
+    if (i % 2)
+      by_name_table.insert(sessions.back());
+  }
+  assert (by_id_table.size() == 100);
+  assert (by_name_table.size() == 50);
+  assert (session::unlink<by_name>(sessions[1]));
+  assert (!session::is_linked<by_name>(sessions[1]));
+  assert (session::is_linked<by_id>(sessions[1]));
+  assert (by_id_table.size() == 100);
+  assert (by_name_table.size() == 49);
+
+  // Moved node takes the place of the source
+  session moved(std::move(sessions[3]));
+  assert (&*by_id_table.find(3) == &moved);
+  assert (&*by_name_table.find(3) == &moved);
+  assert (!session::is_linked<by_id>(sessions[3]));
+  sessions.clear();
+  assert (by_id_table.size() == 1);
+  assert (by_name_table.size() == 1);
+}
+
+int main()
+{
+  random_test<spin::intruse::hash_table<int, item>>(1);
+  random_test<spin::intruse::hash_table<int, item, void, poor_hash>>(2);
+  growth_test();
+  multi_tag_test();
+
+  return 0;
+}
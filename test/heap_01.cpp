@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/intruse/pairing_heap.hpp>
+#include <spin/intruse/dary_heap.hpp>
+#include <cassert>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+struct by_deadline;
+
+struct item
+  : spin::intruse::pairing_heap_node<int, item>
+  , spin::intruse::dary_heap_node<int, item>
+  , spin::intruse::pairing_heap_node<int, item, by_deadline,
+      spin::greater<int>>
+{
+  item(int key)
+    : pairing_heap_node<int, item>(key)
+    , dary_heap_node(key)
+    , pairing_heap_node<int, item, by_deadline, spin::greater<int>>(key)
+  { }
+};
+
+using pairing_heap_type = spin::intruse::pairing_heap<int, item>;
+using dary_heap_type = spin::intruse::dary_heap<int, item>;
+
+using expected_type = std::set<std::pair<int, item *>>;
+
+template<typename Heap>
+void check(Heap &heap, const expected_type &expected)
+{
+  assert (heap.empty() == expected.empty());
+  assert (heap.size() == expected.size());
+  if (!expected.empty())
+    assert (Heap::node_type::get_index(heap.top())
+        == expected.begin()->first);
+}
+
+template<typename Heap>
+void random_test(unsigned seed)
+{
+  using node_type = typename Heap::node_type;
+  const int max = 2000;
+  std::mt19937 rng(seed);
+  std::vector<item> items;
+  items.reserve(max);
+  for (int i = 0; i < max; i++)
+    items.emplace_back(rng() % 500);
+
+  Heap heap;
+  expected_type expected;
+  auto key_of = [](item &x) { return node_type::get_index(x); };
+
+  for (int round = 0; round < 40000; round++)
+  {
+    item &x = items[rng() % max];
+    bool present = node_type::is_linked(x);
+    assert (present == (expected.count(std::make_pair(key_of(x), &x)) != 0));
+    switch (rng() % 6)
+    {
+    case 0:
+    case 1:
+      heap.push(x);
+      expected.emplace(key_of(x), &x);
+      break;
+    case 2:
+      if (!heap.empty())
+      {
+        item &top = heap.top();
+        assert (key_of(top) == expected.begin()->first);
+        expected.erase(std::make_pair(key_of(top), &top));
+        heap.pop();
+        assert (!node_type::is_linked(top));
+      }
+      break;
+    case 3:
+      // Unlink via node
+      assert (node_type::unlink(x) == present);
+      expected.erase(std::make_pair(key_of(x), &x));
+      break;
+    default:
+      {
+        // Decrease or increase key
+        int key = rng() % 500;
+        expected.erase(std::make_pair(key_of(x), &x));
+        int old = key_of(x);
+        assert (heap.update_index(x, key) == old);
+        assert (key_of(x) == key);
+        if (present)
+          expected.emplace(key, &x);
+        break;
+      }
+    }
+    if (round % 500 == 0)
+      check(heap, expected);
+    else if (!expected.empty())
+      assert (key_of(heap.top()) == expected.begin()->first);
+  }
+  check(heap, expected);
+
+  // Move and swap
+  Heap moved(std::move(heap));
+  assert (heap.empty());
+  check(moved, expected);
+  heap = std::move(moved);
+  check(heap, expected);
+  moved.push(items[0]);
+  expected.erase(std::make_pair(key_of(items[0]), &items[0]));
+  heap.swap(moved);
+  assert (heap.size() == 1 && &heap.top() == &items[0]);
+  check(moved, expected);
+
+  // Pops come in order
+  int last = -1;
+  while (!moved.empty())
+  {
+    item &top = moved.top();
+    assert (key_of(top) >= last);
+    last = key_of(top);
+    moved.pop();
+  }
+
+  // Destructed nodes unlink themselves
+  for (auto &x : items)
+    heap.push(x);
+  while (items.size() > max / 2)
+    items.pop_back();
+  assert (heap.size() == max / 2);
+  heap.clear();
+  for (auto &x : items)
+    assert (!node_type::is_linked(x));
+}
+
+void pairing_heap_test()
+{
+  using node_type = spin::intruse::pairing_heap_node<int, item, by_deadline,
+        spin::greater<int>>;
+  std::vector<item> items;
+  items.reserve(100);
+  spin::intruse::pairing_heap<int, item, by_deadline, spin::greater<int>> a, b;
+  for (int i = 0; i < 100; i++)
+  {
+    items.emplace_back(i);
+    (i % 2 ? a : b).push(items.back());
+  }
+
+  // Greater comparator puts the largest at top
+  assert (node_type::get_index(a.top()) == 99);
+  assert (node_type::get_index(b.top()) == 98);
+  a.merge(b);
+  assert (b.empty() && a.size() == 100);
+
+  // Decreasing key of root to the least keeps it at top
+  a.update_index(items[99], 1000);
+  assert (&a.top() == &items[99]);
+  a.update_index(items[99], -1);
+  assert (&a.top() == &items[98]);
+  for (int i = 98; i >= 0; i--)
+  {
+    assert (&a.top() == &items[i]);
+    a.pop();
+  }
+  assert (&a.top() == &items[99]);
+
+  // Nodes can be moved in place
+  item moved(std::move(items[99]));
+  assert (&a.top() == &moved && a.size() == 1);
+  assert (!node_type::is_linked(items[99]));
+}
+
+int main()
+{
+  for (unsigned seed = 0; seed < 3; seed++)
+  {
+    random_test<pairing_heap_type>(seed);
+    random_test<dary_heap_type>(seed);
+  }
+  pairing_heap_test();
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/intruse/interval_tree.hpp>
+#include <algorithm>
+#include <cassert>
+#include <random>
+#include <vector>
+
+using namespace spin::intruse;
+
+class range : public interval_tree_node<int, range>
+{
+public:
+  range(int low, int high)
+    : interval_tree_node(low, high)
+  { }
+
+  int low() const
+  { return get_low(*this); }
+
+  int high() const
+  { return get_high(*this); }
+};
+
+using tree_type = interval_tree<int, range>;
+
+std::vector<range*> brute_force(const std::vector<range*> &linked,
+    int lo, int hi)
+{
+  std::vector<range*> ret;
+  for (auto *x : linked)
+    if (x->low() < hi && lo < x->high())
+      ret.push_back(x);
+  return ret;
+}
+
+void check(tree_type &tree, std::vector<range*> linked)
+{
+  for (int lo = -2; lo < 105; lo += 3)
+  {
+    for (int hi = lo + 1; hi < lo + 20; hi += 4)
+    {
+      auto expected = brute_force(linked, lo, hi);
+      std::vector<range*> result;
+      tree.overlap(lo, hi, [&](range &x) { result.push_back(&x); });
+      assert (std::is_sorted(result.begin(), result.end(),
+            [](range *l, range *r) { return l->low() < r->low(); }));
+      std::sort(result.begin(), result.end());
+      std::sort(expected.begin(), expected.end());
+      assert (result == expected);
+
+      auto i = tree.find_overlap(lo, hi);
+      if (expected.empty())
+        assert (i == tree.end());
+      else
+      {
+        assert (i != tree.end());
+        assert (i->low() < hi && lo < i->high());
+        for (auto *x : expected)
+          assert (i->low() <= x->low());
+      }
+    }
+
+    auto expected = brute_force(linked, lo, lo + 1);
+    std::vector<range*> result;
+    tree.stab(lo, [&](range &x) { result.push_back(&x); });
+    std::sort(result.begin(), result.end());
+    std::sort(expected.begin(), expected.end());
+    assert (result == expected);
+  }
+}
+
+int main()
+{
+  const int max = 200;
+  std::mt19937 rng(0);
+  std::vector<range> ranges;
+  ranges.reserve(max);
+  for (int i = 0; i < max; i++)
+  {
+    int low = rng() % 100;
+    ranges.emplace_back(low, low + 1 + rng() % 10);
+  }
+
+  tree_type tree;
+  assert (tree.find_overlap(0, 100) == tree.end());
+
+  std::vector<range*> linked;
+  for (auto &x : ranges)
+  {
+    tree.insert(x);
+    linked.push_back(&x);
+    if (linked.size() % 20 == 0)
+      check(tree, linked);
+  }
+  assert (tree.size() == std::size_t(max));
+
+  std::shuffle(linked.begin(), linked.end(), rng);
+  while (!linked.empty())
+  {
+    auto *x = linked.back();
+    linked.pop_back();
+    tree.erase(tree_type::iterator(x));
+    if (linked.size() % 20 == 0)
+      check(tree, linked);
+  }
+  assert (tree.empty());
+  return 0;
+}
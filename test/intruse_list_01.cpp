@@ -75,6 +75,56 @@ void test_sort()
   assert(std::is_sorted(l.begin(), l.end()));
 }
 
+void test_sort_throw()
+{
+  vector<X> v;
+  std::mt19937 engine;
+  for (int i = 0; i < 1000; ++i)
+    v.emplace_back(engine() % 100);
+
+  // Throw at different points, including the last merge
+  for (int limit = 0; limit < 20000; limit = limit * 2 + 1)
+  {
+    X::list l;
+    for (auto i = v.begin(); i != v.end(); ++i)
+      l.push_back(*i);
+
+    int count = 0;
+    bool thrown = false;
+    try
+    {
+      l.sort([&](const X &lhs, const X &rhs)
+          {
+            if (count++ == limit)
+              throw count;
+            return lhs < rhs;
+          });
+    }
+    catch (int)
+    {
+      thrown = true;
+    }
+
+    if (limit == 0)
+      assert(thrown && std::equal(l.begin(), l.end(), v.begin()));
+    if (!thrown)
+      assert(std::is_sorted(l.begin(), l.end()));
+
+    // All nodes are kept, and linked both ways
+    vector<const X*> forward, backward;
+    for (auto &x : l)
+      forward.push_back(&x);
+    for (auto i = l.rbegin(); i != l.rend(); ++i)
+      backward.push_back(&*i);
+    assert(forward.size() == v.size());
+    assert(std::equal(forward.begin(), forward.end(), backward.rbegin()));
+    std::sort(forward.begin(), forward.end());
+    for (std::size_t i = 0; i < v.size(); ++i)
+      assert(forward[i] == &v[i]);
+    l.clear();
+  }
+}
+
 X return_x(X::list &l)
 {
   X x(-1);
@@ -155,5 +205,6 @@ int main()
   assert(*++l.begin() == 3);
 
   test_sort();
+  test_sort_throw();
 }
 
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/intruse/list.hpp>
+#include <algorithm>
+#include <cassert>
+#include <random>
+#include <vector>
+
+using counted = spin::intruse::list_policy_counted;
+
+// A task-like type which unlinks itself without knowing its list
+struct job : spin::intruse::list_node<job, job, counted>
+{
+  using node_type = spin::intruse::list_node<job, job, counted>;
+  using queue_type = spin::intruse::list<job, job, counted>;
+
+  job(int i)
+    : i(i)
+  { }
+
+  bool cancel() noexcept
+  { return node_type::unlink(*this); }
+
+  friend bool operator < (const job &lhs, const job &rhs) noexcept
+  { return lhs.i < rhs.i; }
+
+  int i;
+};
+
+struct plain : spin::intruse::list_node<plain>
+{ };
+
+// Lists without the policy pay nothing
+static_assert(sizeof(plain) == 2 * sizeof(void *), "");
+static_assert(sizeof(spin::intruse::list<plain>) == 4 * sizeof(void *), "");
+
+std::size_t walk(const job::queue_type &q)
+{
+  return std::distance(const_cast<job::queue_type &>(q).begin(),
+      const_cast<job::queue_type &>(q).end());
+}
+
+void random_test()
+{
+  const int max = 500;
+  std::mt19937 rng(0);
+  std::vector<job> jobs;
+  jobs.reserve(max);
+  for (int i = 0; i < max; i++)
+    jobs.emplace_back(rng() % 100);
+
+  job::queue_type q[3];
+  for (int round = 0; round < 20000; round++)
+  {
+    auto &a = q[rng() % 3], &b = q[rng() % 3];
+    job &x = jobs[rng() % max];
+    switch (rng() % 9)
+    {
+    case 0:
+      a.push_back(x);
+      break;
+    case 1:
+      a.push_front(x);
+      break;
+    case 2:
+      x.cancel();
+      break;
+    case 3:
+      if (!a.empty())
+        a.erase(a.begin());
+      break;
+    case 4:
+      if (&a != &b && !b.empty())
+        a.splice(a.begin(), ++b.begin(), b.end());
+      break;
+    case 5:
+      if (&a != &b)
+      {
+        a.sort();
+        b.sort();
+        a.merge(b);
+        assert (b.empty());
+        assert (std::is_sorted(a.begin(), a.end()));
+      }
+      break;
+    case 6:
+      a.swap(b);
+      break;
+    case 7:
+      if (rng() % 8 == 0)
+        a.clear();
+      else
+        a.reverse();
+      break;
+    default:
+      {
+        job::queue_type moved(std::move(a));
+        assert (a.size() == 0);
+        a = std::move(moved);
+        break;
+      }
+    }
+
+    std::size_t linked = 0;
+    for (auto &l : q)
+    {
+      assert (l.size() == walk(l));
+      assert (l.empty() == (l.size() == 0));
+      linked += l.size();
+    }
+    assert (linked == std::size_t(std::count_if(jobs.begin(), jobs.end(),
+            [](job &j) { return job::node_type::is_linked(j); })));
+  }
+
+  // Destructed nodes are not counted any more
+  for (auto &j : jobs)
+    q[0].push_back(j);
+  assert (q[0].size() == max);
+  while (jobs.size() > max / 2)
+    jobs.pop_back();
+  assert (q[0].size() == max / 2);
+  assert (walk(q[0]) == max / 2);
+
+  // Moved nodes take place of the origin
+  job moved(std::move(jobs.front()));
+  assert (&q[0].front() == &moved);
+  assert (q[0].size() == max / 2);
+  assert (!jobs.front().cancel());
+  assert (moved.cancel());
+  assert (q[0].size() == max / 2 - 1);
+}
+
+int main()
+{
+  random_test();
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/intruse/list.hpp>
+#include <spin/parallel_sort.hpp>
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct item : spin::intruse::list_node<item>
+{
+  item(int key, int seq)
+    : key(key)
+    , seq(seq)
+  { }
+
+  int key;
+  int seq;
+};
+
+struct counted_item
+  : spin::intruse::list_node<counted_item, counted_item,
+      spin::intruse::list_policy_counted>
+{
+  counted_item(int key)
+    : key(key)
+  { }
+
+  int key;
+};
+
+using list_type = spin::intruse::list<item>;
+using counted_list_type = spin::intruse::list<counted_item, counted_item,
+      spin::intruse::list_policy_counted>;
+
+struct by_key
+{
+  template<typename T>
+  bool operator () (const T &x, const T &y) const noexcept
+  { return x.key < y.key; }
+};
+
+// Stateful, so each job must use its own copy
+struct by_key_single_thread
+{
+  template<typename T>
+  bool operator () (const T &x, const T &y)
+  {
+    if (owner == std::thread::id())
+      owner = std::this_thread::get_id();
+    assert (owner == std::this_thread::get_id());
+    return x.key < y.key;
+  }
+
+  std::thread::id owner;
+};
+
+// The list is sorted by key and stable, its links are consistent
+void check(list_type &l, std::size_t n)
+{
+  assert (l.size() == n);
+  std::size_t walked = 0;
+  for (auto i = l.rbegin(); i != l.rend(); ++i)
+    walked++;
+  assert (walked == n);
+  assert (std::is_sorted(l.begin(), l.end(),
+        [](const item &x, const item &y)
+        { return x.key < y.key || (x.key == y.key && x.seq < y.seq); }));
+}
+
+template<typename Generator>
+void sort_test(std::size_t n, Generator &&gen)
+{
+  std::deque<item> items;
+  list_type l;
+  for (std::size_t i = 0; i < n; i++)
+  {
+    items.emplace_back(gen(i), i);
+    l.push_back(items.back());
+  }
+  l.sort(by_key());
+  check(l, n);
+}
+
+void patterns_test()
+{
+  std::mt19937 rng(0);
+  for (std::size_t n : { 0, 1, 2, 3, 7, 8, 9, 31, 100, 1000, 10007 })
+  {
+    sort_test(n, [&](std::size_t) { return int(rng() % 1000000); });
+    sort_test(n, [&](std::size_t) { return int(rng() % 3); });
+    sort_test(n, [](std::size_t i) { return int(i); });
+    sort_test(n, [n](std::size_t i) { return int(n - i); });
+    sort_test(n, [](std::size_t i) { return int(i / 4); });
+    sort_test(n, [](std::size_t i) { return -int(i / 4); });
+    sort_test(n, [](std::size_t i) { return int(i % 16); });
+    sort_test(n, [&](std::size_t i)
+        { return rng() % 100 == 0 ? int(rng() % n) : int(i); });
+  }
+}
+
+void parallel_test()
+{
+  auto pool = spin::thread_pool::get_instance();
+  std::mt19937 rng(1);
+  for (std::size_t n : { 0, 10, 1000, 100000 })
+  {
+    std::deque<item> items;
+    list_type l;
+    for (std::size_t i = 0; i < n; i++)
+    {
+      items.emplace_back(rng() % 1000, i);
+      l.push_back(items.back());
+    }
+    spin::parallel_sort(l, by_key(), *pool, 100);
+    check(l, n);
+
+    std::shuffle(items.begin(), items.end(), rng);
+    l.clear();
+    for (auto &x : items)
+      l.push_back(x);
+    spin::parallel_sort(l, by_key_single_thread(), *pool, 100);
+    assert (l.size() == n);
+    assert (std::is_sorted(l.begin(), l.end(), by_key()));
+  }
+
+  // Counted lists keep their size
+  std::deque<counted_item> items;
+  counted_list_type l;
+  for (int i = 0; i < 50000; i++)
+  {
+    items.emplace_back(rng() % 1000);
+    l.push_back(items.back());
+  }
+  spin::parallel_sort(l, by_key(), *pool, 1000);
+  assert (l.size() == items.size());
+  assert (std::is_sorted(l.begin(), l.end(), by_key()));
+}
+
+int main()
+{
+  patterns_test();
+  parallel_test();
+  return 0;
+}
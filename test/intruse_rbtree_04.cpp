@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/intruse/rbtree.hpp>
+#include "rbtree_verify.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace spin::intruse;
+
+class X : public rbtree_node<int, X>
+{
+public:
+  X(int x = 0)
+    : rbtree_node(x)
+  {}
+
+  friend bool operator < (const X &l, const X &r) noexcept
+  { return get_index(l) < get_index(r); }
+};
+
+std::size_t perfect_depth(std::size_t n)
+{
+  std::size_t depth = 0;
+  while ((n >> depth) != 0)
+    ++depth;
+  return depth;
+}
+
+int main()
+{
+  const int max = 300;
+  std::vector<X> vn;
+  vn.reserve(max);
+  for (int i = 0; i < max; i++)
+    vn.emplace_back(i);
+
+  for (int n = 1; n < max; n++)
+  {
+    rbtree<int, X> tree;
+    tree.assign_sorted(vn.begin(), vn.begin() + n);
+    auto r = checker::verify(tree);
+    assert (r.size == std::size_t(n));
+    assert (r.depth == perfect_depth(n));
+    assert (std::is_sorted(tree.begin(), tree.end()));
+    assert (tree.find(n / 2) != tree.end());
+
+    // Still a valid tree for following modification
+    tree.erase(tree.find(n / 2));
+    if (n > 1)
+      checker::verify(tree);
+    tree.insert(vn[n / 2]);
+    checker::verify(tree);
+  }
+
+  // Reassign with nodes currently linked in this tree
+  rbtree<int, X> tree(vn.begin(), vn.end());
+  std::vector<std::reference_wrapper<X>> odd;
+  for (int i = 1; i < max; i += 2)
+    odd.emplace_back(vn[i]);
+  tree.assign_sorted(odd.begin(), odd.end());
+  auto r = checker::verify(tree);
+  assert (r.size == odd.size());
+  assert (tree.find(0) == tree.end());
+  assert (tree.find(1) != tree.end());
+
+  // Append to an empty tree and then to a non-empty tree
+  tree.clear();
+  assert (tree.empty());
+  tree.append_sorted(vn.begin(), vn.begin() + 10);
+  checker::verify(tree);
+  tree.append_sorted(vn.begin() + 10, vn.end());
+  r = checker::verify(tree);
+  assert (r.size == std::size_t(max));
+  assert (std::is_sorted(tree.begin(), tree.end()));
+  assert (tree.find(max - 1) != tree.end());
+
+  // Random erasure keeps the tree valid
+  std::mt19937 rng(0);
+  std::vector<int> order(max);
+  for (int i = 0; i < max; i++)
+    order[i] = i;
+  std::shuffle(order.begin(), order.end(), rng);
+  for (int i = 0; i < max - 1; i++)
+  {
+    tree.erase(tree.find(order[i]));
+    r = checker::verify(tree);
+    assert (r.size == std::size_t(max - 1 - i));
+  }
+  return 0;
+}
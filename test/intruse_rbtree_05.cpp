@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/intruse/rbtree.hpp>
+#include <algorithm>
+#include <cassert>
+#include <random>
+#include <vector>
+
+using namespace spin::intruse;
+
+struct tag_a;
+
+using counted = order_statistic<spin::less<int>>;
+
+class X : public rbtree_node<int, X, tag_a, counted, void>
+{
+public:
+  X(int x = 0)
+    : rbtree_node(x)
+  {}
+
+  static int index(const X &x)
+  { return get_index(x); }
+};
+
+// Only tag_a is counted
+static_assert(sizeof(rbtree_node<int, X, tag_a, counted>)
+    > sizeof(rbtree_node<int, X, void>), "");
+
+using tree_type = rbtree<int, X, tag_a, counted>;
+
+void check(tree_type &tree, std::vector<int> expected)
+{
+  std::sort(expected.begin(), expected.end());
+  assert (tree.size() == expected.size());
+  assert (tree.select(expected.size()) == tree.end());
+  assert (tree.rank(tree.end()) == expected.size());
+
+  std::size_t k = 0;
+  for (auto i = tree.begin(); i != tree.end(); ++i, ++k)
+  {
+    assert (tree.rank(i) == k);
+    assert (tree.select(k) == i);
+    assert (X::index(*i) == expected[k]);
+  }
+
+  for (int lo = -1; lo < 40; lo += 7)
+    for (int hi = lo; hi < 42; hi += 5)
+    {
+      auto n = std::lower_bound(expected.begin(), expected.end(), hi)
+        - std::lower_bound(expected.begin(), expected.end(), lo);
+      assert (tree.count_range(lo, hi) == std::size_t(n));
+    }
+  assert (tree.count_range(10, 5) == 0);
+}
+
+int main()
+{
+  const int max = 200;
+  std::mt19937 rng(0);
+  std::vector<X> vn;
+  vn.reserve(max);
+  for (int i = 0; i < max; i++)
+    vn.emplace_back(rng() % 40);
+
+  tree_type tree;
+  assert (tree.size() == 0);
+  assert (tree.select(0) == tree.end());
+
+  // Insertion with duplicated index
+  std::vector<int> expected;
+  for (auto &x : vn)
+  {
+    tree.insert(x, policy_backmost);
+    expected.push_back(X::index(x));
+    check(tree, expected);
+  }
+
+  // Random erasure
+  std::vector<X*> order;
+  for (auto &x : vn)
+    order.push_back(&x);
+  std::shuffle(order.begin(), order.end(), rng);
+  for (int i = 0; i < max / 2; i++)
+  {
+    auto *x = order[i];
+    expected.erase(std::find(expected.begin(), expected.end(), X::index(*x)));
+    tree_type::node_type::unlink(*x);
+    check(tree, expected);
+  }
+
+  // Moving a linked node keeps the counts
+  X moved(std::move(*order[max - 1]));
+  check(tree, expected);
+
+  // Linear time construction and swapping
+  std::vector<X*> sorted(order.begin() + max / 2, order.end() - 1);
+  sorted.push_back(&moved);
+  std::sort(sorted.begin(), sorted.end(), [](X *l, X *r)
+      { return X::index(*l) < X::index(*r); });
+  std::vector<std::reference_wrapper<X>> refs;
+  for (auto *x : sorted)
+    refs.emplace_back(*x);
+  tree_type other;
+  other.assign_sorted(refs.begin(), refs.end());
+  check(other, expected);
+  assert (tree.empty());
+
+  tree.swap(other);
+  check(tree, expected);
+  check(other, std::vector<int>());
+
+  tree_type target(std::move(tree));
+  check(target, expected);
+  return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/intruse/rbtree.hpp>
+#include "rbtree_verify.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+using namespace spin::intruse;
+
+struct tag_a;
+
+using counted = order_statistic<spin::less<int>>;
+
+class X : public rbtree_node<int, X, tag_a, counted, void>
+{
+public:
+  X(int x = 0, int id = 0)
+    : rbtree_node(x)
+    , id(id)
+  {}
+
+  static int index(const X &x)
+  { return get_index(x); }
+
+  int id;
+};
+
+using tree_type = rbtree<int, X, tag_a, counted>;
+
+/** @brief Throws once a number of comparisons is used up */
+struct limited_less
+{
+  static int limit;
+
+  bool operator () (int x, int y) const
+  {
+    if (limit-- == 0)
+      throw limit;
+    return x < y;
+  }
+};
+
+int limited_less::limit = -1;
+
+class Y : public rbtree_node<int, Y, tag_a, limited_less, void>
+{
+public:
+  Y(int y = 0)
+    : rbtree_node(y)
+  {}
+
+  static int index(const Y &y)
+  { return get_index(y); }
+};
+
+using throwing_tree = rbtree<int, Y, tag_a, limited_less>;
+
+void check(tree_type &tree, int first, int last)
+{
+  checker::verify(tree);
+  assert (tree.size() == std::size_t(last - first));
+  std::size_t k = 0;
+  for (auto i = tree.begin(); i != tree.end(); ++i, ++k)
+  {
+    assert (X::index(*i) == first + int(k));
+    assert (tree.rank(i) == k);
+  }
+}
+
+int main()
+{
+  const int max = 80;
+  std::mt19937 rng(0);
+  std::vector<X> vn;
+  vn.reserve(max);
+  for (int i = 0; i < max; i++)
+    vn.emplace_back(i);
+
+  // Split at every position of trees in various shapes and join them back
+  for (int n = 0; n <= max; n++)
+  {
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++)
+      order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    for (int k = 0; k <= n; k++)
+    {
+      tree_type left, right;
+      for (int i : order)
+        left.insert(vn[i]);
+
+      left.split(k, right);
+      check(left, 0, k);
+      check(right, k, n);
+
+      left.join(right);
+      assert (right.empty());
+      check(left, 0, n);
+
+      // Split at iterator and join into an empty tree
+      tree_type tree;
+      left.split(left.select(k), right);
+      tree.join(left);
+      tree.join(right);
+      check(tree, 0, n);
+    }
+  }
+
+  // Join trees with very different heights
+  for (int n = 1; n < max; n++)
+  {
+    tree_type left, right;
+    left.assign_sorted(vn.begin(), vn.begin() + n);
+    for (int i = max - 1; i >= n; i--)
+      right.insert(vn[i]);
+    left.join(right);
+    check(left, 0, max);
+    left.clear();
+
+    left.insert(vn[0]);
+    right.assign_sorted(vn.begin() + 1, vn.begin() + n);
+    left.join(right);
+    check(left, 0, n);
+  }
+
+  // Repeated random splits and joins
+  tree_type tree(vn.begin(), vn.end());
+  std::uniform_int_distribution<int> dist(0, max);
+  for (int i = 0; i < 1000; i++)
+  {
+    tree_type a, b;
+    int x = dist(rng), y = dist(rng);
+    if (x > y)
+      std::swap(x, y);
+    tree.split(y, b);
+    tree.split(x, a);
+    check(tree, 0, x);
+    check(a, x, y);
+    check(b, y, max);
+    a.join(b);
+    tree.join(a);
+    check(tree, 0, max);
+  }
+  tree.clear();
+
+  // Merge overlapping and disjoint trees
+  std::vector<X> wn;
+  wn.reserve(max);
+  for (int i = 0; i < max; i++)
+    wn.emplace_back(i, 1);
+
+  for (int n = 0; n <= max; n++)
+  {
+    tree_type even, odd;
+    for (int i = 0; i < n; i++)
+      (i % 2 ? odd : even).insert(vn[i]);
+    even.merge(odd);
+    assert (odd.empty());
+    check(even, 0, n);
+    even.clear();
+
+    tree_type low, high;
+    for (int i = 0; i < n; i++)
+      (i < n / 2 ? low : high).insert(vn[i]);
+    high.merge(low);
+    check(high, 0, n);
+    high.merge(low);
+    low.merge(high);
+    check(low, 0, n);
+    low.clear();
+
+    // Equivalent elements of the merged tree come last
+    tree_type x(vn.begin(), vn.begin() + n);
+    tree_type y(wn.begin(), wn.begin() + n);
+    x.merge(y);
+    checker::verify(x);
+    assert (x.size() == std::size_t(2 * n));
+    int k = 0;
+    for (auto i = x.begin(); i != x.end(); ++i, ++k)
+    {
+      assert (X::index(*i) == k / 2);
+      assert (i->id == k % 2);
+    }
+  }
+
+  // A comparator throwing while merging loses no element
+  std::vector<Y> un;
+  un.reserve(max);
+  for (int i = 0; i < max; i++)
+    un.emplace_back(i);
+
+  for (int limit = 2; limit < max; limit++)
+  {
+    throwing_tree even, odd;
+    for (int i = 0; i < max; i++)
+      (i % 2 ? odd : even).insert(un[i]);
+
+    bool thrown = false;
+    limited_less::limit = limit;
+    try
+    {
+      even.merge(odd);
+    }
+    catch (int)
+    {
+      thrown = true;
+    }
+    limited_less::limit = -1;
+    assert (thrown);
+
+    checker::verify(even);
+    checker::verify(odd);
+    assert (even.size() + odd.size() == std::size_t(max));
+    assert (std::is_sorted(even.begin(), even.end(),
+          [](const Y &a, const Y &b) { return Y::index(a) < Y::index(b); }));
+    assert (std::is_sorted(odd.begin(), odd.end(),
+          [](const Y &a, const Y &b) { return Y::index(a) < Y::index(b); }));
+    for (auto &y : odd)
+      assert (Y::index(y) % 2 == 1);
+    even.clear();
+    odd.clear();
+  }
+  return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/intruse/rbtree.hpp>
+#include "rbtree_verify.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+using namespace spin::intruse;
+
+class X : public rbtree_node<int, X>
+{
+public:
+  X(int x = 0, int id = 0)
+    : rbtree_node(x)
+    , id(id)
+  {}
+
+  static int index(const X &x)
+  { return get_index(x); }
+
+  int id;
+};
+
+using tree_type = rbtree<int, X>;
+
+int main()
+{
+  const int max = 1000;
+  std::vector<X> vn;
+  vn.reserve(max);
+  for (int i = 0; i < max; i++)
+    vn.emplace_back(i / 2, i);
+
+  // Monotone insertion at the end with policy_backmost, as timers do
+  {
+    tree_type tree;
+    for (auto &x : vn)
+    {
+      auto i = tree.insert(tree.end(), x, policy_backmost);
+      assert (&*i == &x);
+    }
+    checker::verify(tree);
+    int id = 0;
+    for (auto &x : tree)
+      assert (x.id == id++);
+  }
+
+  // Equivalent elements are kept in order of policy even if hint is wrong
+  {
+    tree_type tree;
+    for (int i = 0; i < max; i += 2)
+      tree.insert(vn[i]);
+    for (int i = 1; i < max; i += 2)
+    {
+      tree.insert(tree.find(X::index(vn[i])), vn[i], policy_frontmost);
+      checker::verify(tree);
+    }
+    for (auto i = tree.begin(); i != tree.end(); ++i)
+      assert (i->id % 2 == 1 || std::next(i) == tree.end()
+          || std::next(i)->id % 2 == 1);
+  }
+
+  // Unique policy with correct, wrong and conflicting hints
+  {
+    std::vector<X> un;
+    un.reserve(max);
+    for (int i = 0; i < max; i++)
+      un.emplace_back(i, i);
+
+    std::mt19937 rng(0);
+    std::vector<int> order(max);
+    for (int i = 0; i < max; i++)
+      order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    tree_type tree;
+    for (int i : order)
+    {
+      auto hint = rng() % 2 ? tree.upper_bound(i) : tree.begin();
+      auto r = tree.insert(hint, un[i], policy_unique);
+      assert (&*r == &un[i]);
+      checker::verify(tree);
+    }
+    assert (std::is_sorted(tree.begin(), tree.end(),
+          [](const X &a, const X &b) { return X::index(a) < X::index(b); }));
+
+    X dup(max / 2);
+    auto r = tree.insert(tree.upper_bound(max / 2), dup, policy_unique);
+    assert (&*r == &un[max / 2]);
+    r = tree.insert(tree.find(max / 2), dup, policy_unique);
+    assert (&*r == &un[max / 2]);
+  }
+
+  // Search from every hint finds the conflicting element
+  for (int n = 1; n < 40; n++)
+  {
+    std::vector<X> un;
+    un.reserve(n);
+    for (int i = 0; i < n; i++)
+      un.emplace_back(i * 2);
+    tree_type tree(un.begin(), un.end());
+
+    for (int k = -1; k <= n * 2; k++)
+    {
+      auto hint = tree.begin();
+      for (int h = 0; h <= n; h++, ++hint)
+      {
+        X x(k);
+        auto r = tree.insert(hint, x, policy_unique);
+        if (k % 2 == 0 && k < n * 2)
+          assert (&*r == &un[k / 2]);
+        else
+        {
+          assert (&*r == &x);
+          checker::verify(tree);
+          tree.erase(r);
+        }
+        if (h == n)
+          break;
+      }
+    }
+  }
+  return 0;
+}
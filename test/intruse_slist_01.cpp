@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/intruse/slist.hpp>
+#include <spin/intruse/atomic_stack.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct by_free_list;
+
+struct item
+  : spin::intruse::slist_node<item>
+  , spin::intruse::slist_node<item, by_free_list>
+{
+  item(int i)
+    : i(i)
+  { }
+
+  int i;
+};
+
+using list_type = spin::intruse::slist<item>;
+using node_type = spin::intruse::slist_node<item>;
+using free_list_type = spin::intruse::slist<item, by_free_list>;
+using stack_type = spin::intruse::atomic_stack<item, by_free_list>;
+
+static_assert(sizeof(node_type) == sizeof(void *), "");
+
+void check(const list_type &l, const std::deque<item *> &expected)
+{
+  assert (l.size() == expected.size());
+  assert (l.empty() == expected.empty());
+  assert (std::equal(expected.begin(), expected.end(), l.begin(),
+        [](item *x, const item &y) { return x == &y; }));
+  if (!expected.empty())
+  {
+    assert (&l.front() == expected.front());
+    assert (&l.back() == expected.back());
+  }
+}
+
+void slist_test()
+{
+  const int max = 200;
+  std::mt19937 rng(0);
+  std::deque<item> items;
+  for (int i = 0; i < max; i++)
+    items.emplace_back(i);
+
+  list_type l, other;
+  std::deque<item *> expected, expected_other;
+  for (int round = 0; round < 20000; round++)
+  {
+    item &x = items[rng() % max];
+    bool linked = node_type::is_linked(x);
+    switch (rng() % 8)
+    {
+    case 0:
+      if (!linked)
+      {
+        l.push_back(x);
+        expected.push_back(&x);
+      }
+      break;
+    case 1:
+      if (!linked)
+      {
+        l.push_front(x);
+        expected.push_front(&x);
+      }
+      break;
+    case 2:
+      if (!l.empty())
+      {
+        assert (node_type::is_linked(l.front()));
+        l.pop_front();
+        assert (!node_type::is_linked(*expected.front()));
+        expected.pop_front();
+      }
+      break;
+    case 3:
+      if (!linked && !l.empty())
+      {
+        // Insert after the back, the tail is updated
+        auto pos = std::next(l.begin(), expected.size() - 1);
+        assert (&*l.insert_after(pos, x) == &x);
+        expected.push_back(&x);
+      }
+      break;
+    case 4:
+      if (expected.size() >= 2)
+      {
+        // Erase the back
+        auto pos = std::next(l.begin(), expected.size() - 2);
+        assert (l.erase_after(pos) == l.end());
+        expected.pop_back();
+      }
+      break;
+    case 5:
+      if (!linked)
+      {
+        other.push_back(x);
+        expected_other.push_back(&x);
+      }
+      break;
+    case 6:
+      if (rng() % 2)
+      {
+        l.splice_back(other);
+        expected.insert(expected.end(), expected_other.begin(),
+            expected_other.end());
+        expected_other.clear();
+      }
+      else
+      {
+        l.swap(other);
+        expected.swap(expected_other);
+      }
+      break;
+    default:
+      l.reverse();
+      std::reverse(expected.begin(), expected.end());
+      break;
+    }
+    check(l, expected);
+    check(other, expected_other);
+  }
+
+  list_type moved(std::move(l));
+  assert (l.empty());
+  check(moved, expected);
+  moved.clear();
+  other.clear();
+  for (auto &x : items)
+    assert (!node_type::is_linked(x));
+}
+
+void atomic_stack_test()
+{
+  const int threads = 4, per_thread = 2000, rounds = 50000;
+  std::deque<item> items;
+  for (int i = 0; i < threads * per_thread; i++)
+    items.emplace_back(i);
+
+  // The bottom node is seen linked like the others
+  {
+    using free_node_type = spin::intruse::slist_node<item, by_free_list>;
+    stack_type stack;
+    assert (stack.empty() && stack.pop() == nullptr);
+    stack.push(items[0]);
+    stack.push(items[1]);
+    assert (free_node_type::is_linked(items[0]));
+    assert (free_node_type::is_linked(items[1]));
+    assert (stack.pop() == &items[1]);
+    assert (!free_node_type::is_linked(items[1]));
+    assert (free_node_type::is_linked(items[0]));
+    assert (stack.pop() == &items[0]);
+    assert (!free_node_type::is_linked(items[0]));
+    assert (stack.empty());
+  }
+
+  // Nodes are popped and pushed again concurrently, which would corrupt
+  // the stack by ABA without tagging
+  stack_type stack;
+  for (auto &x : items)
+    stack.push(x);
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back([&stack, t]
+        {
+          std::vector<item *> held;
+          for (int r = 0; r < rounds; r++)
+          {
+            if ((r + t) % 97 == 0)
+            {
+              auto l = stack.pop_all();
+              stack.push(l);
+              assert (l.empty());
+              continue;
+            }
+            if (held.size() < 4)
+            {
+              if (item *x = stack.pop())
+                held.push_back(x);
+            }
+            else
+            {
+              for (auto *x : held)
+                stack.push(*x);
+              held.clear();
+            }
+          }
+          for (auto *x : held)
+            stack.push(*x);
+        });
+  for (auto &w : workers)
+    w.join();
+
+  // Every node is in the stack exactly once
+  auto l = stack.pop_all();
+  assert (stack.empty());
+  std::vector<int> seen;
+  for (auto &x : l)
+    seen.push_back(x.i);
+  std::sort(seen.begin(), seen.end());
+  assert (seen.size() == items.size());
+  for (std::size_t i = 0; i < seen.size(); i++)
+    assert (seen[i] == int(i));
+
+  // Batch push keeps order, the front becomes the top
+  item *front = &l.front();
+  stack.push(l);
+  assert (l.empty());
+  assert (stack.pop() == front);
+  l = stack.pop_all();
+  assert (l.size() == items.size() - 1);
+  free_list_type drained;
+  drained.splice_back(l);
+  assert (l.empty() && drained.size() == items.size() - 1);
+  drained.clear();
+}
+
+int main()
+{
+  slist_test();
+  atomic_stack_test();
+  return 0;
+}
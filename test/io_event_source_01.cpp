@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/event_source.hpp>
+#include <spin/socket.hpp>
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+  /** @brief Reads one byte per step and records what it read */
+  class byte_reader : public spin::io_event_source
+  {
+  public:
+    byte_reader(spin::scheduler &s, spin::system_handle h, std::string &log,
+        std::size_t expected, std::size_t &pending)
+      : io_event_source(s, std::move(h), readonly)
+      , m_scheduler(s)
+      , m_log(log)
+      , m_expected(expected)
+      , m_pending(pending)
+      , m_received(0)
+      , m_exhausted(0)
+    { }
+
+    std::size_t get_received() const noexcept
+    { return m_received; }
+
+    std::size_t get_exhausted() const noexcept
+    { return m_exhausted; }
+
+  protected:
+    void on_readable() noexcept override
+    {
+      if (!drain_readable([this] () -> std::ptrdiff_t
+            {
+              char c;
+              ::ssize_t n = ::read(get_device().get_raw_handle(), &c, 1);
+              if (n <= 0)
+                return -1;
+              m_log.push_back(c);
+              ++m_received;
+              return 1;
+            }))
+        ++m_exhausted;
+      else if (m_received == m_expected && --m_pending == 0)
+        m_scheduler.stop();
+    }
+
+  private:
+    spin::scheduler &m_scheduler;
+    std::string &m_log;
+    const std::size_t m_expected;
+    std::size_t &m_pending;
+    std::size_t m_received;
+    std::size_t m_exhausted;
+  };
+
+  void write_all(const spin::system_handle &h, const std::string &data)
+  {
+    ::ssize_t n = ::write(h.get_raw_handle(), data.data(), data.size());
+    assert(n == static_cast<::ssize_t>(data.size()));
+    (void)n;
+  }
+}
+
+/**
+ * @brief Data of a single edge is read completely over several iterations
+ * once the budget is small
+ */
+void check_continuation()
+{
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_STREAM);
+  std::string log;
+  std::size_t pending = 1;
+  byte_reader reader(loop, std::move(pair.first), log, 10, pending);
+  reader.set_budget(spin::io_event_source::budget(4, 64));
+  assert(reader.get_budget().bytes == 4);
+
+  write_all(pair.second, "0123456789");
+  loop.run();
+  assert(log == "0123456789");
+  assert(reader.get_exhausted() == 2);
+}
+
+/**
+ * @brief Two busy sources take turns instead of one starving the other
+ */
+void check_fairness()
+{
+  spin::scheduler loop;
+  auto a = spin::open_socket_pair(SOCK_STREAM);
+  auto b = spin::open_socket_pair(SOCK_STREAM);
+  std::string log;
+  std::size_t pending = 2;
+  byte_reader ra(loop, std::move(a.first), log, 6, pending);
+  byte_reader rb(loop, std::move(b.first), log, 6, pending);
+  ra.set_budget(spin::io_event_source::budget(1 << 20, 2));
+  rb.set_budget(spin::io_event_source::budget(1 << 20, 2));
+
+  write_all(a.second, "aaaaaa");
+  write_all(b.second, "bbbbbb");
+  loop.run();
+  assert(ra.get_received() == 6 && rb.get_received() == 6);
+
+  // Each source reads no more than its budget before the other one runs
+  std::size_t run = 0;
+  for (std::size_t i = 0; i < log.size(); ++i)
+  {
+    run = (i != 0 && log[i] == log[i - 1]) ? run + 1 : 1;
+    assert(run <= 2);
+  }
+}
+
+/** @brief A budget of zero still makes progress, a step at a time */
+void check_zero_budget()
+{
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_STREAM);
+  std::string log;
+  std::size_t pending = 1;
+  byte_reader reader(loop, std::move(pair.first), log, 3, pending);
+  reader.set_budget(spin::io_event_source::budget(0, 0));
+  assert(reader.get_budget().bytes == 1);
+  assert(reader.get_budget().iterations == 1);
+
+  write_all(pair.second, "xyz");
+  loop.run();
+  assert(log == "xyz");
+  assert(reader.get_exhausted() == 3);
+}
+
+int main()
+{
+  check_continuation();
+  check_fairness();
+  check_zero_budget();
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2014 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPIN_TEST_RBTREE_VERIFY_HPP_INCLUDED__
+#define __SPIN_TEST_RBTREE_VERIFY_HPP_INCLUDED__
+
+#include <spin/intruse/rbtree.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+namespace spin
+{
+  namespace intruse
+  {
+    // Friend of rbtree_node<void, void>, used to inspect the tree structure
+    template<>
+    class rbtree_iterator<void, void, void, void>
+    {
+      using node = rbtree_node<void, void>;
+    public:
+
+      struct result
+      {
+        std::size_t size;
+        std::size_t depth;
+      };
+
+      /**
+       * @brief Check links, threads and colors of @a tree
+       * @returns Number of nodes and depth of the deepest one
+       */
+      template<typename Tree>
+      static result verify(Tree &tree)
+      {
+        result r = { 0, 0 };
+        if (tree.empty())
+          return r;
+
+        node *c = &static_cast<typename Tree::node_type&>(*tree.begin());
+        while (!c->m_is_container)
+          c = c->m_p;
+        node *root = c->m_p;
+        assert (root->m_p == c);
+        assert (!root->m_is_red);
+
+        node *prev = c;
+        verify(root, 1, prev, r);
+        assert (c->m_l == c->m_l->front());
+        assert (prev == c->m_r);
+        assert (!prev->m_has_r && prev->m_r == c);
+        return r;
+      }
+
+    private:
+      static std::size_t verify(node *n, std::size_t depth, node *&prev,
+          result &r)
+      {
+        r.depth = std::max(r.depth, depth);
+        std::size_t lh = 1, rh = 1;
+        if (n->m_has_l)
+        {
+          assert (n->m_l->m_p == n);
+          assert (!(n->m_is_red && n->m_l->m_is_red));
+          lh = verify(n->m_l, depth + 1, prev, r);
+        }
+        else
+          assert (n->m_l == prev);
+
+        if (!prev->m_is_container && !prev->m_has_r)
+          assert (prev->m_r == n);
+        prev = n;
+        ++r.size;
+
+        if (n->m_has_r)
+        {
+          assert (n->m_r->m_p == n);
+          assert (!(n->m_is_red && n->m_r->m_is_red));
+          rh = verify(n->m_r, depth + 1, prev, r);
+        }
+
+        assert (lh == rh);
+        return lh + (n->m_is_red ? 0 : 1);
+      }
+    };
+  }
+}
+
+using checker = spin::intruse::rbtree_iterator<void, void, void, void>;
+
+#endif
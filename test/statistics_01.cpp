@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/scheduler.hpp>
+#include <vector>
+#include <thread>
+#include <cassert>
+
+int main()
+{
+  spin::scheduler loop;
+  auto monitor = loop.get_event_monitor();
+  const std::size_t n = 100;
+  std::vector<spin::task> tasks(n);
+  for (auto &t : tasks)
+    loop.dispatch(t);
+  spin::task posted([&loop] { loop.stop(); });
+  loop.post(posted);
+
+  loop.run();
+
+  auto s = loop.get_statistics();
+  if (spin::scheduler::is_statistics_enabled())
+  {
+    assert(s.iterations == 1);
+    assert(s.tasks == n + 1);
+    assert(s.task_time.get_count() == n + 1);
+    assert(s.posts == 1);
+    assert(s.waits == 1);
+    assert(s.blocking_waits == 0);
+    assert(s.wait_time.get_count() == 1);
+    assert(s.events == 0);
+  }
+  else
+  {
+    assert(s.iterations == 0);
+    assert(s.tasks == 0);
+    assert(s.task_time.get_count() == 0);
+  }
+
+  loop.reset_statistics();
+  s = loop.get_statistics();
+  assert(s.tasks == 0);
+  assert(s.task_time.get_count() == 0);
+
+  spin::histogram h;
+  h.record(std::chrono::nanoseconds(0));
+  h.record(std::chrono::nanoseconds(1));
+  h.record(std::chrono::nanoseconds(3));
+  h.record(std::chrono::nanoseconds(1024));
+  h.record(std::chrono::hours(1000));
+  assert(h.get_bucket(0) == 2);
+  assert(h.get_bucket(1) == 1);
+  assert(h.get_bucket(10) == 1);
+  assert(h.get_bucket(spin::histogram::bucket_count - 1) == 1);
+  assert(h.get_count() == 5);
+  assert(spin::histogram::get_bucket_lower_bound(10).count() == 1024);
+
+  // Counters may be read and reset from another thread while running
+  const std::size_t m = 1000;
+  std::vector<spin::task> posted_tasks(m);
+  std::size_t executed = 0;
+  for (auto &t : posted_tasks)
+    t = spin::task([&] { if (++executed == m) loop.stop(); });
+  std::thread poster([&]
+      {
+        for (auto &t : posted_tasks)
+        {
+          loop.post(t);
+          auto r = loop.get_statistics();
+          assert(r.tasks <= m);
+          if (&t == &posted_tasks[m / 2])
+            loop.reset_statistics();
+        }
+      });
+  loop.run();
+  poster.join();
+  s = loop.get_statistics();
+  assert(executed == m);
+  if (spin::scheduler::is_statistics_enabled())
+    assert(s.tasks > 0 && s.tasks <= m);
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/acceptor.hpp>
+#include <spin/stream_socket.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+  spin::socket_address loopback()
+  { return spin::socket_address::from_ip("127.0.0.1", 0); }
+
+  /** @brief Frames are a 4-byte length followed by payload */
+  std::string make_frame(std::size_t size, char fill)
+  {
+    std::uint32_t length = static_cast<std::uint32_t>(size);
+    std::string ret(reinterpret_cast<const char *>(&length), 4);
+    ret.append(size, fill);
+    return ret;
+  }
+
+  /** @brief Pop a complete frame from front of @a data */
+  bool parse_frame(spin::buffer &data, spin::buffer &frame)
+  {
+    std::uint32_t length;
+    if (data.size() < 4)
+      return false;
+    std::memcpy(&length, data.data(), 4);
+    if (data.size() < 4 + length)
+      return false;
+    frame = data.slice(0, 4 + length);
+    data.consume(4 + length);
+    return true;
+  }
+}
+
+/**
+ * @brief Frames split across reads are reassembled, echoed as slices, and
+ * nothing is buffered once the connection is idle
+ */
+void check_echo()
+{
+  spin::scheduler loop;
+  std::vector<std::unique_ptr<spin::stream_socket>> connections;
+  bool server_closed = false;
+
+  spin::acceptor listener(loop, loopback(), [&](spin::system_handle &h)
+      {
+        connections.emplace_back(new spin::stream_socket(loop, std::move(h),
+              [](spin::stream_socket &s, spin::buffer &data)
+              {
+                spin::buffer frame;
+                while (parse_frame(data, frame))
+                  s.send(std::move(frame));
+              },
+              [&](spin::stream_socket &, const std::error_code &e)
+              {
+                assert(!e);
+                server_closed = true;
+                loop.stop();
+              }));
+      });
+
+  std::string expected;
+  for (std::size_t i = 0; i < 200; ++i)
+    expected += make_frame((i * 997) % 20000, static_cast<char>('a' + i % 26));
+  std::string received;
+
+  std::unique_ptr<spin::stream_socket> client(new spin::stream_socket(loop,
+        listener.get_local_address(),
+        [&](spin::stream_socket &, spin::buffer &data)
+        {
+          received.append(data.data(), data.size());
+          data.consume(data.size());
+          if (received.size() == expected.size())
+            loop.stop();
+        },
+        [](spin::stream_socket &, const std::error_code &e)
+        {
+          assert(!e);
+        }));
+
+  // Sent in pieces not aligned to frames
+  for (std::size_t i = 0; i < expected.size(); i += 1000)
+    client->send(expected.data() + i,
+        std::min<std::size_t>(1000, expected.size() - i));
+  loop.run();
+  assert(received == expected);
+  assert(connections.size() == 1);
+  assert(connections[0]->get_buffered_bytes() == 0);
+  assert(connections[0]->get_pending_bytes() == 0);
+  assert(client->get_buffered_bytes() == 0);
+  assert(loop.get_buffer_pool().get_statistics().classes[2].used_blocks == 0);
+
+  // A partial frame is kept in a small block
+  std::string partial = make_frame(100, 'x').substr(0, 50);
+  client->send(partial.data(), partial.size());
+  while (connections[0]->get_buffered_bytes() != 50)
+  {
+    spin::task step([&] { loop.stop(); });
+    loop.dispatch(step);
+    loop.run();
+  }
+  auto s = loop.get_buffer_pool().get_statistics();
+  assert(s.classes[0].used_blocks == 1);
+  assert(s.classes[2].used_blocks == 0);
+
+  client.reset();
+  loop.run();
+  assert(server_closed);
+  assert(!connections[0]->is_open());
+  connections.clear();
+}
+
+void check_connect_refused()
+{
+  spin::scheduler loop;
+  spin::socket_address address;
+  {
+    // Take a port nobody listens on
+    spin::system_handle h = spin::open_socket(AF_INET, SOCK_STREAM);
+    auto local = loopback();
+    assert(::bind(h.get_raw_handle(), local.get_data(), local.get_size())
+        == 0);
+    address = spin::get_local_address(h);
+  }
+
+  std::error_code error;
+  spin::stream_socket client(loop, address,
+      [](spin::stream_socket &, spin::buffer &) { },
+      [&](spin::stream_socket &, const std::error_code &e)
+      {
+        error = e;
+        loop.stop();
+      });
+  client.send("hello", 5);
+  loop.run();
+  assert(error == std::errc::connection_refused);
+  assert(client.get_pending_bytes() == 0);
+}
+
+/** @brief Data never consumed is limited to the largest block */
+void check_unconsumed_limit()
+{
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_STREAM);
+  std::error_code error;
+  spin::stream_socket reader(loop, std::move(pair.first),
+      [](spin::stream_socket &, spin::buffer &) { },
+      [&](spin::stream_socket &, const std::error_code &e)
+      {
+        error = e;
+        loop.stop();
+      });
+  spin::stream_socket writer(loop, std::move(pair.second),
+      [](spin::stream_socket &, spin::buffer &) { },
+      [](spin::stream_socket &, const std::error_code &) { });
+
+  std::vector<char> data(100000, 'z');
+  writer.send(data.data(), data.size());
+  loop.run();
+  assert(error == std::errc::no_buffer_space);
+  assert(!reader.is_open());
+}
+
+/** @brief End of file right after data under the same edge is seen */
+void check_write_then_close()
+{
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_STREAM);
+  std::size_t received = 0;
+  bool closed = false;
+  spin::stream_socket reader(loop, std::move(pair.first),
+      [&](spin::stream_socket &, spin::buffer &data)
+      {
+        received += data.size();
+        data.consume(data.size());
+      },
+      [&](spin::stream_socket &, const std::error_code &e)
+      {
+        assert(!e);
+        closed = true;
+        loop.stop();
+      });
+
+  assert(::send(pair.second.get_raw_handle(), "hello", 5, 0) == 5);
+  pair.second.close();
+  loop.run();
+  assert(received == 5);
+  assert(closed);
+  assert(!reader.is_open());
+}
+
+/**
+ * @brief An exception of the receive handler propagates out of
+ * scheduler::run, data not consumed is handed again with more, and the
+ * socket may be destroyed in the close handler
+ */
+void check_handler_exception()
+{
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_STREAM);
+  std::string received;
+  std::unique_ptr<spin::stream_socket> reader(new spin::stream_socket(loop,
+        std::move(pair.first),
+        [&](spin::stream_socket &, spin::buffer &data)
+        {
+          while (!data.empty())
+          {
+            char c = data.data()[0];
+            data.consume(1);
+            if (c == '!')
+              throw std::runtime_error("bad data");
+            received.push_back(c);
+          }
+        },
+        [&](spin::stream_socket &, const std::error_code &e)
+        {
+          assert(!e);
+          loop.stop();
+          reader.reset();
+        }));
+
+  assert(::send(pair.second.get_raw_handle(), "a!b", 3, 0) == 3);
+  bool thrown = false;
+  try
+  {
+    loop.run();
+  }
+  catch (std::runtime_error &)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(received == "a");
+  assert(reader->get_buffered_bytes() == 1);
+
+  assert(::send(pair.second.get_raw_handle(), "c", 1, 0) == 1);
+  pair.second.close();
+  loop.run();
+  assert(received == "abc");
+  assert(!reader);
+}
+
+int main()
+{
+  check_echo();
+  check_connect_refused();
+  check_unconsumed_limit();
+  check_write_then_close();
+  check_handler_exception();
+}
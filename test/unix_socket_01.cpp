@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <spin/acceptor.hpp>
+#include <spin/unix_socket.hpp>
+
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+  void ignore_close(spin::unix_socket &, const std::error_code &)
+  { }
+}
+
+void check_unix_address()
+{
+  auto path = spin::socket_address::from_unix_path("/tmp/spin.sock");
+  assert(path.get_family() == AF_UNIX);
+  assert(path.to_string() == "/tmp/spin.sock");
+
+  auto abstract = spin::socket_address::from_abstract_name("spin");
+  assert(abstract.get_family() == AF_UNIX);
+  assert(abstract.to_string() == "@spin");
+  assert(abstract != spin::socket_address::from_abstract_name("spi"));
+}
+
+/**
+ * @brief Message boundaries are kept over seqpacket, and descriptors are
+ * passed along with messages
+ */
+void check_seqpacket()
+{
+  constexpr std::size_t N = 100;
+  spin::scheduler loop;
+  auto address = spin::socket_address::from_abstract_name(
+      "spin-test-" + std::to_string(::getpid()));
+  std::vector<std::unique_ptr<spin::unix_socket>> connections;
+  std::size_t expected = 0;
+
+  int pipe_fds[2];
+  assert(::pipe(pipe_fds) == 0);
+  spin::system_handle pipe_read(pipe_fds[0]);
+  spin::system_handle pipe_write(pipe_fds[1]);
+
+  spin::acceptor::options aopt;
+  aopt.type = SOCK_SEQPACKET;
+  spin::acceptor listener(loop, address,
+      [&](spin::system_handle &h)
+      {
+        connections.emplace_back(new spin::unix_socket(loop, std::move(h),
+              [&](spin::unix_socket &, spin::unix_message *m, std::size_t n)
+              {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                  std::string s(m[i].data, m[i].size);
+                  assert(!m[i].truncated);
+                  assert(s == std::to_string(expected));
+                  if (expected == N - 1)
+                  {
+                    // Write to the pipe passed by client, then take it
+                    assert(m[i].handle_count == 1);
+                    assert(::write(m[i].handles[0].get_raw_handle(), "ok", 2)
+                        == 2);
+                    spin::system_handle taken(std::move(m[i].handles[0]));
+                    assert(taken);
+                    loop.stop();
+                  }
+                  else
+                    assert(m[i].handle_count == 0);
+                  expected++;
+                }
+              }, &ignore_close));
+      }, aopt);
+  assert(listener.get_local_address() == address);
+
+  spin::unix_socket client(loop, address, SOCK_SEQPACKET,
+      [](spin::unix_socket &, spin::unix_message *, std::size_t) { },
+      &ignore_close);
+  assert(client.get_type() == SOCK_SEQPACKET);
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    auto s = std::to_string(i);
+    bool last = i == N - 1;
+    while (!client.send(s.data(), s.size(), last ? &pipe_write : nullptr,
+          last ? 1 : 0))
+      ;
+  }
+  // The duplicate is sent, the original can be closed right away
+  pipe_write.close();
+
+  loop.run();
+  assert(expected == N);
+  assert(connections.size() == 1);
+
+  char buffer[2];
+  assert(::read(pipe_read.get_raw_handle(), buffer, 2) == 2);
+  assert(std::memcmp(buffer, "ok", 2) == 0);
+}
+
+/** @brief Bytes arrive in order over stream despite partial writes */
+void check_stream()
+{
+  constexpr std::size_t N = 4 << 20;
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_STREAM);
+  std::size_t received = 0;
+  bool closed = false;
+
+  spin::unix_socket reader(loop, std::move(pair.first),
+      [&](spin::unix_socket &, spin::unix_message *m, std::size_t n)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+          for (std::size_t j = 0; j < m[i].size; ++j, ++received)
+            assert(m[i].data[j] == static_cast<char>(received % 251));
+      },
+      [&](spin::unix_socket &s, const std::error_code &e)
+      {
+        assert(!e);
+        assert(!s.is_open());
+        closed = true;
+        loop.stop();
+      });
+  assert(reader.get_type() == SOCK_STREAM);
+
+  std::unique_ptr<spin::unix_socket> writer(new spin::unix_socket(loop,
+        std::move(pair.second),
+        [](spin::unix_socket &, spin::unix_message *, std::size_t) { },
+        &ignore_close));
+
+  std::vector<char> chunk(3000);
+  std::size_t sent = 0;
+  spin::task sender;
+  sender.reset_routine([&]
+      {
+        while (sent < N)
+        {
+          for (std::size_t j = 0; j < chunk.size(); ++j)
+            chunk[j] = static_cast<char>((sent + j) % 251);
+          if (!writer->send(chunk.data(), chunk.size()))
+            break;
+          sent += chunk.size();
+        }
+        if (sent < N)
+          loop.dispatch(sender);
+        else if (writer->flush() == 0)
+          writer.reset();
+        else
+          loop.dispatch(sender);
+      });
+  loop.dispatch(sender);
+  loop.run();
+  assert(closed);
+  assert(received == sent);
+}
+
+/**
+ * @brief Descriptors squeezed into the padding of an odd max_handles are
+ * received, and those of earlier messages in the batch stay valid
+ */
+void check_padded_handles()
+{
+  constexpr std::size_t N = 16;
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_SEQPACKET);
+  std::size_t received = 0;
+
+  spin::unix_socket::options ropt;
+  ropt.max_handles = 1;
+  spin::unix_socket reader(loop, std::move(pair.first),
+      [&](spin::unix_socket &, spin::unix_message *m, std::size_t n)
+      {
+        for (std::size_t i = 0; i < n; ++i, ++received)
+          for (std::size_t j = 0; j < m[i].handle_count; ++j)
+            assert(::fcntl(m[i].handles[j].get_raw_handle(), F_GETFD)
+                != -1);
+        if (received == N)
+          loop.stop();
+      }, &ignore_close, ropt);
+
+  spin::unix_socket::options wopt;
+  wopt.max_handles = 2;
+  spin::unix_socket writer(loop, std::move(pair.second),
+      [](spin::unix_socket &, spin::unix_message *, std::size_t) { },
+      &ignore_close, wopt);
+
+  int pipe_fds[2];
+  assert(::pipe(pipe_fds) == 0);
+  spin::system_handle handles[2] = { pipe_fds[0], pipe_fds[1] };
+  for (std::size_t i = 0; i < N; ++i)
+    assert(writer.send("x", 1, handles, 2));
+  writer.flush();
+
+  loop.run();
+  assert(received == N);
+}
+
+/**
+ * @brief An exception of the receive handler propagates out of
+ * scheduler::run, the rest is received once it runs again, and the socket
+ * may be destroyed in the close handler
+ */
+void check_handler_exception()
+{
+  spin::scheduler loop;
+  auto pair = spin::open_socket_pair(SOCK_SEQPACKET);
+  std::string received;
+  std::unique_ptr<spin::unix_socket> reader;
+
+  spin::unix_socket::options ropt;
+  ropt.batch_size = 1;
+  reader.reset(new spin::unix_socket(loop, std::move(pair.first),
+      [&](spin::unix_socket &, spin::unix_message *m, std::size_t n)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          if (m[i].data[0] == '1')
+            throw std::runtime_error("bad message");
+          received.push_back(m[i].data[0]);
+        }
+      },
+      [&](spin::unix_socket &, const std::error_code &e)
+      {
+        assert(!e);
+        loop.stop();
+        reader.reset();
+      }, ropt));
+
+  {
+    spin::unix_socket writer(loop, std::move(pair.second),
+        [](spin::unix_socket &, spin::unix_message *, std::size_t) { },
+        &ignore_close);
+    assert(writer.send("0", 1));
+    assert(writer.send("1", 1));
+    assert(writer.send("2", 1));
+    writer.flush();
+  }
+
+  bool thrown = false;
+  try
+  {
+    loop.run();
+  }
+  catch (std::runtime_error &)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(received == "0");
+
+  loop.run();
+  assert(received == "02");
+  assert(!reader);
+}
+
+int main()
+{
+  check_unix_address();
+  check_seqpacket();
+  check_stream();
+  check_padded_handles();
+  check_handler_exception();
+}
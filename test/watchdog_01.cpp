@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2013 LAN Xingcan
+ * All right reserved
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <spin/event_source.hpp>
+#include <spin/scheduler.hpp>
+#include <spin/watchdog.hpp>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include <sys/eventfd.h>
+
+class slow_source : public spin::io_event_source
+{
+public:
+  explicit slow_source(spin::scheduler &s)
+    : io_event_source(s, spin::system_handle(::eventfd, 0,
+          EFD_NONBLOCK | EFD_CLOEXEC), readonly)
+    , m_scheduler(s)
+  { }
+
+  void trigger()
+  { ::eventfd_write(get_device().get_raw_handle(), 1); }
+
+protected:
+  void on_readable() noexcept override
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    m_scheduler.stop();
+  }
+
+private:
+  spin::scheduler &m_scheduler;
+};
+
+int main()
+{
+  std::mutex mutex;
+  std::vector<spin::watchdog_report> reports;
+
+  spin::watchdog w(std::chrono::milliseconds(20),
+      [&](const spin::watchdog_report &report)
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        reports.push_back(report);
+      }, true);
+
+  auto slow = [] { std::this_thread::sleep_for(std::chrono::milliseconds(200)); };
+  auto fast = [] { };
+
+  {
+    spin::scheduler loop;
+    w.watch(loop);
+    spin::task t1(fast);
+    spin::task t2(slow);
+    spin::task t3(fast);
+    loop.dispatch(t1);
+    loop.dispatch(t2);
+    loop.dispatch(t3);
+    loop.run();
+
+    std::lock_guard<std::mutex> guard(mutex);
+    assert(reports.size() == 1);
+    assert(reports[0].source == &loop);
+    assert(reports[0].activity == spin::watchdog_activity::task);
+    assert(*reports[0].target_type == typeid(slow));
+    assert(reports[0].elapsed >= std::chrono::milliseconds(20));
+    assert(!reports[0].backtrace.empty());
+  }
+
+  // event callbacks are reported with the type of their event source
+  {
+    spin::scheduler loop;
+    w.watch(loop);
+    slow_source source(loop);
+    source.trigger();
+    loop.run();
+
+    std::lock_guard<std::mutex> guard(mutex);
+    assert(reports.size() == 2);
+    assert(reports[1].activity == spin::watchdog_activity::event);
+    assert(*reports[1].target_type == typeid(slow_source));
+    assert(!reports[1].backtrace.empty());
+    reports.pop_back();
+  }
+
+  // a loop doesn't return while its report is being handled, even by a
+  // slow handler, which may unwatch the scheduler itself
+  {
+    std::vector<const spin::scheduler *> sources;
+    spin::scheduler loop;
+    spin::watchdog slow_handler(std::chrono::milliseconds(20),
+        [&](const spin::watchdog_report &report)
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          sources.push_back(report.source);
+          slow_handler.unwatch(loop);
+        });
+    slow_handler.watch(loop);
+    spin::task t(slow);
+    loop.dispatch(t);
+    loop.run();
+    assert(sources.size() == 1);
+    assert(sources[0] == &loop);
+  }
+
+  // destroyed scheduler unwatches itself, a new one can be watched again
+  spin::scheduler loop;
+  w.watch(loop);
+  w.unwatch(loop);
+  spin::task t(slow);
+  loop.dispatch(t);
+  loop.run();
+  std::lock_guard<std::mutex> guard(mutex);
+  assert(reports.size() == 1);
+}